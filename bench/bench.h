@@ -0,0 +1,46 @@
+#ifndef LADYBUG_BENCH_H
+#define LADYBUG_BENCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Registers a benchmark under a name, ladybug_bench runs every benchmark whose name starts with one of its arguments
+ * Benchmarks print their own results through report(), one line per configuration they measure
+ */
+struct BenchRegistrar
+{
+    BenchRegistrar(const char *name, void (*bench)());
+};
+
+#define LADYBUG_BENCH(name)                                                                                                                \
+    static void bench_##name();                                                                                                            \
+    static BenchRegistrar bench_registrar_##name(#name, bench_##name);                                                                     \
+    static void bench_##name()
+
+/**
+ * Average wall time of one call of fn in milliseconds
+ * fn is called once to warm up, and then at least iterations times and for at least min_seconds
+ */
+double timeMs(const std::function<void()> &fn, int iterations = 10, double min_seconds = 0.5);
+
+/**
+ * Print one result line, with the throughput as well if the number of bytes handled per call is given
+ */
+void report(const std::string &name, double ms, double bytes = 0);
+
+/**
+ * Size of a raw Ladybug5 head, side-ways like the sensor is mounted
+ */
+static const int BENCH_COLS = 2048;
+static const int BENCH_ROWS = 2448;
+
+/**
+ * A deterministic 8-bit RGGB Bayer plane, a gradient with some noise on it, so nothing compresses or caches trivially
+ */
+std::vector<uint8_t> benchPlane(int cols, int rows, unsigned int seed);
+
+#endif // LADYBUG_BENCH_H
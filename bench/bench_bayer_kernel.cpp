@@ -0,0 +1,36 @@
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "bayer_kernel.h"
+#include "bench.h"
+
+/**
+ * One head through the fused kernel, with and without SSE4.1, against the cvtColor, resize, transpose and flip chain it replaced
+ */
+LADYBUG_BENCH(bayer_kernel)
+{
+    std::vector<uint8_t> plane = benchPlane(BENCH_COLS, BENCH_ROWS, 1);
+    const cv::Mat raw(BENCH_ROWS, BENCH_COLS, CV_8UC1, plane.data());
+    for (double scale : {100.0, 75.0, 50.0, 25.0})
+    {
+        const std::string name = "scale " + std::to_string((int)scale) + "%, ";
+        BayerKernel kernel(BENCH_COLS, BENCH_ROWS, scale);
+        cv::Mat out(kernel.out_rows(), kernel.out_cols(), CV_8UC3);
+        report(name + "fused kernel", timeMs([&]() { kernel.process(raw.ptr<uint8_t>(), out.ptr<uint8_t>(), out.step); }), (double)plane.size());
+        if (kernel.vectorized())
+        {
+            kernel.setVectorized(false);
+            report(name + "fused kernel without SSE4.1", timeMs([&]() { kernel.process(raw.ptr<uint8_t>(), out.ptr<uint8_t>(), out.step); }),
+                   (double)plane.size());
+        }
+
+        cv::Mat image;
+        report(name + "OpenCV chain", timeMs([&]() {
+                   cv::cvtColor(raw, image, cv::COLOR_BayerBG2RGB);
+                   if (scale != 100)
+                       cv::resize(image, image, cv::Size(BENCH_COLS * scale / 100, BENCH_ROWS * scale / 100));
+                   cv::transpose(image, image);
+                   cv::flip(image, image, 1);
+               }),
+               (double)plane.size());
+    }
+}
@@ -0,0 +1,87 @@
+#include <cmath>
+#include <cstdio>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "bayer_kernel.h"
+#include "bench.h"
+
+namespace
+{
+
+/**
+ * An RGB scene with colored blocks under a zone plate, whose rings get finer towards the corners
+ * It is sampled through an RGGB filter, so the scene itself is the reference the outputs are measured against
+ */
+void zonePlate(int cols, int rows, cv::Mat &scene, cv::Mat &raw)
+{
+    scene.create(rows, cols, CV_8UC3);
+    raw.create(rows, cols, CV_8UC1);
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < cols; c++)
+        {
+            const double ring = 60.0 * std::sin(M_PI * (double)(c * c + r * r) / 16000.0);
+            const int block = ((r / 256) + (c / 256)) % 3;
+            uint8_t *rgb = scene.ptr<uint8_t>(r) + 3 * c;
+            for (int ch = 0; ch < 3; ch++)
+                rgb[ch] = (uint8_t)std::min(255.0, std::max(0.0, (ch == block ? 150.0 : 90.0) + ring));
+            const int ch = (r & 1) + (c & 1);
+            raw.at<uint8_t>(r, c) = rgb[ch];
+        }
+    }
+}
+
+/**
+ * What the driver publishes for the scene at this scale, if it could see the scene without the color filter
+ */
+cv::Mat reference(const cv::Mat &scene, const cv::Size &size)
+{
+    cv::Mat image;
+    cv::resize(scene, image, size, 0, 0, cv::INTER_AREA);
+    cv::transpose(image, image);
+    cv::flip(image, image, 1);
+    return image;
+}
+
+} // namespace
+
+/**
+ * Speed and quality of the binned and area paths of the kernel below 50%, against the cvtColor and resize chain they replaced
+ * 50% itself interpolates like the chain, it is here to compare the quality of the two paths
+ * PSNR is against the scene the plane was sampled from, and against the output of the chain
+ */
+LADYBUG_BENCH(binning)
+{
+    cv::Mat scene, raw;
+    zonePlate(BENCH_COLS, BENCH_ROWS, scene, raw);
+    const double raw_bytes = (double)raw.total();
+    for (double scale : {50.0, 25.0, 12.5, 20.0})
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "scale %g%%, ", scale);
+        BayerKernel kernel(BENCH_COLS, BENCH_ROWS, scale);
+        cv::Mat out(kernel.out_rows(), kernel.out_cols(), CV_8UC3);
+        report(std::string(name) + "kernel", timeMs([&]() { kernel.process(raw.ptr<uint8_t>(), out.ptr<uint8_t>(), out.step); }), raw_bytes);
+
+        const cv::Size size((int)(BENCH_COLS * scale / 100), (int)(BENCH_ROWS * scale / 100));
+        cv::Mat chain;
+        report(std::string(name) + "OpenCV chain", timeMs([&]() {
+                   cv::cvtColor(raw, chain, cv::COLOR_BayerBG2RGB);
+                   cv::resize(chain, chain, size);
+                   cv::transpose(chain, chain);
+                   cv::flip(chain, chain, 1);
+               }),
+               raw_bytes);
+
+        const cv::Mat truth = reference(scene, size);
+        if (out.size() != truth.size() || chain.size() != truth.size())
+        {
+            printf("%s%dx%d against %dx%d, not compared\n", name, out.cols, out.rows, truth.cols, truth.rows);
+            continue;
+        }
+        printf("%sPSNR against the scene, kernel %.1f dB, OpenCV chain %.1f dB, kernel against the chain %.1f dB\n", name,
+               cv::PSNR(out, truth), cv::PSNR(chain, truth), cv::PSNR(out, chain));
+    }
+}
@@ -0,0 +1,52 @@
+#include "bayer_kernel.h"
+#include "bench.h"
+#include "color_correction.h"
+#include "color_matrix.h"
+
+/**
+ * The color matrix over a head's worth of 64-pixel rows with SSE2 and with the scalar loop alone,
+ * and what applying it in the kernel costs on top of the plain demosaic, for 8-bit and 16-bit planes
+ */
+LADYBUG_BENCH(color_correction)
+{
+    const double gains[3] = {1.9, 1.0, 1.4};
+    const double matrix[9] = {1.6, -0.4, -0.2, -0.3, 1.5, -0.2, -0.1, -0.5, 1.6};
+    const ColorCorrection color(gains, matrix);
+
+    const int n = BayerKernel::BLOCK_SIZE;
+    const size_t rows = (size_t)BENCH_COLS * BENCH_ROWS / n;
+    const std::vector<uint8_t> plane = benchPlane(BENCH_COLS, BENCH_ROWS, 3);
+    std::vector<int> values(3 * n);
+    const auto run = [&](bool sse2) {
+        for (size_t row = 0; row < rows; row++)
+        {
+            // Refill the row like the kernel does, so the values do not saturate after the first pass
+            for (int i = 0; i < 3 * n; i++)
+                values[i] = plane[(row * n + i) % plane.size()];
+            if (sse2)
+                correctColor<255>(color.coefs(), &values[0], &values[n], &values[2 * n], n);
+            else
+                correctColorScalar<255>(color.coefs(), &values[0], &values[n], &values[2 * n], n);
+        }
+    };
+#ifdef LADYBUG_HAVE_SSE2_COLOR
+    report("matrix, SSE2", timeMs([&]() { run(true); }));
+#endif
+    report("matrix, scalar loop", timeMs([&]() { run(false); }));
+
+    std::vector<uint16_t> wide(plane.size());
+    for (size_t i = 0; i < plane.size(); i++)
+        wide[i] = (uint16_t)(plane[i] << 8);
+    for (double scale : {100.0, 50.0, 25.0})
+    {
+        const std::string name = "scale " + std::to_string((int)scale) + "%, ";
+        const BayerKernel kernel(BENCH_COLS, BENCH_ROWS, scale);
+        const size_t step = (size_t)kernel.out_cols() * 3;
+        std::vector<uint8_t> out(step * kernel.out_rows());
+        std::vector<uint16_t> out16(step * kernel.out_rows());
+        report(name + "raw8", timeMs([&]() { kernel.process(plane.data(), out.data(), step); }), (double)plane.size());
+        report(name + "raw8 color", timeMs([&]() { kernel.process(plane.data(), out.data(), step, nullptr, &color); }), (double)plane.size());
+        report(name + "raw16", timeMs([&]() { kernel.process(wide.data(), out16.data(), 2 * step); }), 2.0 * wide.size());
+        report(name + "raw16 color", timeMs([&]() { kernel.process(wide.data(), out16.data(), 2 * step, nullptr, &color); }), 2.0 * wide.size());
+    }
+}
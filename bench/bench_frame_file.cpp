@@ -0,0 +1,107 @@
+#include <unistd.h>
+
+#include <cstdio>
+#include <random>
+
+#include "bench.h"
+#include "frame_file.h"
+#include "replay_backend.h"
+
+namespace
+{
+
+/**
+ * Read one byte of every page of a frame, so the mapping is actually paged in
+ */
+uint64_t touch(const LadybugImage &image)
+{
+    uint64_t sum = 0;
+    for (size_t k = 0; k < image.uiDataSizeBytes; k += 4096)
+        sum += image.pData[k];
+    return sum;
+}
+
+} // namespace
+
+/**
+ * Writing full RAW8 frames into a frame file, and getting them back out of the mapping in order through the replay
+ * backend at rate 0 and at random through the index
+ * The file is in the page cache right after it is written, so the reads are what replay costs once the disk keeps up
+ * Frames are not copied out of the mapping, reading them only pages them in, so the reads have no MB/s
+ */
+LADYBUG_BENCH(frame_file)
+{
+    std::vector<uint8_t> buffer;
+    for (unsigned int i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    {
+        const std::vector<uint8_t> plane = benchPlane(BENCH_COLS, BENCH_ROWS, i);
+        buffer.insert(buffer.end(), plane.begin(), plane.end());
+    }
+    LadybugImage image = LadybugImage();
+    image.uiCols = image.uiFullCols = BENCH_COLS;
+    image.uiRows = image.uiFullRows = BENCH_ROWS;
+    image.dataFormat = LADYBUG_DATAFORMAT_RAW8;
+    image.pData = buffer.data();
+    image.uiDataSizeBytes = (unsigned int)buffer.size();
+    const double bytes = (double)buffer.size();
+
+    LadybugCameraInfo camera = LadybugCameraInfo();
+    FrameFileWriter writer(camera);
+    std::string path;
+    if (!writer.open("/tmp/ladybug_bench_" + std::to_string(getpid()), path))
+    {
+        printf("unable to open a frame file in /tmp, skipping\n");
+        return;
+    }
+    const size_t frames = 8;
+    size_t written = 0;
+    report("write", timeMs(
+                        [&]() {
+                            if (written < frames)
+                                writer.write(image, ros::Time(1500000000.0 + 0.1 * written++));
+                        },
+                        (int)frames - 1, 0.0),
+           bytes);
+    writer.close();
+
+    // In order, the way the replay node gets its frames
+    ReplayConfig config;
+    config.path = path;
+    config.rate = 0.0;
+    config.loop = true;
+    config.start_frame = 0;
+    config.max_locked = 2;
+    config.use_recorded_time = true;
+    ReplayBackend replay(config);
+    LadybugCameraInfo info;
+    CameraSettings settings = CameraSettings();
+    if (replay.connect(info) != LADYBUG_OK || replay.start(settings) != LADYBUG_OK)
+    {
+        printf("unable to replay %s, skipping\n", path.c_str());
+        unlink(path.c_str());
+        return;
+    }
+    uint64_t sum = 0;
+    report("replay in order", timeMs([&]() {
+               LadybugImage frame;
+               if (replay.lockNext(frame) != LADYBUG_OK)
+                   return;
+               sum += touch(frame);
+               replay.unlock(frame.uiBufferIndex);
+           }));
+    replay.stop();
+
+    // Seeking is a lookup in the index
+    FrameFileReader reader;
+    if (reader.open(path))
+    {
+        std::mt19937 random(1);
+        report("random seek", timeMs([&]() {
+                   LadybugImage frame;
+                   reader.frame(random() % reader.size(), frame);
+                   sum += touch(frame);
+               }));
+    }
+    printf("checksum %llu\n", (unsigned long long)sum);
+    unlink(path.c_str());
+}
@@ -0,0 +1,39 @@
+#include <cstdio>
+
+#include "bench.h"
+#include "jpeg_decoder.h"
+
+/**
+ * Decoding the 24 JPEG tiles of a frame back into raw planes, for the full and half-height formats
+ * One lane decodes the tiles one after the other, like tjDecompress in a loop would
+ */
+LADYBUG_BENCH(jpeg_decoder)
+{
+    for (bool half_height : {false, true})
+    {
+        const int rows = half_height ? BENCH_ROWS / 2 : BENCH_ROWS;
+        std::vector<uint8_t> tiles[LADYBUG_JPEG_TILES], scratch, buffer;
+        tjhandle handle = tjInitCompress();
+        for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+        {
+            const std::vector<uint8_t> plane = benchPlane(BENCH_COLS, rows, (unsigned int)i);
+            for (size_t k = 0; k < LADYBUG_JPEG_CHANNELS; k++)
+                encodeBayerTile(handle, plane.data(), BENCH_COLS, rows, k, 85, scratch, tiles[i * LADYBUG_JPEG_CHANNELS + k]);
+        }
+        tjDestroy(handle);
+        packJpegImage(tiles, buffer);
+        LadybugImage image = LadybugImage();
+        image.pData = buffer.data();
+        image.uiDataSizeBytes = (unsigned int)buffer.size();
+
+        const std::string format = half_height ? "half_height_jpeg8" : "jpeg8";
+        const double raw_bytes = (double)LADYBUG_NUM_CAMERAS * BENCH_COLS * rows;
+        printf("%s, %.1f MB of tiles for %.1f MB of raw planes\n", format.c_str(), buffer.size() / 1e6, raw_bytes / 1e6);
+        for (size_t lanes : {1, 6})
+        {
+            WorkerPool pool(lanes);
+            JpegDecoder decoder;
+            report(format + ", " + std::to_string(lanes) + " lanes", timeMs([&]() { decoder.decode(image, pool); }), raw_bytes);
+        }
+    }
+}
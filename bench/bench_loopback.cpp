@@ -0,0 +1,204 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <ros/serialization.h>
+#include <sensor_msgs/Image.h>
+
+#include "bench.h"
+#include "ladybug.h"
+
+namespace
+{
+
+/**
+ * CPU time of the whole process so far (all threads, user and system), in milliseconds
+ */
+double cpuMs()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return 1000.0 * (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+}
+
+/**
+ * Connected TCP sockets over 127.0.0.1, like TCPROS between two nodes on one machine
+ */
+bool loopbackSockets(int &writer, int &reader)
+{
+    const int server = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(server, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(server, 1) != 0 || getsockname(server, (sockaddr *)&addr, &len) != 0)
+    {
+        close(server);
+        return false;
+    }
+    writer = socket(AF_INET, SOCK_STREAM, 0);
+    const int one = 1;
+    setsockopt(writer, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(writer, (sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(server);
+        close(writer);
+        return false;
+    }
+    reader = accept(server, nullptr, nullptr);
+    close(server);
+    return reader >= 0;
+}
+
+bool sendAll(int fd, const uint8_t *data, size_t size)
+{
+    while (size > 0)
+    {
+        const ssize_t sent = send(fd, data, size, 0);
+        if (sent <= 0)
+            return false;
+        data += sent;
+        size -= (size_t)sent;
+    }
+    return true;
+}
+
+bool receiveAll(int fd, uint8_t *data, size_t size)
+{
+    while (size > 0)
+    {
+        const ssize_t got = recv(fd, data, size, 0);
+        if (got <= 0)
+            return false;
+        data += got;
+        size -= (size_t)got;
+    }
+    return true;
+}
+
+/**
+ * Hands messages to a subscriber thread through a queue, like a callback queue of a nodelet manager does
+ */
+template <typename T>
+class Handoff
+{
+  public:
+    void push(const T &item)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_items.push_back(item);
+        m_cv.notify_one();
+    }
+    T pop()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this] { return !m_items.empty(); });
+        T item = m_items.front();
+        m_items.erase(m_items.begin());
+        return item;
+    }
+
+  private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<T> m_items;
+};
+
+} // namespace
+
+/**
+ * Latency and CPU per frame of getting all six full size RGB8 heads to a subscriber
+ * In a nodelet manager the subscriber gets the ConstPtr the driver published, a separate node gets the
+ * messages serialized, sent over TCP loopback, and deserialized, which is what is measured here without a master
+ */
+LADYBUG_BENCH(loopback)
+{
+    std::vector<sensor_msgs::ImageConstPtr> frame;
+    for (int i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    {
+        sensor_msgs::ImagePtr msg(new sensor_msgs::Image());
+        msg->width = BENCH_ROWS;
+        msg->height = BENCH_COLS;
+        msg->encoding = "rgb8";
+        msg->step = msg->width * 3;
+        msg->data.assign((size_t)msg->step * msg->height, (uint8_t)(40 * i));
+        frame.push_back(msg);
+    }
+    const double frame_bytes = (double)LADYBUG_NUM_CAMERAS * frame[0]->data.size();
+    const int frames = 20;
+
+    // Intra-process, the subscriber thread gets the pointer and touches the data
+    {
+        Handoff<sensor_msgs::ImageConstPtr> queue, done;
+        std::thread subscriber([&]() {
+            for (int n = 0; n < frames * LADYBUG_NUM_CAMERAS; n++)
+            {
+                sensor_msgs::ImageConstPtr msg = queue.pop();
+                volatile uint8_t sink = msg->data[msg->data.size() / 2];
+                (void)sink;
+                done.push(msg);
+            }
+        });
+        const double cpu = cpuMs();
+        const double ms = timeMs(
+            [&]() {
+                for (const auto &msg : frame)
+                    queue.push(msg);
+                for (size_t i = 0; i < frame.size(); i++)
+                    done.pop();
+            },
+            frames - 1, 0);
+        report("nodelet, ConstPtr, latency", ms);
+        report("nodelet, ConstPtr, cpu", (cpuMs() - cpu) / frames);
+        subscriber.join();
+    }
+
+    // Separate process, serialize, TCP loopback and deserialize into a new message
+    int writer, reader;
+    if (!loopbackSockets(writer, reader))
+    {
+        printf("no loopback sockets, skipping the TCP case\n");
+        return;
+    }
+    Handoff<int> done;
+    std::thread subscriber([&]() {
+        std::vector<uint8_t> buffer;
+        for (int n = 0; n < frames * LADYBUG_NUM_CAMERAS; n++)
+        {
+            uint32_t size;
+            if (!receiveAll(reader, reinterpret_cast<uint8_t *>(&size), 4))
+                break;
+            buffer.resize(size);
+            if (!receiveAll(reader, buffer.data(), size))
+                break;
+            sensor_msgs::Image msg;
+            ros::serialization::IStream stream(buffer.data(), size);
+            ros::serialization::deserialize(stream, msg);
+            done.push(n);
+        }
+    });
+    const double cpu = cpuMs();
+    const double ms = timeMs(
+        [&]() {
+            for (const auto &msg : frame)
+            {
+                ros::SerializedMessage serialized = ros::serialization::serializeMessage(*msg);
+                sendAll(writer, serialized.buf.get(), serialized.num_bytes);
+            }
+            for (size_t i = 0; i < frame.size(); i++)
+                done.pop();
+        },
+        frames - 1, 0);
+    report("separate node, TCP loopback, latency", ms, frame_bytes);
+    report("separate node, TCP loopback, cpu", (cpuMs() - cpu) / frames);
+    subscriber.join();
+    close(writer);
+    close(reader);
+}
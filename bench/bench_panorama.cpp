@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "bench.h"
+#include "panorama.h"
+#include "worker_pool.h"
+
+namespace
+{
+
+/**
+ * Calibrations and extrinsics of a Ladybug5-like rig, five heads around the horizon and one looking up, for heads published by the kernel
+ */
+void benchRig(const BayerKernel &kernel, sensor_msgs::CameraInfo calib[LADYBUG_NUM_CAMERAS], double extrinsics[LADYBUG_NUM_CAMERAS][16])
+{
+    const double deg = 3.14159265358979323846 / 180.0;
+    const int cols = kernel.out_cols(), rows = kernel.out_rows();
+    for (size_t h = 0; h < LADYBUG_NUM_CAMERAS; h++)
+    {
+        calib[h] = sensor_msgs::CameraInfo();
+        calib[h].width = (uint32_t)cols;
+        calib[h].height = (uint32_t)rows;
+        const double K[9] = {0.41 * cols, 0, 0.5 * cols, 0, 0.41 * cols, 0.5 * rows, 0, 0, 1};
+        for (int i = 0; i < 9; i++)
+        {
+            calib[h].K[i] = K[i];
+            calib[h].R[i] = (i % 4 == 0) ? 1.0 : 0.0;
+            calib[h].P[(i / 3) * 4 + i % 3] = K[i];
+        }
+        calib[h].D = {-0.04, 0.006, 0.0, 0.0, 0.0};
+        calib[h].distortion_model = "plumb_bob";
+
+        // Columns of the rotation are the camera's right, down and forward axes
+        const double yaw = 72.0 * h * deg;
+        const double right[3] = {h < 5 ? std::sin(yaw) : 0, h < 5 ? -std::cos(yaw) : -1, 0};
+        const double down[3] = {h < 5 ? 0 : 1.0, 0, h < 5 ? -1.0 : 0};
+        const double forward[3] = {h < 5 ? std::cos(yaw) : 0, h < 5 ? std::sin(yaw) : 0, h < 5 ? 0 : 1.0};
+        double *T = extrinsics[h];
+        for (int row = 0; row < 3; row++)
+        {
+            T[row * 4 + 0] = right[row];
+            T[row * 4 + 1] = down[row];
+            T[row * 4 + 2] = forward[row];
+            T[row * 4 + 3] = 0.04 * forward[row];
+        }
+        T[12] = T[13] = T[14] = 0.0;
+        T[15] = 1.0;
+    }
+}
+
+} // namespace
+
+/**
+ * Building the equirectangular table from calibration files, and rendering it from heads published at 50%, in row blocks
+ * on a pool with a lane per CPU, against OpenCV remapping the two taps of every pixel from the stacked heads (before blending them)
+ */
+LADYBUG_BENCH(panorama)
+{
+    const BayerKernel kernel(BENCH_COLS, BENCH_ROWS, 50);
+    sensor_msgs::CameraInfo calib[LADYBUG_NUM_CAMERAS];
+    double extrinsics[LADYBUG_NUM_CAMERAS][16];
+    benchRig(kernel, calib, extrinsics);
+    const int head_cols = kernel.out_cols(), head_rows = kernel.out_rows();
+    cv::Mat heads(LADYBUG_NUM_CAMERAS * head_rows, head_cols, CV_8UC3);
+    const std::vector<uint8_t> plane = benchPlane(head_cols * 3, heads.rows, 0);
+    for (int r = 0; r < heads.rows; r++)
+        memcpy(heads.ptr<uint8_t>(r), plane.data() + (size_t)r * head_cols * 3, (size_t)head_cols * 3);
+    const uint8_t *planes[LADYBUG_NUM_CAMERAS];
+    for (size_t h = 0; h < LADYBUG_NUM_CAMERAS; h++)
+        planes[h] = heads.ptr<uint8_t>((int)h * head_rows);
+
+    WorkerPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    for (int cols : {2048, 4096})
+    {
+        const int rows = cols / 2;
+        char name[48];
+        snprintf(name, sizeof(name), "%dx%d, ", cols, rows);
+        std::unique_ptr<Panorama> panorama;
+        const auto build = [&]() {
+            panorama = Panorama::fromCalibration(calib, extrinsics, kernel, cols, rows, Panorama::equirectangular(cols, rows), 20.0, 0.1);
+        };
+        report(std::string(name) + "build table", timeMs(build, 1, 0.0));
+        cv::Mat out(rows, cols, CV_8UC3);
+        const double bytes = (double)out.total() * out.elemSize();
+        const int block_rows = 32;
+        const size_t blocks = (size_t)(rows + block_rows - 1) / block_rows;
+        report(std::string(name) + "render, " + std::to_string(pool.size()) + " threads", timeMs([&]() {
+                   pool.run(blocks, [&](size_t b) {
+                       panorama->render(planes, heads.step, out.ptr<uint8_t>(), out.step, (int)b * block_rows,
+                                        std::min(rows, (int)(b + 1) * block_rows));
+                   });
+               }),
+               bytes);
+
+        // Float maps into the stacked heads, one per tap; the maps are made up, only the access pattern of a stitch matters
+        cv::Mat map_x(rows, cols, CV_32FC1), map_y(rows, cols, CV_32FC1), sampled;
+        for (int r = 0; r < rows; r++)
+        {
+            for (int c = 0; c < cols; c++)
+            {
+                const double head = 5.0 * c / cols;
+                map_x.at<float>(r, c) = (float)((head - std::floor(head)) * (head_cols - 1));
+                map_y.at<float>(r, c) = (float)(std::floor(head) * head_rows + (double)r * (head_rows - 1) / rows);
+            }
+        }
+        report(std::string(name) + "two cv::remap passes", timeMs([&]() {
+                   for (int t = 0; t < 2; t++)
+                       cv::remap(heads, sampled, map_x, map_y, cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+               }),
+               bytes);
+    }
+}
+
+/**
+ * Building and rendering the six cube faces at 512 from heads published at 50%, against one cv::remap pass per face,
+ * and how much of the heads the kernel has to demosaic for them and for a single narrower view
+ */
+LADYBUG_BENCH(views)
+{
+    const BayerKernel kernel(BENCH_COLS, BENCH_ROWS, 50);
+    sensor_msgs::CameraInfo calib[LADYBUG_NUM_CAMERAS];
+    double extrinsics[LADYBUG_NUM_CAMERAS][16];
+    benchRig(kernel, calib, extrinsics);
+    const int head_cols = kernel.out_cols(), head_rows = kernel.out_rows();
+    cv::Mat heads(LADYBUG_NUM_CAMERAS * head_rows, head_cols, CV_8UC3);
+    const std::vector<uint8_t> plane = benchPlane(head_cols * 3, heads.rows, 0);
+    for (int r = 0; r < heads.rows; r++)
+        memcpy(heads.ptr<uint8_t>(r), plane.data() + (size_t)r * head_cols * 3, (size_t)head_cols * 3);
+    const uint8_t *planes[LADYBUG_NUM_CAMERAS];
+    for (size_t h = 0; h < LADYBUG_NUM_CAMERAS; h++)
+        planes[h] = heads.ptr<uint8_t>((int)h * head_rows);
+
+    // Share of the kernel blocks of all heads the views sample
+    const auto sampled = [&](const std::vector<std::unique_ptr<Panorama>> &views) {
+        size_t used = 0, total = 0;
+        for (size_t h = 0; h < LADYBUG_NUM_CAMERAS; h++)
+        {
+            std::vector<uint8_t> blocks(kernel.block_rows() * kernel.block_cols(), 0);
+            for (const auto &view : views)
+                if (view->heads() & (1u << h))
+                    for (size_t b = 0; b < blocks.size(); b++)
+                        blocks[b] |= view->blocks(h)[b];
+            for (uint8_t block : blocks)
+                used += block;
+            total += blocks.size();
+        }
+        return 100.0 * used / total;
+    };
+
+    const int size = 512;
+    const double faces[6][2] = {{0, 0}, {90, 0}, {180, 0}, {-90, 0}, {0, 90}, {0, -90}};
+    std::vector<std::unique_ptr<Panorama>> cube(6);
+    report("cube, build 6 tables", timeMs([&]() {
+               for (int f = 0; f < 6; f++)
+                   cube[f] = Panorama::fromCalibration(calib, extrinsics, kernel, size, size,
+                                                       Panorama::pinhole(size, size, faces[f][0], faces[f][1], 90.0), 20.0, 0.1);
+           }, 1, 0.0));
+    cv::Mat out(size, size, CV_8UC3);
+    const double bytes = 6.0 * out.total() * out.elemSize();
+    report("cube, render 6 faces", timeMs([&]() {
+               for (int f = 0; f < 6; f++)
+                   cube[f]->render(planes, heads.step, out.ptr<uint8_t>(), out.step, 0, size);
+           }),
+           bytes);
+    printf("cube, kernel blocks sampled %.1f%%\n", sampled(cube));
+
+    std::vector<std::unique_ptr<Panorama>> single(1);
+    single[0] = Panorama::fromCalibration(calib, extrinsics, kernel, 640, 480, Panorama::pinhole(640, 480, 36.0, 0.0, 60.0), 20.0, 0.1);
+    printf("640x480 at 60 degrees, kernel blocks sampled %.1f%%\n", sampled(single));
+
+    // One float map pass into the stacked heads per face, from a made-up map with the same footprint
+    cv::Mat map_x(size, size, CV_32FC1), map_y(size, size, CV_32FC1), remapped;
+    for (int r = 0; r < size; r++)
+    {
+        for (int c = 0; c < size; c++)
+        {
+            map_x.at<float>(r, c) = (float)(0.25 * head_cols + 0.5 * c * head_cols / size);
+            map_y.at<float>(r, c) = (float)(0.25 * head_rows + 0.5 * r * head_rows / size);
+        }
+    }
+    report("cube, 6 cv::remap passes", timeMs([&]() {
+               for (int f = 0; f < 6; f++)
+                   cv::remap(heads, remapped, map_x, map_y, cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+           }),
+           bytes);
+}
@@ -0,0 +1,75 @@
+#include <cstdio>
+
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+
+#include "bayer_kernel.h"
+#include "bench.h"
+#include "jpeg_decoder.h"
+
+/**
+ * Getting a COLOR_SEP_JPEG8 frame onto the wire, as the camera's own tiles on the jpeg topics, against
+ * decoding and demosaicing it to rgb8 and having image_transport compress that again for recording
+ * Everything runs on one thread, so the time per frame is also the CPU it costs; MB/s is of the published bytes
+ */
+LADYBUG_BENCH(passthrough)
+{
+    std::vector<uint8_t> tiles[LADYBUG_JPEG_TILES], scratch, buffer;
+    tjhandle handle = tjInitCompress();
+    for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    {
+        const std::vector<uint8_t> plane = benchPlane(BENCH_COLS, BENCH_ROWS, (unsigned int)i);
+        for (size_t k = 0; k < LADYBUG_JPEG_CHANNELS; k++)
+            encodeBayerTile(handle, plane.data(), BENCH_COLS, BENCH_ROWS, k, 85, scratch, tiles[i * LADYBUG_JPEG_CHANNELS + k]);
+    }
+    tjDestroy(handle);
+    packJpegImage(tiles, buffer);
+    LadybugImage image = LadybugImage();
+    image.pData = buffer.data();
+    image.uiDataSizeBytes = (unsigned int)buffer.size();
+
+    // The jpeg topics, what publish_jpeg_tiles does per frame
+    std::vector<uint8_t> messages[LADYBUG_NUM_CAMERAS];
+    const double ms = timeMs([&]() {
+        JpegTile found[LADYBUG_JPEG_TILES];
+        findJpegTiles(image, found);
+        for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+            packJpegTiles(found + i * LADYBUG_JPEG_CHANNELS, messages[i]);
+    });
+    double jpeg_bytes = 0;
+    for (const auto &msg : messages)
+        jpeg_bytes += msg.size();
+    printf("jpeg topics, %.1f MB per frame\n", jpeg_bytes / 1e6);
+    report("jpeg topics, pass-through", ms, jpeg_bytes);
+
+    // The rgb8 topics, decoded and demosaiced at full size
+    WorkerPool pool(1);
+    JpegDecoder decoder;
+    BayerKernel kernel(BENCH_COLS, BENCH_ROWS, 100);
+    std::vector<cv::Mat> heads(LADYBUG_NUM_CAMERAS);
+    for (auto &head : heads)
+        head = cv::Mat(kernel.out_rows(), kernel.out_cols(), CV_8UC3);
+    const auto raw_path = [&]() {
+        decoder.decode(image, pool);
+        for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+            kernel.process(decoder.planes() + i * BENCH_COLS * BENCH_ROWS, heads[i].ptr<uint8_t>(), heads[i].step);
+    };
+    const double rgb_bytes = (double)LADYBUG_NUM_CAMERAS * heads[0].total() * heads[0].elemSize();
+    printf("rgb8 topics, %.1f MB per frame\n", rgb_bytes / 1e6);
+    report("rgb8 topics, decode and demosaic", timeMs(raw_path, 3), rgb_bytes);
+
+    // And compressed again by image_transport's jpeg plugin at its default quality, for the bag
+    std::vector<uint8_t> encoded[LADYBUG_NUM_CAMERAS];
+    const std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, 80};
+    const double recompressed_ms = timeMs(
+        [&]() {
+            raw_path();
+            for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+                cv::imencode(".jpg", heads[i], encoded[i], params);
+        },
+        3);
+    double recompressed_bytes = 0;
+    for (const auto &data : encoded)
+        recompressed_bytes += data.size();
+    printf("rgb8 topics recompressed, %.1f MB per frame\n", recompressed_bytes / 1e6);
+    report("rgb8 topics, decode, demosaic and recompress", recompressed_ms, recompressed_bytes);
+}
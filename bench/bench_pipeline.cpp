@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+#include "bayer_kernel.h"
+#include "bench.h"
+#include "data_format.h"
+#include "frame_ring.h"
+#include "jpeg_decoder.h"
+#include "pipeline_timing.h"
+#include "raw_unpack.h"
+#include "synthetic_backend.h"
+#include "tone_curve.h"
+
+namespace
+{
+
+/**
+ * Frames the synthetic camera delivered and what became of them
+ */
+struct PipelineCounts
+{
+    size_t processed;
+    size_t lost;    // the camera had no unlocked buffer for them
+    size_t dropped; // the ring to the processing thread was full
+    double busy;    // seconds spent processing them
+};
+
+/**
+ * Grab from the synthetic camera at frame_rate on one thread and process on another, like the driver does without a camera or ROS
+ * Processing decodes or unpacks the frame and runs the Bayer kernel on every head on the pool, then unlocks the buffer
+ * With a timing that is enabled the stages are recorded like the driver records them
+ */
+PipelineCounts runPipeline(LadybugDataFormat format, double scale, double frame_rate, WorkerPool &pool, double seconds,
+                           PipelineTiming *timing = nullptr)
+{
+    SyntheticConfig config;
+    config.cols = BENCH_COLS;
+    config.rows = BENCH_ROWS;
+    config.num_buffers = 4;
+    config.jitter = 0.0;
+    config.error_rate = 0.0;
+    config.seed = 1;
+    config.stippled_format = LADYBUG_RGGB;
+    CameraSettings settings = CameraSettings();
+    settings.data_format = format;
+    settings.frame_rate = (float)frame_rate;
+    settings.jpeg_quality = 85;
+    SyntheticBackend backend(config);
+    PipelineCounts counts = PipelineCounts();
+    if (backend.start(settings) != LADYBUG_OK)
+        return counts;
+
+    const bool half_height = isHalfHeightFormat(format);
+    const int bits = rawSampleBits(format);
+    const size_t plane_pixels = (size_t)BENCH_COLS * (half_height ? BENCH_ROWS / 2 : BENCH_ROWS);
+    const BayerKernel kernel(BENCH_COLS, BENCH_ROWS, scale, half_height);
+    const ToneCurve curve;
+    JpegDecoder decoder;
+    std::vector<uint16_t> samples(bits == 12 ? LADYBUG_NUM_CAMERAS * plane_pixels : 0);
+    std::vector<std::vector<uint8_t>> heads(LADYBUG_NUM_CAMERAS, std::vector<uint8_t>((size_t)kernel.out_rows() * kernel.out_cols() * 3));
+    const size_t out_step = (size_t)kernel.out_cols() * 3;
+
+    SpscRing<LockedFrame> ring(2);
+    std::atomic<bool> running(true);
+    std::thread grab([&]() {
+        while (running)
+        {
+            LockedFrame frame;
+            const LadybugError error = backend.lockNext(frame.image);
+            if (error == LADYBUG_TOO_MANY_LOCKED_BUFFERS)
+                counts.lost++;
+            if (error != LADYBUG_OK)
+                continue;
+            if (!ring.push(frame))
+            {
+                counts.dropped++;
+                backend.unlock(frame.image.uiBufferIndex);
+            }
+        }
+    });
+
+    const auto end =
+        std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+    while (std::chrono::steady_clock::now() < end)
+    {
+        LockedFrame frame;
+        if (!ring.pop(frame))
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            continue;
+        }
+        const bool timed = timing && timing->enabled();
+        const auto start = std::chrono::steady_clock::now();
+        const uint8_t *planes = frame.image.pData;
+        if (isJpegFormat(format))
+        {
+            decoder.decode(frame.image, pool);
+            planes = decoder.planes();
+            if (timed)
+                timing->record(STAGE_DECODE, start, PipelineTiming::Clock::now());
+        }
+        pool.run(LADYBUG_NUM_CAMERAS, [&](size_t i) {
+            PipelineTiming::Clock::time_point t0;
+            if (timed)
+                t0 = PipelineTiming::Clock::now();
+            if (bits == 8)
+            {
+                kernel.process(planes + i * plane_pixels, heads[i].data(), out_step);
+                if (timed)
+                    timing->record(STAGE_DEMOSAIC, t0, PipelineTiming::Clock::now(), i);
+                return;
+            }
+            const uint16_t *raw = reinterpret_cast<const uint16_t *>(planes) + i * plane_pixels;
+            if (bits == 12)
+            {
+                unpackRaw12(planes + i * plane_pixels * 3 / 2, samples.data() + i * plane_pixels, plane_pixels);
+                raw = samples.data() + i * plane_pixels;
+                if (timed)
+                {
+                    const PipelineTiming::Clock::time_point t1 = PipelineTiming::Clock::now();
+                    timing->record(STAGE_DECODE, t0, t1, i);
+                    t0 = t1;
+                }
+            }
+            kernel.process(raw, curve, heads[i].data(), out_step);
+            if (timed)
+                timing->record(STAGE_DEMOSAIC, t0, PipelineTiming::Clock::now(), i);
+        });
+        const auto end = std::chrono::steady_clock::now();
+        backend.unlock(frame.image.uiBufferIndex);
+        if (timed)
+        {
+            timing->record(STAGE_PROCESS, start, end);
+            timing->record(STAGE_UNLOCK, end, std::chrono::steady_clock::now());
+        }
+        counts.busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        counts.processed++;
+    }
+    running = false;
+    grab.join();
+    LockedFrame frame;
+    while (ring.pop(frame))
+        backend.unlock(frame.image.uiBufferIndex);
+    backend.stop();
+    return counts;
+}
+
+} // namespace
+
+/**
+ * The grab -> process path end to end on the synthetic camera, which offers frames faster than they can be processed,
+ * so the frame rate reached is what this machine can sustain for the format, scale and number of threads
+ * Nothing is published, the loopback benchmark measures that part
+ */
+LADYBUG_BENCH(pipeline)
+{
+    const size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    WorkerPool pool(threads);
+    const double seconds = 2.0;
+    const struct
+    {
+        LadybugDataFormat format;
+        const char *name;
+    } formats[] = {{LADYBUG_DATAFORMAT_RAW8, "raw8"},
+                   {LADYBUG_DATAFORMAT_HALF_HEIGHT_RAW8, "half-height raw8"},
+                   {LADYBUG_DATAFORMAT_RAW12, "raw12"},
+                   {LADYBUG_DATAFORMAT_COLOR_SEP_JPEG8, "jpeg8"}};
+    for (const auto &format : formats)
+    {
+        for (double scale : {100.0, 50.0})
+        {
+            char name[64];
+            snprintf(name, sizeof(name), "%s at %g%%, %zu threads", format.name, scale, threads);
+            const PipelineCounts counts = runPipeline(format.format, scale, 1000.0, pool, seconds);
+            if (counts.processed == 0)
+            {
+                printf("%s, no frames processed\n", name);
+                continue;
+            }
+            printf("%s, %.1f fps (%zu lost on the camera, %zu dropped on the ring)\n", name, counts.processed / seconds, counts.lost,
+                   counts.dropped);
+            report(name, 1e3 * seconds / counts.processed);
+        }
+    }
+}
+
+/**
+ * The half-height formats are for capturing at about twice the full-height frame rate, so this paces the synthetic
+ * camera at 60 fps and checks whether every frame gets through, next to the full-height format at the same rate
+ * The load is the fraction of the frame interval spent processing, above 1 frames have to be lost or dropped
+ */
+LADYBUG_BENCH(half_height)
+{
+    const size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    WorkerPool pool(threads);
+    const double seconds = 3.0, frame_rate = 60.0;
+    const struct
+    {
+        LadybugDataFormat format;
+        const char *name;
+    } formats[] = {{LADYBUG_DATAFORMAT_HALF_HEIGHT_RAW8, "half-height raw8"},   {LADYBUG_DATAFORMAT_RAW8, "raw8"},
+                   {LADYBUG_DATAFORMAT_HALF_HEIGHT_RAW12, "half-height raw12"}, {LADYBUG_DATAFORMAT_RAW12, "raw12"},
+                   {LADYBUG_DATAFORMAT_COLOR_SEP_HALF_HEIGHT_JPEG8, "half-height jpeg8"}, {LADYBUG_DATAFORMAT_COLOR_SEP_JPEG8, "jpeg8"}};
+    for (double scale : {50.0, 25.0})
+    {
+        for (const auto &format : formats)
+        {
+            char name[80];
+            snprintf(name, sizeof(name), "%s at %g%% and %g fps, %zu threads", format.name, scale, frame_rate, threads);
+            const PipelineCounts counts = runPipeline(format.format, scale, frame_rate, pool, seconds);
+            if (counts.processed == 0)
+            {
+                printf("%s, no frames processed\n", name);
+                continue;
+            }
+            printf("%s, %.1f fps (%zu lost on the camera, %zu dropped on the ring), load %.2f\n", name, counts.processed / seconds, counts.lost,
+                   counts.dropped, counts.busy / counts.processed * frame_rate);
+            report(name, 1e3 * counts.busy / counts.processed);
+        }
+    }
+}
+
+/**
+ * What recording the pipeline timing costs, the same pipeline as above with the timing switched off and on
+ * Off it only reads the switch once per frame, on it records the stages of every frame and head like the driver does
+ */
+LADYBUG_BENCH(timing_overhead)
+{
+    const size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    WorkerPool pool(threads);
+    const double seconds = 2.0;
+    PipelineTiming timing;
+    const struct
+    {
+        LadybugDataFormat format;
+        const char *name;
+    } formats[] = {{LADYBUG_DATAFORMAT_RAW8, "raw8"}, {LADYBUG_DATAFORMAT_RAW12, "raw12"}};
+    for (const auto &format : formats)
+    {
+        for (double scale : {100.0, 25.0})
+        {
+            for (bool enabled : {false, true})
+            {
+                char name[80];
+                snprintf(name, sizeof(name), "%s at %g%%, timing %s, %zu threads", format.name, scale, enabled ? "on" : "off", threads);
+                timing.setEnabled(enabled);
+                const PipelineCounts counts = runPipeline(format.format, scale, 1000.0, pool, seconds, &timing);
+                if (counts.processed == 0)
+                {
+                    printf("%s, no frames processed\n", name);
+                    continue;
+                }
+                report(name, 1e3 * counts.busy / counts.processed);
+            }
+        }
+    }
+}
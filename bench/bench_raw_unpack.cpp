@@ -0,0 +1,41 @@
+#include <cstdio>
+
+#include "bayer_kernel.h"
+#include "bench.h"
+#include "raw_unpack.h"
+#include "tone_curve.h"
+
+/**
+ * Unpacking one RAW12 head with the SSSE3 shuffle and with the scalar loop, and what RAW12 costs end to end, unpacking
+ * and demosaicing through the tone curve, against demosaicing the same head sent as RAW8
+ */
+LADYBUG_BENCH(raw_unpack)
+{
+    const size_t num_pixels = (size_t)BENCH_COLS * BENCH_ROWS;
+    const std::vector<uint8_t> plane = benchPlane(BENCH_COLS, BENCH_ROWS, 2);
+    std::vector<uint16_t> wide(num_pixels);
+    for (size_t i = 0; i < num_pixels; i++)
+        wide[i] = (uint16_t)((plane[i] << 8) | ((i * 7) & 0xf0));
+    std::vector<uint8_t> packed(num_pixels * 3 / 2);
+    packRaw12(wide.data(), packed.data(), num_pixels);
+
+    std::vector<uint16_t> samples(num_pixels);
+    printf("unpackRaw12 is %s\n", unpackRaw12IsVectorized() ? "SSSE3" : "scalar");
+    report("unpack, unpackRaw12", timeMs([&]() { unpackRaw12(packed.data(), samples.data(), num_pixels); }), (double)packed.size());
+    report("unpack, scalar loop", timeMs([&]() { unpackRaw12Scalar(packed.data(), samples.data(), num_pixels); }), (double)packed.size());
+
+    const ToneCurve curve(2.2);
+    for (double scale : {100.0, 50.0})
+    {
+        const std::string name = "scale " + std::to_string((int)scale) + "%, ";
+        const BayerKernel kernel(BENCH_COLS, BENCH_ROWS, scale);
+        std::vector<uint8_t> out((size_t)kernel.out_rows() * kernel.out_cols() * 3);
+        const size_t step = (size_t)kernel.out_cols() * 3;
+        report(name + "RAW8 demosaic", timeMs([&]() { kernel.process(plane.data(), out.data(), step); }), (double)plane.size());
+        report(name + "RAW12 unpack and demosaic", timeMs([&]() {
+                   unpackRaw12(packed.data(), samples.data(), num_pixels);
+                   kernel.process(samples.data(), curve, out.data(), step);
+               }),
+               (double)packed.size());
+    }
+}
@@ -0,0 +1,75 @@
+#include <cstdio>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "bench.h"
+#include "rectifier.h"
+
+namespace
+{
+
+/**
+ * Calibration of a published head of cols x rows, with the barrel distortion of the Ladybug5 lenses
+ */
+sensor_msgs::CameraInfo benchCalibration(int cols, int rows)
+{
+    sensor_msgs::CameraInfo info;
+    info.width = (uint32_t)cols;
+    info.height = (uint32_t)rows;
+    const double K[9] = {0.4 * cols, 0, 0.5 * cols, 0, 0.4 * cols, 0.5 * rows, 0, 0, 1};
+    for (int row = 0; row < 3; row++)
+    {
+        for (int col = 0; col < 3; col++)
+        {
+            info.K[row * 3 + col] = K[row * 3 + col];
+            info.R[row * 3 + col] = (row == col) ? 1.0 : 0.0;
+            info.P[row * 4 + col] = K[row * 3 + col];
+        }
+    }
+    info.D = {-0.25, 0.07, 0.0, 0.0, -0.008};
+    info.distortion_model = "plumb_bob";
+    return info;
+}
+
+} // namespace
+
+/**
+ * Building the fixed-point table of one published head and remapping a frame with it, against the
+ * initUndistortRectifyMap and remap that image_proc runs per head (with its 16-bit fixed-point maps)
+ */
+LADYBUG_BENCH(rectifier)
+{
+    for (double scale : {100.0, 50.0})
+    {
+        const int cols = (int)(BENCH_ROWS * scale / 100), rows = (int)(BENCH_COLS * scale / 100);
+        char name[48];
+        snprintf(name, sizeof(name), "%dx%d, ", cols, rows);
+        const sensor_msgs::CameraInfo info = benchCalibration(cols, rows);
+        cv::Mat src(rows, cols, CV_8UC3), dst(rows, cols, CV_8UC3);
+        const std::vector<uint8_t> plane = benchPlane(cols * 3, rows, 0);
+        for (int r = 0; r < rows; r++)
+            memcpy(src.ptr<uint8_t>(r), plane.data() + (size_t)r * cols * 3, (size_t)cols * 3);
+        const double bytes = (double)src.total() * src.elemSize();
+
+        std::unique_ptr<Rectifier> rectifier;
+        report(std::string(name) + "build table", timeMs([&]() { rectifier = Rectifier::fromCalibration(info); }, 3, 0.0));
+        report(std::string(name) + "remap with the table", timeMs([&]() { rectifier->remap(src.ptr<uint8_t>(), src.step, dst.ptr<uint8_t>(), dst.step); }),
+               bytes);
+
+        cv::Mat K(3, 3, CV_64F), R(3, 3, CV_64F), P(3, 3, CV_64F), D(1, 5, CV_64F);
+        for (int i = 0; i < 9; i++)
+        {
+            K.at<double>(i / 3, i % 3) = info.K[i];
+            R.at<double>(i / 3, i % 3) = info.R[i];
+            P.at<double>(i / 3, i % 3) = info.P[(i / 3) * 4 + i % 3];
+        }
+        for (int i = 0; i < 5; i++)
+            D.at<double>(0, i) = info.D[i];
+        cv::Mat map1, map2, expected;
+        report(std::string(name) + "initUndistortRectifyMap",
+               timeMs([&]() { cv::initUndistortRectifyMap(K, D, R, P, cv::Size(cols, rows), CV_16SC2, map1, map2); }, 3, 0.0));
+        report(std::string(name) + "cv::remap", timeMs([&]() { cv::remap(src, expected, map1, map2, cv::INTER_LINEAR, cv::BORDER_CONSTANT); }),
+               bytes);
+        printf("%sPSNR of the table against cv::remap %.1f dB\n", name, cv::PSNR(dst, expected));
+    }
+}
@@ -0,0 +1,109 @@
+#include <unistd.h>
+
+#include <cstdio>
+#include <thread>
+
+#include "bench.h"
+#include "frame_file.h"
+#include "stream_recorder.h"
+
+namespace
+{
+
+/**
+ * Sink that only counts, so the recorder itself is measured
+ */
+class NullSink : public RecordSink
+{
+  public:
+    bool open(const std::string &base_name, std::string &file_name) override
+    {
+        file_name = base_name;
+        return true;
+    }
+    bool write(const LadybugImage &, const ros::Time &) override { return true; }
+    void close() override {}
+};
+
+} // namespace
+
+/**
+ * Cost of queueing a full RAW8 frame for recording on the grab thread, copied there or pinned for the writer to copy,
+ * and how fast the recorder gets frames into a raw frame file
+ */
+LADYBUG_BENCH(stream_recorder)
+{
+    std::vector<uint8_t> buffer;
+    for (unsigned int i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    {
+        const std::vector<uint8_t> plane = benchPlane(BENCH_COLS, BENCH_ROWS, i);
+        buffer.insert(buffer.end(), plane.begin(), plane.end());
+    }
+    LockedFrame frame;
+    frame.image = LadybugImage();
+    frame.image.uiFullCols = BENCH_COLS;
+    frame.image.uiFullRows = BENCH_ROWS;
+    frame.image.uiCols = BENCH_COLS;
+    frame.image.uiRows = BENCH_ROWS;
+    frame.image.dataFormat = LADYBUG_DATAFORMAT_RAW8;
+    frame.image.uiDataSizeBytes = (unsigned int)buffer.size();
+    frame.image.pData = buffer.data();
+    frame.stamp = ros::Time(1500000000.0);
+    const double bytes = (double)buffer.size();
+
+    // On the grab thread, only the pushes that queued the frame are timed
+    for (size_t max_pinned : {0, 8})
+    {
+        auto queue = std::make_shared<FrameReleaseQueue>();
+        StreamRecorder recorder(std::unique_ptr<RecordSink>(new NullSink()), "/tmp/ladybug_bench", 8, max_pinned, 0, 0);
+        recorder.start();
+        const int frames = 20;
+        double total_ms = 0;
+        std::vector<LockedFrame> released;
+        for (int n = 0; n < frames; n++)
+        {
+            while (true)
+            {
+                const auto start = std::chrono::steady_clock::now();
+                const bool queued =
+                    max_pinned > 0 ? recorder.push(std::make_shared<FrameHold>(frame, queue), frame.stamp) : recorder.push(frame.image, frame.stamp);
+                if (queued)
+                {
+                    total_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            queue->take(released);
+        }
+        recorder.stop();
+        if (max_pinned > 0)
+            report("grab thread, pinned for the writer", total_ms / frames);
+        else
+            report("grab thread, copied", total_ms / frames, bytes);
+    }
+
+    // Into a frame file, from the first push until the writer is done
+    LadybugCameraInfo camera = LadybugCameraInfo();
+    const std::string base = "/tmp/ladybug_bench_" + std::to_string(getpid());
+    StreamRecorder recorder(std::unique_ptr<RecordSink>(new FrameFileWriter(camera)), base, 8, 2, 0, 0);
+    if (!recorder.start())
+    {
+        printf("unable to open a frame file in /tmp, skipping the disk case\n");
+        return;
+    }
+    auto queue = std::make_shared<FrameReleaseQueue>();
+    std::vector<LockedFrame> released;
+    const int frames = 20;
+    const auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < frames; n++)
+    {
+        while (!(recorder.canPin() ? recorder.push(std::make_shared<FrameHold>(frame, queue), frame.stamp) : recorder.push(frame.image, frame.stamp)))
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        queue->take(released);
+    }
+    recorder.stop();
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+    report("frame file, through the recorder", ms, bytes);
+    unlink(recorder.fileName().c_str());
+}
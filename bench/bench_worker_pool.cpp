@@ -0,0 +1,38 @@
+#include <thread>
+
+#include "bayer_kernel.h"
+#include "bench.h"
+#include "ladybug.h"
+#include "worker_pool.h"
+
+/**
+ * Latency of demosaicing all six heads of a frame, against the number of lanes they are spread over
+ * One lane is what the driver did before the pool, a lane per head is its default
+ */
+LADYBUG_BENCH(worker_pool)
+{
+    std::vector<std::vector<uint8_t>> planes;
+    for (unsigned int i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+        planes.push_back(benchPlane(BENCH_COLS, BENCH_ROWS, i));
+    std::vector<size_t> lane_counts = {1, 2, 3, 4, 5, 6};
+    if (std::thread::hardware_concurrency() > LADYBUG_NUM_CAMERAS)
+        lane_counts.push_back(std::thread::hardware_concurrency());
+    for (double scale : {100.0, 50.0})
+    {
+        BayerKernel kernel(BENCH_COLS, BENCH_ROWS, scale);
+        const size_t out_step = (size_t)kernel.out_cols() * 3;
+        std::vector<std::vector<uint8_t>> out(LADYBUG_NUM_CAMERAS, std::vector<uint8_t>(out_step * kernel.out_rows()));
+        for (size_t lanes : lane_counts)
+        {
+            WorkerPool pool(lanes);
+            const double ms = timeMs([&]() {
+                pool.run(LADYBUG_NUM_CAMERAS, [&](size_t i) { kernel.process(planes[i].data(), out[i].data(), out_step); });
+            });
+            report("scale " + std::to_string((int)scale) + "%, " + std::to_string(lanes) + " lanes", ms);
+        }
+    }
+
+    // The bare cost of handing out a batch, with jobs that do nothing
+    WorkerPool pool(LADYBUG_NUM_CAMERAS);
+    report("empty batch of 6 jobs", timeMs([&]() { pool.run(LADYBUG_NUM_CAMERAS, [](size_t) {}); }, 1000, 0.2));
+}
@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <utility>
+
+#include <ros/ros.h>
+
+#include "bench.h"
+
+namespace
+{
+
+std::vector<std::pair<std::string, void (*)()>> &benches()
+{
+    static std::vector<std::pair<std::string, void (*)()>> registered;
+    return registered;
+}
+
+} // namespace
+
+BenchRegistrar::BenchRegistrar(const char *name, void (*bench)())
+{
+    benches().emplace_back(name, bench);
+}
+
+double timeMs(const std::function<void()> &fn, int iterations, double min_seconds)
+{
+    typedef std::chrono::steady_clock Clock;
+    fn();
+    int calls = 0;
+    const Clock::time_point start = Clock::now();
+    double elapsed = 0;
+    while (calls < iterations || elapsed < min_seconds)
+    {
+        fn();
+        calls++;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    return 1000.0 * elapsed / calls;
+}
+
+void report(const std::string &name, double ms, double bytes)
+{
+    if (bytes > 0)
+        printf("%-48s %10.3f ms %10.1f MB/s\n", name.c_str(), ms, bytes / (1000.0 * ms));
+    else
+        printf("%-48s %10.3f ms\n", name.c_str(), ms);
+    fflush(stdout);
+}
+
+std::vector<uint8_t> benchPlane(int cols, int rows, unsigned int seed)
+{
+    std::vector<uint8_t> plane((size_t)cols * rows);
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> noise(-8, 8);
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < cols; c++)
+        {
+            const int value = (c * 160) / cols + (r * 80) / rows + ((r & 1) ^ (c & 1)) * 12 + noise(rng);
+            plane[(size_t)r * cols + c] = (uint8_t)std::min(255, std::max(0, value));
+        }
+    }
+    return plane;
+}
+
+/**
+ * Runs the benchmarks named on the command line (by prefix), or all of them, --list prints the names
+ */
+int main(int argc, char **argv)
+{
+    ros::Time::init();
+    std::sort(benches().begin(), benches().end());
+    if (argc > 1 && strcmp(argv[1], "--list") == 0)
+    {
+        for (const auto &bench : benches())
+            printf("%s\n", bench.first.c_str());
+        return 0;
+    }
+    for (const auto &bench : benches())
+    {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc && !selected; i++)
+            selected = bench.first.compare(0, strlen(argv[i]), argv[i]) == 0;
+        if (!selected)
+            continue;
+        printf("== %s\n", bench.first.c_str());
+        bench.second();
+    }
+    return 0;
+}
@@ -0,0 +1,188 @@
+#ifndef LADYBUG_BAYER_IMAGE_H
+#define LADYBUG_BAYER_IMAGE_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+#include <ros/message_traits.h>
+#include <ros/serialization.h>
+#include <sensor_msgs/Image.h>
+#include <std_msgs/Header.h>
+
+#include "bayer_kernel.h"
+#include "frame_ring.h"
+#include "ladybug.h"
+
+/**
+ * A raw Bayer plane of one head, published as a sensor_msgs/Image without copying it out of the locked SDK buffer
+ *
+ * The pixels are read at an offset into the buffer of the hold, which keeps it locked for as long as this message is alive.
+ * If the driver stops first, the camera is only stopped once the last such hold is gone, so pixels() stays valid and in place.
+ * It has the same wire format, md5sum and datatype as sensor_msgs/Image, so every subscriber sees an ordinary image.
+ * Subscribers in other processes get it serialized straight from the SDK buffer, which is the only copy that is made.
+ * Intra-process subscribers of sensor_msgs/Image get a deserialized copy, only subscribers of this type share the buffer.
+ */
+struct BayerImage
+{
+    typedef boost::shared_ptr<BayerImage> Ptr;
+    typedef boost::shared_ptr<BayerImage const> ConstPtr;
+
+    BayerImage() : height(0), width(0), is_bigendian(0), step(0), offset(0) {}
+
+    std_msgs::Header header;
+    uint32_t height;
+    uint32_t width;
+    std::string encoding;
+    uint8_t is_bigendian;
+    uint32_t step;
+    size_t offset;
+    std::shared_ptr<const FrameHold> hold;
+
+    const uint8_t *pixels() const { return hold->data() + offset; }
+};
+
+/**
+ * Called by the MessagePool when a message comes back, so a recycled BayerImage does not keep its buffer locked
+ */
+inline void recycleMessage(BayerImage &msg)
+{
+    msg.offset = 0;
+    msg.hold.reset();
+}
+
+/**
+ * The sensor_msgs/Image encoding of a Bayer plane, for the CFA order the camera reports
+ * LADYBUG_DEFAULT is taken to be RGGB, like bayerPattern() does
+ */
+inline std::string bayerEncoding(LadybugStippledFormat format, int bits)
+{
+    std::string pattern;
+    switch (format)
+    {
+    case LADYBUG_BGGR:
+        pattern = "bayer_bggr";
+        break;
+    case LADYBUG_GBRG:
+        pattern = "bayer_gbrg";
+        break;
+    case LADYBUG_GRBG:
+        pattern = "bayer_grbg";
+        break;
+    default:
+        pattern = "bayer_rggb";
+        break;
+    }
+    return pattern + (bits > 8 ? "16" : "8");
+}
+
+/**
+ * The demosaic kernel pattern for the CFA order the camera reports, LADYBUG_DEFAULT is taken to be RGGB
+ */
+inline BayerPattern bayerPattern(LadybugStippledFormat format)
+{
+    switch (format)
+    {
+    case LADYBUG_BGGR:
+        return BAYER_BGGR;
+    case LADYBUG_GBRG:
+        return BAYER_GBRG;
+    case LADYBUG_GRBG:
+        return BAYER_GRBG;
+    default:
+        return BAYER_RGGB;
+    }
+}
+
+/**
+ * The demosaic kernel pattern of a Bayer encoding like bayer_grbg8, returns false if it is not one
+ */
+inline bool parseBayerPattern(const std::string &encoding, BayerPattern &pattern)
+{
+    static const char *const names[] = {"bayer_rggb", "bayer_grbg", "bayer_gbrg", "bayer_bggr"};
+    for (int p = 0; p < 4; p++)
+    {
+        if (encoding.compare(0, 10, names[p]) == 0 && (encoding.substr(10) == "8" || encoding.substr(10) == "16"))
+        {
+            pattern = (BayerPattern)p;
+            return true;
+        }
+    }
+    return false;
+}
+
+namespace ros
+{
+namespace message_traits
+{
+
+template <>
+struct IsMessage<BayerImage> : TrueType
+{
+};
+
+template <>
+struct HasHeader<BayerImage> : TrueType
+{
+};
+
+template <>
+struct MD5Sum<BayerImage>
+{
+    static const char *value() { return MD5Sum<sensor_msgs::Image>::value(); }
+    static const char *value(const BayerImage &) { return value(); }
+};
+
+template <>
+struct DataType<BayerImage>
+{
+    static const char *value() { return DataType<sensor_msgs::Image>::value(); }
+    static const char *value(const BayerImage &) { return value(); }
+};
+
+template <>
+struct Definition<BayerImage>
+{
+    static const char *value() { return Definition<sensor_msgs::Image>::value(); }
+    static const char *value(const BayerImage &) { return value(); }
+};
+
+} // namespace message_traits
+
+namespace serialization
+{
+
+/**
+ * Writes a BayerImage exactly like a sensor_msgs/Image, with the pixels copied straight from the SDK buffer
+ * There is no read, the Bayer images are only ever published
+ */
+template <>
+struct Serializer<BayerImage>
+{
+    template <typename Stream>
+    inline static void write(Stream &stream, const BayerImage &m)
+    {
+        stream.next(m.header);
+        stream.next(m.height);
+        stream.next(m.width);
+        stream.next(m.encoding);
+        stream.next(m.is_bigendian);
+        stream.next(m.step);
+        const uint32_t size = m.step * m.height;
+        stream.next(size);
+        if (size > 0)
+            memcpy(stream.advance(size), m.pixels(), size);
+    }
+
+    inline static uint32_t serializedLength(const BayerImage &m)
+    {
+        return serializationLength(m.header) + 4 + 4 + serializationLength(m.encoding) + 1 + 4 + 4 + m.step * m.height;
+    }
+};
+
+} // namespace serialization
+} // namespace ros
+
+#endif // LADYBUG_BAYER_IMAGE_H
@@ -0,0 +1,1118 @@
+#include "bayer_kernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <smmintrin.h>
+#define LADYBUG_HAVE_SSE41_DEMOSAIC
+#endif
+
+#include "color_correction.h"
+#include "color_matrix.h"
+#include "falloff.h"
+
+namespace
+{
+
+// Fixed point precision of the linear weights, same as cv::resize
+const int COEF_BITS = 11;
+const int COEF_SCALE = 1 << COEF_BITS;
+
+/**
+ * Compute the source index and weight of the next source sample for every destination pixel
+ * This follows the pixel-center mapping and border clamping of cv::resize(INTER_LINEAR)
+ */
+void computeLinear(int dst_size, int src_size, std::vector<int> &ofs, std::vector<short> &alpha)
+{
+    ofs.resize(dst_size);
+    alpha.resize(dst_size);
+    const double scale = (double)src_size / dst_size;
+    for (int d = 0; d < dst_size; d++)
+    {
+        double f = (d + 0.5) * scale - 0.5;
+        int s = (int)std::floor(f);
+        f -= s;
+        if (s < 0)
+        {
+            s = 0;
+            f = 0;
+        }
+        if (s >= src_size - 1)
+        {
+            s = src_size - 1;
+            f = 0;
+        }
+        ofs[d] = s;
+        alpha[d] = (short)std::lround(f * COEF_SCALE);
+    }
+}
+
+/**
+ * Compute the source cells and weights that every destination pixel covers
+ * Each destination pixel covers src_size / dst_size cells, and cells it only partly covers get a partial weight
+ * The weights of a pixel always sum to exactly COEF_SCALE, so flat areas stay flat
+ */
+void computeArea(int dst_size, int src_size, std::vector<int> &tap, std::vector<int> &cell, std::vector<short> &weight)
+{
+    tap.assign(1, 0);
+    cell.clear();
+    weight.clear();
+    const double scale = (double)src_size / dst_size;
+    for (int d = 0; d < dst_size; d++)
+    {
+        const double a = d * scale;
+        const double b = std::min((d + 1) * scale, (double)src_size);
+        int total = 0;
+        size_t largest = weight.size();
+        for (int k = (int)std::floor(a); k < src_size && k < b; k++)
+        {
+            const double w = std::min(b, k + 1.0) - std::max(a, (double)k);
+            const short fixed = (short)std::lround(w / scale * COEF_SCALE);
+            if (fixed <= 0)
+                continue;
+            if (largest == weight.size() || fixed > weight[largest])
+                largest = weight.size();
+            cell.push_back(k);
+            weight.push_back(fixed);
+            total += fixed;
+        }
+
+        // Put any rounding error onto the biggest tap
+        weight[largest] = (short)(weight[largest] + COEF_SCALE - total);
+        tap.push_back((int)cell.size());
+    }
+}
+
+/**
+ * Integer types the weighted sums of a sample type are accumulated in
+ * Two 11-bit weights on a 16-bit sample no longer fit in 32 bits, so those use 64-bit sums
+ * Narrow is what a blend along y fits in once its zero low bits are shifted out, see BayerKernel::m_lineShift
+ */
+template <typename Sample>
+struct Accumulator;
+
+template <>
+struct Accumulator<uint8_t>
+{
+    typedef int Signed;
+    typedef uint32_t Unsigned;
+    typedef uint16_t Narrow;
+};
+
+template <>
+struct Accumulator<uint16_t>
+{
+    typedef int64_t Signed;
+    typedef uint64_t Unsigned;
+    typedef int Narrow;
+};
+
+/**
+ * Where the channels of an output pixel go, for each output format
+ * Mono pixels are the luma of the RGB value, with the 14-bit fixed-point weights of cv::COLOR_RGB2GRAY
+ */
+template <OutputFormat Format>
+struct Layout;
+
+template <>
+struct Layout<OUTPUT_RGB>
+{
+    static const int CHANNELS = 3;
+
+    template <typename Pixel>
+    static void write(Pixel *dst, int r, int g, int b)
+    {
+        dst[0] = (Pixel)r;
+        dst[1] = (Pixel)g;
+        dst[2] = (Pixel)b;
+    }
+};
+
+template <>
+struct Layout<OUTPUT_BGR>
+{
+    static const int CHANNELS = 3;
+
+    template <typename Pixel>
+    static void write(Pixel *dst, int r, int g, int b)
+    {
+        dst[0] = (Pixel)b;
+        dst[1] = (Pixel)g;
+        dst[2] = (Pixel)r;
+    }
+};
+
+inline int luma(int r, int g, int b)
+{
+    return (r * 4899 + g * 9617 + b * 1868 + (1 << 13)) >> 14;
+}
+
+template <>
+struct Layout<OUTPUT_MONO>
+{
+    static const int CHANNELS = 1;
+
+    template <typename Pixel>
+    static void write(Pixel *dst, int r, int g, int b)
+    {
+        dst[0] = (Pixel)luma(r, g, b);
+    }
+};
+
+/**
+ * Writes the output pixels as they are, so 8 bits for 8-bit planes and 16 bits for 16-bit planes
+ */
+template <typename Sample, OutputFormat Format>
+struct StoreLinear
+{
+    typedef Sample Pixel;
+    static const int CHANNELS = Layout<Format>::CHANNELS;
+    static const int MAX_INPUT = (1 << (8 * sizeof(Sample))) - 1;
+
+    template <typename Value>
+    void operator()(Pixel *__restrict dst, int, int, int n, const Value *__restrict red, const Value *__restrict green,
+                    const Value *__restrict blue)
+    {
+        for (int i = 0; i < n; i++, dst += CHANNELS)
+            pixel(dst, red[i], green[i], blue[i]);
+    }
+
+    void pixel(Pixel *dst, int r, int g, int b) const { Layout<Format>::write(dst, r, g, b); }
+};
+
+/**
+ * Maps the 16-bit output pixels to 8 bits through the table of a tone curve
+ * Mono pixels take their luma from the linear values, before the curve
+ * NOTE: this keeps its own copy of the table pointer, the byte stores could alias the one inside the curve
+ */
+template <OutputFormat Format>
+struct StoreToneCurve
+{
+    typedef uint8_t Pixel;
+    static const int CHANNELS = Layout<Format>::CHANNELS;
+    static const int MAX_INPUT = 65535;
+    static const int SHIFT = 16 - ToneCurve::INPUT_BITS;
+
+    explicit StoreToneCurve(const ToneCurve &curve) : table(curve.table()) {}
+
+    template <typename Value>
+    void operator()(Pixel *__restrict dst, int, int, int n, const Value *__restrict red, const Value *__restrict green,
+                    const Value *__restrict blue)
+    {
+        for (int i = 0; i < n; i++, dst += CHANNELS)
+            pixel(dst, red[i], green[i], blue[i]);
+    }
+
+    void pixel(Pixel *dst, int r, int g, int b) const
+    {
+        if (Format == OUTPUT_MONO)
+            dst[0] = table[luma(r, g, b) >> SHIFT];
+        else
+            Layout<Format>::write(dst, table[r >> SHIFT], table[g >> SHIFT], table[b >> SHIFT]);
+    }
+
+    const uint8_t *table;
+};
+
+/**
+ * Corrects the lens falloff and the color of every pixel, and then hands it to the pixel store of the inner store
+ *
+ * A row goes through a single loop, the corrections it has are template flags of that loop, so it only does what it needs.
+ * The kernel only wraps its store in this one when there is at least one of the two.
+ * The falloff gains are bilinear between the nodes of the FalloffTiles. The gain of a channel is constant over the few raw
+ * pixels a demosaiced value is made of, and bilinear demosaicing only mixes samples of the same channel, so scaling
+ * here is the same as scaling the raw samples. The color matrix is applied after that.
+ */
+template <typename Inner>
+struct StoreCorrected
+{
+    typedef typename Inner::Pixel Pixel;
+    static const int CHANNELS = Inner::CHANNELS;
+    static const int TILE = FalloffTiles::TILE;
+    static const int TILE_BITS = FalloffTiles::TILE_BITS;
+    static const int GAIN_BITS = FalloffTiles::GAIN_BITS;
+    static const int CHUNK = 8;
+
+    StoreCorrected(Inner inner, const FalloffTiles *tiles, const ColorCorrection *color)
+        : inner(inner), tiles(tiles), color(color && !color->identity() ? color : nullptr)
+    {
+    }
+
+    template <typename Value>
+    void operator()(Pixel *dst, int r, int c0, int n, const Value *red, const Value *green, const Value *blue)
+    {
+        if (tiles && color)
+            correct<true, true>(dst, r, c0, n, red, green, blue);
+        else if (tiles)
+            correct<true, false>(dst, r, c0, n, red, green, blue);
+        else
+            correct<false, true>(dst, r, c0, n, red, green, blue);
+    }
+
+    template <bool Falloff, bool Color, typename Value>
+    void correct(Pixel *dst, int r, int c0, int n, const Value *red, const Value *green, const Value *blue)
+    {
+        // Blend the two node rows around the row, and then step along it between each pair of nodes
+        // Both blends have TILE_BITS fractional bits, on top of the GAIN_BITS of the gains
+        const int k = r >> TILE_BITS, fr = r & (TILE - 1);
+        const uint16_t *top = Falloff ? tiles->row(k) : nullptr, *bottom = Falloff ? tiles->row(k + 1) : nullptr;
+        const int shift = GAIN_BITS + 2 * TILE_BITS;
+        const uint64_t round = 1ull << (shift - 1);
+        const uint64_t max = Inner::MAX_INPUT;
+        uint32_t acc[3] = {0, 0, 0};
+        int step[3] = {0, 0, 0};
+
+        // The byte stores may alias the coefficients, so they are copied
+        int m[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+        if (Color)
+            std::copy(color->coefs(), color->coefs() + 9, m);
+#ifdef LADYBUG_HAVE_SSE2_COLOR
+        const ColorCoefsSse2 coefs(m);
+#endif
+
+        // One pass corrects the row 8 pixels at a time into ints, the matrix reads the row itself when there is no falloff
+        int values[3][BayerKernel::BLOCK_SIZE];
+        for (int i = 0; i < n; i += CHUNK)
+        {
+            const int count = std::min(n - i, (int)CHUNK);
+            int *vr = values[0] + i, *vg = values[1] + i, *vb = values[2] + i;
+            for (int x = 0, c = c0 + i; Falloff && x < count; x++, c++)
+            {
+                if (x == 0 || !(c & (TILE - 1)))
+                {
+                    const int j = c >> TILE_BITS;
+                    for (int ch = 0; ch < 3; ch++)
+                    {
+                        const int left = top[3 * j + ch] * (TILE - fr) + bottom[3 * j + ch] * fr;
+                        step[ch] = top[3 * j + 3 + ch] * (TILE - fr) + bottom[3 * j + 3 + ch] * fr - left;
+                        acc[ch] = (uint32_t)((left << TILE_BITS) + step[ch] * (c & (TILE - 1)));
+                    }
+                }
+                vr[x] = (int)std::min(max, ((uint64_t)(uint32_t)red[i + x] * acc[0] + round) >> shift);
+                vg[x] = (int)std::min(max, ((uint64_t)(uint32_t)green[i + x] * acc[1] + round) >> shift);
+                vb[x] = (int)std::min(max, ((uint64_t)(uint32_t)blue[i + x] * acc[2] + round) >> shift);
+                acc[0] += step[0];
+                acc[1] += step[1];
+                acc[2] += step[2];
+            }
+            if (!Color)
+                continue;
+#ifdef LADYBUG_HAVE_SSE2_COLOR
+            if (count == CHUNK)
+            {
+                if (Falloff)
+                    correctColorSse2<Inner::MAX_INPUT>(coefs, vr, vg, vb, vr, vg, vb);
+                else
+                    correctColorSse2<Inner::MAX_INPUT>(coefs, red + i, green + i, blue + i, vr, vg, vb);
+                continue;
+            }
+#endif
+            for (int x = 0; x < count; x++)
+            {
+                if (!Falloff)
+                {
+                    vr[x] = red[i + x];
+                    vg[x] = green[i + x];
+                    vb[x] = blue[i + x];
+                }
+                correctColorPixel<Inner::MAX_INPUT>(m, vr[x], vg[x], vb[x]);
+            }
+        }
+        inner(dst, r, c0, n, values[0], values[1], values[2]);
+    }
+
+    Inner inner;
+    const FalloffTiles *tiles;
+    const ColorCorrection *color;
+};
+
+/**
+ * Bilinear demosaic of a single pixel, same as cv::cvtColor with the Bayer code of the pattern (COLOR_BayerBG2RGB for RGGB)
+ * Like OpenCV, the outer rows and cols are copies of their inner neighbours, so we clamp to those
+ * The pattern only moves where red sits in the cell, so it folds into the parity we switch on
+ * NOTE: with an instantiation per pattern GCC stops inlining this on its own, which made the linear path up to 40% slower
+ */
+template <BayerPattern Pattern, typename Sample>
+inline __attribute__((always_inline)) void demosaicPixel(const Sample *raw, int cols, int rows, int x, int y, int rgb[3])
+{
+    x = std::min(std::max(x, 1), cols - 2);
+    y = std::min(std::max(y, 1), rows - 2);
+    const Sample *p = raw + (size_t)y * cols + x;
+    const int center = p[0];
+    const int horiz = (p[-1] + p[1] + 1) >> 1;
+    const int vert = (p[-cols] + p[cols] + 1) >> 1;
+    const int cross = (p[-1] + p[1] + p[-cols] + p[cols] + 2) >> 2;
+    const int diag = (p[-cols - 1] + p[-cols + 1] + p[cols - 1] + p[cols + 1] + 2) >> 2;
+    switch ((((y ^ (Pattern >> 1)) & 1) << 1) | ((x ^ Pattern) & 1))
+    {
+    case 0: // red
+        rgb[0] = center;
+        rgb[1] = cross;
+        rgb[2] = diag;
+        break;
+    case 1: // green on a red row
+        rgb[0] = horiz;
+        rgb[1] = center;
+        rgb[2] = vert;
+        break;
+    case 2: // green on a blue row
+        rgb[0] = vert;
+        rgb[1] = center;
+        rgb[2] = horiz;
+        break;
+    default: // blue
+        rgb[0] = diag;
+        rgb[1] = cross;
+        rgb[2] = center;
+        break;
+    }
+}
+
+#ifdef LADYBUG_HAVE_SSE41_DEMOSAIC
+/**
+ * The vector operations demosaicRowSse41() needs, for 16 8-bit or 8 16-bit samples at a time
+ * The averages of four are widened first, so they round exactly like demosaicPixel()
+ */
+template <typename Sample>
+struct DemosaicSse41;
+
+template <>
+struct DemosaicSse41<uint8_t>
+{
+    static const int LANES = 16;
+
+    __attribute__((target("sse4.1"))) static __m128i load(const uint8_t *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+    __attribute__((target("sse4.1"))) static void store(uint8_t *p, __m128i v) { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v); }
+    __attribute__((target("sse4.1"))) static __m128i average(__m128i a, __m128i b) { return _mm_avg_epu8(a, b); }
+
+    __attribute__((target("sse4.1"))) static __m128i average(__m128i a, __m128i b, __m128i c, __m128i d)
+    {
+        const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+        const __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)),
+                                         _mm_add_epi16(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(d, zero)));
+        const __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)),
+                                         _mm_add_epi16(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(d, zero)));
+        return _mm_packus_epi16(_mm_srli_epi16(_mm_add_epi16(lo, two), 2), _mm_srli_epi16(_mm_add_epi16(hi, two), 2));
+    }
+
+    // All bits set in the lanes of the even (0) or odd (1) pixels
+    __attribute__((target("sse4.1"))) static __m128i lanes(int odd) { return _mm_set1_epi16(odd ? (short)0xff00 : 0x00ff); }
+};
+
+template <>
+struct DemosaicSse41<uint16_t>
+{
+    static const int LANES = 8;
+
+    __attribute__((target("sse4.1"))) static __m128i load(const uint16_t *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+    __attribute__((target("sse4.1"))) static void store(uint16_t *p, __m128i v) { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v); }
+    __attribute__((target("sse4.1"))) static __m128i average(__m128i a, __m128i b) { return _mm_avg_epu16(a, b); }
+
+    __attribute__((target("sse4.1"))) static __m128i average(__m128i a, __m128i b, __m128i c, __m128i d)
+    {
+        const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi32(2);
+        const __m128i lo = _mm_add_epi32(_mm_add_epi32(_mm_unpacklo_epi16(a, zero), _mm_unpacklo_epi16(b, zero)),
+                                         _mm_add_epi32(_mm_unpacklo_epi16(c, zero), _mm_unpacklo_epi16(d, zero)));
+        const __m128i hi = _mm_add_epi32(_mm_add_epi32(_mm_unpackhi_epi16(a, zero), _mm_unpackhi_epi16(b, zero)),
+                                         _mm_add_epi32(_mm_unpackhi_epi16(c, zero), _mm_unpackhi_epi16(d, zero)));
+        return _mm_packus_epi32(_mm_srli_epi32(_mm_add_epi32(lo, two), 2), _mm_srli_epi32(_mm_add_epi32(hi, two), 2));
+    }
+
+    __attribute__((target("sse4.1"))) static __m128i lanes(int odd) { return _mm_set1_epi32(odd ? (int)0xffff0000 : 0x0000ffff); }
+};
+
+/**
+ * Bilinear demosaic of plane row y from col x on, a vector at a time, while the vectors stay inside the row and before x1
+ * x must be even and at least 1, and y an inner row, so every load stays in the plane and every lane keeps its color
+ * Returns the col it stopped at, demosaicRow() does the rest
+ */
+template <BayerPattern Pattern, typename Sample>
+__attribute__((target("sse4.1"))) int demosaicRowSse41(const Sample *raw, int cols, int y, int x, int x1, Sample *red, Sample *green,
+                                                       Sample *blue)
+{
+    typedef DemosaicSse41<Sample> Ops;
+    const int lanes = Ops::LANES;
+
+    // The lanes of the red cols on a red row, or of the blue cols on a blue row, the others are green
+    const bool red_row = ((y ^ (Pattern >> 1)) & 1) == 0;
+    const __m128i own = Ops::lanes(red_row ? (Pattern & 1) : 1 - (Pattern & 1));
+    const Sample *row = raw + (size_t)y * cols;
+    for (; x + lanes < cols && x + lanes <= x1; x += lanes, red += lanes, green += lanes, blue += lanes)
+    {
+        const Sample *p = row + x;
+        const __m128i center = Ops::load(p), left = Ops::load(p - 1), right = Ops::load(p + 1);
+        const __m128i up = Ops::load(p - cols), down = Ops::load(p + cols);
+        const __m128i horiz = Ops::average(left, right), vert = Ops::average(up, down);
+        const __m128i cross = Ops::average(left, right, up, down);
+        const __m128i diag = Ops::average(Ops::load(p - cols - 1), Ops::load(p - cols + 1), Ops::load(p + cols - 1), Ops::load(p + cols + 1));
+        Ops::store(green, _mm_blendv_epi8(center, cross, own));
+        if (red_row)
+        {
+            Ops::store(red, _mm_blendv_epi8(horiz, center, own));
+            Ops::store(blue, _mm_blendv_epi8(vert, diag, own));
+        }
+        else
+        {
+            Ops::store(red, _mm_blendv_epi8(vert, diag, own));
+            Ops::store(blue, _mm_blendv_epi8(horiz, center, own));
+        }
+    }
+    return x;
+}
+#endif
+
+/**
+ * Bilinear demosaic of the pixels [x0, x1) of plane row y into a row of each channel, the same values as demosaicPixel()
+ * With SSE4.1 the inner cols are done a vector at a time, and the border cols go through demosaicPixel()
+ */
+template <BayerPattern Pattern, typename Sample>
+void demosaicRow(const Sample *raw, int cols, int rows, int y, int x0, int x1, Sample *const rgb[3], bool vectorized)
+{
+    int x = x0, pixel[3];
+#ifdef LADYBUG_HAVE_SSE41_DEMOSAIC
+    if (vectorized)
+    {
+        for (const int start = std::min(x1, (std::max(x0, 1) + 1) & ~1); x < start; x++)
+        {
+            demosaicPixel<Pattern>(raw, cols, rows, x, y, pixel);
+            for (int ch = 0; ch < 3; ch++)
+                rgb[ch][x - x0] = (Sample)pixel[ch];
+        }
+        x = demosaicRowSse41<Pattern>(raw, cols, std::min(std::max(y, 1), rows - 2), x, x1, rgb[0] + (x - x0), rgb[1] + (x - x0),
+                                      rgb[2] + (x - x0));
+    }
+#else
+    (void)vectorized;
+#endif
+    for (; x < x1; x++)
+    {
+        demosaicPixel<Pattern>(raw, cols, rows, x, y, pixel);
+        for (int ch = 0; ch < 3; ch++)
+            rgb[ch][x - x0] = (Sample)pixel[ch];
+    }
+}
+
+#ifdef __SSE2__
+/**
+ * Square blocks of samples rotated in registers, 16 rows of 8-bit, 8 rows of 16-bit or 4 rows of blended samples
+ * Interleaving pairs of rows in units of one, two, four and eight samples transposes the block, but leaves
+ * its rows in bit-reversed order, so row j is stored at ORDER[j]
+ */
+template <typename Sample>
+struct RotateSse2;
+
+template <>
+struct RotateSse2<uint8_t>
+{
+    static const int SIZE = 16;
+
+    static void block(const uint8_t *src, size_t src_stride, uint8_t *dst, size_t dst_stride)
+    {
+        static const int ORDER[16] = {0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15};
+        __m128i a[16], b[16];
+        for (int k = 0; k < 16; k++)
+            a[k] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + (15 - k) * src_stride));
+        for (int k = 0; k < 8; k++)
+        {
+            b[k] = _mm_unpacklo_epi8(a[2 * k], a[2 * k + 1]);
+            b[k + 8] = _mm_unpackhi_epi8(a[2 * k], a[2 * k + 1]);
+        }
+        for (int k = 0; k < 8; k++)
+        {
+            a[k] = _mm_unpacklo_epi16(b[2 * k], b[2 * k + 1]);
+            a[k + 8] = _mm_unpackhi_epi16(b[2 * k], b[2 * k + 1]);
+        }
+        for (int k = 0; k < 8; k++)
+        {
+            b[k] = _mm_unpacklo_epi32(a[2 * k], a[2 * k + 1]);
+            b[k + 8] = _mm_unpackhi_epi32(a[2 * k], a[2 * k + 1]);
+        }
+        for (int k = 0; k < 8; k++)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + ORDER[k] * dst_stride), _mm_unpacklo_epi64(b[2 * k], b[2 * k + 1]));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + ORDER[k + 8] * dst_stride), _mm_unpackhi_epi64(b[2 * k], b[2 * k + 1]));
+        }
+    }
+};
+
+template <>
+struct RotateSse2<uint16_t>
+{
+    static const int SIZE = 8;
+
+    static void block(const uint16_t *src, size_t src_stride, uint16_t *dst, size_t dst_stride)
+    {
+        static const int ORDER[8] = {0, 4, 2, 6, 1, 5, 3, 7};
+        __m128i a[8], b[8];
+        for (int k = 0; k < 8; k++)
+            a[k] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + (7 - k) * src_stride));
+        for (int k = 0; k < 4; k++)
+        {
+            b[k] = _mm_unpacklo_epi16(a[2 * k], a[2 * k + 1]);
+            b[k + 4] = _mm_unpackhi_epi16(a[2 * k], a[2 * k + 1]);
+        }
+        for (int k = 0; k < 4; k++)
+        {
+            a[k] = _mm_unpacklo_epi32(b[2 * k], b[2 * k + 1]);
+            a[k + 4] = _mm_unpackhi_epi32(b[2 * k], b[2 * k + 1]);
+        }
+        for (int k = 0; k < 4; k++)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + ORDER[k] * dst_stride), _mm_unpacklo_epi64(a[2 * k], a[2 * k + 1]));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + ORDER[k + 4] * dst_stride), _mm_unpackhi_epi64(a[2 * k], a[2 * k + 1]));
+        }
+    }
+};
+
+template <>
+struct RotateSse2<int>
+{
+    static const int SIZE = 4;
+
+    static void block(const int *src, size_t src_stride, int *dst, size_t dst_stride)
+    {
+        static const int ORDER[4] = {0, 2, 1, 3};
+        __m128i a[4], b[4];
+        for (int k = 0; k < 4; k++)
+            a[k] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + (3 - k) * src_stride));
+        for (int k = 0; k < 2; k++)
+        {
+            b[k] = _mm_unpacklo_epi32(a[2 * k], a[2 * k + 1]);
+            b[k + 2] = _mm_unpackhi_epi32(a[2 * k], a[2 * k + 1]);
+        }
+        for (int k = 0; k < 2; k++)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + ORDER[k] * dst_stride), _mm_unpacklo_epi64(b[2 * k], b[2 * k + 1]));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + ORDER[k + 2] * dst_stride), _mm_unpackhi_epi64(b[2 * k], b[2 * k + 1]));
+        }
+    }
+};
+#endif
+
+/**
+ * Rotate a plane of the tile clockwise like the output, so row y, col x of src ends up in row x, col (rows - 1 - y) of dst
+ * With SSE2 the plane goes in square blocks that are rotated in registers, and the cols and rows left over one sample at a time
+ */
+template <typename Sample>
+void rotateTile(const Sample *src, size_t src_stride, int rows, int cols, Sample *dst, size_t dst_stride)
+{
+    int block_rows = 0, block_cols = 0;
+#ifdef __SSE2__
+    const int size = RotateSse2<Sample>::SIZE;
+    block_rows = rows - rows % size;
+    block_cols = cols - cols % size;
+    for (int y = 0; y < block_rows; y += size)
+        for (int x = 0; x < block_cols; x += size)
+            RotateSse2<Sample>::block(src + y * src_stride + x, src_stride, dst + x * dst_stride + (rows - size - y), dst_stride);
+#endif
+    for (int y = 0; y < rows; y++)
+        for (int x = (y < block_rows) ? block_cols : 0; x < cols; x++)
+            dst[x * dst_stride + (rows - 1 - y)] = src[y * src_stride + x];
+}
+
+#ifdef LADYBUG_HAVE_SSE41_DEMOSAIC
+/**
+ * Blend two rows of samples with pmaddwd, 16 8-bit or 8 16-bit samples at a time, and return the col it stopped at
+ * 16-bit samples are offset by 32768 to fit its signed inputs, which takes 32768 * COEF_SCALE off every sum
+ * The lines of 16 bits hold the sums shifted down by the low bits they all have zero
+ */
+__attribute__((target("sse4.1"))) int blendRowsSse41(const uint8_t *p0, const uint8_t *p1, int alpha, int, int *line, int n)
+{
+    const __m128i coefs = _mm_set1_epi32(alpha << 16 | (COEF_SCALE - alpha)), zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 16 <= n; x += 16)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p0 + x));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p1 + x));
+        const __m128i pairs[2] = {_mm_unpacklo_epi8(a, b), _mm_unpackhi_epi8(a, b)};
+        for (int k = 0; k < 2; k++)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(line + x + 8 * k), _mm_madd_epi16(_mm_unpacklo_epi8(pairs[k], zero), coefs));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(line + x + 8 * k + 4), _mm_madd_epi16(_mm_unpackhi_epi8(pairs[k], zero), coefs));
+        }
+    }
+    return x;
+}
+
+__attribute__((target("sse4.1"))) int blendRowsSse41(const uint8_t *p0, const uint8_t *p1, int alpha, int shift, uint16_t *line, int n)
+{
+    const __m128i coefs = _mm_set1_epi32(alpha << 16 | (COEF_SCALE - alpha)), zero = _mm_setzero_si128(), count = _mm_cvtsi32_si128(shift);
+    int x = 0;
+    for (; x + 16 <= n; x += 16)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p0 + x));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p1 + x));
+        const __m128i pairs[2] = {_mm_unpacklo_epi8(a, b), _mm_unpackhi_epi8(a, b)};
+        for (int k = 0; k < 2; k++)
+        {
+            const __m128i lo = _mm_srl_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(pairs[k], zero), coefs), count);
+            const __m128i hi = _mm_srl_epi32(_mm_madd_epi16(_mm_unpackhi_epi8(pairs[k], zero), coefs), count);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(line + x + 8 * k), _mm_packus_epi32(lo, hi));
+        }
+    }
+    return x;
+}
+
+__attribute__((target("sse4.1"))) int blendRowsSse41(const uint16_t *p0, const uint16_t *p1, int alpha, int, int *line, int n)
+{
+    const __m128i coefs = _mm_set1_epi32(alpha << 16 | (COEF_SCALE - alpha));
+    const __m128i sign = _mm_set1_epi16(-32768), offset = _mm_set1_epi32(32768 * COEF_SCALE);
+    int x = 0;
+    for (; x + 8 <= n; x += 8)
+    {
+        const __m128i a = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p0 + x)), sign);
+        const __m128i b = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p1 + x)), sign);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(line + x), _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), coefs), offset));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(line + x + 4), _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), coefs), offset));
+    }
+    return x;
+}
+
+/**
+ * Blend two lines of 8-bit samples and round them, 8 or 4 at a time, and return the col it stopped at
+ * The sums stay below 2^31, the lines of 16-bit samples need 64 bits and are left to blendLines()
+ */
+__attribute__((target("sse4.1"))) int blendLinesSse41(const uint16_t *p0, const uint16_t *p1, int alpha, int shift, int *values, int n)
+{
+    const __m128i a0 = _mm_set1_epi32(COEF_SCALE - alpha), a1 = _mm_set1_epi32(alpha), zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(1 << (2 * COEF_BITS - 1 - shift)), count = _mm_cvtsi32_si128(2 * COEF_BITS - shift);
+    int k = 0;
+    for (; k + 8 <= n; k += 8)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p0 + k));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p1 + k));
+        const __m128i lo = _mm_add_epi32(_mm_mullo_epi32(_mm_unpacklo_epi16(a, zero), a0), _mm_mullo_epi32(_mm_unpacklo_epi16(b, zero), a1));
+        const __m128i hi = _mm_add_epi32(_mm_mullo_epi32(_mm_unpackhi_epi16(a, zero), a0), _mm_mullo_epi32(_mm_unpackhi_epi16(b, zero), a1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(values + k), _mm_sra_epi32(_mm_add_epi32(lo, round), count));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(values + k + 4), _mm_sra_epi32(_mm_add_epi32(hi, round), count));
+    }
+    return k;
+}
+
+__attribute__((target("sse4.1"))) int blendLinesSse41(const int *p0, const int *p1, int alpha, int, int *values, int n)
+{
+    const __m128i a0 = _mm_set1_epi32(COEF_SCALE - alpha), a1 = _mm_set1_epi32(alpha), round = _mm_set1_epi32(1 << (2 * COEF_BITS - 1));
+    int k = 0;
+    for (; k + 4 <= n; k += 4)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p0 + k));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p1 + k));
+        const __m128i sum = _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(a, a0), _mm_mullo_epi32(b, a1)), round);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(values + k), _mm_srai_epi32(sum, 2 * COEF_BITS));
+    }
+    return k;
+}
+
+// The other combinations of samples and lines have no vector version
+template <typename Sample, typename Line>
+int blendRowsSse41(const Sample *, const Sample *, int, int, Line *, int)
+{
+    return 0;
+}
+#endif
+
+/**
+ * Blend two rows of samples into a line, p0 * (COEF_SCALE - alpha) + p1 * alpha, which is exact in an int
+ * Lines of 16 bits hold that shifted down by shift, which only drops bits that are zero, see BayerKernel::m_lineShift
+ */
+template <typename Sample, typename Line>
+void blendRows(const Sample *p0, const Sample *p1, int alpha, int shift, Line *line, int n, bool vectorized)
+{
+    int x = 0;
+#ifdef LADYBUG_HAVE_SSE41_DEMOSAIC
+    if (vectorized)
+        x = blendRowsSse41(p0, p1, alpha, shift, line, n);
+#else
+    (void)vectorized;
+#endif
+    for (; x < n; x++)
+        line[x] = (Line)((p0[x] * (COEF_SCALE - alpha) + p1[x] * alpha) >> shift);
+}
+
+/**
+ * Blend two lines like blendRows() and round the sums back to samples
+ */
+template <typename Sample, typename Line>
+void blendLines(const Line *p0, const Line *p1, int alpha, int shift, int *values, int n, bool vectorized)
+{
+    typedef typename Accumulator<Sample>::Signed Sum;
+    int k = 0;
+#ifdef LADYBUG_HAVE_SSE41_DEMOSAIC
+    if (vectorized && sizeof(Sample) == 1)
+        k = blendLinesSse41(p0, p1, alpha, shift, values, n);
+#else
+    (void)vectorized;
+#endif
+    for (; k < n; k++)
+        values[k] = (int)(((Sum)p0[k] * (COEF_SCALE - alpha) + (Sum)p1[k] * alpha + ((Sum)1 << (2 * COEF_BITS - 1 - shift))) >> (2 * COEF_BITS - shift));
+}
+
+} // namespace
+
+const int BayerKernel::BLOCK_SIZE;
+
+BayerKernel::BayerKernel(int src_cols, int src_rows, double scale, bool half_height, BayerPattern pattern, OutputFormat format)
+    : m_srcCols(src_cols), m_srcRows(src_rows), m_scale(scale), m_pattern(pattern), m_format(format), m_halfHeight(half_height),
+      m_planeRows(half_height ? src_rows / 2 : src_rows)
+{
+    switch (pattern)
+    {
+    case BAYER_GRBG:
+        selectFormat<BAYER_GRBG>();
+        break;
+    case BAYER_GBRG:
+        selectFormat<BAYER_GBRG>();
+        break;
+    case BAYER_BGGR:
+        selectFormat<BAYER_BGGR>();
+        break;
+    default:
+        selectFormat<BAYER_RGGB>();
+        break;
+    }
+
+    // Size after scaling, before the image is rotated, this is always relative to the full sensor
+    const int scaled_cols = std::max(1, (int)(src_cols * scale / 100));
+    const int scaled_rows = std::max(1, (int)(src_rows * scale / 100));
+
+    // The tables sample the rows of the plane, and row k of a half-height plane is centered on sensor row 2k + 0.5
+    // Mapping pixel centers to the plane is then the same as mapping them to the sensor and halving, so the
+    // anisotropic scale needs nothing else. Above 50% it interpolates between the rows the plane has.
+    const int plane_rows = m_planeRows;
+
+    // By default the image is side-ways, so the output is the scaled image rotated clockwise
+    // Output row r is scaled column r, and output col c is scaled row (scaled_rows - 1 - c)
+    m_outRows = scaled_cols;
+    m_outCols = scaled_rows;
+
+    // Below half size of the sensor, every output pixel covers more than a 2x2 Bayer cell of the plane, so we bin cells
+    // At exactly 50% the linear weights are all one half, which is the 2x2 average the chain takes, and binning is much blurrier
+    m_binned = (2 * scaled_cols < src_cols && 2 * scaled_rows < src_rows && 2 * scaled_rows <= plane_rows);
+    m_unscaled = (scaled_cols == src_cols && scaled_rows == plane_rows);
+#ifdef LADYBUG_HAVE_SSE41_DEMOSAIC
+    m_vectorized = __builtin_cpu_supports("sse4.1");
+#else
+    m_vectorized = false;
+#endif
+    m_tileCols = m_tileRows = m_lineShift = 0;
+    if (m_binned)
+    {
+        computeArea(scaled_cols, src_cols / 2, m_xTap, m_xCell, m_xWeight);
+        std::vector<int> y_tap, y_cell;
+        std::vector<short> y_weight;
+        computeArea(scaled_rows, plane_rows / 2, y_tap, y_cell, y_weight);
+
+        // Reverse the order of the output cols, the taps of each col stay as they are
+        m_yTap.assign(1, 0);
+        for (int c = scaled_rows - 1; c >= 0; c--)
+        {
+            m_yCell.insert(m_yCell.end(), y_cell.begin() + y_tap[c], y_cell.begin() + y_tap[c + 1]);
+            m_yWeight.insert(m_yWeight.end(), y_weight.begin() + y_tap[c], y_weight.begin() + y_tap[c + 1]);
+            m_yTap.push_back((int)m_yCell.size());
+        }
+        return;
+    }
+
+    computeLinear(scaled_cols, src_cols, m_xOfs, m_xAlpha);
+    std::vector<int> y_ofs;
+    std::vector<short> y_alpha;
+    computeLinear(scaled_rows, plane_rows, y_ofs, y_alpha);
+    m_yOfs.assign(y_ofs.rbegin(), y_ofs.rend());
+    m_yAlpha.assign(y_alpha.rbegin(), y_alpha.rend());
+
+    // Low bits that are zero in every y weight, the blends along y are multiples of 1 << m_lineShift
+    m_lineShift = COEF_BITS;
+    for (short alpha : m_yAlpha)
+        while (alpha & ((1 << m_lineShift) - 1))
+            m_lineShift--;
+
+    // Size of the largest window of the plane a block samples, see processBlockRow()
+    for (int r0 = 0; r0 < m_outRows; r0 += BLOCK_SIZE)
+    {
+        const int r1 = std::min(r0 + BLOCK_SIZE, m_outRows);
+        m_tileCols = std::max(m_tileCols, std::min(m_xOfs[r1 - 1] + 1, src_cols - 1) - m_xOfs[r0] + 1);
+    }
+    for (int c0 = 0; c0 < m_outCols; c0 += BLOCK_SIZE)
+    {
+        const int c1 = std::min(c0 + BLOCK_SIZE, m_outCols);
+        m_tileRows = std::max(m_tileRows, std::min(m_yOfs[c0] + 1, plane_rows - 1) - m_yOfs[c1 - 1] + 1);
+    }
+}
+
+void BayerKernel::setVectorized(bool vectorized)
+{
+#ifdef LADYBUG_HAVE_SSE41_DEMOSAIC
+    m_vectorized = vectorized && __builtin_cpu_supports("sse4.1");
+#else
+    (void)vectorized;
+#endif
+}
+
+void BayerKernel::rawToOutput(double raw_col, double raw_row, double &col, double &row) const
+{
+    // Scale with pixel centers aligned, then rotate clockwise like process() does
+    // NOTE: raw_row is a sensor row, also for half-height planes
+    const double x = (raw_col + 0.5) * m_outRows / m_srcCols - 0.5;
+    const double y = (raw_row + 0.5) * m_outCols / m_srcRows - 0.5;
+    col = (m_outCols - 1) - y;
+    row = x;
+}
+
+void BayerKernel::outputToRaw(double col, double row, double &raw_col, double &raw_row) const
+{
+    const double y = (m_outCols - 1) - col;
+    raw_col = (row + 0.5) * m_srcCols / m_outRows - 0.5;
+    raw_row = (y + 0.5) * m_srcRows / m_outCols - 0.5;
+}
+
+template <BayerPattern Pattern>
+void BayerKernel::selectFormat()
+{
+    switch (m_format)
+    {
+    case OUTPUT_BGR:
+        m_process8 = &BayerKernel::process8<Pattern, OUTPUT_BGR>;
+        m_process16 = &BayerKernel::process16<Pattern, OUTPUT_BGR>;
+        m_processTone = &BayerKernel::processTone<Pattern, OUTPUT_BGR>;
+        break;
+    case OUTPUT_MONO:
+        m_process8 = &BayerKernel::process8<Pattern, OUTPUT_MONO>;
+        m_process16 = &BayerKernel::process16<Pattern, OUTPUT_MONO>;
+        m_processTone = &BayerKernel::processTone<Pattern, OUTPUT_MONO>;
+        break;
+    default:
+        m_process8 = &BayerKernel::process8<Pattern, OUTPUT_RGB>;
+        m_process16 = &BayerKernel::process16<Pattern, OUTPUT_RGB>;
+        m_processTone = &BayerKernel::processTone<Pattern, OUTPUT_RGB>;
+        break;
+    }
+}
+
+template <BayerPattern Pattern, OutputFormat Format>
+void BayerKernel::process8(const uint8_t *raw, uint8_t *out, size_t out_step, const std::vector<uint8_t> *blocks, const FalloffTiles *falloff,
+                           const ColorCorrection *color) const
+{
+    typedef StoreLinear<uint8_t, Format> Store;
+    if (falloff || (color && !color->identity()))
+        processBlocks<Pattern>(raw, out, out_step, blocks, StoreCorrected<Store>(Store(), falloff, color));
+    else
+        processBlocks<Pattern>(raw, out, out_step, blocks, Store());
+}
+
+template <BayerPattern Pattern, OutputFormat Format>
+void BayerKernel::process16(const uint16_t *raw, uint8_t *out, size_t out_step, const std::vector<uint8_t> *blocks, const FalloffTiles *falloff,
+                            const ColorCorrection *color) const
+{
+    typedef StoreLinear<uint16_t, Format> Store;
+    if (falloff || (color && !color->identity()))
+        processBlocks<Pattern>(raw, out, out_step, blocks, StoreCorrected<Store>(Store(), falloff, color));
+    else
+        processBlocks<Pattern>(raw, out, out_step, blocks, Store());
+}
+
+template <BayerPattern Pattern, OutputFormat Format>
+void BayerKernel::processTone(const uint16_t *raw, const ToneCurve &curve, uint8_t *out, size_t out_step, const std::vector<uint8_t> *blocks,
+                              const FalloffTiles *falloff, const ColorCorrection *color) const
+{
+    typedef StoreToneCurve<Format> Store;
+    if (falloff || (color && !color->identity()))
+        processBlocks<Pattern>(raw, out, out_step, blocks, StoreCorrected<Store>(Store(curve), falloff, color));
+    else
+        processBlocks<Pattern>(raw, out, out_step, blocks, Store(curve));
+}
+
+void BayerKernel::process(const uint8_t *raw, uint8_t *out, size_t out_step, const FalloffTiles *falloff, const ColorCorrection *color) const
+{
+    (this->*m_process8)(raw, out, out_step, nullptr, falloff, color);
+}
+
+void BayerKernel::process(const uint8_t *raw, uint8_t *out, size_t out_step, const std::vector<uint8_t> &blocks, const FalloffTiles *falloff,
+                          const ColorCorrection *color) const
+{
+    (this->*m_process8)(raw, out, out_step, &blocks, falloff, color);
+}
+
+void BayerKernel::process(const uint16_t *raw, uint16_t *out, size_t out_step, const FalloffTiles *falloff, const ColorCorrection *color) const
+{
+    (this->*m_process16)(raw, reinterpret_cast<uint8_t *>(out), out_step, nullptr, falloff, color);
+}
+
+void BayerKernel::process(const uint16_t *raw, const ToneCurve &curve, uint8_t *out, size_t out_step, const FalloffTiles *falloff,
+                          const ColorCorrection *color) const
+{
+    (this->*m_processTone)(raw, curve, out, out_step, nullptr, falloff, color);
+}
+
+void BayerKernel::process(const uint16_t *raw, const ToneCurve &curve, uint8_t *out, size_t out_step, const std::vector<uint8_t> &blocks,
+                          const FalloffTiles *falloff, const ColorCorrection *color) const
+{
+    (this->*m_processTone)(raw, curve, out, out_step, &blocks, falloff, color);
+}
+
+// NOTE: the block functions are kept out of line, inlined into this loop they run about 25% slower at scale 100
+template <BayerPattern Pattern, typename Sample, typename Store>
+void BayerKernel::processBlocks(const Sample *raw, uint8_t *out, size_t out_step, const std::vector<uint8_t> *blocks, Store store) const
+{
+    // Blends of 8-bit samples fit 16 bits once 3 or more zero low bits are shifted out, like at 50% or for half-height planes
+    if (!m_binned)
+    {
+        if (sizeof(Sample) == 1 && m_lineShift >= 3)
+            processBlockRows<Pattern, typename Accumulator<Sample>::Narrow>(raw, out, out_step, blocks, m_lineShift, store);
+        else
+            processBlockRows<Pattern, int>(raw, out, out_step, blocks, 0, store);
+        return;
+    }
+    for (int br = 0; br < block_rows(); br++)
+    {
+        for (int bc = 0; bc < block_cols(); bc++)
+        {
+            if (blocks && !(*blocks)[br * block_cols() + bc])
+                continue;
+            const int r0 = br * BLOCK_SIZE, c0 = bc * BLOCK_SIZE;
+            processBinnedBlock<Pattern>(raw, out, out_step, r0, std::min(r0 + BLOCK_SIZE, m_outRows), c0, std::min(c0 + BLOCK_SIZE, m_outCols),
+                                        store);
+        }
+    }
+}
+
+template <BayerPattern Pattern, typename Line, typename Sample, typename Store>
+void BayerKernel::processBlockRows(const Sample *raw, uint8_t *out, size_t out_step, const std::vector<uint8_t> *blocks, int shift, Store store) const
+{
+    // Every call has tiles of its own, the same kernel processes all heads at once
+    // At full size the demosaiced planes of every block of a row are kept, otherwise the blended ones, see processBlockRow()
+    const size_t planes = 3 * (size_t)(block_cols() + 1);
+    std::unique_ptr<Sample[]> tiles(new Sample[(m_unscaled ? planes : 3) * m_tileCols * m_tileRows]);
+    std::unique_ptr<Line[]> blended(m_unscaled ? nullptr : new Line[planes * m_tileCols * BLOCK_SIZE]);
+    for (int br = 0; br < block_rows(); br++)
+        processBlockRow<Pattern>(raw, tiles.get(), blended.get(), out, out_step, br, blocks ? blocks->data() + br * block_cols() : nullptr, shift,
+                                 store);
+}
+
+template <BayerPattern Pattern, typename Sample, typename Line, typename Store>
+__attribute__((noinline)) void BayerKernel::processBlockRow(const Sample *raw, Sample *tiles, Line *blended, uint8_t *out, size_t out_step, int br,
+                                                            const uint8_t *mask, int shift, Store store) const
+{
+    // Byte stores may alias anything, so keep the sizes and tables in locals instead of reloading the members every pixel
+    const int cols = m_srcCols, rows = m_planeRows, nb = block_cols();
+    const size_t size = (size_t)m_tileCols * m_tileRows, line_size = (size_t)m_tileCols * BLOCK_SIZE;
+    const int *y_ofs = m_yOfs.data();
+    const short *y_alpha = m_yAlpha.data();
+
+    // Output rows run along the plane cols, and output cols along the plane rows backwards
+    // So all blocks of the row sample the same plane cols, and each block a window of plane rows of its own
+    const int r0 = br * BLOCK_SIZE, r1 = std::min(r0 + BLOCK_SIZE, m_outRows);
+    const int xa = m_xOfs[r0], xb = std::min(m_xOfs[r1 - 1] + 1, cols - 1);
+    const int tile_cols = xb - xa + 1;
+    for (int bc = 0; bc < nb; bc++)
+    {
+        if (mask && !mask[bc])
+            continue;
+
+        // Demosaic the window of the block into the first planes, each pixel once and a plane row at a time
+        const int c0 = bc * BLOCK_SIZE, c1 = std::min(c0 + BLOCK_SIZE, m_outCols), n = c1 - c0;
+        const int ya = y_ofs[c1 - 1], yb = std::min(y_ofs[c0] + 1, rows - 1), tile_rows = yb - ya + 1;
+        for (int y = ya; y <= yb; y++)
+        {
+            Sample *const rgb[3] = {tiles + (y - ya) * tile_cols, tiles + size + (y - ya) * tile_cols, tiles + 2 * size + (y - ya) * tile_cols};
+            demosaicRow<Pattern>(raw, cols, rows, y, xa, xb + 1, rgb, m_vectorized);
+        }
+
+        // At full size rotate it into the planes of the block, so each output row reads a row of them, with plane row y at col yb - y
+        if (m_unscaled)
+        {
+            for (int ch = 0; ch < 3; ch++)
+                rotateTile(tiles + ch * size, tile_cols, tile_rows, tile_cols, tiles + (3 * bc + 3 + ch) * size, tile_rows);
+            continue;
+        }
+
+        // Otherwise blend the two plane rows of every output col first, with the last col on top, and then rotate that
+        // Each output row then blends two rows of the planes of the block, and the sums stay exact until that last blend
+        for (int ch = 0; ch < 3; ch++)
+        {
+            for (int k = 0; k < n; k++)
+            {
+                const Sample *p0 = tiles + ch * size + (y_ofs[c0 + k] - ya) * tile_cols;
+                const Sample *p1 = tiles + ch * size + (std::min(y_ofs[c0 + k] + 1, rows - 1) - ya) * tile_cols;
+                blendRows(p0, p1, y_alpha[c0 + k], shift, blended + ch * line_size + (n - 1 - k) * tile_cols, tile_cols, m_vectorized);
+            }
+            rotateTile(blended + ch * line_size, tile_cols, n, tile_cols, blended + (3 * bc + 3 + ch) * line_size, BLOCK_SIZE);
+        }
+    }
+
+    // Then write the output a row at a time, instead of a block at a time, which keeps far fewer pages in use at once
+    int values[3][BLOCK_SIZE];
+    for (int r = r0; r < r1; r++)
+    {
+        typename Store::Pixel *const dst = reinterpret_cast<typename Store::Pixel *>(out + r * out_step);
+        const size_t x0 = m_xOfs[r] - xa, x1 = std::min(m_xOfs[r] + 1, cols - 1) - xa;
+        const int ax = m_xAlpha[r];
+        for (int bc = 0; bc < nb; bc++)
+        {
+            if (mask && !mask[bc])
+                continue;
+            const int c0 = bc * BLOCK_SIZE, c1 = std::min(c0 + BLOCK_SIZE, m_outCols), n = c1 - c0;
+            if (m_unscaled)
+            {
+                const Sample *const planes = tiles + (3 * bc + 3) * size;
+                const int yb = std::min(y_ofs[c0] + 1, rows - 1), tile_rows = yb - y_ofs[c1 - 1] + 1;
+                const size_t i = x0 * tile_rows + (yb - y_ofs[c0]);
+                store(dst + c0 * Store::CHANNELS, r, c0, n, planes + i, planes + size + i, planes + 2 * size + i);
+                continue;
+            }
+            for (int ch = 0; ch < 3; ch++)
+            {
+                const Line *planes = blended + (3 * bc + 3 + ch) * line_size;
+                blendLines<Sample>(planes + x0 * BLOCK_SIZE, planes + x1 * BLOCK_SIZE, ax, shift, values[ch], n, m_vectorized);
+            }
+            store(dst + c0 * Store::CHANNELS, r, c0, n, values[0], values[1], values[2]);
+        }
+    }
+}
+
+template <BayerPattern Pattern, typename Sample, typename Store>
+__attribute__((noinline)) void BayerKernel::processBinnedBlock(const Sample *raw, uint8_t *out, size_t out_step, int r0, int r1, int c0, int c1, Store store) const
+{
+    typedef typename Accumulator<Sample>::Unsigned Sum;
+    const size_t cols = (size_t)m_srcCols;
+    const int red_x = Pattern & 1, red_y = Pattern >> 1;
+    const int *y_tap = m_yTap.data(), *y_cell = m_yCell.data(), *x_cell = m_xCell.data();
+    const short *y_weight = m_yWeight.data(), *x_weight = m_xWeight.data();
+    int values[3][BLOCK_SIZE];
+    for (int r = r0; r < r1; r++)
+    {
+        const int xt0 = m_xTap[r];
+        const int xt1 = m_xTap[r + 1];
+        for (int c = c0; c < c1; c++)
+        {
+
+            // Weighted sum of the cells under this pixel, first along x then along y
+            // NOTE: green is the sum of both greens of a cell, so it carries one extra bit
+            Sum sum[3] = {0, 0, 0};
+            for (int yt = y_tap[c]; yt < y_tap[c + 1]; yt++)
+            {
+                const Sample *red_row = raw + (size_t)(2 * y_cell[yt] + red_y) * cols;
+                const Sample *blue_row = raw + (size_t)(2 * y_cell[yt] + 1 - red_y) * cols;
+                Sum row[3] = {0, 0, 0};
+                for (int xt = xt0; xt < xt1; xt++)
+                {
+                    const int x = 2 * x_cell[xt];
+                    const Sum wx = (Sum)x_weight[xt];
+                    row[0] += wx * red_row[x + red_x];
+                    row[1] += wx * (Sum)(red_row[x + 1 - red_x] + blue_row[x + red_x]);
+                    row[2] += wx * blue_row[x + 1 - red_x];
+                }
+                const Sum wy = (Sum)y_weight[yt];
+                sum[0] += wy * row[0];
+                sum[1] += wy * row[1];
+                sum[2] += wy * row[2];
+            }
+            values[0][c - c0] = (int)((sum[0] + ((Sum)1 << (2 * COEF_BITS - 1))) >> (2 * COEF_BITS));
+            values[1][c - c0] = (int)((sum[1] + ((Sum)1 << (2 * COEF_BITS))) >> (2 * COEF_BITS + 1));
+            values[2][c - c0] = (int)((sum[2] + ((Sum)1 << (2 * COEF_BITS - 1))) >> (2 * COEF_BITS));
+        }
+        typename Store::Pixel *dst = reinterpret_cast<typename Store::Pixel *>(out + r * out_step) + c0 * Store::CHANNELS;
+        store(dst, r, c0, c1 - c0, values[0], values[1], values[2]);
+    }
+}
@@ -0,0 +1,262 @@
+#ifndef LADYBUG_BAYER_KERNEL_H
+#define LADYBUG_BAYER_KERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "tone_curve.h"
+
+class ColorCorrection;
+class FalloffTiles;
+
+/**
+ * Order of the colors in every 2x2 Bayer cell, named after its top row then its bottom row like the ROS encodings
+ * Bit 0 of the value is the column of red in the cell and bit 1 is its row, blue is always diagonal to red
+ */
+enum BayerPattern
+{
+    BAYER_RGGB = 0,
+    BAYER_GRBG = 1,
+    BAYER_GBRG = 2,
+    BAYER_BGGR = 3
+};
+
+/**
+ * Pixel layout the kernel writes, mono is the luma of the demosaiced RGB value (same weights as cv::COLOR_RGB2GRAY)
+ */
+enum OutputFormat
+{
+    OUTPUT_RGB,
+    OUTPUT_BGR,
+    OUTPUT_MONO
+};
+
+/**
+ * Fused Bayer demosaic + downscale + rotate for a single camera head
+ *
+ * This replaces the cvtColor(COLOR_BayerBG2RGB) -> resize -> transpose -> flip(1) chain.
+ * The rotated and scaled RGB output is written in one pass straight into the destination buffer. Each row of output blocks
+ * demosaics the window of the raw plane it samples once into tiles that stay in cache, and blends and writes from those.
+ *
+ * At scale 100 the output is identical to the OpenCV chain (same bilinear demosaic and border copy).
+ * Down to 50% the same 11-bit fixed-point linear weights as cv::resize(INTER_LINEAR) are used, but the blend is only
+ * rounded once at the end, while OpenCV shifts its intermediate sums down, so pixels can differ from the chain by 1.
+ * At exactly 50% every weight is one half, which averages 2x2 demosaiced pixels like the chain does there.
+ * test/test_bayer_kernel.cpp checks both against the chain for every pattern.
+ *
+ * Below 50% we never demosaic at full resolution. Every 2x2 Bayer cell is one RGB superpixel
+ * (red, average of the two greens, blue), like the SDK's LADYBUG_DOWNSAMPLE4, and the output pixel is
+ * an area average of the cells under it. At 25% and 12.5% this is plain binning of 4 and 16 cells,
+ * and other scales get fractional edge weights like cv::resize(INTER_AREA).
+ * The red and blue of a cell are a sensor pixel apart, which is why 50% itself is not binned, a single cell per pixel
+ * gave fine detail color fringes and about 10 dB less PSNR than the chain. At 12.5% the area average aliases less than
+ * its resize. The binning benchmark of ladybug_bench reports the PSNR of both against the scene the plane was sampled from.
+ *
+ * Raw planes of 12 or 16 bits come in as 16-bit samples, with the value in the high bits. They are demosaiced and
+ * scaled at full precision, and written either as RGB16 or mapped to RGB8 through a ToneCurve as the last step.
+ *
+ * Half-height planes only hold every other pair of sensor rows. They are demosaiced on the rows they have, and
+ * then scaled anisotropically to the size of the full sensor, so the output has the same proportions (and the same
+ * calibration) as a full-height head. Sizes and rawToOutput() are always in full sensor rows.
+ *
+ * Lens falloff can be corrected in the same pass with the FalloffTiles of the head (see falloff.h), which scale each
+ * channel right before the value is stored. The white balance and color matrix of a ColorCorrection (see color_correction.h)
+ * are applied after that, also before the value is stored.
+ *
+ * Every path is a template over the Bayer pattern and the output format, so the CFA phase and channel order are
+ * constants in the inner loops. The constructor picks the instantiation for its pattern and format once, and each
+ * process() call then goes through a member pointer, so nothing is decided per pixel or per block.
+ * Demosaicing and blending use SSE4.1 when the CPU has it, and the tiles are rotated with SSE2. The bayer_kernel benchmark
+ * of ladybug_bench times the kernel with and without SSE4.1 against the chain, on a single core the vectorized kernel is
+ * about as fast as the chain at 75% and faster at 100%, while it saves the temporaries and memory traffic of the chain.
+ */
+class BayerKernel
+{
+  public:
+    /**
+     * Precompute the sampling tables for a given raw head size and output scale (percent, (0,100])
+     * For a half-height plane src_rows is still the number of sensor rows, the plane itself has half of those
+     */
+    BayerKernel(int src_cols, int src_rows, double scale, bool half_height = false, BayerPattern pattern = BAYER_RGGB,
+                OutputFormat format = OUTPUT_RGB);
+
+    /**
+     * Demosaic, scale and rotate one raw 8-bit Bayer plane into a packed 8-bit image in the output format
+     * The destination must hold out_rows() rows of out_step bytes each
+     * If there are falloff tiles, they must have been built for this kernel, and a color correction is applied after them
+     */
+    void process(const uint8_t *raw, uint8_t *out, size_t out_step, const FalloffTiles *falloff = nullptr,
+                 const ColorCorrection *color = nullptr) const;
+
+    /**
+     * Same as process(), but only for the output blocks that are set in the mask, the rest of the output is left as it is
+     * Block (br, bc) covers output rows [br, br + 1) * BLOCK_SIZE and cols [bc, bc + 1) * BLOCK_SIZE, and is blocks[br * block_cols() + bc]
+     */
+    void process(const uint8_t *raw, uint8_t *out, size_t out_step, const std::vector<uint8_t> &blocks, const FalloffTiles *falloff = nullptr,
+                 const ColorCorrection *color = nullptr) const;
+
+    /**
+     * Demosaic, scale and rotate one 16-bit Bayer plane into a packed 16-bit image in the output format, out_step is in bytes
+     */
+    void process(const uint16_t *raw, uint16_t *out, size_t out_step, const FalloffTiles *falloff = nullptr,
+                 const ColorCorrection *color = nullptr) const;
+
+    /**
+     * Demosaic, scale and rotate one 16-bit Bayer plane, and map the result to a packed 8-bit image through the tone curve
+     * The masked version only processes the blocks that are set, like the 8-bit one
+     */
+    void process(const uint16_t *raw, const ToneCurve &curve, uint8_t *out, size_t out_step, const FalloffTiles *falloff = nullptr,
+                 const ColorCorrection *color = nullptr) const;
+    void process(const uint16_t *raw, const ToneCurve &curve, uint8_t *out, size_t out_step, const std::vector<uint8_t> &blocks,
+                 const FalloffTiles *falloff = nullptr, const ColorCorrection *color = nullptr) const;
+
+    // Size of the square output blocks we process at a time, in pixels
+    // A block only touches a small window of the raw plane, so the reads stay in cache
+    static const int BLOCK_SIZE = 64;
+
+    // Size of the raw head this kernel was built for
+    int src_cols() const { return m_srcCols; }
+    int src_rows() const { return m_srcRows; }
+
+    // True if the raw planes are half-height, then they have plane_rows() = src_rows() / 2 rows
+    bool half_height() const { return m_halfHeight; }
+    int plane_rows() const { return m_planeRows; }
+
+    // Scale in percent this kernel was built for
+    double scale() const { return m_scale; }
+
+    // Bayer pattern of the raw planes and the layout of the output, and its number of channels
+    BayerPattern pattern() const { return m_pattern; }
+    OutputFormat format() const { return m_format; }
+    int channels() const { return m_format == OUTPUT_MONO ? 1 : 3; }
+
+    // Size of the rotated output image (cols of the output = scaled rows of the sensor)
+    int out_cols() const { return m_outCols; }
+    int out_rows() const { return m_outRows; }
+
+    /**
+     * True if the plane rows are demosaiced and blended with SSE4.1, which is the default on CPUs that have it
+     * Turning it off falls back to one pixel at a time, for checking and timing the two against each other
+     */
+    bool vectorized() const { return m_vectorized; }
+    void setVectorized(bool vectorized);
+
+    // Number of blocks the output is processed in
+    int block_cols() const { return (m_outCols + BLOCK_SIZE - 1) / BLOCK_SIZE; }
+    int block_rows() const { return (m_outRows + BLOCK_SIZE - 1) / BLOCK_SIZE; }
+
+    /**
+     * Where a (sub)pixel position of the raw head ends up in the output image, with pixel centers at integers
+     */
+    void rawToOutput(double raw_col, double raw_row, double &col, double &row) const;
+
+    /**
+     * The inverse of rawToOutput(), where an output pixel samples the raw head
+     */
+    void outputToRaw(double col, double row, double &raw_col, double &raw_row) const;
+
+  private:
+    // The instantiations of the three process() flavours for one pattern and format, the blocks mask is optional
+    // The falloff tiles and the color correction are optional too
+    typedef void (BayerKernel::*Process8)(const uint8_t *, uint8_t *, size_t, const std::vector<uint8_t> *, const FalloffTiles *,
+                                          const ColorCorrection *) const;
+    typedef void (BayerKernel::*Process16)(const uint16_t *, uint8_t *, size_t, const std::vector<uint8_t> *, const FalloffTiles *,
+                                           const ColorCorrection *) const;
+    typedef void (BayerKernel::*ProcessTone)(const uint16_t *, const ToneCurve &, uint8_t *, size_t, const std::vector<uint8_t> *,
+                                             const FalloffTiles *, const ColorCorrection *) const;
+
+    template <BayerPattern Pattern, OutputFormat Format>
+    void process8(const uint8_t *raw, uint8_t *out, size_t out_step, const std::vector<uint8_t> *blocks, const FalloffTiles *falloff,
+                  const ColorCorrection *color) const;
+    template <BayerPattern Pattern, OutputFormat Format>
+    void process16(const uint16_t *raw, uint8_t *out, size_t out_step, const std::vector<uint8_t> *blocks, const FalloffTiles *falloff,
+                   const ColorCorrection *color) const;
+    template <BayerPattern Pattern, OutputFormat Format>
+    void processTone(const uint16_t *raw, const ToneCurve &curve, uint8_t *out, size_t out_step, const std::vector<uint8_t> *blocks,
+                     const FalloffTiles *falloff, const ColorCorrection *color) const;
+
+    /**
+     * Point the member pointers at the instantiations for our pattern and format
+     */
+    template <BayerPattern Pattern>
+    void selectFormat();
+
+    /**
+     * Process all blocks of the output image, or only those set in the mask if there is one
+     * The store writes the final RGB value of each output pixel, in the sample type and precision of the input
+     * Stores are small and passed by value, so the compiler can keep what they hold in registers
+     * It is called once for each output row of a block, as store(dst, r, c0, n, red, green, blue) with the values of cols c0
+     * to c0 + n in three arrays
+     */
+    template <BayerPattern Pattern, typename Sample, typename Store>
+    void processBlocks(const Sample *raw, uint8_t *out, size_t out_step, const std::vector<uint8_t> *blocks, Store store) const;
+
+    /**
+     * Process all blocks of the linear path, or only those set in the mask, with blends along y held in Line shifted down by shift
+     */
+    template <BayerPattern Pattern, typename Line, typename Sample, typename Store>
+    void processBlockRows(const Sample *raw, uint8_t *out, size_t out_step, const std::vector<uint8_t> *blocks, int shift, Store store) const;
+
+    /**
+     * Process row br of cache blocks, skipping those that are 0 in mask if there is one
+     * The window of the plane each block samples is demosaiced into tiles first, blended along y when scaling, and rotated into planes
+     * of its own, and then the output is written a row at a time. The tiles hold 3 planes of m_tileCols * m_tileRows samples, or
+     * 3 * (block_cols() + 1) at full size, and the blended ones 3 * (block_cols() + 1) planes of m_tileCols * BLOCK_SIZE values
+     */
+    template <BayerPattern Pattern, typename Sample, typename Line, typename Store>
+    void processBlockRow(const Sample *raw, Sample *tiles, Line *blended, uint8_t *out, size_t out_step, int br, const uint8_t *mask, int shift,
+                         Store store) const;
+
+    /**
+     * Process one cache block of the output image by area averaging Bayer cells, used below 50%
+     */
+    template <BayerPattern Pattern, typename Sample, typename Store>
+    void processBinnedBlock(const Sample *raw, uint8_t *out, size_t out_step, int r0, int r1, int c0, int c1, Store store) const;
+
+    // Input and output sizes
+    int m_srcCols, m_srcRows;
+    int m_outCols, m_outRows;
+    double m_scale;
+
+    // Bayer pattern of the input, layout of the output, and the instantiations that handle them
+    BayerPattern m_pattern;
+    OutputFormat m_format;
+    Process8 m_process8;
+    Process16 m_process16;
+    ProcessTone m_processTone;
+
+    // Rows of the raw plane, only half of the sensor rows for half-height planes
+    bool m_halfHeight;
+    int m_planeRows;
+
+    // True if we are using the binned path, or if the output has exactly the size of the plane
+    bool m_binned;
+    bool m_unscaled;
+
+    // True if plane rows are demosaiced and blended with SSE4.1
+    bool m_vectorized;
+
+    // Largest window of the plane a block of the linear path samples
+    int m_tileCols, m_tileRows;
+
+    // Number of low bits that are zero in every y weight, so also in every blend along y
+    int m_lineShift;
+
+    // Source column (and its weight) for every output row
+    std::vector<int> m_xOfs;
+    std::vector<short> m_xAlpha;
+
+    // Source row (and its weight) for every output column
+    std::vector<int> m_yOfs;
+    std::vector<short> m_yAlpha;
+
+    // Binned path, the Bayer cells (and their weights) that every output row and col averages over
+    // Taps of output index i are [m_xTap[i], m_xTap[i + 1]) in the cell and weight arrays
+    std::vector<int> m_xTap, m_xCell;
+    std::vector<short> m_xWeight;
+    std::vector<int> m_yTap, m_yCell;
+    std::vector<short> m_yWeight;
+};
+
+#endif // LADYBUG_BAYER_KERNEL_H
@@ -0,0 +1,81 @@
+#ifndef LADYBUG_CAMERA_BACKEND_H
+#define LADYBUG_CAMERA_BACKEND_H
+
+#include <ros/ros.h>
+
+#include "ladybug.h"
+
+/**
+ * Settings the camera is started with, these come from the device defaults and the launch params
+ */
+struct CameraSettings
+{
+    LadybugDataFormat data_format;
+    float frame_rate;
+    bool is_frame_rate_auto;
+    float shutter_time;
+    bool is_shutter_auto;
+    float gain_amount;
+    bool is_gain_auto;
+    int jpeg_quality;
+};
+
+/**
+ * Source of locked camera images, this is everything the driver needs from the camera
+ *
+ * The SDK backend talks to a real Ladybug, other backends produce the same LadybugImage buffers without one.
+ * Like the SDK, images are locked by one thread and can be unlocked by index from another.
+ */
+class CameraBackend
+{
+  public:
+    virtual ~CameraBackend() {}
+
+    /**
+     * Find and initialize the camera, and return its information
+     */
+    virtual LadybugError connect(LadybugCameraInfo &info) = 0;
+
+    /**
+     * Configure the camera and start streaming images
+     */
+    virtual LadybugError start(const CameraSettings &settings) = 0;
+
+    /**
+     * Stop streaming, all images must have been unlocked
+     */
+    virtual LadybugError stop() = 0;
+
+    /**
+     * Wait for and lock the next image
+     */
+    virtual LadybugError lockNext(LadybugImage &image) = 0;
+
+    /**
+     * Give a locked image back by its buffer index
+     */
+    virtual LadybugError unlock(unsigned int bufferIndex) = 0;
+
+    /**
+     * Give all locked images back
+     */
+    virtual LadybugError unlockAll() = 0;
+
+    /**
+     * Change the frame rate while streaming, backends that can not do this return LADYBUG_NOT_SUPPORTED
+     */
+    virtual LadybugError setFrameRate(float frame_rate) { return LADYBUG_NOT_SUPPORTED; }
+
+    /**
+     * SDK context of the camera, or nullptr if this backend has no real camera
+     * Things that only the SDK can do (e.g. writing .pgr streams) need this
+     */
+    virtual LadybugContext context() const { return nullptr; }
+
+    /**
+     * Time a replayed image was originally stamped with, returns false for live images
+     */
+    virtual bool recordedStamp(const LadybugImage &image, ros::Time &stamp) const { return false; }
+};
+
+#endif // LADYBUG_CAMERA_BACKEND_H
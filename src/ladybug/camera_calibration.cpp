@@ -0,0 +1,194 @@
+#include "camera_calibration.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <ros/ros.h>
+
+#include "opencv2/core/core.hpp"
+
+namespace
+{
+
+/**
+ * c = a * b, for row-major matrices of size (n x m) * (m x p)
+ */
+void multiply(const double *a, const double *b, double *c, int n, int m, int p)
+{
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < p; j++)
+        {
+            double sum = 0.0;
+            for (int k = 0; k < m; k++)
+                sum += a[i * m + k] * b[k * p + j];
+            c[i * p + j] = sum;
+        }
+    }
+}
+
+/**
+ * True if a calibration is of the side-ways raw head, false if it is of the upright published image
+ */
+bool isSideways(const sensor_msgs::CameraInfo &calib, const BayerKernel &kernel)
+{
+    const double raw_aspect = (double)kernel.src_cols() / kernel.src_rows();
+    return std::abs((double)calib.width / calib.height - raw_aspect) < std::abs((double)calib.height / calib.width - raw_aspect);
+}
+
+} // namespace
+
+bool loadCameraInfo(const std::string &filename, sensor_msgs::CameraInfo &msg)
+{
+
+    // Use opencv to load the file
+    cv::Mat cameraMat;
+    cv::Mat distCoeff;
+    cv::Size imageSize;
+    cv::FileStorage fs(filename, cv::FileStorage::READ);
+    if (!fs.isOpened())
+    {
+        ROS_ERROR("Cannot open calibration file %s", filename.c_str());
+        return false;
+    }
+    fs["CameraMat"] >> cameraMat;
+    fs["DistCoeff"] >> distCoeff;
+    fs["ImageSize"] >> imageSize;
+    if (cameraMat.rows != 3 || cameraMat.cols != 3 || imageSize.width <= 0 || imageSize.height <= 0)
+    {
+        ROS_ERROR("Calibration file %s needs a 3x3 CameraMat and an ImageSize", filename.c_str());
+        return false;
+    }
+    cameraMat.convertTo(cameraMat, CV_64F);
+    distCoeff.convertTo(distCoeff, CV_64F);
+
+    // Size of the images it was calibrated on
+    msg = sensor_msgs::CameraInfo();
+    msg.height = (uint32_t)imageSize.height;
+    msg.width = (uint32_t)imageSize.width;
+
+    // K matrix intrinsics, and P is the same camera as there is no rectification
+    for (int row = 0; row < 3; row++)
+    {
+        for (int col = 0; col < 3; col++)
+        {
+            msg.K[row * 3 + col] = cameraMat.at<double>(row, col);
+            msg.P[row * 4 + col] = cameraMat.at<double>(row, col);
+            msg.R[row * 3 + col] = (row == col) ? 1.0 : 0.0;
+        }
+        msg.P[row * 4 + 3] = 0.0;
+    }
+
+    // D distortion params
+    for (int row = 0; row < distCoeff.rows; row++)
+    {
+        for (int col = 0; col < distCoeff.cols; col++)
+        {
+            msg.D.push_back(distCoeff.at<double>(row, col));
+        }
+    }
+    msg.distortion_model = (msg.D.size() > 5) ? "rational_polynomial" : "plumb_bob";
+    return true;
+}
+
+bool loadCameraExtrinsics(const std::string &filename, double transform[16])
+{
+    cv::Mat extrinsicMat;
+    cv::FileStorage fs(filename, cv::FileStorage::READ);
+    if (!fs.isOpened())
+    {
+        ROS_ERROR("Cannot open calibration file %s", filename.c_str());
+        return false;
+    }
+    fs["CameraExtrinsicMat"] >> extrinsicMat;
+    if (extrinsicMat.rows != 4 || extrinsicMat.cols != 4)
+    {
+        ROS_ERROR("Calibration file %s has no 4x4 CameraExtrinsicMat", filename.c_str());
+        return false;
+    }
+    extrinsicMat.convertTo(extrinsicMat, CV_64F);
+    for (int row = 0; row < 4; row++)
+    {
+        for (int col = 0; col < 4; col++)
+        {
+            transform[row * 4 + col] = extrinsicMat.at<double>(row, col);
+        }
+    }
+    return true;
+}
+
+void distortPoint(const std::vector<double> &D, double x, double y, double &xd, double &yd)
+{
+    double d[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    std::copy(D.begin(), D.begin() + std::min<size_t>(8, D.size()), d);
+    const double r2 = x * x + y * y, r4 = r2 * r2, r6 = r4 * r2;
+    const double radial = (1 + d[0] * r2 + d[1] * r4 + d[4] * r6) / (1 + d[5] * r2 + d[6] * r4 + d[7] * r6);
+    xd = x * radial + 2 * d[2] * x * y + d[3] * (r2 + 2 * x * x);
+    yd = y * radial + d[2] * (r2 + 2 * y * y) + 2 * d[3] * x * y;
+}
+
+void calibrationToOutput(const sensor_msgs::CameraInfo &calib, const BayerKernel &kernel, double u, double v, double &col, double &row)
+{
+    if (isSideways(calib, kernel))
+    {
+        kernel.rawToOutput((u + 0.5) * kernel.src_cols() / calib.width - 0.5, (v + 0.5) * kernel.src_rows() / calib.height - 0.5, col, row);
+        return;
+    }
+    col = (u + 0.5) * kernel.out_cols() / calib.width - 0.5;
+    row = (v + 0.5) * kernel.out_rows() / calib.height - 0.5;
+}
+
+void transformCameraInfo(const sensor_msgs::CameraInfo &calib, const BayerKernel &kernel, sensor_msgs::CameraInfo &msg)
+{
+
+    // The kernel scales the side-ways head to out_rows() x out_cols() and then rotates it clockwise
+    const bool sideways = isSideways(calib, kernel);
+    const int scaled_cols = sideways ? kernel.out_rows() : kernel.out_cols();
+    const int scaled_rows = sideways ? kernel.out_cols() : kernel.out_rows();
+    const double sx = (double)scaled_cols / calib.width;
+    const double sy = (double)scaled_rows / calib.height;
+
+    // Pixel transform A, first scaling with pixel centers at (i + 0.5) / s - 0.5 like the kernel samples them
+    // Then for a side-ways calibration the clockwise rotation u' = (rows - 1) - v, v' = u, and its camera frame rotation Rc
+    const double scale[9] = {sx, 0, 0.5 * sx - 0.5, 0, sy, 0.5 * sy - 0.5, 0, 0, 1};
+    const double rotate[9] = {0, -1, (double)scaled_rows - 1, 1, 0, 0, 0, 0, 1};
+    const double identity[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+    const double rc[9] = {0, -1, 0, 1, 0, 0, 0, 0, 1};
+    const double rc_t[9] = {0, 1, 0, -1, 0, 0, 0, 0, 1};
+    const double rc_t4[16] = {0, 1, 0, 0, -1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+    double a[9];
+    multiply(sideways ? rotate : identity, scale, a, 3, 3, 3);
+
+    // Reuse the strings and D of the message we are given, this only allocates the first time
+    msg.height = (uint32_t)kernel.out_rows();
+    msg.width = (uint32_t)kernel.out_cols();
+    msg.distortion_model = calib.distortion_model;
+    msg.D = calib.D;
+    msg.binning_x = 0;
+    msg.binning_y = 0;
+    msg.roi = sensor_msgs::RegionOfInterest();
+
+    // K' = A K Rc^T, R' = Rc R Rc^T, P' = A P diag(Rc^T, 1)
+    double tmp[12];
+    multiply(calib.K.data(), sideways ? rc_t : identity, tmp, 3, 3, 3);
+    multiply(a, tmp, msg.K.data(), 3, 3, 3);
+    if (sideways)
+    {
+        multiply(calib.R.data(), rc_t, tmp, 3, 3, 3);
+        multiply(rc, tmp, msg.R.data(), 3, 3, 3);
+        multiply(calib.P.data(), rc_t4, tmp, 3, 4, 4);
+        multiply(a, tmp, msg.P.data(), 3, 3, 4);
+
+        // In the rotated frame the tangential distortion terms swap, p1' = p2 and p2' = -p1
+        if (msg.D.size() >= 4)
+        {
+            msg.D[2] = calib.D[3];
+            msg.D[3] = -calib.D[2];
+        }
+    }
+    else
+    {
+        msg.R = calib.R;
+        multiply(a, calib.P.data(), msg.P.data(), 3, 3, 4);
+    }
+}
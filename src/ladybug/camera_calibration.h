@@ -0,0 +1,42 @@
+#ifndef LADYBUG_CAMERA_CALIBRATION_H
+#define LADYBUG_CAMERA_CALIBRATION_H
+
+#include <string>
+#include <vector>
+
+#include <sensor_msgs/CameraInfo.h>
+
+#include "bayer_kernel.h"
+
+/**
+ * Load the intrinsics of one head from an OpenCV calibration file (CameraMat, DistCoeff and ImageSize)
+ * Returns false if the file can not be read
+ */
+bool loadCameraInfo(const std::string &filename, sensor_msgs::CameraInfo &msg);
+
+/**
+ * Load the pose of one head from an OpenCV calibration file (CameraExtrinsicMat)
+ * This is the row-major 4x4 transform from the camera frame of the calibration into the Ladybug frame
+ */
+bool loadCameraExtrinsics(const std::string &filename, double transform[16]);
+
+/**
+ * Apply the plumb_bob (5 terms) or rational_polynomial (8 terms) distortion to a normalized image point
+ */
+void distortPoint(const std::vector<double> &D, double x, double y, double &xd, double &yd);
+
+/**
+ * Where a pixel of the image a calibration was made on ends up in the image the kernel publishes
+ */
+void calibrationToOutput(const sensor_msgs::CameraInfo &calib, const BayerKernel &kernel, double u, double v, double &col, double &row);
+
+/**
+ * Transform a calibration so it matches the images the kernel publishes
+ *
+ * A calibration of the side-ways raw head (its ImageSize has the aspect of the raw head) is scaled and then rotated
+ * clockwise like the image, and its camera frame is rotated with it (x' = -y, y' = x). A calibration of the
+ * upright published image is only scaled. Scaling keeps pixel centers aligned, like the kernel does.
+ */
+void transformCameraInfo(const sensor_msgs::CameraInfo &calib, const BayerKernel &kernel, sensor_msgs::CameraInfo &msg);
+
+#endif // LADYBUG_CAMERA_CALIBRATION_H
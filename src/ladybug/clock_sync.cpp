@@ -0,0 +1,163 @@
+#include "clock_sync.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+// The cycle seconds counter wraps at this many seconds
+const double CYCLE_WRAP = 128.0;
+
+// A host gap longer than this can not be unwrapped without ambiguity, so we start over
+const double MAX_GAP = 0.5 * CYCLE_WRAP;
+
+// A frame further than this from the current fit means the camera clock jumped (e.g. a camera restart)
+const double MAX_RESIDUAL = 1.0;
+
+} // namespace
+
+CameraClockSync::CameraClockSync(size_t window_size, size_t min_samples)
+    : m_windowSize(std::max<size_t>(window_size, 2)), m_minSamples(std::max<size_t>(min_samples, 2)), m_numResets(0),
+      m_latencyOffset(0)
+{
+    resetLocked();
+    m_numResets = 0;
+}
+
+double CameraClockSync::cycleTime(const LadybugTimestamp &stamp)
+{
+    // 8000 cycles per second, and 3072 offset ticks per cycle
+    return (double)stamp.ulCycleSeconds + stamp.ulCycleCount / 8000.0 + stamp.ulCycleOffset / (8000.0 * 3072.0);
+}
+
+void CameraClockSync::setLatencyOffset(double seconds)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_latencyOffset = seconds;
+}
+
+void CameraClockSync::reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    resetLocked();
+}
+
+void CameraClockSync::resetLocked()
+{
+    m_hostRef = 0;
+    m_cameraRef = 0;
+    m_haveLast = false;
+    m_lastCycle = 0;
+    m_lastHost = 0;
+    m_wrapOffset = 0;
+    m_samples.clear();
+    m_fitOffset = 0;
+    m_fitRate = 1;
+    m_jitter = 0;
+    m_lastOffset = 0;
+    m_numResets++;
+}
+
+ros::Time CameraClockSync::update(const LadybugTimestamp &stamp, const ros::Time &host_time)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const double cycle = cycleTime(stamp);
+    const double host = host_time.toSec();
+
+    // If we can not tell how many times the counter wrapped since the last frame, we need to start over
+    if (m_haveLast && (host < m_lastHost || host - m_lastHost > MAX_GAP))
+    {
+        ROS_WARN("Camera clock sync: gap of %.1f seconds between frames, restarting estimate", host - m_lastHost);
+        resetLocked();
+    }
+
+    // Unwrap the 128 second cycle counter
+    if (m_haveLast && cycle < m_lastCycle - 0.5 * CYCLE_WRAP)
+    {
+        m_wrapOffset += CYCLE_WRAP;
+    }
+    if (!m_haveLast)
+    {
+        m_hostRef = host;
+        m_cameraRef = cycle;
+        m_wrapOffset = 0;
+    }
+    m_haveLast = true;
+    m_lastCycle = cycle;
+    m_lastHost = host;
+    Sample sample;
+    sample.camera = cycle + m_wrapOffset - m_cameraRef;
+    sample.host = host - m_hostRef;
+
+    // If this is way off the current line, the camera clock jumped, so start over from this frame
+    if (m_samples.size() >= m_minSamples && std::fabs(sample.host - (m_fitOffset + m_fitRate * sample.camera)) > MAX_RESIDUAL)
+    {
+        ROS_WARN("Camera clock sync: camera clock jumped, restarting estimate");
+        m_samples.clear();
+        m_hostRef = host;
+        m_cameraRef = cycle;
+        m_wrapOffset = 0;
+        m_fitOffset = 0;
+        m_fitRate = 1;
+        m_numResets++;
+        sample.camera = 0;
+        sample.host = 0;
+    }
+
+    // Add it to the window, and refit
+    m_samples.push_back(sample);
+    while (m_samples.size() > m_windowSize)
+        m_samples.pop_front();
+    fit();
+
+    // Till we have enough history, just use the host time
+    if (m_samples.size() < m_minSamples)
+        return host_time - ros::Duration(m_latencyOffset);
+    const double fitted = m_fitOffset + m_fitRate * sample.camera;
+    m_lastOffset = (m_hostRef + fitted) - (m_cameraRef + sample.camera);
+    return ros::Time(m_hostRef + fitted) - ros::Duration(m_latencyOffset);
+}
+
+void CameraClockSync::fit()
+{
+    // Means of both clocks over the window
+    const double n = (double)m_samples.size();
+    double mean_camera = 0, mean_host = 0;
+    for (const Sample &s : m_samples)
+    {
+        mean_camera += s.camera;
+        mean_host += s.host;
+    }
+    mean_camera /= n;
+    mean_host /= n;
+
+    // Least squares fit of host = offset + rate * camera
+    double sxx = 0, sxy = 0;
+    for (const Sample &s : m_samples)
+    {
+        sxx += (s.camera - mean_camera) * (s.camera - mean_camera);
+        sxy += (s.camera - mean_camera) * (s.host - mean_host);
+    }
+    m_fitRate = (sxx > 1e-9) ? sxy / sxx : 1.0;
+    m_fitOffset = mean_host - m_fitRate * mean_camera;
+
+    // Jitter is how much the host receive times scatter around that line
+    double sse = 0;
+    for (const Sample &s : m_samples)
+    {
+        const double residual = s.host - (m_fitOffset + m_fitRate * s.camera);
+        sse += residual * residual;
+    }
+    m_jitter = std::sqrt(sse / n);
+}
+
+void CameraClockSync::getEstimate(double &offset, double &drift_ppm, double &jitter, size_t &num_samples, size_t &num_resets) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    offset = m_lastOffset;
+    drift_ppm = (m_fitRate - 1.0) * 1e6;
+    jitter = m_jitter;
+    num_samples = m_samples.size();
+    num_resets = m_numResets;
+}
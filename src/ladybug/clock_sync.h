@@ -0,0 +1,99 @@
+#ifndef LADYBUG_CLOCK_SYNC_H
+#define LADYBUG_CLOCK_SYNC_H
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+#include <ros/ros.h>
+
+#include "ladybug.h"
+
+/**
+ * Maps the hardware cycle time of the camera onto ROS time
+ *
+ * The camera stamps every image with its 1394 cycle timer (ulCycleSeconds, ulCycleCount, ulCycleOffset),
+ * which wraps every 128 seconds. We unwrap that into a continuous camera time, and fit a line
+ * host = offset + rate * camera over a sliding window of (camera, host receive time) pairs.
+ * The fitted line gives stamps that keep the camera's exposure spacing, without the USB transfer and
+ * scheduling jitter that is in the host receive time.
+ */
+class CameraClockSync
+{
+  public:
+    /**
+     * Create the estimator, fitting over the last window_size frames
+     * We fall back to the host time until at least min_samples frames have been seen
+     */
+    explicit CameraClockSync(size_t window_size = 300, size_t min_samples = 10);
+
+    /**
+     * Add a new frame, and return the ROS time of its camera timestamp
+     */
+    ros::Time update(const LadybugTimestamp &stamp, const ros::Time &host_time);
+
+    /**
+     * Constant latency in seconds that is subtracted from every stamp update() returns, e.g. the known transfer delay
+     * This is kept across reset()
+     */
+    void setLatencyOffset(double seconds);
+
+    /**
+     * Forget all history, e.g. after the camera has been restarted
+     */
+    void reset();
+
+    /**
+     * Current estimate of the clock relation, all safe to call from any thread
+     * offset: host minus camera time at the last frame (s), drift: rate error of the camera clock (ppm)
+     * jitter: RMS of the host receive time around the fit (s)
+     */
+    void getEstimate(double &offset, double &drift_ppm, double &jitter, size_t &num_samples, size_t &num_resets) const;
+
+    /**
+     * Camera cycle time in seconds [0,128) of a single timestamp
+     */
+    static double cycleTime(const LadybugTimestamp &stamp);
+
+  private:
+    /**
+     * Forget all history, the mutex must already be held
+     */
+    void resetLocked();
+
+    /**
+     * Refit the line over the current window
+     */
+    void fit();
+
+    struct Sample
+    {
+        double camera;
+        double host;
+    };
+
+    mutable std::mutex m_mutex;
+    size_t m_windowSize;
+    size_t m_minSamples;
+
+    // Reference times all samples are relative to, this keeps the fit well conditioned
+    double m_hostRef;
+    double m_cameraRef;
+
+    // Unwrapping of the 128 second cycle counter
+    bool m_haveLast;
+    double m_lastCycle;
+    double m_lastHost;
+    double m_wrapOffset;
+
+    // Window of samples and the current fit
+    std::deque<Sample> m_samples;
+    double m_fitOffset;
+    double m_fitRate;
+    double m_jitter;
+    double m_lastOffset;
+    size_t m_numResets;
+    double m_latencyOffset;
+};
+
+#endif // LADYBUG_CLOCK_SYNC_H
@@ -0,0 +1,114 @@
+#include "color_correction.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <ros/ros.h>
+
+namespace
+{
+
+const double UNIT_GAINS[3] = {1, 1, 1};
+const double IDENTITY[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+
+template <typename Sample>
+void sumChannels(const Sample *raw, int cols, int rows, BayerPattern pattern, int step, int clip, double sums[3], size_t &count)
+{
+    const int red_x = pattern & 1, red_y = pattern >> 1;
+    for (int cy = 0; cy < rows / 2; cy += step)
+    {
+        const Sample *red_row = raw + (size_t)(2 * cy + red_y) * cols;
+        const Sample *blue_row = raw + (size_t)(2 * cy + 1 - red_y) * cols;
+        for (int cx = 0; cx < cols / 2; cx += step)
+        {
+            const int x = 2 * cx;
+            const int r = red_row[x + red_x], g0 = red_row[x + 1 - red_x], g1 = blue_row[x + red_x], b = blue_row[x + 1 - red_x];
+            if (r >= clip || g0 >= clip || g1 >= clip || b >= clip)
+                continue;
+            sums[0] += r;
+            sums[1] += 0.5 * (g0 + g1);
+            sums[2] += b;
+            count++;
+        }
+    }
+}
+
+} // namespace
+
+const int ColorCorrection::COEF_BITS;
+const int ColorCorrection::MAX_GAIN;
+
+ColorCorrection::ColorCorrection() : ColorCorrection(UNIT_GAINS, IDENTITY) {}
+
+ColorCorrection::ColorCorrection(const double gains[3], const double matrix[9])
+{
+    for (int ch = 0; ch < 3; ch++)
+        m_gains[ch] = std::min(std::max(gains[ch], 0.0), (double)MAX_GAIN);
+    std::copy(matrix, matrix + 9, m_matrix);
+
+    // Rows whose coefficients add up to MAX_GAIN or more are scaled down, so a 16-bit value times a row still fits in 32 bits
+    const double limit = (MAX_GAIN << COEF_BITS) - 1;
+    m_identity = true;
+    for (int r = 0; r < 3; r++)
+    {
+        double row[3], norm = 0.0;
+        for (int c = 0; c < 3; c++)
+        {
+            row[c] = m_matrix[r * 3 + c] * m_gains[c] * (1 << COEF_BITS);
+            norm += std::abs(row[c]);
+        }
+        const double scale = norm > limit ? limit / norm : 1.0;
+        for (int c = 0; c < 3; c++)
+        {
+            m_coefs[r * 3 + c] = (int32_t)(scale < 1.0 ? std::trunc(row[c] * scale) : std::round(row[c]));
+            m_identity = m_identity && m_coefs[r * 3 + c] == (r == c ? 1 << COEF_BITS : 0);
+        }
+    }
+}
+
+bool ColorCorrection::fromSdk(LadybugContext context, double gains[3], double matrix[9])
+{
+    LadybugColorCorrectionParams params;
+    LadybugError error = ladybugGetColorCorrection(context, &params);
+    if (error != LADYBUG_OK)
+    {
+        ROS_ERROR("Unable to get the color correction (%s)", ladybugErrorToString(error));
+        return false;
+    }
+
+    // Intensity scales all channels on top of their own gains
+    const double intensity = 1.0 + params.iIntensity / 255.0;
+    gains[0] = intensity * (1.0 + params.iRed / 255.0);
+    gains[1] = intensity * (1.0 + params.iGreen / 255.0);
+    gains[2] = intensity * (1.0 + params.iBlue / 255.0);
+
+    // Rotate around the gray axis for the hue, then pull towards or push away from the luma for the saturation
+    const double angle = params.iHue / 255.0 * M_PI;
+    const double cos_a = std::cos(angle), sin_a = std::sin(angle), k = 1.0 / std::sqrt(3.0);
+    const double hue[9] = {cos_a + (1 - cos_a) / 3, (1 - cos_a) / 3 - k * sin_a, (1 - cos_a) / 3 + k * sin_a,
+                           (1 - cos_a) / 3 + k * sin_a, cos_a + (1 - cos_a) / 3, (1 - cos_a) / 3 - k * sin_a,
+                           (1 - cos_a) / 3 - k * sin_a, (1 - cos_a) / 3 + k * sin_a, cos_a + (1 - cos_a) / 3};
+    const double saturation = 1.0 + params.iSaturation / 255.0;
+    const double luma[3] = {0.299, 0.587, 0.114};
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            double sum = 0.0;
+            for (int j = 0; j < 3; j++)
+                sum += ((1.0 - saturation) * luma[j] + (r == j ? saturation : 0.0)) * hue[j * 3 + c];
+            matrix[r * 3 + c] = sum;
+        }
+    }
+    return true;
+}
+
+void sumBayerChannels(const uint8_t *raw, int cols, int rows, BayerPattern pattern, int step, int clip, double sums[3], size_t &count)
+{
+    sumChannels(raw, cols, rows, pattern, step, clip, sums, count);
+}
+
+void sumBayerChannels(const uint16_t *raw, int cols, int rows, BayerPattern pattern, int step, int clip, double sums[3], size_t &count)
+{
+    sumChannels(raw, cols, rows, pattern, step, clip, sums, count);
+}
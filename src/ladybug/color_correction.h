@@ -0,0 +1,68 @@
+#ifndef LADYBUG_COLOR_CORRECTION_H
+#define LADYBUG_COLOR_CORRECTION_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "bayer_kernel.h"
+#include "ladybug.h"
+
+/**
+ * White balance gains and a 3x3 color correction matrix of one head, which the kernel applies as it stores each row
+ *
+ * The gains scale the linear red, green and blue values, and the matrix then mixes them, so a pixel becomes
+ * matrix * diag(gains) * rgb. Both are folded into a single fixed-point matrix with COEF_BITS fractional bits,
+ * and the result is clamped to the range of the output. Gains are limited to MAX_GAIN, and so is the sum of the absolute
+ * coefficients of each row of the folded matrix, which keeps the sums of 16-bit values within 32 bits.
+ * These are immutable, so the driver swaps in new ones while the kernel still uses the old ones.
+ */
+class ColorCorrection
+{
+  public:
+    static const int COEF_BITS = 12;
+    static const int MAX_GAIN = 8;
+
+    /**
+     * Identity, no change at all
+     */
+    ColorCorrection();
+
+    /**
+     * Red, green and blue gains, and a row-major matrix
+     */
+    ColorCorrection(const double gains[3], const double matrix[9]);
+
+    /**
+     * The gains and matrix matching the color correction the SDK applies in ladybugConvertImage(), see ladybugGetColorCorrection()
+     * Its values are -255 to 255 with 0 as no change, and are taken as fractions of 255 of the intensity, the red, green and
+     * blue gains, the saturation around the luma, and the hue rotated around the gray axis by up to 180 degrees
+     * Returns false on an SDK error
+     */
+    static bool fromSdk(LadybugContext context, double gains[3], double matrix[9]);
+
+    // The gains and matrix as given
+    const double *gains() const { return m_gains; }
+    const double *matrix() const { return m_matrix; }
+
+    // The row-major fixed-point matrix with the gains folded in
+    const int32_t *coefs() const { return m_coefs; }
+
+    // True if this does not change anything, the kernel then skips it
+    bool identity() const { return m_identity; }
+
+  private:
+    double m_gains[3];
+    double m_matrix[9];
+    int32_t m_coefs[9];
+    bool m_identity;
+};
+
+/**
+ * Add up each channel of a raw Bayer plane over every step-th cell in both directions, for a gray-world white balance
+ * Cells with a sample at or above clip are skipped, so highlights do not pull the balance towards white
+ * count is the number of cells that were added
+ */
+void sumBayerChannels(const uint8_t *raw, int cols, int rows, BayerPattern pattern, int step, int clip, double sums[3], size_t &count);
+void sumBayerChannels(const uint16_t *raw, int cols, int rows, BayerPattern pattern, int step, int clip, double sums[3], size_t &count);
+
+#endif // LADYBUG_COLOR_CORRECTION_H
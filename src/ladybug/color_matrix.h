@@ -0,0 +1,136 @@
+#ifndef LADYBUG_COLOR_MATRIX_H
+#define LADYBUG_COLOR_MATRIX_H
+
+#include <algorithm>
+#include <cstdint>
+
+#include "color_correction.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#define LADYBUG_HAVE_SSE2_COLOR
+#endif
+
+/**
+ * The fixed-point matrix of a ColorCorrection (see ColorCorrection::coefs()) applied in place to one pixel, each value
+ * clamped to [0, Max]. Max is what the output can hold, 255 for 8-bit and 65535 for 16-bit samples.
+ * The kernel corrects 8 pixels at a time with correctColorSse2() and the last few of a row with this, the coefficients
+ * are copied into a local array first since its stores could otherwise alias them.
+ */
+template <int Max>
+inline void correctColorPixel(const int (&m)[9], int &r, int &g, int &b)
+{
+    const int round = 1 << (ColorCorrection::COEF_BITS - 1);
+    const int vr = r, vg = g, vb = b;
+    r = std::min(std::max((m[0] * vr + m[1] * vg + m[2] * vb + round) >> ColorCorrection::COEF_BITS, 0), Max);
+    g = std::min(std::max((m[3] * vr + m[4] * vg + m[5] * vb + round) >> ColorCorrection::COEF_BITS, 0), Max);
+    b = std::min(std::max((m[6] * vr + m[7] * vg + m[8] * vb + round) >> ColorCorrection::COEF_BITS, 0), Max);
+}
+
+/**
+ * The same matrix over a row of red, green and blue values, the scalar loop and the SSE2 version are here so the tests
+ * and benchmarks can check them against each other and against correctColorPixel()
+ */
+template <int Max>
+inline void correctColorScalar(const int32_t *m, int *vr, int *vg, int *vb, int n)
+{
+    // Copy the coefficients into locals, the stores into the row could otherwise alias them
+    int coefs[9];
+    std::copy(m, m + 9, coefs);
+    for (int i = 0; i < n; i++)
+        correctColorPixel<Max>(coefs, vr[i], vg[i], vb[i]);
+}
+
+#ifdef LADYBUG_HAVE_SSE2_COLOR
+/**
+ * A fixed-point color matrix laid out for correctColorSse2(), pairs of red and green coefficients for pmaddwd,
+ * the blue ones next to zeros, and the rounding plus the matrix times the offset of the values
+ */
+struct ColorCoefsSse2
+{
+    explicit ColorCoefsSse2(const int32_t *m)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            rg[k] = _mm_set1_epi32((int)(((uint32_t)m[3 * k] & 0xffff) | ((uint32_t)m[3 * k + 1] << 16)));
+            b[k] = _mm_set1_epi32(m[3 * k + 2] & 0xffff);
+            bias[k] = _mm_set1_epi32((1 << (ColorCorrection::COEF_BITS - 1)) + (m[3 * k] + m[3 * k + 1] + m[3 * k + 2]) * 32768);
+        }
+    }
+
+    __m128i rg[3], b[3], bias[3];
+};
+
+/**
+ * 8 values offset by -32768 into signed 16-bit lanes, from ints or straight from 8-bit and 16-bit samples
+ */
+inline __m128i loadOffsetSse2(const int *v)
+{
+    const __m128i offset = _mm_set1_epi32(32768);
+    return _mm_packs_epi32(_mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(v)), offset),
+                           _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(v + 4)), offset));
+}
+
+inline __m128i loadOffsetSse2(const uint16_t *v)
+{
+    return _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(v)), _mm_set1_epi16(-32768));
+}
+
+inline __m128i loadOffsetSse2(const uint8_t *v)
+{
+    const __m128i wide = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(v)), _mm_setzero_si128());
+    return _mm_xor_si128(wide, _mm_set1_epi16(-32768));
+}
+
+/**
+ * Apply the fixed-point color matrix to 8 pixels, with pmaddwd on pairs of 16-bit values and coefficients
+ * The values are offset by -32768 to fit in signed 16 bits, and the matrix times that offset is added back with the rounding.
+ * The limit on the rows of the matrix keeps every sum within 32 bits, so this matches the scalar loop exactly.
+ * The output may be the input, the kernel reads its rows of samples or of blended values and writes ints.
+ */
+template <int Max, typename Value>
+inline void correctColorSse2(const ColorCoefsSse2 &coefs, const Value *red, const Value *green, const Value *blue, int *vr,
+                             int *vg, int *vb)
+{
+    static_assert(Max < 32768 || Max == 65535, "the clamp only handles values below 32768 or of 16 bits");
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i offset = _mm_set1_epi32(32768);
+    const __m128i r = loadOffsetSse2(red), g = loadOffsetSse2(green), b = loadOffsetSse2(blue);
+    const __m128i rg_lo = _mm_unpacklo_epi16(r, g), rg_hi = _mm_unpackhi_epi16(r, g);
+    const __m128i b_lo = _mm_unpacklo_epi16(b, zero), b_hi = _mm_unpackhi_epi16(b, zero);
+    int *out[3] = {vr, vg, vb};
+    for (int k = 0; k < 3; k++)
+    {
+        __m128i lo = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rg_lo, coefs.rg[k]), _mm_madd_epi16(b_lo, coefs.b[k])), coefs.bias[k]);
+        __m128i hi = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rg_hi, coefs.rg[k]), _mm_madd_epi16(b_hi, coefs.b[k])), coefs.bias[k]);
+        lo = _mm_srai_epi32(lo, ColorCorrection::COEF_BITS);
+        hi = _mm_srai_epi32(hi, ColorCorrection::COEF_BITS);
+
+        // Clamp by saturating to 16 bits, 16-bit values are offset again so that is 0 to 65535
+        __m128i v;
+        if (Max < 32768)
+            v = _mm_min_epi16(_mm_max_epi16(_mm_packs_epi32(lo, hi), zero), _mm_set1_epi16(Max));
+        else
+            v = _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(lo, offset), _mm_sub_epi32(hi, offset)), _mm_set1_epi16(-32768));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out[k]), _mm_unpacklo_epi16(v, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out[k] + 4), _mm_unpackhi_epi16(v, zero));
+    }
+}
+#endif
+
+/**
+ * The SSE2 version where there is one, and the scalar loop for the rest of the row
+ */
+template <int Max>
+inline void correctColor(const int32_t *m, int *vr, int *vg, int *vb, int n)
+{
+    int i = 0;
+#ifdef LADYBUG_HAVE_SSE2_COLOR
+    const ColorCoefsSse2 coefs(m);
+    for (; i + 8 <= n; i += 8)
+        correctColorSse2<Max>(coefs, vr + i, vg + i, vb + i, vr + i, vg + i, vb + i);
+#endif
+    correctColorScalar<Max>(m, vr + i, vg + i, vb + i, n - i);
+}
+
+#endif // LADYBUG_COLOR_MATRIX_H
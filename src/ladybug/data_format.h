@@ -0,0 +1,87 @@
+#ifndef LADYBUG_DATA_FORMAT_H
+#define LADYBUG_DATA_FORMAT_H
+
+#include <map>
+#include <string>
+
+#include "ladybug.h"
+
+/**
+ * Parse the data_format launch parameter into the SDK enum
+ * Returns false if the string is not a known format
+ */
+inline bool parseDataFormat(const std::string &name, LadybugDataFormat &format)
+{
+    static const std::map<std::string, LadybugDataFormat> formats = {
+        {"raw8", LADYBUG_DATAFORMAT_RAW8},
+        {"raw12", LADYBUG_DATAFORMAT_RAW12},
+        {"raw16", LADYBUG_DATAFORMAT_RAW16},
+        {"jpeg8", LADYBUG_DATAFORMAT_COLOR_SEP_JPEG8},
+        {"half_height_raw8", LADYBUG_DATAFORMAT_HALF_HEIGHT_RAW8},
+        {"half_height_raw12", LADYBUG_DATAFORMAT_HALF_HEIGHT_RAW12},
+        {"half_height_raw16", LADYBUG_DATAFORMAT_HALF_HEIGHT_RAW16},
+        {"half_height_jpeg8", LADYBUG_DATAFORMAT_COLOR_SEP_HALF_HEIGHT_JPEG8},
+    };
+    auto it = formats.find(name);
+    if (it == formats.end())
+        return false;
+    format = it->second;
+    return true;
+}
+
+/**
+ * True if the image buffer holds per-channel JPEG tiles instead of raw Bayer planes
+ * NOTE: the 12-bit JPEG formats are not in the list above, libturbojpeg's tjDecompress2 only decodes 8-bit
+ */
+inline bool isJpegFormat(LadybugDataFormat format)
+{
+    return format == LADYBUG_DATAFORMAT_COLOR_SEP_JPEG8 || format == LADYBUG_DATAFORMAT_COLOR_SEP_HALF_HEIGHT_JPEG8;
+}
+
+/**
+ * Bits per pixel of the raw Bayer planes in the image buffer
+ * RAW12 packs two pixels into three bytes, RAW16 has one 16-bit sample per pixel with the value in the high bits
+ */
+inline int rawSampleBits(LadybugDataFormat format)
+{
+    switch (format)
+    {
+    case LADYBUG_DATAFORMAT_RAW12:
+    case LADYBUG_DATAFORMAT_HALF_HEIGHT_RAW12:
+        return 12;
+    case LADYBUG_DATAFORMAT_RAW16:
+    case LADYBUG_DATAFORMAT_HALF_HEIGHT_RAW16:
+        return 16;
+    default:
+        return 8;
+    }
+}
+
+/**
+ * True if the camera only sends every other pair of sensor rows, which about doubles the frame rate it can reach
+ * Dropping pairs of rows keeps the Bayer pattern intact, so a half-height plane is an ordinary mosaic of half the rows
+ */
+inline bool isHalfHeightFormat(LadybugDataFormat format)
+{
+    return format == LADYBUG_DATAFORMAT_HALF_HEIGHT_RAW8 || format == LADYBUG_DATAFORMAT_HALF_HEIGHT_RAW12 ||
+           format == LADYBUG_DATAFORMAT_HALF_HEIGHT_RAW16 || format == LADYBUG_DATAFORMAT_COLOR_SEP_HALF_HEIGHT_JPEG8;
+}
+
+/**
+ * Rows of the sensor, and of each raw plane in the buffer of a raw format
+ * NOTE: the SDK does not say if uiFullRows counts sensor or plane rows in the half-height formats, so the size of the
+ * buffer decides. If it is too small for full-height planes, uiFullRows is the sensor height.
+ */
+inline void rawPlaneRows(const LadybugImage &image, int &sensor_rows, int &plane_rows)
+{
+    sensor_rows = plane_rows = (int)image.uiFullRows;
+    if (!isHalfHeightFormat(image.dataFormat))
+        return;
+    const size_t full_bytes = (size_t)LADYBUG_NUM_CAMERAS * image.uiFullCols * image.uiFullRows * rawSampleBits(image.dataFormat) / 8;
+    if (image.uiDataSizeBytes < full_bytes)
+        plane_rows = sensor_rows / 2;
+    else
+        sensor_rows = 2 * plane_rows;
+}
+
+#endif // LADYBUG_DATA_FORMAT_H
@@ -0,0 +1,245 @@
+#include "falloff.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <ros/ros.h>
+
+namespace
+{
+
+/**
+ * Header of a falloff cache file, followed by the gains of all heads as little-endian uint16
+ * Version 2 added the Bayer pattern the channels were averaged with, version 1 files are fetched again
+ */
+const char FALLOFF_FILE_MAGIC[8] = {'L', 'B', 'F', 'A', 'L', 'L', 'O', '1'};
+const uint32_t FALLOFF_FILE_VERSION = 2;
+
+struct FalloffFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t serial;
+    uint32_t cols;
+    uint32_t rows;
+    uint32_t tile;
+    float attenuation;
+    int32_t gamma;
+    uint32_t pattern;
+};
+static_assert(sizeof(FalloffFileHeader) == 40, "FalloffFileHeader must have a fixed layout");
+
+// Value of the flat image we let the SDK correct, this leaves room for gains up to 4
+const int FLAT_VALUE = 64;
+
+/**
+ * Channel (0 red, 1 green, 2 blue) of a raw pixel, bit 0 of the pattern is the column of red and bit 1 its row
+ */
+int bayerChannel(BayerPattern pattern, int x, int y)
+{
+    const bool red_col = (x & 1) == (pattern & 1);
+    const bool red_row = (y & 1) == ((pattern >> 1) & 1);
+    if (red_col != red_row)
+        return 1;
+    return red_col ? 0 : 2;
+}
+
+} // namespace
+
+FalloffMap::FalloffMap(uint32_t serial, int cols, int rows, BayerPattern pattern, float attenuation, long gamma)
+    : m_serial(serial), m_cols(cols), m_rows(rows), m_pattern(pattern), m_attenuation(attenuation), m_gamma(gamma)
+{
+    m_tileCols = (cols + TILE - 1) / TILE;
+    m_tileRows = (rows + TILE - 1) / TILE;
+    m_gains.assign((size_t)LADYBUG_NUM_CAMERAS * 3 * m_tileRows * m_tileCols, 1 << GAIN_BITS);
+}
+
+std::unique_ptr<FalloffMap> FalloffMap::fromSdk(LadybugContext context, uint32_t serial, int cols, int rows, BayerPattern pattern,
+                                                float attenuation, long gamma)
+{
+    // The per-pixel factors of the calibration, in a unit the SDK does not document
+    const size_t pixels = (size_t)cols * rows;
+    std::vector<unsigned short> factors((size_t)LADYBUG_NUM_CAMERAS * pixels, 0);
+    unsigned short *factor_buffers[LADYBUG_NUM_CAMERAS];
+    for (int i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+        factor_buffers[i] = factors.data() + i * pixels;
+    LadybugError error = ladybugGetFalloffCalibration(context, (unsigned)cols, (unsigned)rows, attenuation, gamma, factor_buffers);
+    if (error != LADYBUG_OK)
+    {
+        ROS_ERROR("Unable to get the falloff calibration (%s)", ladybugErrorToString(error));
+        return nullptr;
+    }
+
+    // What the SDK's own correction does to a flat image, this gives the gain of every pixel to within 1 / FLAT_VALUE
+    std::vector<unsigned char> flat((size_t)LADYBUG_NUM_CAMERAS * pixels, FLAT_VALUE);
+    unsigned char *flat_buffers[LADYBUG_NUM_CAMERAS];
+    for (int i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+        flat_buffers[i] = flat.data() + i * pixels;
+    error = ladybugSetFalloffCorrectionAttenuation(context, attenuation);
+    if (error == LADYBUG_OK)
+        error = ladybugCorrectStippledFalloffEx(context, (unsigned)cols, (unsigned)rows, flat_buffers, gamma);
+    if (error != LADYBUG_OK)
+    {
+        ROS_ERROR("Unable to correct the falloff of a flat image (%s)", ladybugErrorToString(error));
+        return nullptr;
+    }
+
+    // Find the unit of the factors from the pixels that did not clip, and check that they agree with the flat image
+    double sum_factor = 0.0, sum_flat = 0.0;
+    for (size_t p = 0; p < factors.size(); p++)
+    {
+        if (flat[p] > 0 && flat[p] < 255)
+        {
+            sum_factor += factors[p];
+            sum_flat += flat[p];
+        }
+    }
+    double unit = sum_flat > 0.0 ? sum_factor * FLAT_VALUE / sum_flat : 0.0;
+    if (unit > 0.0)
+    {
+        double error_sum = 0.0;
+        size_t count = 0;
+        for (size_t p = 0; p < factors.size(); p++)
+        {
+            if (flat[p] > 0 && flat[p] < 255)
+            {
+                const double measured = (double)flat[p] / FLAT_VALUE;
+                error_sum += std::abs(factors[p] / unit - measured) / measured;
+                count++;
+            }
+        }
+        if (error_sum > 0.05 * count)
+        {
+            ROS_WARN("The falloff calibration does not match the SDK's correction, using the corrected flat image instead");
+            unit = 0.0;
+        }
+    }
+
+    // Average every channel over each tile, from the factors or else from the flat image
+    std::unique_ptr<FalloffMap> map(new FalloffMap(serial, cols, rows, pattern, attenuation, gamma));
+    const size_t tiles = (size_t)map->m_tileRows * map->m_tileCols;
+    std::vector<double> sum(3 * tiles);
+    std::vector<int> count(3 * tiles);
+    for (int i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    {
+        std::fill(sum.begin(), sum.end(), 0.0);
+        std::fill(count.begin(), count.end(), 0);
+        for (int y = 0; y < rows; y++)
+        {
+            const size_t p0 = i * pixels + (size_t)y * cols;
+            for (int x = 0; x < cols; x++)
+            {
+                const size_t t = bayerChannel(pattern, x, y) * tiles + (size_t)(y / TILE) * map->m_tileCols + x / TILE;
+                sum[t] += unit > 0.0 ? factors[p0 + x] / unit : (double)flat[p0 + x] / FLAT_VALUE;
+                count[t]++;
+            }
+        }
+        for (size_t t = 0; t < 3 * tiles; t++)
+        {
+            const double gain = count[t] > 0 ? sum[t] / count[t] : 1.0;
+            map->m_gains[i * 3 * tiles + t] = (uint16_t)std::min(65535L, std::lround(gain * (1 << GAIN_BITS)));
+        }
+    }
+    return map;
+}
+
+std::unique_ptr<FalloffMap> FalloffMap::load(const std::string &path)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return nullptr;
+    FalloffFileHeader header;
+    std::unique_ptr<FalloffMap> map;
+    if (fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, FALLOFF_FILE_MAGIC, sizeof(header.magic)) == 0 &&
+        header.version == FALLOFF_FILE_VERSION && header.tile == (uint32_t)TILE && header.cols > 0 && header.rows > 0 &&
+        header.cols <= 65536 && header.rows <= 65536 && header.pattern <= BAYER_BGGR)
+    {
+        map.reset(new FalloffMap(header.serial, (int)header.cols, (int)header.rows, (BayerPattern)header.pattern, header.attenuation, header.gamma));
+        if (fread(map->m_gains.data(), sizeof(uint16_t), map->m_gains.size(), file) != map->m_gains.size())
+            map.reset();
+    }
+    fclose(file);
+    if (!map)
+        ROS_WARN("%s is not a valid falloff file, ignoring it", path.c_str());
+    return map;
+}
+
+bool FalloffMap::save(const std::string &path) const
+{
+    FalloffFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FALLOFF_FILE_MAGIC, sizeof(header.magic));
+    header.version = FALLOFF_FILE_VERSION;
+    header.serial = m_serial;
+    header.cols = (uint32_t)m_cols;
+    header.rows = (uint32_t)m_rows;
+    header.tile = (uint32_t)TILE;
+    header.attenuation = m_attenuation;
+    header.gamma = (int32_t)m_gamma;
+    header.pattern = (uint32_t)m_pattern;
+
+    const std::string tmp_path = path + ".tmp";
+    FILE *file = fopen(tmp_path.c_str(), "wb");
+    if (!file)
+    {
+        ROS_ERROR("Error: Unable to write falloff file %s (%s)", tmp_path.c_str(), strerror(errno));
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(m_gains.data(), sizeof(uint16_t), m_gains.size(), file) == m_gains.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        ROS_ERROR("Error: Unable to write falloff file %s (%s)", path.c_str(), strerror(errno));
+        remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool FalloffMap::matches(uint32_t serial, int cols, int rows, BayerPattern pattern, float attenuation, long gamma) const
+{
+    return serial == m_serial && cols == m_cols && rows == m_rows && pattern == m_pattern && attenuation == m_attenuation && gamma == m_gamma;
+}
+
+double FalloffMap::gain(size_t head, int channel, double x, double y) const
+{
+    // Tile centers are at (t + 0.5) * TILE - 0.5, clamp to the outer ones
+    const double tx = std::min(std::max((x + 0.5) / TILE - 0.5, 0.0), m_tileCols - 1.0);
+    const double ty = std::min(std::max((y + 0.5) / TILE - 0.5, 0.0), m_tileRows - 1.0);
+    const int x0 = std::min((int)tx, std::max(m_tileCols - 2, 0));
+    const int y0 = std::min((int)ty, std::max(m_tileRows - 2, 0));
+    const int x1 = std::min(x0 + 1, m_tileCols - 1);
+    const int y1 = std::min(y0 + 1, m_tileRows - 1);
+    const double ax = tx - x0, ay = ty - y0;
+
+    const uint16_t *g = m_gains.data() + (head * 3 + channel) * m_tileRows * m_tileCols;
+    const double top = g[y0 * m_tileCols + x0] * (1.0 - ax) + g[y0 * m_tileCols + x1] * ax;
+    const double bottom = g[y1 * m_tileCols + x0] * (1.0 - ax) + g[y1 * m_tileCols + x1] * ax;
+    return (top * (1.0 - ay) + bottom * ay) / (1 << GAIN_BITS);
+}
+
+FalloffTiles::FalloffTiles(const FalloffMap &map, size_t head, const BayerKernel &kernel)
+{
+    // The map is over the raw sensor, which the kernel may have scaled from a different size than the map's
+    const double sx = (double)map.cols() / kernel.src_cols();
+    const double sy = (double)map.rows() / kernel.src_rows();
+    m_nodeCols = (kernel.out_cols() - 1) / TILE + 2;
+    m_nodeRows = (kernel.out_rows() - 1) / TILE + 2;
+    m_gains.resize((size_t)m_nodeRows * m_nodeCols * 3);
+    for (int k = 0; k < m_nodeRows; k++)
+    {
+        for (int j = 0; j < m_nodeCols; j++)
+        {
+            double x, y;
+            kernel.outputToRaw(j * TILE, k * TILE, x, y);
+            for (int ch = 0; ch < 3; ch++)
+            {
+                const double gain = map.gain(head, ch, (x + 0.5) * sx - 0.5, (y + 0.5) * sy - 0.5);
+                m_gains[((size_t)k * m_nodeCols + j) * 3 + ch] = (uint16_t)std::min(65535L, std::lround(gain * (1 << GAIN_BITS)));
+            }
+        }
+    }
+}
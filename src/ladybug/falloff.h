@@ -0,0 +1,101 @@
+#ifndef LADYBUG_FALLOFF_H
+#define LADYBUG_FALLOFF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bayer_kernel.h"
+#include "ladybug.h"
+
+/**
+ * Lens falloff gains of the six heads, one per Bayer channel on a coarse grid of tiles over the raw sensor
+ *
+ * The gains come from the camera's own calibration with ladybugGetFalloffCalibration(), for an attenuation and gamma.
+ * The SDK does not document the unit of those factors, so they are scaled to match what ladybugCorrectStippledFalloffEx()
+ * does to a flat image. The per-pixel factors are averaged over TILE x TILE pixels per channel, and stored as fixed-point
+ * gains with GAIN_BITS fractional bits, which is about 30 KB per head for a Ladybug5.
+ * Maps are saved to a cache file, so only the first startup with a camera and setting needs the SDK.
+ */
+class FalloffMap
+{
+  public:
+    static const int TILE = 32;
+    static const int GAIN_BITS = 12;
+
+    /**
+     * Fetch the gains of a cols x rows head from the calibration loaded into the context with ladybugLoadConfig()
+     * Returns nullptr on any SDK error
+     */
+    static std::unique_ptr<FalloffMap> fromSdk(LadybugContext context, uint32_t serial, int cols, int rows, BayerPattern pattern, float attenuation,
+                                               long gamma);
+
+    /**
+     * Read a map saved with save(), returns nullptr if the file is missing or not a valid map
+     */
+    static std::unique_ptr<FalloffMap> load(const std::string &path);
+
+    /**
+     * Write the map to a file, the old file is only replaced once the new one is complete
+     */
+    bool save(const std::string &path) const;
+
+    /**
+     * True if this map was made for this camera, head size, Bayer pattern and correction settings
+     * The gains are averaged per channel, so a map of another CFA order would swap red, green and blue
+     */
+    bool matches(uint32_t serial, int cols, int rows, BayerPattern pattern, float attenuation, long gamma) const;
+
+    /**
+     * Gain of a channel (0 red, 1 green, 2 blue) at a raw pixel of a head, bilinear between the tile centers
+     */
+    double gain(size_t head, int channel, double x, double y) const;
+
+    int cols() const { return m_cols; }
+    int rows() const { return m_rows; }
+    BayerPattern pattern() const { return m_pattern; }
+
+  private:
+    FalloffMap(uint32_t serial, int cols, int rows, BayerPattern pattern, float attenuation, long gamma);
+
+    uint32_t m_serial;
+    int m_cols, m_rows;
+    BayerPattern m_pattern;
+    float m_attenuation;
+    long m_gamma;
+
+    // Gains of tile (ty, tx) of channel ch of head i are at ((i * 3 + ch) * m_tileRows + ty) * m_tileCols + tx
+    int m_tileCols, m_tileRows;
+    std::vector<uint16_t> m_gains;
+};
+
+/**
+ * Falloff gains of one head on a grid over the output of a kernel, this is what the kernel applies
+ *
+ * Node (k, j) sits on output row k * TILE and col j * TILE and holds a GAIN_BITS fixed-point gain per channel.
+ * There is one more node row and col past the end of the image, so every output pixel lies between four nodes.
+ * These are built whenever the kernel is, in a few ms.
+ */
+class FalloffTiles
+{
+  public:
+    static const int TILE_BITS = 4;
+    static const int TILE = 1 << TILE_BITS;
+    static const int GAIN_BITS = FalloffMap::GAIN_BITS;
+
+    FalloffTiles(const FalloffMap &map, size_t head, const BayerKernel &kernel);
+
+    // The 3 * node_cols() gains of node row k, red, green and blue of every node
+    const uint16_t *row(int k) const { return m_gains.data() + (size_t)k * m_nodeCols * 3; }
+
+    int node_cols() const { return m_nodeCols; }
+    int node_rows() const { return m_nodeRows; }
+
+  private:
+    int m_nodeCols, m_nodeRows;
+    std::vector<uint16_t> m_gains;
+};
+
+#endif // LADYBUG_FALLOFF_H
@@ -0,0 +1,230 @@
+#include "frame_file.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+FrameFileWriter::FrameFileWriter(const LadybugCameraInfo &camera) : m_fd(-1), m_offset(0)
+{
+    memset(&m_header, 0, sizeof(m_header));
+    memcpy(m_header.magic, FRAME_FILE_MAGIC, sizeof(m_header.magic));
+    m_header.version = FRAME_FILE_VERSION;
+    m_header.device_type = (uint32_t)camera.deviceType;
+    m_header.serial_base = (uint32_t)camera.serialBase;
+    m_header.serial_head = (uint32_t)camera.serialHead;
+    strncpy(m_header.model, camera.pszModelName, sizeof(m_header.model) - 1);
+}
+
+FrameFileWriter::~FrameFileWriter()
+{
+    close();
+}
+
+bool FrameFileWriter::open(const std::string &base_name, std::string &file_name)
+{
+    close();
+    file_name = base_name + ".lbf";
+    m_fd = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (m_fd < 0)
+    {
+        ROS_ERROR("Error: Unable to open frame file %s (%s)", file_name.c_str(), strerror(errno));
+        return false;
+    }
+
+    // The header takes up the whole first block
+    std::vector<uint8_t> block(FRAME_FILE_ALIGNMENT, 0);
+    memcpy(block.data(), &m_header, sizeof(m_header));
+    m_offset = 0;
+    m_index.clear();
+    return writeAll(block.data(), block.size());
+}
+
+bool FrameFileWriter::write(const LadybugImage &image, const ros::Time &stamp)
+{
+    if (m_fd < 0)
+        return false;
+
+    // Describe this frame in the index
+    FrameIndexEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.offset = m_offset;
+    entry.size = image.uiDataSizeBytes;
+    entry.stamp_ns = (int64_t)stamp.toNSec();
+    entry.seconds = image.timeStamp.ulSeconds;
+    entry.micro_seconds = image.timeStamp.ulMicroSeconds;
+    entry.cycle_seconds = image.timeStamp.ulCycleSeconds;
+    entry.cycle_count = image.timeStamp.ulCycleCount;
+    entry.cycle_offset = image.timeStamp.ulCycleOffset;
+    entry.sequence = image.imageInfo.ulSequenceId;
+    entry.data_format = (uint32_t)image.dataFormat;
+    entry.cols = image.uiFullCols;
+    entry.rows = image.uiFullRows;
+    entry.stippled_format = (uint32_t)image.stippledFormat;
+    for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    {
+        entry.gain[i] = image.imageInfo.arulGainAdjust[i];
+        entry.shutter[i] = image.imageInfo.ulShutter[i];
+    }
+
+    // Write the data, and pad it up to the next block
+    static const uint8_t zeros[FRAME_FILE_ALIGNMENT] = {0};
+    const size_t padding = (FRAME_FILE_ALIGNMENT - entry.size % FRAME_FILE_ALIGNMENT) % FRAME_FILE_ALIGNMENT;
+    if (!writeAll(image.pData, entry.size) || !writeAll(zeros, padding))
+        return false;
+    m_index.push_back(entry);
+    return true;
+}
+
+void FrameFileWriter::close()
+{
+    if (m_fd < 0)
+        return;
+
+    // Index and footer go at the very end
+    FrameFileFooter footer;
+    footer.index_offset = m_offset;
+    footer.num_frames = m_index.size();
+    memcpy(footer.magic, FRAME_FILE_MAGIC, sizeof(footer.magic));
+    if (!writeAll(m_index.data(), m_index.size() * sizeof(FrameIndexEntry)) || !writeAll(&footer, sizeof(footer)))
+        ROS_ERROR("Error: Unable to write the frame file index, the file can not be replayed");
+    ::close(m_fd);
+    m_fd = -1;
+}
+
+bool FrameFileWriter::writeAll(const void *data, size_t size)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    while (size > 0)
+    {
+        const ssize_t written = ::write(m_fd, p, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+        {
+            ROS_ERROR_THROTTLE(5, "Error: Unable to write to frame file (%s)", strerror(errno));
+            return false;
+        }
+        p += written;
+        size -= (size_t)written;
+        m_offset += (uint64_t)written;
+    }
+    return true;
+}
+
+FrameFileReader::FrameFileReader() : m_fd(-1), m_data(nullptr), m_size(0), m_header(nullptr), m_index(nullptr), m_numFrames(0)
+{
+}
+
+FrameFileReader::~FrameFileReader()
+{
+    close();
+}
+
+bool FrameFileReader::open(const std::string &path)
+{
+    close();
+    m_fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (m_fd < 0 || fstat(m_fd, &st) != 0)
+    {
+        ROS_ERROR("Error: Unable to open frame file %s (%s)", path.c_str(), strerror(errno));
+        close();
+        return false;
+    }
+    m_size = (size_t)st.st_size;
+    if (m_size < FRAME_FILE_ALIGNMENT + sizeof(FrameFileFooter))
+    {
+        ROS_ERROR("Error: %s is too small to be a frame file", path.c_str());
+        close();
+        return false;
+    }
+    void *data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (data == MAP_FAILED)
+    {
+        ROS_ERROR("Error: Unable to map frame file %s (%s)", path.c_str(), strerror(errno));
+        close();
+        return false;
+    }
+    m_data = (uint8_t *)data;
+
+    // Check the header and footer, and that the index and all frames are inside the file
+    // The footer is checked against the size before its values are added up, so a damaged one can not wrap around
+    m_header = (const FrameFileHeader *)m_data;
+    const FrameFileFooter *footer = (const FrameFileFooter *)(m_data + m_size - sizeof(FrameFileFooter));
+    const size_t index_space = m_size - sizeof(FrameFileFooter);
+    if (memcmp(m_header->magic, FRAME_FILE_MAGIC, sizeof(FRAME_FILE_MAGIC)) != 0 || m_header->version != FRAME_FILE_VERSION ||
+        memcmp(footer->magic, FRAME_FILE_MAGIC, sizeof(FRAME_FILE_MAGIC)) != 0 || footer->index_offset < FRAME_FILE_ALIGNMENT ||
+        footer->index_offset > index_space || footer->num_frames > (index_space - footer->index_offset) / sizeof(FrameIndexEntry) ||
+        footer->index_offset + footer->num_frames * sizeof(FrameIndexEntry) + sizeof(FrameFileFooter) != m_size)
+    {
+        ROS_ERROR("Error: %s is not a complete frame file", path.c_str());
+        close();
+        return false;
+    }
+    m_index = (const FrameIndexEntry *)(m_data + footer->index_offset);
+    m_numFrames = (size_t)footer->num_frames;
+    for (size_t i = 0; i < m_numFrames; i++)
+    {
+        if (m_index[i].offset < FRAME_FILE_ALIGNMENT || m_index[i].offset > footer->index_offset ||
+            m_index[i].size > footer->index_offset - m_index[i].offset)
+        {
+            ROS_ERROR("Error: frame %d of %s is outside of the file", (int)i, path.c_str());
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void FrameFileReader::close()
+{
+    if (m_data != nullptr)
+        munmap(m_data, m_size);
+    if (m_fd >= 0)
+        ::close(m_fd);
+    m_fd = -1;
+    m_data = nullptr;
+    m_size = 0;
+    m_header = nullptr;
+    m_index = nullptr;
+    m_numFrames = 0;
+}
+
+void FrameFileReader::frame(size_t i, LadybugImage &image) const
+{
+    const FrameIndexEntry &e = m_index[i];
+    image = LadybugImage();
+    image.uiCols = image.uiFullCols = e.cols;
+    image.uiRows = image.uiFullRows = e.rows;
+    image.dataFormat = (LadybugDataFormat)e.data_format;
+    image.resolution = LADYBUG_RESOLUTION_ANY;
+    image.pData = m_data + e.offset;
+    image.uiDataSizeBytes = (unsigned int)e.size;
+    image.bStippled = true;
+    image.stippledFormat = (LadybugStippledFormat)e.stippled_format;
+    image.timeStamp.ulSeconds = e.seconds;
+    image.timeStamp.ulMicroSeconds = e.micro_seconds;
+    image.timeStamp.ulCycleSeconds = e.cycle_seconds;
+    image.timeStamp.ulCycleCount = e.cycle_count;
+    image.timeStamp.ulCycleOffset = e.cycle_offset;
+    image.imageInfo.ulFingerprint = LADYBUGIMAGEINFO_STRUCT_FINGERPRINT;
+    image.imageInfo.ulVersion = 2;
+    image.imageInfo.ulSequenceId = e.sequence;
+    image.imageInfo.ulSerialNum = m_header->serial_base;
+    for (size_t h = 0; h < LADYBUG_NUM_CAMERAS; h++)
+    {
+        image.imageInfo.arulGainAdjust[h] = e.gain[h];
+        image.imageInfo.ulShutter[h] = e.shutter[h];
+    }
+}
+
+void FrameFileReader::prefetch(size_t i) const
+{
+    // madvise needs a page aligned start, frames are already aligned to blocks
+    const FrameIndexEntry &e = m_index[i];
+    madvise(m_data + e.offset, (size_t)e.size, MADV_WILLNEED);
+}
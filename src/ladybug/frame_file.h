@@ -0,0 +1,146 @@
+#ifndef LADYBUG_FRAME_FILE_H
+#define LADYBUG_FRAME_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <ros/ros.h>
+
+#include "ladybug.h"
+#include "stream_recorder.h"
+
+/**
+ * Indexed container of untouched camera images, written by the driver and replayed with mmap
+ *
+ * All values are little-endian, and the file is laid out as:
+ *   header (FRAME_FILE_ALIGNMENT bytes): FrameFileHeader followed by zeros
+ *   frames: the image data of every frame, each starting on a FRAME_FILE_ALIGNMENT boundary
+ *   index: one FrameIndexEntry per frame
+ *   footer: FrameFileFooter, which points at the index
+ * The index is only written when the file is closed, so a file from a crash has no index.
+ */
+const size_t FRAME_FILE_ALIGNMENT = 4096;
+const char FRAME_FILE_MAGIC[8] = {'L', 'B', 'F', 'R', 'A', 'M', 'E', '1'};
+const uint32_t FRAME_FILE_VERSION = 1;
+
+struct FrameFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t device_type;
+    uint32_t serial_base;
+    uint32_t serial_head;
+    char model[64];
+};
+
+struct FrameIndexEntry
+{
+    // Where the image data is in the file
+    uint64_t offset;
+    uint64_t size;
+
+    // ROS time the frame was published with (ns), and the camera's own timestamp
+    int64_t stamp_ns;
+    int64_t seconds;
+    uint32_t micro_seconds;
+    uint32_t cycle_seconds;
+    uint32_t cycle_count;
+    uint32_t cycle_offset;
+
+    // Image description, and the per head gain and shutter from LadybugImageInfo
+    uint32_t sequence;
+    uint32_t data_format;
+    uint32_t cols;
+    uint32_t rows;
+    uint32_t stippled_format;
+    uint32_t gain[LADYBUG_NUM_CAMERAS];
+    uint32_t shutter[LADYBUG_NUM_CAMERAS];
+    uint32_t reserved;
+};
+static_assert(sizeof(FrameIndexEntry) == 120, "FrameIndexEntry must have a fixed layout");
+
+struct FrameFileFooter
+{
+    uint64_t index_offset;
+    uint64_t num_frames;
+    char magic[8];
+};
+
+/**
+ * Record sink writing frame files named <base name>.lbf
+ */
+class FrameFileWriter : public RecordSink
+{
+  public:
+    explicit FrameFileWriter(const LadybugCameraInfo &camera);
+    ~FrameFileWriter();
+
+    bool open(const std::string &base_name, std::string &file_name) override;
+    bool write(const LadybugImage &image, const ros::Time &stamp) override;
+    void close() override;
+
+  private:
+    FrameFileWriter(const FrameFileWriter &) = delete;
+    FrameFileWriter &operator=(const FrameFileWriter &) = delete;
+
+    /**
+     * Write all of this data, returns false on any error
+     */
+    bool writeAll(const void *data, size_t size);
+
+    FrameFileHeader m_header;
+    int m_fd;
+    uint64_t m_offset;
+    std::vector<FrameIndexEntry> m_index;
+};
+
+/**
+ * Read-only view of a frame file, the file is mapped into memory so frames are never copied
+ * Seeking to any frame is O(1) through the index
+ */
+class FrameFileReader
+{
+  public:
+    FrameFileReader();
+    ~FrameFileReader();
+
+    /**
+     * Map the file and check its header, footer and index, returns false if it is not a valid frame file
+     */
+    bool open(const std::string &path);
+
+    /**
+     * Unmap the file, all images returned by frame() become invalid
+     */
+    void close();
+
+    size_t size() const { return m_numFrames; }
+    const FrameFileHeader &header() const { return *m_header; }
+    const FrameIndexEntry &entry(size_t i) const { return m_index[i]; }
+
+    /**
+     * Describe frame i as a LadybugImage whose data points straight into the mapping
+     * NOTE: the mapping is read-only, the image data must not be written to
+     */
+    void frame(size_t i, LadybugImage &image) const;
+
+    /**
+     * Ask the kernel to start reading frame i in, so it is in memory by the time it is used
+     */
+    void prefetch(size_t i) const;
+
+  private:
+    FrameFileReader(const FrameFileReader &) = delete;
+    FrameFileReader &operator=(const FrameFileReader &) = delete;
+
+    int m_fd;
+    uint8_t *m_data;
+    size_t m_size;
+    const FrameFileHeader *m_header;
+    const FrameIndexEntry *m_index;
+    size_t m_numFrames;
+};
+
+#endif // LADYBUG_FRAME_FILE_H
@@ -0,0 +1,323 @@
+#ifndef LADYBUG_FRAME_RING_H
+#define LADYBUG_FRAME_RING_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <ros/ros.h>
+
+#include "ladybug.h"
+
+/**
+ * A single locked SDK buffer that has been handed from the grab thread to processing
+ * We remember when it was locked so we can stamp it and track how long the SDK buffer was held
+ */
+struct LockedFrame
+{
+    LadybugImage image;
+    ros::Time stamp;
+    std::chrono::steady_clock::time_point lock_time;
+
+    // True if the stamp is the camera's exposure time, so the end to end latency can be measured from it
+    bool camera_stamp;
+};
+
+class FrameHold;
+
+/**
+ * Locked frames whose last FrameHold has gone away, waiting for the processing thread to unlock them
+ * Holds can be dropped on any thread (e.g. by an intra-process subscriber), but buffers are only unlocked from processing
+ * The queue also knows every hold that is still alive, so the driver can wait for them when it stops, and leave
+ * stopping the camera to the last of them if they outlive it.
+ */
+class FrameReleaseQueue
+{
+  public:
+    FrameReleaseQueue() : m_published(0), m_retired(false) {}
+
+    /**
+     * Take all frames that can be unlocked, frames is cleared first
+     */
+    void take(std::vector<LockedFrame> &frames)
+    {
+        frames.clear();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        frames.swap(m_frames);
+    }
+
+    /**
+     * Number of holds that are still alive, and of those that published messages point into
+     */
+    size_t held() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_holds.size();
+    }
+    size_t published() const { return m_published.load(std::memory_order_relaxed); }
+
+    /**
+     * Run teardown once no hold is alive anymore, right away if there are none, and otherwise on the thread that drops
+     * the last of them. Nothing is queued for unlocking after this, teardown gives back every buffer at once.
+     * Returns the number of holds that were still alive.
+     */
+    size_t retire(std::function<void()> teardown);
+
+  private:
+    friend class FrameHold;
+
+    void add(FrameHold *hold)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_holds.push_back(hold);
+    }
+
+    /**
+     * Forget a hold that is going away, and queue its frame, or run the teardown once the queue is retired and this was the last one
+     */
+    void release(FrameHold *hold);
+
+    mutable std::mutex m_mutex;
+    std::vector<LockedFrame> m_frames;
+    std::vector<FrameHold *> m_holds;
+    std::atomic<size_t> m_published;
+    std::function<void()> m_teardown;
+    bool m_retired;
+};
+
+/**
+ * Keeps a locked SDK buffer from being unlocked while anything still points into it
+ * Processing shares one hold per frame with every message that aliases the buffer, and the last one to let go
+ * queues the frame for unlocking. The queue is shared, so a message that outlives the driver is still safe to drop.
+ * Its buffer stays locked until then, the driver leaves stopping the camera to the last hold (see FrameReleaseQueue::retire()).
+ */
+class FrameHold
+{
+  public:
+    FrameHold(const LockedFrame &frame, const std::shared_ptr<FrameReleaseQueue> &queue)
+        : m_frame(frame), m_queue(queue), m_published(false)
+    {
+        m_queue->add(this);
+    }
+    ~FrameHold()
+    {
+        m_queue->release(this);
+        if (m_published)
+            m_queue->m_published--;
+    }
+
+    const LockedFrame &frame() const { return m_frame; }
+
+    /**
+     * The image data of the frame, in the SDK buffer that stays locked for as long as this hold lives
+     */
+    const uint8_t *data() const { return m_frame.image.pData; }
+
+    /**
+     * Count this hold in FrameReleaseQueue::published(), once a message that points into the buffer is published
+     */
+    void markPublished()
+    {
+        if (!m_published.exchange(true))
+            m_queue->m_published++;
+    }
+    bool published() const { return m_published; }
+
+  private:
+    friend class FrameReleaseQueue;
+
+    FrameHold(const FrameHold &) = delete;
+    FrameHold &operator=(const FrameHold &) = delete;
+
+    LockedFrame m_frame;
+    std::shared_ptr<FrameReleaseQueue> m_queue;
+    std::atomic<bool> m_published;
+};
+
+/**
+ * What the grab thread hands to processing, the locked frame and the hold the recorder already shares, if any
+ * Processing makes the hold itself for frames that do not have one, so only recorded frames pay for it on the grab thread
+ */
+struct QueuedFrame
+{
+    LockedFrame frame;
+    std::shared_ptr<FrameHold> hold;
+};
+
+inline size_t FrameReleaseQueue::retire(std::function<void()> teardown)
+{
+    size_t held;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_retired = true;
+        m_frames.clear();
+        held = m_holds.size();
+        if (held > 0)
+            m_teardown = std::move(teardown);
+    }
+    if (held == 0)
+        teardown();
+    return held;
+}
+
+inline void FrameReleaseQueue::release(FrameHold *hold)
+{
+    std::function<void()> teardown;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < m_holds.size(); i++)
+        {
+            if (m_holds[i] == hold)
+            {
+                m_holds[i] = m_holds.back();
+                m_holds.pop_back();
+                break;
+            }
+        }
+        if (!m_retired)
+            m_frames.push_back(hold->m_frame);
+        else if (m_holds.empty())
+            teardown.swap(m_teardown);
+    }
+
+    // Outside the mutex, since teardown stops the camera and that takes a while
+    if (teardown)
+        teardown();
+}
+
+/**
+ * Bounded lock-free single producer / single consumer ring
+ * The grab thread is the only one to push, and the processing loop the only one to pop
+ * One slot is kept free to tell full from empty, so capacity() is the requested size
+ * The consumer can also sleep in wait() until there is an item. Pushing only takes the mutex when it is asleep,
+ * so the data path stays lock-free while the consumer keeps up.
+ */
+template <typename T>
+class SpscRing
+{
+  public:
+    explicit SpscRing(size_t capacity) : m_slots(capacity + 1), m_head(0), m_tail(0), m_waiting(false) {}
+
+    /**
+     * Try to add an item, returns false if the ring is full (producer only)
+     */
+    bool push(const T &item)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        const size_t next = (head + 1) % m_slots.size();
+        if (next == m_tail.load(std::memory_order_acquire))
+            return false;
+        m_slots[head] = item;
+        m_head.store(next, std::memory_order_release);
+
+        // Pairs with the fence in wait(), either it sees the new head or we see that it sleeps
+        // NOTE: taking the mutex makes sure it is really waiting on the condition, and not just about to
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiting.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_wakeup.notify_one();
+        }
+        return true;
+    }
+
+    /**
+     * Sleep until there is an item or the timeout has passed, returns false if the ring is still empty (consumer only)
+     */
+    template <typename Rep, typename Period>
+    bool wait(const std::chrono::duration<Rep, Period> &timeout)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_waiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const bool ready = m_wakeup.wait_for(lock, timeout, [this]() { return size() > 0; });
+        m_waiting.store(false, std::memory_order_relaxed);
+        return ready;
+    }
+
+    /**
+     * Try to take the oldest item, returns false if the ring is empty (consumer only)
+     * The item is moved out, so a slot does not keep what it held (e.g. a FrameHold) alive until it is reused
+     */
+    bool pop(T &item)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire))
+            return false;
+        item = std::move(m_slots[tail]);
+        m_tail.store((tail + 1) % m_slots.size(), std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Number of items currently in the ring (approximate if called while the other side runs)
+     */
+    size_t size() const
+    {
+        const size_t head = m_head.load(std::memory_order_acquire);
+        const size_t tail = m_tail.load(std::memory_order_acquire);
+        return (head + m_slots.size() - tail) % m_slots.size();
+    }
+
+    size_t capacity() const { return m_slots.size() - 1; }
+
+  private:
+    std::vector<T> m_slots;
+    // Keep producer and consumer indices on their own cache lines
+    // NOTE: padded rather than alignas(64), so the ring can be heap allocated without C++17 aligned new
+    char m_padHead[64];
+    std::atomic<size_t> m_head;
+    char m_padTail[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> m_tail;
+
+    // Only used while the consumer sleeps in wait()
+    std::atomic<bool> m_waiting;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+};
+
+/**
+ * Counters that describe how the ring between grabbing and processing is doing
+ * These are written from both threads, so everything is atomic
+ */
+struct FrameRingStats
+{
+    std::atomic<uint64_t> grabbed{0};
+    std::atomic<uint64_t> processed{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> max_depth{0};
+    std::atomic<uint64_t> hold_time_total_us{0};
+    std::atomic<uint64_t> hold_time_max_us{0};
+
+    /**
+     * Record the current depth of the ring, keeping the high-water mark
+     */
+    void recordDepth(uint64_t depth)
+    {
+        uint64_t prev = max_depth.load(std::memory_order_relaxed);
+        while (depth > prev && !max_depth.compare_exchange_weak(prev, depth, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    /**
+     * Record how long a SDK buffer was held between lock and unlock
+     */
+    void recordHoldTime(uint64_t hold_us)
+    {
+        hold_time_total_us.fetch_add(hold_us, std::memory_order_relaxed);
+        uint64_t prev = hold_time_max_us.load(std::memory_order_relaxed);
+        while (hold_us > prev && !hold_time_max_us.compare_exchange_weak(prev, hold_us, std::memory_order_relaxed))
+        {
+        }
+    }
+};
+
+#endif // LADYBUG_FRAME_RING_H
@@ -0,0 +1,235 @@
+#include "jpeg_decoder.h"
+
+#include <atomic>
+#include <cstring>
+
+#include <ros/ros.h>
+
+namespace
+{
+
+// Offset of the tile table in the JPEG image header
+const size_t TILE_TABLE_OFFSET = 0x340;
+
+/**
+ * Read a big-endian 32-bit int
+ */
+inline uint32_t readBigEndian(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+/**
+ * Write a big-endian 32-bit int
+ */
+inline void writeBigEndian(uint8_t *p, uint32_t value)
+{
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+/**
+ * Read and write the little-endian 32-bit ints of our own CompressedImage layout
+ */
+inline uint32_t readLittleEndian(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline void writeLittleEndian(uint8_t *p, uint32_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+} // namespace
+
+bool findJpegTiles(const LadybugImage &image, JpegTile tiles[LADYBUG_JPEG_TILES])
+{
+    const size_t buffer_size = image.uiDataSizeBytes;
+    if (image.pData == nullptr || buffer_size < TILE_TABLE_OFFSET + 8 * LADYBUG_JPEG_TILES)
+        return false;
+    for (size_t i = 0; i < LADYBUG_JPEG_TILES; i++)
+    {
+        const uint8_t *entry = image.pData + TILE_TABLE_OFFSET + 8 * i;
+        const size_t offset = readBigEndian(entry);
+        const size_t size = readBigEndian(entry + 4);
+        if (size == 0 || offset + size > buffer_size)
+            return false;
+        tiles[i].data = image.pData + offset;
+        tiles[i].size = size;
+    }
+    return true;
+}
+
+void packJpegImage(const std::vector<uint8_t> tiles[LADYBUG_JPEG_TILES], std::vector<uint8_t> &buffer)
+{
+
+    // Header with the tile table, followed by the tiles themselves
+    size_t offset = TILE_TABLE_OFFSET + 8 * LADYBUG_JPEG_TILES;
+    size_t total = offset;
+    for (size_t i = 0; i < LADYBUG_JPEG_TILES; i++)
+        total += tiles[i].size();
+    buffer.assign(total, 0);
+    for (size_t i = 0; i < LADYBUG_JPEG_TILES; i++)
+    {
+        uint8_t *entry = buffer.data() + TILE_TABLE_OFFSET + 8 * i;
+        writeBigEndian(entry, (uint32_t)offset);
+        writeBigEndian(entry + 4, (uint32_t)tiles[i].size());
+        memcpy(buffer.data() + offset, tiles[i].data(), tiles[i].size());
+        offset += tiles[i].size();
+    }
+}
+
+bool encodeBayerTile(tjhandle handle, const uint8_t *plane, int cols, int rows, size_t channel, int quality, std::vector<uint8_t> &buffer,
+                     std::vector<uint8_t> &jpeg)
+{
+
+    // Gather this channel out of each 2x2 Bayer block
+    const int tile_cols = cols / 2;
+    const int tile_rows = rows / 2;
+    buffer.resize((size_t)tile_cols * tile_rows);
+    for (int r = 0; r < tile_rows; r++)
+    {
+        const uint8_t *src = plane + (size_t)(2 * r + channel / 2) * cols + channel % 2;
+        uint8_t *dst = buffer.data() + (size_t)r * tile_cols;
+        for (int c = 0; c < tile_cols; c++)
+            dst[c] = src[2 * c];
+    }
+
+    // Compress it, and copy it out of the buffer libturbojpeg allocated
+    unsigned char *data = nullptr;
+    unsigned long size = 0;
+    if (tjCompress2(handle, buffer.data(), tile_cols, 0, tile_rows, TJPF_GRAY, &data, &size, TJSAMP_GRAY, quality, TJFLAG_FASTDCT) != 0)
+    {
+        tjFree(data);
+        return false;
+    }
+    jpeg.assign(data, data + size);
+    tjFree(data);
+    return true;
+}
+
+bool decodeBayerTile(tjhandle handle, const JpegTile &jpeg, size_t channel, std::vector<uint8_t> &buffer, uint8_t *plane, int cols, int rows)
+{
+
+    // Make sure this tile has the size of the plane we are decoding into
+    int tile_cols, tile_rows, subsamp, colorspace;
+    if (tjDecompressHeader3(handle, jpeg.data, jpeg.size, &tile_cols, &tile_rows, &subsamp, &colorspace) != 0 || 2 * tile_cols != cols ||
+        2 * tile_rows != rows)
+    {
+        return false;
+    }
+
+    // Decode the channel into our buffer
+    buffer.resize((size_t)tile_cols * tile_rows);
+    if (tjDecompress2(handle, jpeg.data, jpeg.size, buffer.data(), tile_cols, 0, tile_rows, TJPF_GRAY, TJFLAG_FASTDCT) != 0)
+    {
+        return false;
+    }
+
+    // Scatter it back into its position of each 2x2 Bayer block
+    for (int r = 0; r < tile_rows; r++)
+    {
+        const uint8_t *src = buffer.data() + (size_t)r * tile_cols;
+        uint8_t *dst = plane + (size_t)(2 * r + channel / 2) * cols + channel % 2;
+        for (int c = 0; c < tile_cols; c++)
+            dst[2 * c] = src[c];
+    }
+    return true;
+}
+
+void packJpegTiles(const JpegTile tiles[LADYBUG_JPEG_CHANNELS], std::vector<uint8_t> &data)
+{
+    size_t total = LADYBUG_JPEG_HEADER_SIZE;
+    for (size_t k = 0; k < LADYBUG_JPEG_CHANNELS; k++)
+        total += tiles[k].size;
+    data.resize(total);
+    uint8_t *dst = data.data();
+    for (size_t k = 0; k < LADYBUG_JPEG_CHANNELS; k++, dst += 4)
+        writeLittleEndian(dst, (uint32_t)tiles[k].size);
+    for (size_t k = 0; k < LADYBUG_JPEG_CHANNELS; k++)
+    {
+        memcpy(dst, tiles[k].data, tiles[k].size);
+        dst += tiles[k].size;
+    }
+}
+
+bool unpackJpegTiles(const std::vector<uint8_t> &data, JpegTile tiles[LADYBUG_JPEG_CHANNELS])
+{
+    if (data.size() < LADYBUG_JPEG_HEADER_SIZE)
+        return false;
+    size_t offset = LADYBUG_JPEG_HEADER_SIZE;
+    for (size_t k = 0; k < LADYBUG_JPEG_CHANNELS; k++)
+    {
+        tiles[k].size = readLittleEndian(data.data() + 4 * k);
+        tiles[k].data = data.data() + offset;
+        offset += tiles[k].size;
+    }
+    return offset == data.size();
+}
+
+JpegDecoder::JpegDecoder() : m_cols(0), m_rows(0)
+{
+    for (size_t i = 0; i < LADYBUG_JPEG_TILES; i++)
+        m_handles[i] = tjInitDecompress();
+}
+
+JpegDecoder::~JpegDecoder()
+{
+    for (size_t i = 0; i < LADYBUG_JPEG_TILES; i++)
+    {
+        if (m_handles[i] != nullptr)
+            tjDestroy(m_handles[i]);
+    }
+}
+
+bool JpegDecoder::decode(const LadybugImage &image, WorkerPool &pool, uint32_t heads)
+{
+
+    // Find where all the tiles are in this buffer
+    JpegTile tiles[LADYBUG_JPEG_TILES];
+    if (!findJpegTiles(image, tiles))
+    {
+        ROS_WARN("JPEG tile table of image is invalid, skipping it");
+        return false;
+    }
+
+    // The first tile tells us how big the planes are, all tiles are the same size
+    int tile_cols, tile_rows, subsamp, colorspace;
+    if (tjDecompressHeader3(m_handles[0], tiles[0].data, tiles[0].size, &tile_cols, &tile_rows, &subsamp, &colorspace) != 0)
+    {
+        ROS_WARN("Unable to read JPEG tile header (%s)", tjGetErrorStr());
+        return false;
+    }
+    m_cols = 2 * tile_cols;
+    m_rows = 2 * tile_rows;
+    m_planes.resize((size_t)LADYBUG_NUM_CAMERAS * m_cols * m_rows);
+
+    // Only the tiles of the heads we were asked for
+    size_t active[LADYBUG_JPEG_TILES];
+    size_t num_active = 0;
+    for (size_t i = 0; i < LADYBUG_JPEG_TILES; i++)
+    {
+        if (heads & (1u << (i / LADYBUG_JPEG_CHANNELS)))
+            active[num_active++] = i;
+    }
+
+    // Decode them in parallel
+    std::atomic<bool> success(true);
+    pool.run(num_active, [&](size_t j) {
+        const size_t i = active[j];
+        uint8_t *plane = m_planes.data() + (i / LADYBUG_JPEG_CHANNELS) * m_cols * m_rows;
+        if (!decodeBayerTile(m_handles[i], tiles[i], i % LADYBUG_JPEG_CHANNELS, m_tileBuffers[i], plane, m_cols, m_rows))
+        {
+            ROS_WARN("Unable to decode JPEG tile %d of the image", (int)i);
+            success = false;
+        }
+    });
+    return success;
+}
+
@@ -0,0 +1,119 @@
+#ifndef LADYBUG_JPEG_DECODER_H
+#define LADYBUG_JPEG_DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <turbojpeg.h>
+
+#include "ladybug.h"
+#include "watched_outputs.h"
+#include "worker_pool.h"
+
+// Each head is sent as four JPEG tiles, one per Bayer channel
+const size_t LADYBUG_JPEG_CHANNELS = 4;
+const size_t LADYBUG_JPEG_TILES = LADYBUG_NUM_CAMERAS * LADYBUG_JPEG_CHANNELS;
+
+/**
+ * A single compressed Bayer channel of one head, pointing into the SDK image buffer
+ */
+struct JpegTile
+{
+    const uint8_t *data;
+    size_t size;
+};
+
+/**
+ * Find the 24 JPEG tiles in a COLOR_SEP_JPEG image buffer
+ *
+ * The buffer starts with a header, and at offset 0x340 of that header there is a table with one
+ * big-endian (offset, size) pair of 32-bit ints per tile, ordered by head and then by channel.
+ * Channel k of a head holds the pixels at Bayer position (row k / 2, col k % 2) of every 2x2 block.
+ * Returns false if the table points outside of the buffer.
+ */
+bool findJpegTiles(const LadybugImage &image, JpegTile tiles[LADYBUG_JPEG_TILES]);
+
+/**
+ * Build a buffer laid out like the camera's COLOR_SEP_JPEG images from 24 encoded tiles
+ * This is the inverse of findJpegTiles, for image sources that are not a real camera
+ */
+void packJpegImage(const std::vector<uint8_t> tiles[LADYBUG_JPEG_TILES], std::vector<uint8_t> &buffer);
+
+/**
+ * Encode one Bayer channel of a raw plane into a grayscale JPEG, the inverse of decodeBayerTile
+ */
+bool encodeBayerTile(tjhandle handle, const uint8_t *plane, int cols, int rows, size_t channel, int quality, std::vector<uint8_t> &buffer,
+                     std::vector<uint8_t> &jpeg);
+
+/**
+ * Decode one compressed Bayer channel, and scatter it into its position of each 2x2 block of the raw plane
+ * The buffer is scratch space for the decoded channel, pass the same one in every time to avoid allocations
+ */
+bool decodeBayerTile(tjhandle handle, const JpegTile &jpeg, size_t channel, std::vector<uint8_t> &buffer, uint8_t *plane, int cols, int rows);
+
+/**
+ * Layout of the sensor_msgs/CompressedImage we publish with the camera's own JPEG tiles of one head
+ *
+ * It is published on <image topic>/LADYBUG_JPEG_TRANSPORT, so image_transport subscribers can pick it up.
+ * The format field is LADYBUG_JPEG_FORMAT, then "; " and the Bayer encoding of the raw plane (e.g. "ladybug_jpeg8; bayer_grbg8"),
+ * messages without the encoding are RGGB. The data holds the four channel tiles of the head:
+ *   uint32 little-endian size of tile 0, 1, 2 and 3 (16 bytes)
+ *   the JPEG data of tile 0, 1, 2 and 3, one after the other
+ * Each tile is a grayscale JPEG of half the raw width and height, channel k holds the raw pixels
+ * at Bayer position (row k / 2, col k % 2) of every 2x2 block.
+ * Half-height heads have LADYBUG_JPEG_HALF_HEIGHT_FORMAT instead, their raw plane only has half of the sensor rows.
+ */
+const std::string LADYBUG_JPEG_FORMAT = "ladybug_jpeg8";
+const std::string LADYBUG_JPEG_HALF_HEIGHT_FORMAT = "ladybug_jpeg8_half_height";
+const std::string LADYBUG_JPEG_TRANSPORT = "ladybug_jpeg";
+const size_t LADYBUG_JPEG_HEADER_SIZE = 4 * LADYBUG_JPEG_CHANNELS;
+
+/**
+ * Pack the four tiles of a head into the data of a CompressedImage
+ */
+void packJpegTiles(const JpegTile tiles[LADYBUG_JPEG_CHANNELS], std::vector<uint8_t> &data);
+
+/**
+ * Find the four tiles of a head in the data of a CompressedImage, returns false if the data is malformed
+ */
+bool unpackJpegTiles(const std::vector<uint8_t> &data, JpegTile tiles[LADYBUG_JPEG_CHANNELS]);
+
+/**
+ * Decodes the per-channel JPEG tiles of an image back into six raw Bayer planes
+ * All 24 tiles are decoded in parallel on the worker pool, into buffers that are reused every frame
+ */
+class JpegDecoder
+{
+  public:
+    JpegDecoder();
+    ~JpegDecoder();
+
+    /**
+     * Decode the tiles of the heads in the mask, returns false if the buffer could not be decoded
+     * The planes of the other heads are left as they were
+     */
+    bool decode(const LadybugImage &image, WorkerPool &pool, uint32_t heads = LADYBUG_ALL_HEADS);
+
+    /**
+     * The decoded raw Bayer planes, one after the other just like the RAW8 format
+     */
+    const uint8_t *planes() const { return m_planes.data(); }
+    int cols() const { return m_cols; }
+    int rows() const { return m_rows; }
+
+  private:
+    JpegDecoder(const JpegDecoder &) = delete;
+    JpegDecoder &operator=(const JpegDecoder &) = delete;
+
+    // One decompressor and one decode buffer per tile, so tiles can be decoded concurrently
+    tjhandle m_handles[LADYBUG_JPEG_TILES];
+    std::vector<uint8_t> m_tileBuffers[LADYBUG_JPEG_TILES];
+
+    // The re-interleaved raw planes of all heads
+    std::vector<uint8_t> m_planes;
+    int m_cols, m_rows;
+};
+
+#endif // LADYBUG_JPEG_DECODER_H
@@ -1,11 +1,16 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <sstream>
 #include "ladybug.h"
 #include "ladybugstream.h"
 #include <stdexcept>
+#include <thread>
 #include <unistd.h>
-#include <signal.h>
 
 #include <ros/ros.h>
 #include <sensor_msgs/image_encodings.h>
@@ -19,195 +24,189 @@
 #include "opencv2/highgui/highgui.hpp"
 #include <opencv2/imgproc/imgproc.hpp>
 
-using namespace std;
-
-static volatile int running_ = 1;
+#include "camera_calibration.h"
+#include "data_format.h"
+#include "ladybug_driver.h"
+#include "ladybuggeom.h"
+#include "frame_file.h"
+#include "replay_backend.h"
+#include "sdk_backend.h"
+#include "synthetic_backend.h"
 
-LadybugContext m_context;
-LadybugDataFormat m_dataFormat;
-// camera config settings
-float m_frameRate, m_shutterTime, m_gainAmount;
-bool m_isFrameRateAuto, m_isShutterAuto, m_isGainAuto;
-int m_jpegQualityPercentage;
-
-ros::Publisher pub[LADYBUG_NUM_CAMERAS + 1];
+using namespace std;
 
 /**
- * Callback function when the user requests for shutdown
- * Will signal the main thread to stop grabbing frames
+ * This will get a pooled message ready to have an image of the given size written into it
+ * NOTE: recycled messages already have the right size, so this does not allocate or zero-fill
  */
-static void signalHandler(int)
+void prepareImage(sensor_msgs::Image &msg, uint32_t width, uint32_t height, const std::string &encoding, uint32_t pixel_size)
 {
-    ROS_INFO("Shutdown signal received!");
-    running_ = 0;
-    ros::shutdown();
+    msg.height = height;
+    msg.width = width;
+    msg.encoding = encoding;
+    msg.is_bigendian = 0;
+    msg.step = width * pixel_size;
+    msg.data.resize((size_t)msg.step * msg.height);
 }
 
 /**
- * Callback when we are loading camera parameter file
- * This will load all the camera K&D into into the camerainfo ROS message
+ * This function will publish a given image to the ROS communication framework
+ * The message is handed over as const, so intra-process subscribers get it with zero copies
  */
-void parseCameraInfo(const cv::Mat &camMat, const cv::Mat &disCoeff, const cv::Size &imgSize, sensor_msgs::CameraInfo &msg)
+void publishImage(ros::Time &timestamp, const sensor_msgs::ImagePtr &msg, ros::Publisher &image_pub, long int &count, size_t camid)
 {
 
     // Set the header
-    msg.header.frame_id = "camera";
-    msg.height = (uint32_t)imgSize.height;
-    msg.width = (uint32_t)imgSize.width;
+    msg->header.seq = (uint)count;
+    msg->header.frame_id = "camera" + std::to_string(camid);
+    msg->header.stamp = timestamp;
+
+    // Publish
+    image_pub.publish(sensor_msgs::ImageConstPtr(msg));
+}
 
-    // K matrix intrinsics
-    for (int row = 0; row < 3; row++)
+/**
+ * The sensor_msgs encoding of the published heads, for an output format and sample depth
+ */
+std::string outputEncoding(OutputFormat format, bool sixteen_bit)
+{
+    switch (format)
     {
-        for (int col = 0; col < 3; col++)
-        {
-            msg.K[row * 3 + col] = camMat.at<double>(row, col);
-        }
+    case OUTPUT_BGR:
+        return sixteen_bit ? sensor_msgs::image_encodings::BGR16 : sensor_msgs::image_encodings::BGR8;
+    case OUTPUT_MONO:
+        return sixteen_bit ? sensor_msgs::image_encodings::MONO16 : sensor_msgs::image_encodings::MONO8;
+    default:
+        return sixteen_bit ? sensor_msgs::image_encodings::RGB16 : sensor_msgs::image_encodings::RGB8;
     }
+}
 
-    // P matrix
-    for (int row = 0; row < 3; row++)
+/**
+ * Parse the output_encoding launch parameter, returns false if it is not one we can publish
+ */
+bool parseOutputEncoding(const std::string &encoding, OutputFormat &format, bool &sixteen_bit)
+{
+    const OutputFormat formats[] = {OUTPUT_RGB, OUTPUT_BGR, OUTPUT_MONO};
+    for (OutputFormat f : formats)
     {
-        for (int col = 0; col < 4; col++)
+        for (bool sixteen : {false, true})
         {
-            if (col == 3)
-            {
-                msg.P[row * 4 + col] = 0.0f;
-            }
-            else
+            if (encoding == outputEncoding(f, sixteen))
             {
-                msg.P[row * 4 + col] = camMat.at<double>(row, col);
+                format = f;
+                sixteen_bit = sixteen;
+                return true;
             }
         }
     }
-
-    // D distortion params
-    for (int row = 0; row < disCoeff.rows; row++)
-    {
-        for (int col = 0; col < disCoeff.cols; col++)
-        {
-            msg.D.push_back(disCoeff.at<double>(row, col));
-        }
-    }
+    return false;
 }
 
 /**
- * This will load the camera intrinsics from file
- * It will load it, parse it, and return the topic
+ * Read a number from a struct param, YAML gives whole numbers as ints
  */
-void GetMatricesFromFile(ros::NodeHandle nh, sensor_msgs::CameraInfo &camerainfo_msg, size_t cam_id)
+bool getNumber(XmlRpc::XmlRpcValue &value, const std::string &key, double &number)
 {
-
-    //////////////////CAMERA INFO/////////////////////////////////////////
-    cv::Mat cameraExtrinsicMat;
-    cv::Mat cameraMat;
-    cv::Mat distCoeff;
-    cv::Size imageSize;
-    std::string filename;
-
-    // Load the location of the calibration file
-    if (nh.getParam("calib_file_" + std::to_string(cam_id), filename) && filename != "")
-    {
-        ROS_INFO("Trying to parse calib_file_%d", (int)cam_id);
-        ROS_INFO("> %s", filename.c_str());
-    }
-    else
-    {
-        ROS_INFO("No calib_file_%d param was received, will not load", (int)cam_id);
-        return;
-    }
-
-    // Use opencv to load the file
-    cv::FileStorage fs(filename, cv::FileStorage::READ);
-    if (!fs.isOpened())
-    {
-        ROS_INFO("Cannot open %s", filename.c_str());
-        ;
-        return;
-    }
+    if (!value.hasMember(key))
+        return false;
+    XmlRpc::XmlRpcValue &member = value[key];
+    if (member.getType() == XmlRpc::XmlRpcValue::TypeInt)
+        number = (int)member;
+    else if (member.getType() == XmlRpc::XmlRpcValue::TypeDouble)
+        number = (double)member;
     else
-    {
-        fs["CameraMat"] >> cameraMat;
-        fs["DistCoeff"] >> distCoeff;
-        fs["ImageSize"] >> imageSize;
-    }
-
-    // Finally, parse the yaml file!
-    parseCameraInfo(cameraMat, distCoeff, imageSize, camerainfo_msg);
+        return false;
+    return true;
 }
 
 /**
- * This function will publish a given image to the ROS communication framework
+ * Read a list param of count numbers, returns false if it is not set or has the wrong length
  */
-void publishImage(ros::Time &timestamp, cv::Mat &image, ros::Publisher &image_pub, long int &count, size_t camid)
+bool getNumbers(ros::NodeHandle &nh, const std::string &name, double *numbers, size_t count)
 {
-
-    // Create the message
-    sensor_msgs::Image msg;
-    msg.header.seq = (uint)count;
-    msg.header.frame_id = "camera" + std::to_string(camid);
-    msg.header.stamp = timestamp;
-    msg.height = (uint)image.size().height;
-    msg.width = (uint)image.size().width;
-    msg.encoding = "rgb8";
-    msg.step = (uint)(image.cols * image.elemSize());
-    size_t image_size = image.rows * image.cols * image.elemSize();
-
-    // Copy the actual image data
-    msg.data.resize(image_size);
-    memcpy(msg.data.data(), image.data, image_size);
-
-    // Publish
-    image_pub.publish(msg);
+    std::vector<double> list;
+    if (!nh.getParam(name, list))
+        return false;
+    if (list.size() != count)
+    {
+        ROS_WARN("Ladybug %s must be a list of %d numbers, ignoring it", name.c_str(), (int)count);
+        return false;
+    }
+    std::copy(list.begin(), list.end(), numbers);
+    return true;
 }
 
 /**
- * This will use the ladybug SDK to initalize the camera
- * We need to first create the context, and detect the cameras attached
- * We then load the properties of the camera and initialize the communication
+ * This will create the camera backend and initalize the camera
+ * The SDK backend detects the cameras attached and initializes the communication with the first one
+ * We then print the properties of the camera and load the defaults for its model
  */
-LadybugError init_camera()
+LadybugError LadybugDriver::init_camera()
 {
 
-    // Create the SDK context
-    LadybugError error;
-    error = ladybugCreateContext(&m_context);
-    if (error != LADYBUG_OK)
-    {
-        throw std::runtime_error("Unable to create Ladybug context.");
-    }
-
-    // Here we want to get the number of cameras this sensor has
-    LadybugCameraInfo enumeratedCameras[16];
-    unsigned int numCameras = 16;
-    error = ladybugBusEnumerateCameras(m_context, enumeratedCameras, &numCameras);
-    if (error != LADYBUG_OK)
+    // Pick where the images come from, a real camera, a synthetic one for testing without hardware, or a recording
+    std::string backend;
+    m_privateNh.param<std::string>("backend", backend, "sdk");
+    if (backend == "replay")
     {
-        return error;
+        ReplayConfig config;
+        int start_frame, max_locked, bayer_frames = 0, record_pinned = 0;
+        bool bayer = false, record = false;
+        m_privateNh.param<std::string>("replay_file", config.path, "");
+        m_privateNh.param<double>("replay_rate", config.rate, 1.0);
+        m_privateNh.param<bool>("replay_loop", config.loop, false);
+        m_privateNh.param<int>("replay_start", start_frame, 0);
+        m_privateNh.param<bool>("replay_use_recorded_time", config.use_recorded_time, true);
+        m_privateNh.param<int>("ring_size", max_locked, 4);
+        m_privateNh.param<bool>("bayer", bayer, false);
+        if (bayer)
+            m_privateNh.param<int>("bayer_max_frames", bayer_frames, 2);
+        m_privateNh.param<bool>("record", record, false);
+        if (record)
+            m_privateNh.param<int>("record_max_pinned", record_pinned, 2);
+        config.start_frame = (size_t)std::max(0, start_frame);
+        config.max_locked = (size_t)std::max(1, max_locked) + 1 + (size_t)std::max(0, bayer_frames) + (size_t)std::max(0, record_pinned);
+        m_backend.reset(new ReplayBackend(config));
     }
-    ROS_INFO("%d cameras detected", numCameras);
-
-    // If we where not able to load any cameras, then error
-    // NOTE: Need to at least have one camera...
-    if (numCameras == 0)
+    else if (backend == "synthetic")
     {
-        ROS_ERROR("Insufficient number of cameras detected. ");
-        return LADYBUG_FAILED;
+        SyntheticConfig config;
+        int num_buffers, seed;
+        std::string pattern;
+        m_privateNh.param<int>("synthetic_cols", config.cols, 2048);
+        m_privateNh.param<int>("synthetic_rows", config.rows, 2448);
+        m_privateNh.param<int>("synthetic_buffers", num_buffers, 8);
+        m_privateNh.param<double>("synthetic_jitter", config.jitter, 0.0);
+        m_privateNh.param<double>("synthetic_error_rate", config.error_rate, 0.0);
+        m_privateNh.param<int>("synthetic_seed", seed, 0);
+        m_privateNh.param<std::string>("synthetic_pattern", pattern, "rggb");
+        config.num_buffers = (size_t)std::max(1, num_buffers);
+        config.seed = (unsigned int)seed;
+        config.stippled_format = LADYBUG_DEFAULT;
+        for (LadybugStippledFormat format : {LADYBUG_BGGR, LADYBUG_GBRG, LADYBUG_GRBG, LADYBUG_RGGB})
+        {
+            if (bayerEncoding(format, 8) == "bayer_" + pattern + "8")
+                config.stippled_format = format;
+        }
+        if (config.stippled_format == LADYBUG_DEFAULT)
+        {
+            ROS_WARN("Ladybug synthetic_pattern must be rggb, grbg, gbrg or bggr. Defaulting to rggb");
+            config.stippled_format = LADYBUG_RGGB;
+        }
+        m_backend.reset(new SyntheticBackend(config));
     }
-
-    // Finally, lets initalize!
-    error = ladybugInitializeFromIndex(m_context, 0);
-    if (error != LADYBUG_OK)
+    else
     {
-        return error;
+        m_backend.reset(new SdkBackend());
     }
 
-    // Get the camera information about the connected device
-    LadybugCameraInfo camInfo;
-    error = ladybugGetCameraInfo(m_context, &camInfo);
+    // Connect to it, and get the camera information about the connected device
+    LadybugError error = m_backend->connect(m_cameraInfo);
     if (error != LADYBUG_OK)
     {
         return error;
     }
+    const LadybugCameraInfo &camInfo = m_cameraInfo;
 
     // Bunch of maps between the enums of the SDK and strings
     // This allows for nice printing of the properties of the sensor for debug
@@ -300,241 +299,1637 @@ LadybugError init_camera()
 
 /**
  * This will configure the camera with our parameters, and start the actual stream
- * We will set the framerate, and JPEG quality here...
  */
-LadybugError start_camera()
+LadybugError LadybugDriver::start_camera()
 {
+    CameraSettings settings;
+    settings.data_format = m_dataFormat;
+    settings.frame_rate = m_frameRate;
+    settings.is_frame_rate_auto = m_isFrameRateAuto;
+    settings.shutter_time = m_shutterTime;
+    settings.is_shutter_auto = m_isShutterAuto;
+    settings.gain_amount = m_gainAmount;
+    settings.is_gain_auto = m_isGainAuto;
+    settings.jpeg_quality = m_jpegQualityPercentage;
+    return m_backend->start(settings);
+}
 
-    // Start the camera in the "lock" mode where we can unlock and lock to get the image
-    LadybugError error;
-    error = ladybugStartLockNext(m_context, m_dataFormat);
-    if (error != LADYBUG_OK)
-    {
-        return error;
-    }
-
-    // Set the framerate of the camera
-    ROS_INFO("CONFIG: setting framerate of %d (auto = %d)", (int)m_frameRate, (int)m_isFrameRateAuto);
-    error = ladybugSetAbsPropertyEx(m_context, LADYBUG_FRAME_RATE, false, true, m_isFrameRateAuto, m_frameRate);
-    if (error != LADYBUG_OK)
-    {
-        return error;
-    }
-
-    // Set the shutter/exposure of the camera
-    ROS_INFO("CONFIG: setting shutter time of %.3f (auto = %d)", m_shutterTime, (int)m_isShutterAuto);
-    error = ladybugSetAbsPropertyEx(m_context, LADYBUG_SHUTTER, false, true, m_isShutterAuto, m_shutterTime);
-    if (error != LADYBUG_OK)
-    {
-        return error;
-    }
-
-    // Set the gain of the camera
-    ROS_INFO("CONFIG: setting gain db of %d (auto = %d)", (int)m_gainAmount, (int)m_isGainAuto);
-    error = ladybugSetAbsPropertyEx(m_context, LADYBUG_GAIN, false, true, m_isGainAuto, m_gainAmount);
-    if (error != LADYBUG_OK)
-    {
-        return error;
-    }
-
-    // Set the JPEG quality of the image
-    ROS_INFO("CONFIG: setting jpeg quality of %d", (int)m_jpegQualityPercentage);
-    error = ladybugSetJPEGQuality(m_context, m_jpegQualityPercentage);
-    if (error != LADYBUG_OK)
-    {
-        return error;
-    }
-
-    // Perform a quick test to make sure images can be successfully acquired
-    ROS_INFO("Testing that images can be acquired..");
-    for (int i = 0; i < 5; i++)
-    {
-        LadybugImage tempImage;
-        error = ladybugLockNext(m_context, &tempImage);
-        ROS_INFO("\t- got image %d", i + 1);
-    }
-    ROS_INFO("Testing successful! All good to stream!");
-
-    // Unlock all the images we have
-    error = ladybugUnlockAll(m_context);
-    if (error != LADYBUG_OK)
-    {
-        return error;
-    }
+/**
+ * Get the next image
+ */
+LadybugError LadybugDriver::acquire_image(LadybugImage &image)
+{
+    return m_backend->lockNext(image);
+}
 
-    // Done, return the error if we had one
-    return error;
+/**
+ * Unlock the old image
+ */
+LadybugError LadybugDriver::unlock_image(unsigned int bufferIndex)
+{
+    return m_backend->unlock(bufferIndex);
 }
 
 /**
- * Stop the camera context on program exit
+ * Grab thread, this keeps locking new buffers from the SDK and hands them to processing
+ * If processing has fallen behind and the ring is full, the new buffer is dropped right away
+ * This keeps the SDK from running out of buffers, so the camera itself does not drop frames
  */
-LadybugError stop_camera()
+void LadybugDriver::grab_loop()
 {
-    const LadybugError cameraError = ladybugStop(m_context);
-    if (cameraError != LADYBUG_OK)
+    while (m_running && ros::ok())
     {
-        ROS_ERROR("Error: Unable to stop camera (%s)", ladybugErrorToString(cameraError));
+
+        // Aquire a new image from the device
+        LockedFrame frame;
+        const auto acquire_start = std::chrono::steady_clock::now();
+        const LadybugError acquisitionError = acquire_image(frame.image);
+        if (acquisitionError != LADYBUG_OK)
+        {
+            ROS_WARN("Failed to acquire image. Error (%s). Trying to continue..", ladybugErrorToString(acquisitionError));
+            continue;
+        }
+        frame.stamp = ros::Time::now();
+        frame.lock_time = std::chrono::steady_clock::now();
+        frame.camera_stamp = false;
+        if (m_timing.enabled())
+            m_timing.record(STAGE_ACQUIRE, acquire_start, frame.lock_time);
+
+        // Replace the host stamp with the camera's own clock mapped onto ROS time
+        // NOTE: the fitted stamp still contains the average transfer latency, the clock sync subtracts the offset param for it
+        if (m_backend->recordedStamp(frame.image, frame.stamp))
+        {
+            // Replayed frames keep the stamp they were recorded with
+        }
+        else if (m_useCameraTime)
+        {
+            frame.stamp = m_clockSync.update(frame.image.timeStamp, frame.stamp);
+            frame.camera_stamp = true;
+        }
+        m_ringStats.grabbed++;
+
+        // Queue it for recording, this never waits on the disk
+        // Up to record_max_pinned frames the recorder shares a hold on the buffer and its writer copies the image,
+        // past that it is copied right here
+        // NOTE: this is before the ring, so frames that processing drops are still recorded
+        QueuedFrame queued;
+        queued.frame = frame;
+        if (m_recorder && m_recorder->canPin())
+        {
+            queued.hold = std::make_shared<FrameHold>(frame, m_releaseQueue);
+            m_recorder->push(queued.hold, frame.stamp);
+        }
+        else if (m_recorder)
+        {
+            m_recorder->push(frame.image, frame.stamp);
+        }
+
+        // Hand it off to processing, or give the buffer back if there is no room
+        // A frame with a hold is unlocked by processing, once the recorder is done with it too
+        if (!m_ring->push(queued))
+        {
+            if (queued.hold)
+                queued.hold.reset();
+            else
+                unlock_image(frame.image.uiBufferIndex);
+            m_ringStats.dropped++;
+            continue;
+        }
+        m_ringStats.recordDepth(m_ring->size());
     }
-    return cameraError;
 }
 
 /**
- * Get the next image
+ * Processing thread, this takes locked buffers from the ring and publishes all the heads
+ * Each frame is spread over the worker lanes, and we join on them before unlocking the buffer
  */
-LadybugError acquire_image(LadybugImage &image)
+void LadybugDriver::process_loop()
 {
-    return ladybugLockNext(m_context, &image);
+    long int count = 0;
+    while (m_running && ros::ok())
+    {
+
+        // Get the oldest locked buffer, or sleep until the grab thread pushes one
+        // Subscribers may let go of Bayer images of older frames meanwhile, so wake up every so often to unlock those too
+        QueuedFrame queued;
+        if (!m_ring->pop(queued))
+        {
+            release_frames();
+            m_ring->wait(std::chrono::milliseconds(5));
+            continue;
+        }
+
+        // Publish everything for this frame, with the hold the recorder shares if it has one
+        // NOTE: the hold is dropped right after, so unless a message or the recorder still holds the buffer it is unlocked below
+        const LockedFrame &frame = queued.frame;
+        const bool timing = m_timing.enabled();
+        const auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<FrameHold> hold = queued.hold ? std::move(queued.hold) : std::make_shared<FrameHold>(frame, m_releaseQueue);
+        process_frame(hold, count);
+        hold.reset();
+        const auto end = std::chrono::steady_clock::now();
+
+        // Unlock the image buffers that nothing holds anymore, normally just this one
+        // NOTE: buffers are given back by index, so this does not need to match the lock order
+        release_frames();
+        if (timing)
+        {
+            m_timing.record(STAGE_QUEUE, frame.lock_time, start);
+            m_timing.record(STAGE_PROCESS, start, end);
+            m_timing.record(STAGE_UNLOCK, end, std::chrono::steady_clock::now());
+            if (frame.camera_stamp)
+            {
+                const double latency = (ros::Time::now() - frame.stamp).toSec();
+                m_timing.recordUs(STAGE_END_TO_END, (uint64_t)(1e6 * std::max(0.0, latency)));
+            }
+        }
+        m_ringStats.processed++;
+
+        // Let the adaptive controller see how long this frame took and how far behind we are
+        if (m_rateController)
+        {
+            m_rateController->recordFrame(std::chrono::duration<double>(end - start).count(), m_ring->size(), m_ring->capacity());
+            if (m_pendingTables.valid())
+                m_rateController->hold(end, m_ringStats.dropped.load());
+            else if (m_rateController->update(end, m_ringStats.dropped.load()))
+                apply_rate_control();
+        }
+
+        // Debug print the ring state every so often
+        ROS_INFO_THROTTLE(10, "Ring: depth %d/%d (max %d), grabbed %d, processed %d, dropped %d, avg hold %.1f ms (max %.1f ms)",
+                          (int)m_ring->size(), (int)m_ring->capacity(), (int)m_ringStats.max_depth.load(), (int)m_ringStats.grabbed.load(),
+                          (int)m_ringStats.processed.load(), (int)m_ringStats.dropped.load(),
+                          1e-3 * m_ringStats.hold_time_total_us.load() / std::max<uint64_t>(1, m_ringStats.processed.load()),
+                          1e-3 * m_ringStats.hold_time_max_us.load());
+        m_diagnostics.update();
+        count++;
+    }
 }
 
 /**
- * Unlock the old image
+ * Unlock every buffer whose last hold is gone, and track how long it was held
  */
-LadybugError unlock_image(unsigned int bufferIndex)
+void LadybugDriver::release_frames()
 {
-    return ladybugUnlock(m_context, bufferIndex);
+    m_releaseQueue->take(m_released);
+    for (const LockedFrame &frame : m_released)
+    {
+        unlock_image(frame.image.uiBufferIndex);
+        m_ringStats.recordHoldTime((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - frame.lock_time).count());
+    }
 }
 
 /**
- * Main method, that will startup the camera
- * This will also make all the ROS publishers needed
+ * Process and publish all the heads of a single locked frame
  */
-int main(int argc, char **argv)
+void LadybugDriver::process_frame(const std::shared_ptr<FrameHold> &hold, long int count)
 {
-    ////ROS STUFF
-    ros::init(argc, argv, "ladybug_camera");
-    ros::NodeHandle n;
-    ros::NodeHandle private_nh("~");
+    const LockedFrame &frame = hold->frame();
+    const LadybugImage &currentImage = frame.image;
 
-    // set our callback for closing
-    signal(SIGTERM, signalHandler);
+    // Current timestamp of this image, taken when it was locked
+    ros::Time timestamp = frame.stamp;
 
-    // Initialize ladybug camera
-    const LadybugError grabberInitError = init_camera();
-    if (grabberInitError != LADYBUG_OK)
+    // Heads that someone is subscribed to, nothing is computed for the others
+    // The lock is only held for the copy, so the connect callbacks and add_view do not wait for a whole frame
+    WatchedOutputs watched;
     {
-        ROS_FATAL("Error: Failed to initialize camera (%s). Terminating...", ladybugErrorToString(grabberInitError));
-        ladybugDestroyContext(&m_context);
-        return EXIT_FAILURE;
+        std::lock_guard<std::mutex> view_lock(m_viewMutex);
+        watched = m_watched;
+        m_frameViews.clear();
+        m_watchedViews.clear();
+        for (const auto &view : m_views)
+        {
+            m_frameViews.push_back(view.get());
+            if (view->subscribed)
+                m_watchedViews.push_back(view.get());
+        }
     }
+    const uint32_t raw_heads = watched.raw;
 
-    // Read in how much we should scale each image by
-    int image_scale = 100;
-    if (private_nh.getParam("scale", image_scale) && image_scale > 0 && image_scale <= 100)
+    // The pass-through outputs go first, they do not need anything else
+    if (isJpegFormat(currentImage.dataFormat) && watched.jpeg)
     {
-        ROS_INFO("Ladybug ImageScale > %i%%", image_scale);
+        publish_jpeg_tiles(currentImage, timestamp, count, watched.jpeg);
     }
-    else
+    sensor_msgs::ImagePtr unpacked[LADYBUG_NUM_CAMERAS];
+    if (!isJpegFormat(currentImage.dataFormat) && watched.bayer)
     {
-        ROS_WARN("Ladybug ImageScale scale must be (0,100]. Defaulting to 20 ");
-        image_scale = 20;
+        publish_bayer(hold, count, watched.bayer, unpacked);
     }
 
-    // Read in our launch parameters
-    private_nh.param<int>("jpeg_percent", m_jpegQualityPercentage, m_jpegQualityPercentage);
-    private_nh.param<float>("framerate", m_frameRate, m_frameRate);
-    private_nh.param<bool>("use_auto_framerate", m_isFrameRateAuto, m_isFrameRateAuto);
-    private_nh.param<float>("shutter_time", m_shutterTime, m_shutterTime);
-    private_nh.param<bool>("use_auto_shutter_time", m_isShutterAuto, m_isShutterAuto);
-    private_nh.param<float>("gain_amount", m_gainAmount, m_gainAmount);
-    private_nh.param<bool>("use_auto_gain", m_isGainAuto, m_isGainAuto);
-
-    // Get the ladybug camera information, also show the debug
-    LadybugCameraInfo camInfo;
-    if (LADYBUG_OK != ladybugGetCameraInfo(m_context, &camInfo))
+    // Heads the watched views sample, these are only demosaiced where the views look
+    // A watched view without a table needs the kernel first, so that frame decodes all heads
+    uint32_t view_heads = 0;
+    for (View *view : m_watchedViews)
     {
-        ROS_ERROR("Error: Failed to get camera information. Terminating...");
-        ladybugDestroyContext(&m_context);
-        return EXIT_FAILURE;
+        if (view->table)
+            view_heads |= view->table->heads();
+        else if (!view->built)
+            view_heads = LADYBUG_ALL_HEADS;
     }
-
-    // Start the camera!
-    const LadybugError startError = start_camera();
-    if (startError != LADYBUG_OK)
+    if (!raw_heads && !view_heads)
     {
-        ROS_ERROR("Error: Failed to start camera (%s). Terminating...", ladybugErrorToString(startError));
-        ladybugDestroyContext(&m_context);
-        return EXIT_FAILURE;
+        return;
     }
 
-    // Get the camera information
-    ///////calibration data
-    //sensor_msgs::CameraInfo camerainfo_msg;
-    //GetMatricesFromFile(private_nh, camerainfo_msg);
-    //ros::Publisher camera_info_pub = n.advertise<sensor_msgs::CameraInfo>("/camera/camera_info", 1, true);
+    // Raw Bayer planes of all the heads, one after the other
+    // If the camera sends JPEG tiles, then we decode the ones of the watched heads back into raw planes
+    const bool timing = m_timing.enabled();
+    const uint8_t *rawPlanes = currentImage.pData;
+    const int bits = rawSampleBits(currentImage.dataFormat);
+    const bool half_height = isHalfHeightFormat(currentImage.dataFormat);
+    cv::Size size(currentImage.uiFullCols, currentImage.uiFullRows);
+    int plane_rows = size.height;
+    if (isJpegFormat(currentImage.dataFormat))
+    {
+        const auto decode_start = std::chrono::steady_clock::now();
+        if (!m_jpegDecoder.decode(currentImage, *m_pool, raw_heads | view_heads))
+            return;
+        rawPlanes = m_jpegDecoder.planes();
+        plane_rows = m_jpegDecoder.rows();
+        size = cv::Size(m_jpegDecoder.cols(), half_height ? 2 * plane_rows : plane_rows);
+        if (timing)
+            m_timing.record(STAGE_DECODE, decode_start, std::chrono::steady_clock::now());
+    }
+    else
+    {
+        rawPlaneRows(currentImage, size.height, plane_rows);
+    }
 
-    // Create the publishers
-    ROS_INFO("Successfully started ladybug camera and stream");
-    for (int i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    // Tables of a new scale from the adaptive controller are built off this thread, swap them in once they are ready
+    // Until then the old ones keep publishing at the old scale, so a step never stalls processing for the whole rebuild
+    const BayerPattern pattern = bayerPattern(currentImage.stippledFormat);
+    const auto sameSensor = [&](const BayerKernel &kernel) {
+        return kernel.src_cols() == size.width && kernel.src_rows() == size.height && kernel.half_height() == half_height &&
+               kernel.pattern() == pattern;
+    };
+    // The tables from the SDK are only built here, at the swap, since the grab thread uses the context while the others are built
+    if (m_pendingTables.valid() && m_pendingTables.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
     {
-        std::string topic = "/ladybug/camera" + std::to_string(i) + "/image_raw";
-        pub[i] = n.advertise<sensor_msgs::Image>(topic, 100);
-        ROS_INFO("Publishing.. %s", topic.c_str());
+        std::unique_ptr<KernelTables> tables = m_pendingTables.get();
+        if (m_kernel && sameSensor(*tables->kernel))
+        {
+            finish_tables(*tables);
+            ROS_INFO("Switched to %dx%d images at %.1f%%", tables->kernel->out_cols(), tables->kernel->out_rows(), tables->kernel->scale());
+            install_tables(std::move(tables));
+        }
     }
 
-    // Start camera polling loop
-    ros::Rate loop_rate(m_frameRate);
-    long int count = 0;
-    while (running_ && ros::ok())
+    // Builds for an old sensor are dropped once they are done, std::future would otherwise wait for them when it goes away
+    m_droppedTables.erase(std::remove_if(m_droppedTables.begin(), m_droppedTables.end(),
+                                         [](const std::future<std::unique_ptr<KernelTables>> &build) {
+                                             return build.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+                                         }),
+                          m_droppedTables.end());
+
+    // Size of the sensor, rebuild our kernel if this has changed
+    // NOTE: the kernel tables depend on the sensor size, so they are built on the first frame, here and all at once
+    // A tables build that is still running for the old sensor is left to finish with the falloff map it has, and dropped
+    // Half-height planes are stretched back to the sensor size, so the calibration, rectifiers and panorama stay as they are
+    // The CFA order is a template parameter of the kernel, so it is only picked here and not per pixel
+    if (!m_kernel || !sameSensor(*m_kernel) || (!m_pendingTables.valid() && m_kernel->scale() != m_imageScale))
+    {
+        if (m_pendingTables.valid())
+            m_droppedTables.push_back(std::move(m_pendingTables));
+        update_falloff_map(size.width, size.height, pattern);
+        install_tables(build_tables(size.width, size.height, m_imageScale, half_height, pattern, m_watchedViews,
+                                    m_falloff ? m_falloffMap : nullptr, true));
+        ROS_INFO("Raw heads are %dx%d%s %s, publishing %dx%d images", size.width, plane_rows, half_height ? " (half-height)" : "",
+                 bayerEncoding(currentImage.stippledFormat, bits).c_str(), m_kernel->out_cols(), m_kernel->out_rows());
+    }
+    const uint32_t rect_heads = watched.rect;
+    sensor_msgs::ImagePtr images[LADYBUG_NUM_CAMERAS];
+
+    // Now that the kernel is known, the views can tell which heads they really need
+    // Heads that were not decoded for this frame can not be used by the views
+    update_views();
+    const uint32_t decoded_heads = isJpegFormat(currentImage.dataFormat) ? (raw_heads | view_heads) : LADYBUG_ALL_HEADS;
+    view_heads = 0;
+    for (View *view : m_watchedViews)
     {
+        if (view->table)
+            view_heads |= view->table->heads();
+    }
+    view_heads &= decoded_heads;
+
+    // RAW12 heads get unpacked into their own plane of 16-bit samples
+    const size_t plane_pixels = (size_t)size.width * plane_rows;
+    if (bits == 12)
+        m_unpacked.resize(LADYBUG_NUM_CAMERAS * plane_pixels);
+
+    // List of the heads we need to process
+    size_t heads[LADYBUG_NUM_CAMERAS];
+    size_t num_heads = 0;
+    const uint32_t kernel_heads = kernelHeads(watched, view_heads, decoded_heads);
+    for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    {
+        if (kernel_heads & (1u << i))
+            heads[num_heads++] = i;
+    }
 
-        // Aquire a new image from the device
-        LadybugImage currentImage;
-        const LadybugError acquisitionError = acquire_image(currentImage);
-        if (acquisitionError != LADYBUG_OK)
+    // A requested auto white balance is measured on the raw planes of this frame, each head adds up its own channels
+    const bool white_balance = m_whiteBalancePending.exchange(false);
+    double wb_sums[LADYBUG_NUM_CAMERAS][3] = {};
+    size_t wb_counts[LADYBUG_NUM_CAMERAS] = {};
+
+    // For each of the watched cameras, publish to ROS
+    // NOTE: each head is handled by its own lane, and we join before unlocking
+    m_pool->run(num_heads, [&](size_t j) {
+        const size_t i = heads[j];
+        if (!ros::ok())
+            return;
+
+        // Get a recycled message to write this head into
+        // NOTE: the stages are timed per head, so the clock is only read when timing is on
+        PipelineTiming::Clock::time_point t0, t1, t2;
+        if (timing)
+            t0 = PipelineTiming::Clock::now();
+        sensor_msgs::ImagePtr msg = m_imagePool[i].acquire();
+
+        // Raw plane of this head, RAW16 is used in place and RAW12 is unpacked into 16-bit samples first
+        // If the Bayer output already unpacked this head, we read the samples from its message
+        const uint8_t *rawImage = rawPlanes + i * plane_pixels * bits / 8;
+        const uint16_t *rawSamples = (bits == 16) ? reinterpret_cast<const uint16_t *>(rawImage) : nullptr;
+        if (bits == 12 && unpacked[i])
         {
-            ROS_WARN("Failed to acquire image. Error (%s). Trying to continue..", ladybugErrorToString(acquisitionError));
-            continue;
+            rawSamples = reinterpret_cast<const uint16_t *>(unpacked[i]->data.data());
         }
+        else if (bits == 12)
+        {
+            uint16_t *samples = m_unpacked.data() + i * plane_pixels;
+            unpackRaw12(rawImage, samples, plane_pixels);
+            rawSamples = samples;
+            if (timing)
+            {
+                t1 = PipelineTiming::Clock::now();
+                m_timing.record(STAGE_DECODE, t0, t1, i);
+                t0 = t1;
+            }
+        }
+        if (white_balance && rawSamples)
+            sumBayerChannels(rawSamples, size.width, plane_rows, pattern, 8, 250 << 8, wb_sums[i], wb_counts[i]);
+        else if (white_balance)
+            sumBayerChannels(rawImage, size.width, plane_rows, pattern, 8, 250, wb_sums[i], wb_counts[i]);
 
-        // Convert to OpenCV Mat
-        // NOTE: receive Bayer Image, convert to Color 3 channels
-        cv::Size size(currentImage.uiFullCols, currentImage.uiFullRows);
-
-        // Current timestamp of this image
-        ros::Time timestamp = ros::Time::now();
+        // Heads only the views need are not published, so only the blocks the views sample are demosaiced
+        if (!(raw_heads & (1u << i)))
+        {
+            demosaic_head(i, rawImage, rawSamples, &m_viewBlocks[i], *msg);
+            if (timing)
+                m_timing.record(STAGE_DEMOSAIC, t0, PipelineTiming::Clock::now(), i);
+            images[i] = msg;
+            return;
+        }
 
-        // For each of the cameras, publish to ROS
-        for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+        // Demosaic the raw Bayer image into RGB, scale it, and correct for it being side-ways
+        // NOTE: this is a single pass that replaces cvtColor with the Bayer code of the head's CFA order, resize, transpose and flip
+        demosaic_head(i, rawImage, rawSamples, nullptr, *msg);
+        if (timing)
         {
-            if (!ros::ok())
-                continue;
+            t1 = PipelineTiming::Clock::now();
+            m_timing.record(STAGE_DEMOSAIC, t0, t1, i);
+        }
 
-            // Debug print outs
-            // ROS_INFO("image time %.5f",currentImage.timeStamp.ulSeconds+1e-6*currentImage.timeStamp.ulMicroSeconds);
+        // Publish the current image, and its calibration with the same stamp
+        // NOTE: the recycled message already holds a copy, so assigning the cached one does not allocate
+        publishImage(timestamp, msg, m_pub[i], count, i);
+        if (m_headInfo[i])
+        {
+            sensor_msgs::CameraInfoPtr info = m_infoPool[i].acquire();
+            *info = *m_headInfo[i];
+            info->header.seq = (uint)count;
+            info->header.stamp = timestamp;
+            m_infoPub[i].publish(sensor_msgs::CameraInfoConstPtr(info));
+        }
+        if (timing)
+        {
+            t2 = PipelineTiming::Clock::now();
+            m_timing.record(STAGE_PUBLISH, t1, t2, i);
+        }
 
-            // Get the raw image, and convert it into the standard RGB image type
-            cv::Mat rawImage(size, CV_8UC1, currentImage.pData + (i * size.width * size.height));
-            cv::Mat image(size, CV_8UC3);
-            cv::cvtColor(rawImage, image, cv::COLOR_BayerBG2RGB);
+        // Undistort the image we just demosaiced with the precomputed table of this head
+        if ((rect_heads & (1u << i)) && m_rectifier[i])
+        {
+            sensor_msgs::ImagePtr rect = m_rectPool[i].acquire();
+            prepareImage(*rect, m_rectifier[i]->cols(), m_rectifier[i]->rows(), sensor_msgs::image_encodings::RGB8, 3);
+            m_rectifier[i]->remap(msg->data.data(), msg->step, rect->data.data(), rect->step);
+            publishImage(timestamp, rect, m_rectPub[i], count, i);
+            if (timing)
+                m_timing.record(STAGE_RECTIFY, t2, PipelineTiming::Clock::now(), i);
+        }
+        images[i] = msg;
+    });
+    if (white_balance)
+        apply_white_balance(wb_sums, wb_counts);
+
+    // Sources for stitching, the images we just published and the partly demosaiced heads of the views
+    const uint8_t *sources[LADYBUG_NUM_CAMERAS];
+    uint32_t source_heads = 0;
+    for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    {
+        sources[i] = images[i] ? images[i]->data.data() : nullptr;
+        if (images[i])
+            source_heads |= (1u << i);
+    }
+    const size_t source_step = (size_t)m_kernel->out_cols() * 3;
 
-            // Resize the image based on the specified amount
-            cv::resize(image, image, cv::Size(size.width * image_scale / 100, size.height * image_scale / 100));
+    // Stitch the panorama from the images we just published, in blocks of rows spread over the lanes
+    const auto stitch_start = timing ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    bool stitched = false;
+    const int block_rows = 32;
+    if (watched.pano && m_panorama && (raw_heads & source_heads) == LADYBUG_ALL_HEADS)
+    {
+        sensor_msgs::ImagePtr pano = m_panoPool.acquire();
+        prepareImage(*pano, m_panorama->cols(), m_panorama->rows(), sensor_msgs::image_encodings::RGB8, 3);
+        const int rows = m_panorama->rows();
+        m_pool->run((size_t)((rows + block_rows - 1) / block_rows), [&](size_t b) {
+            const int r0 = (int)b * block_rows;
+            m_panorama->render(sources, source_step, pano->data.data(), pano->step, r0, std::min(r0 + block_rows, rows));
+        });
+        pano->header.seq = (uint)count;
+        pano->header.frame_id = "ladybug";
+        pano->header.stamp = timestamp;
+        m_panoPub.publish(sensor_msgs::ImageConstPtr(pano));
+        stitched = true;
+    }
 
-            // By default the image is side-ways, so correct for this
-            cv::transpose(image, image);
-            cv::flip(image, image, 1);
+    // Render every watched view whose heads we have, the same way
+    for (View *view : m_watchedViews)
+    {
+        if (!view->table || (view->table->heads() & ~source_heads))
+            continue;
+        sensor_msgs::ImagePtr msg = view->pool.acquire();
+        prepareImage(*msg, view->cols, view->rows, sensor_msgs::image_encodings::RGB8, 3);
+        m_pool->run((size_t)((view->rows + block_rows - 1) / block_rows), [&](size_t b) {
+            const int r0 = (int)b * block_rows;
+            view->table->render(sources, source_step, msg->data.data(), msg->step, r0, std::min(r0 + block_rows, view->rows));
+        });
+        msg->header.seq = (uint)count;
+        msg->header.frame_id = view->name;
+        msg->header.stamp = timestamp;
+        view->pub.publish(sensor_msgs::ImageConstPtr(msg));
+        sensor_msgs::CameraInfoPtr info = view->info_pool.acquire();
+        *info = *view->info;
+        info->header.seq = (uint)count;
+        info->header.stamp = timestamp;
+        view->info_pub.publish(sensor_msgs::CameraInfoConstPtr(info));
+        stitched = true;
+    }
+    if (timing && stitched)
+        m_timing.record(STAGE_STITCH, stitch_start, std::chrono::steady_clock::now());
+}
 
-            // Publish the current image!
-            // TODO: also publish the camera info here too!
-            publishImage(timestamp, image, pub[i], count, i);
-        }
+/**
+ * Demosaic one head with the current kernel, into the encoding we publish for the data format
+ */
+void LadybugDriver::demosaic_head(size_t i, const uint8_t *raw, const uint16_t *samples, const std::vector<uint8_t> *blocks, sensor_msgs::Image &msg)
+{
+    const uint32_t channels = (uint32_t)m_kernel->channels();
+    const FalloffTiles *falloff = m_falloffTiles[i].get();
+    const std::shared_ptr<const ColorCorrection> color_ref = std::atomic_load(&m_color[i]);
+    const ColorCorrection *color = color_ref.get();
+    if (samples == nullptr)
+    {
+        prepareImage(msg, m_kernel->out_cols(), m_kernel->out_rows(), outputEncoding(m_outputFormat, false), channels);
+        if (blocks)
+            m_kernel->process(raw, msg.data.data(), msg.step, *blocks, falloff, color);
+        else
+            m_kernel->process(raw, msg.data.data(), msg.step, falloff, color);
+    }
+    else if (m_output16)
+    {
+        // NOTE: nothing samples 16-bit images, so these are always whole
+        prepareImage(msg, m_kernel->out_cols(), m_kernel->out_rows(), outputEncoding(m_outputFormat, true), 2 * channels);
+        m_kernel->process(samples, reinterpret_cast<uint16_t *>(msg.data.data()), msg.step, falloff, color);
+    }
+    else
+    {
+        prepareImage(msg, m_kernel->out_cols(), m_kernel->out_rows(), outputEncoding(m_outputFormat, false), channels);
+        if (blocks)
+            m_kernel->process(samples, m_toneCurve, msg.data.data(), msg.step, *blocks, falloff, color);
+        else
+            m_kernel->process(samples, m_toneCurve, msg.data.data(), msg.step, falloff, color);
+    }
+}
 
-        // Unlock the image buffer for this image
-        unlock_image(currentImage.uiBufferIndex);
+/**
+ * Apply the settings of the adaptive controller, the tables of a new scale are built in the background
+ */
+void LadybugDriver::apply_rate_control()
+{
+    const float frame_rate = (float)m_rateController->frameRate();
+    if (frame_rate != m_frameRate)
+    {
+        const LadybugError error = m_backend->setFrameRate(frame_rate);
+        if (error != LADYBUG_OK)
+            ROS_WARN("Unable to set the frame rate to %.1f fps (%s)", frame_rate, ladybugErrorToString(error));
+        else
+            m_frameRate = frame_rate;
+    }
+    const double scale = m_rateController->scale();
+    if (scale != m_imageScale)
+    {
+        m_imageScale = scale;
+        rebuild_tables();
+    }
+}
 
-        // Spin, so everything is published, and wait if needed
-        ros::spinOnce();
-        loop_rate.sleep();
-        count++;
+/**
+ * Publish the raw Bayer plane of each watched head as it is in the buffer, in the CFA order the camera reports
+ * RAW8 and RAW16 messages point into the locked buffer and share the hold of the frame, so nothing is copied here.
+ * Only bayer_max_frames frames can be aliased at once, beyond that the planes are copied into recycled messages instead,
+ * so subscribers that hang on to their messages can not starve the SDK of buffers.
+ * RAW12 has no Bayer encoding in ROS, so those planes are unpacked to 16-bit samples into recycled messages on the lanes.
+ * Half-height planes are published with the rows they have, stretching them is left to the subscriber.
+ */
+void LadybugDriver::publish_bayer(const std::shared_ptr<FrameHold> &hold, long int count, uint32_t bayer_heads,
+                                  sensor_msgs::ImagePtr unpacked[LADYBUG_NUM_CAMERAS])
+{
+    const LadybugImage &image = hold->frame().image;
+    const int bits = rawSampleBits(image.dataFormat);
+    int sensor_rows, plane_rows;
+    rawPlaneRows(image, sensor_rows, plane_rows);
+    const size_t plane_pixels = (size_t)image.uiFullCols * plane_rows;
+    const std::string encoding = bayerEncoding(image.stippledFormat, bits);
+    if (bits == 12)
+    {
+        size_t heads[LADYBUG_NUM_CAMERAS];
+        size_t num_heads = 0;
+        for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+        {
+            if (bayer_heads & (1u << i))
+                heads[num_heads++] = i;
+        }
+        const bool timing = m_timing.enabled();
+        m_pool->run(num_heads, [&](size_t j) {
+            const size_t i = heads[j];
+            const auto start = timing ? PipelineTiming::Clock::now() : PipelineTiming::Clock::time_point();
+            sensor_msgs::ImagePtr msg = m_bayerUnpackedPool[i].acquire();
+            prepareImage(*msg, image.uiFullCols, (uint32_t)plane_rows, encoding, 2);
+            unpackRaw12(image.pData + i * plane_pixels * 3 / 2, reinterpret_cast<uint16_t *>(msg->data.data()), plane_pixels);
+            if (timing)
+                m_timing.record(STAGE_DECODE, start, PipelineTiming::Clock::now(), i);
+            ros::Time timestamp = hold->frame().stamp;
+            long int seq = count;
+            publishImage(timestamp, msg, m_bayerPub[i], seq, i);
+            unpacked[i] = msg;
+        });
+        return;
     }
+    const bool alias = m_releaseQueue->published() - (hold->published() ? 1 : 0) < (size_t)m_bayerMaxFrames;
+    for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    {
+        if (!(bayer_heads & (1u << i)))
+            continue;
+        const uint8_t *plane = image.pData + i * plane_pixels * bits / 8;
+        if (!alias)
+        {
+            sensor_msgs::ImagePtr msg = m_bayerUnpackedPool[i].acquire();
+            prepareImage(*msg, image.uiFullCols, (uint32_t)plane_rows, encoding, bits / 8);
+            memcpy(msg->data.data(), plane, msg->data.size());
+            ros::Time timestamp = hold->frame().stamp;
+            long int seq = count;
+            publishImage(timestamp, msg, m_bayerPub[i], seq, i);
+            continue;
+        }
+        BayerImage::Ptr msg = m_bayerPool[i].acquire();
+        msg->header.seq = (uint)count;
+        msg->header.frame_id = "camera" + std::to_string(i);
+        msg->header.stamp = hold->frame().stamp;
+        msg->height = (uint32_t)plane_rows;
+        msg->width = image.uiFullCols;
+        msg->encoding = encoding;
+        msg->is_bigendian = 0;
+        msg->step = image.uiFullCols * (uint32_t)(bits / 8);
+        msg->offset = plane - image.pData;
+        msg->hold = hold;
+        hold->markPublished();
+        m_bayerPub[i].publish(BayerImage::ConstPtr(msg));
+    }
+}
 
-    // Shutdown, and disconnect camera
-    ROS_INFO("Stopping ladybug_camera...");
-    stop_camera();
-    ladybugDestroyContext(&m_context);
+/**
+ * Publish the camera's own JPEG tiles of each head, without decoding or re-encoding them
+ * See jpeg_decoder.h for the layout, the ladybug_jpeg image_transport plugin decodes these
+ */
+void LadybugDriver::publish_jpeg_tiles(const LadybugImage &image, const ros::Time &timestamp, long int count, uint32_t jpeg_heads)
+{
+    JpegTile tiles[LADYBUG_JPEG_TILES];
+    if (!findJpegTiles(image, tiles))
+        return;
+    for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    {
+        if (!(jpeg_heads & (1u << i)))
+            continue;
+        sensor_msgs::CompressedImagePtr msg = m_jpegPool[i].acquire();
+        msg->header.seq = (uint)count;
+        msg->header.frame_id = "camera" + std::to_string(i);
+        msg->header.stamp = timestamp;
+        msg->format = (isHalfHeightFormat(image.dataFormat) ? LADYBUG_JPEG_HALF_HEIGHT_FORMAT : LADYBUG_JPEG_FORMAT) + "; " +
+                      bayerEncoding(image.stippledFormat, 8);
+        packJpegTiles(tiles + i * LADYBUG_JPEG_CHANNELS, msg->data);
+        m_jpegPub[i].publish(sensor_msgs::CompressedImageConstPtr(msg));
+    }
+}
 
-    // Done! :D
-    ROS_INFO("ladybug_camera stopped");
-    return EXIT_SUCCESS;
+/**
+ * Build a kernel for the sensor and scale, and every table that depends on it
+ * The tables of views are only built for the views given, the others get theirs once someone watches them
+ * NOTE: this runs either on the processing thread or while it carries on with the old tables, so it only fills in the tables it returns
+ * The SDK is not safe to call while the grab thread locks buffers, so off the processing thread the SDK tables are left out
+ */
+std::unique_ptr<LadybugDriver::KernelTables> LadybugDriver::build_tables(int cols, int rows, double scale, bool half_height, BayerPattern pattern,
+                                                                         const std::vector<View *> &views,
+                                                                         std::shared_ptr<const FalloffMap> falloff_map, bool sdk)
+{
+    const auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<KernelTables> tables(new KernelTables());
+    tables->kernel.reset(new BayerKernel(cols, rows, scale, half_height, pattern, m_outputFormat));
+    build_camera_infos(*tables);
+    if (sdk || !m_rectifySdk)
+        build_rectifiers(*tables);
+    if (sdk || !m_panoSdk)
+        build_panorama(*tables);
+    if (falloff_map)
+        build_falloff_tiles(*tables, *falloff_map);
+    for (View *view : views)
+    {
+        if (sdk || !m_viewSdk)
+            tables->views.emplace_back(view, build_view(*view, *tables->kernel));
+    }
+    ROS_INFO("Built the tables for %.1f%% in %.1f ms", scale,
+             1e-3 * std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    return tables;
+}
+
+/**
+ * Build the tables of the scale the adaptive controller moved to, for the sensor of the current kernel
+ * The views watched now are built with them, the tables from the SDK are left for finish_tables() at the swap
+ */
+void LadybugDriver::rebuild_tables()
+{
+    if (!m_kernel || m_pendingTables.valid())
+        return;
+    const int cols = m_kernel->src_cols(), rows = m_kernel->src_rows();
+    const bool half_height = m_kernel->half_height();
+    const BayerPattern pattern = m_kernel->pattern();
+    const double scale = m_imageScale;
+    const std::vector<View *> views = m_watchedViews;
+    const std::shared_ptr<const FalloffMap> falloff_map = m_falloff ? m_falloffMap : nullptr;
+    m_pendingTables = std::async(std::launch::async, [this, cols, rows, scale, half_height, pattern, views, falloff_map]() {
+        return build_tables(cols, rows, scale, half_height, pattern, views, falloff_map, false);
+    });
+}
+
+/**
+ * Build the rectifiers and panorama from the SDK that rebuild_tables() left out, this stalls processing for as long as they take
+ * SDK tables of the views are left out too, update_views() builds them once the tables are swapped in
+ * NOTE: this runs on the processing thread, which is the only one that uses the context besides the grab thread
+ */
+void LadybugDriver::finish_tables(KernelTables &tables)
+{
+    if (m_rectifySdk)
+        build_rectifiers(tables);
+    if (m_panoSdk)
+        build_panorama(tables);
+}
+
+/**
+ * Swap in the tables, the views that were not built with them get theirs when they are next watched
+ */
+void LadybugDriver::install_tables(std::unique_ptr<KernelTables> tables)
+{
+    m_kernel = std::move(tables->kernel);
+    for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    {
+        m_headInfo[i] = tables->head_info[i];
+        m_rectifier[i] = std::move(tables->rectifier[i]);
+        m_falloffTiles[i] = std::move(tables->falloff_tiles[i]);
+    }
+    m_panorama = std::move(tables->panorama);
+    for (View *view : m_frameViews)
+    {
+        view->table.reset();
+        view->built = false;
+    }
+    for (auto &view : tables->views)
+    {
+        view.first->table = std::move(view.second);
+        view.first->built = true;
+    }
+}
+
+/**
+ * Transform the loaded calibration of every head to the size and orientation the kernel publishes
+ * This is only done when the kernel is rebuilt, each frame then just stamps a copy
+ */
+void LadybugDriver::build_camera_infos(KernelTables &tables)
+{
+    for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    {
+        if (!m_hasCalibration[i])
+            continue;
+        sensor_msgs::CameraInfoPtr info(new sensor_msgs::CameraInfo());
+        transformCameraInfo(m_calibration[i], *tables.kernel, *info);
+        info->header.frame_id = "camera" + std::to_string(i);
+        ROS_INFO("Camera %d intrinsics at %ux%u: fx %.1f fy %.1f cx %.1f cy %.1f", (int)i, info->width, info->height, info->K[0], info->K[4],
+                 info->K[2], info->K[5]);
+        tables.head_info[i] = info;
+    }
+}
+
+/**
+ * Build the remap tables of every head with a rectified output, for the size and orientation the kernel publishes
+ * This is only done when the kernel is rebuilt, and is slow (about 0.2 s per full size head)
+ */
+void LadybugDriver::build_rectifiers(KernelTables &tables)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    {
+        if (!m_rectPub[i])
+            continue;
+        if (m_rectifySdk)
+            tables.rectifier[i] = Rectifier::fromSdk(m_backend->context(), (unsigned int)i, *tables.kernel);
+        else
+            tables.rectifier[i] = Rectifier::fromCalibration(*tables.head_info[i]);
+    }
+    if (m_rectPub[0] || m_rectPub[1] || m_rectPub[2] || m_rectPub[3] || m_rectPub[4] || m_rectPub[5])
+    {
+        ROS_INFO("Built the rectification tables in %.1f ms",
+                 1e-3 * std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+}
+
+/**
+ * Build the panorama table for the size and orientation the kernel publishes
+ * This is only done when the kernel is rebuilt, and takes about a second for a 4096x2048 panorama
+ */
+void LadybugDriver::build_panorama(KernelTables &tables)
+{
+    if (!m_panoPub)
+        return;
+    const auto start = std::chrono::steady_clock::now();
+    if (m_panoSdk)
+        tables.panorama = Panorama::fromSdk(m_backend->context(), *tables.kernel, m_panoCols, m_panoRows,
+                                            Panorama::equirectangular(m_panoCols, m_panoRows), m_panoRadius, m_panoFeather);
+    else
+        tables.panorama = Panorama::fromCalibration(m_calibration, m_extrinsics, *tables.kernel, m_panoCols, m_panoRows,
+                                                    Panorama::equirectangular(m_panoCols, m_panoRows), m_panoRadius, m_panoFeather);
+    ROS_INFO("Built the %dx%d panorama table in %.1f ms", m_panoCols, m_panoRows,
+             1e-3 * std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+/**
+ * Fetch the falloff map for a sensor size if the one we have does not match
+ * The first kernel of a sensor size without a cached map fetches it from the SDK, which takes a few seconds, and saves it
+ * NOTE: only the processing thread changes the map, tables that are still being built hold on to the one they started with
+ */
+void LadybugDriver::update_falloff_map(int cols, int rows, BayerPattern pattern)
+{
+    if (!m_falloff)
+        return;
+    const uint32_t serial = (uint32_t)m_cameraInfo.serialHead;
+    if (!m_falloffMap || !m_falloffMap->matches(serial, cols, rows, pattern, m_falloffAttenuation, m_falloffGamma))
+    {
+        m_falloffMap.reset();
+        if (load_sdk_config())
+            m_falloffMap = FalloffMap::fromSdk(m_backend->context(), serial, cols, rows, pattern, m_falloffAttenuation, m_falloffGamma);
+        if (m_falloffMap && m_falloffMap->save(m_falloffCache))
+            ROS_INFO("Saved the falloff map to %s", m_falloffCache.c_str());
+    }
+    if (!m_falloffMap)
+    {
+        ROS_WARN("No falloff map for this camera and %dx%d heads, continuing without falloff correction", cols, rows);
+        m_falloff = false;
+    }
+}
+
+/**
+ * Build the falloff tiles of every head for the sensor size and output of the kernel, from the map
+ */
+void LadybugDriver::build_falloff_tiles(KernelTables &tables, const FalloffMap &map)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+        tables.falloff_tiles[i].reset(new FalloffTiles(map, i, *tables.kernel));
+    ROS_INFO("Built the falloff tiles in %.1f ms",
+             1e-3 * std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+/**
+ * Add a virtual pinhole view looking at yaw and pitch, see Panorama::pinhole() for the orientation
+ * Its table is only built once someone subscribes, so adding views is cheap
+ */
+bool LadybugDriver::add_view(const std::string &name, double yaw, double pitch, double fov, int cols, int rows, std::string &message)
+{
+    // The name becomes part of the topic, so keep it to what ROS allows
+    const bool valid_name = !name.empty() && std::isalpha((unsigned char)name[0]) &&
+                            std::all_of(name.begin(), name.end(), [](char c) { return std::isalnum((unsigned char)c) || c == '_'; });
+    if (!valid_name)
+        message = "view name '" + name + "' must be a letter followed by letters, digits and underscores";
+    else if (fov <= 0 || fov >= 180)
+        message = "view fov must be in (0,180) degrees";
+    else if (cols < 2 || rows < 2)
+        message = "view cols and rows must be at least 2";
+    if (!message.empty())
+        return false;
+    {
+        std::lock_guard<std::mutex> lock(m_viewMutex);
+        if (std::any_of(m_views.begin(), m_views.end(), [&](const std::unique_ptr<View> &view) { return view->name == name; }))
+        {
+            message = "a view named " + name + " already exists";
+            return false;
+        }
+    }
+    std::unique_ptr<View> view(new View());
+    view->name = name;
+    view->yaw = yaw;
+    view->pitch = pitch;
+    view->fov = fov;
+    view->cols = cols;
+    view->rows = rows;
+    view->built = false;
+    view->subscribed = false;
+
+    // The view is an ideal pinhole, x is right and y is down in the image, and z is where it looks
+    const double focal = 0.5 * cols / std::tan(0.5 * fov * M_PI / 180.0);
+    const double cx = 0.5 * cols - 0.5, cy = 0.5 * rows - 0.5;
+    sensor_msgs::CameraInfoPtr info(new sensor_msgs::CameraInfo());
+    info->header.frame_id = name;
+    info->width = (uint32_t)cols;
+    info->height = (uint32_t)rows;
+    info->distortion_model = "plumb_bob";
+    info->D.assign(5, 0.0);
+    info->K = {{focal, 0, cx, 0, focal, cy, 0, 0, 1}};
+    info->R = {{1, 0, 0, 0, 1, 0, 0, 0, 1}};
+    info->P = {{focal, 0, cx, 0, 0, focal, cy, 0, 0, 0, 1, 0}};
+    view->info = info;
+
+    // Advertise without holding the lock, subscribing takes it to update the view
+    const std::string topic = "/ladybug/views/" + name;
+    ros::SubscriberStatusCallback connect_cb = [this](const ros::SingleSubscriberPublisher &) { update_subscribers(); };
+    view->pub = m_nh.advertise<sensor_msgs::Image>(topic + "/image", 10, connect_cb, connect_cb);
+    view->info_pub = m_nh.advertise<sensor_msgs::CameraInfo>(topic + "/camera_info", 10);
+    {
+        std::lock_guard<std::mutex> lock(m_viewMutex);
+        if (std::any_of(m_views.begin(), m_views.end(), [&](const std::unique_ptr<View> &other) { return other->name == name; }))
+        {
+            message = "a view named " + name + " already exists";
+            return false;
+        }
+        m_views.push_back(std::move(view));
+    }
+    ROS_INFO("Publishing.. %s/image (%dx%d, yaw %.1f, pitch %.1f, fov %.1f)", topic.c_str(), cols, rows, yaw, pitch, fov);
+    message = "publishing " + topic + "/image";
+    update_subscribers();
+    return true;
+}
+
+bool LadybugDriver::on_add_view(pointgrey_ladybug::AddView::Request &req, pointgrey_ladybug::AddView::Response &res)
+{
+    res.success = add_view(req.name, req.yaw, req.pitch, req.fov, req.cols, req.rows, res.message);
+    if (!res.success)
+        ROS_WARN("Unable to add view: %s", res.message.c_str());
+    return true;
+}
+
+bool LadybugDriver::on_enable_timing(std_srvs::SetBool::Request &req, std_srvs::SetBool::Response &res)
+{
+    m_timing.setEnabled(req.data);
+    ROS_INFO("Pipeline timing is %s", req.data ? "on" : "off");
+    res.success = true;
+    res.message = req.data ? "timing on" : "timing off";
+    return true;
+}
+
+/**
+ * The same gains for all heads keep them consistent where they overlap, a gray world per head would tint each one by what it sees
+ */
+void LadybugDriver::apply_white_balance(const double sums[LADYBUG_NUM_CAMERAS][3], const size_t counts[LADYBUG_NUM_CAMERAS])
+{
+    double total[3] = {0.0, 0.0, 0.0};
+    size_t count = 0;
+    for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    {
+        for (int ch = 0; ch < 3; ch++)
+            total[ch] += sums[i][ch];
+        count += counts[i];
+    }
+    if (count == 0 || total[0] <= 0.0 || total[2] <= 0.0)
+    {
+        ROS_WARN("Unable to white balance, the watched heads have no pixels below clipping");
+        return;
+    }
+    const double gains[3] = {total[1] / total[0], 1.0, total[1] / total[2]};
+    std::lock_guard<std::mutex> lock(m_colorMutex);
+    for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    {
+        const std::shared_ptr<const ColorCorrection> old = std::atomic_load(&m_color[i]);
+        std::atomic_store(&m_color[i], std::make_shared<const ColorCorrection>(gains, old->matrix()));
+    }
+    ROS_INFO("White balance gains are %.3f, %.3f, %.3f, from %d cells", gains[0], gains[1], gains[2], (int)count);
+}
+
+bool LadybugDriver::on_set_color_correction(pointgrey_ladybug::SetColorCorrection::Request &req,
+                                            pointgrey_ladybug::SetColorCorrection::Response &res)
+{
+    res.success = false;
+    if (req.head < -1 || req.head >= LADYBUG_NUM_CAMERAS)
+        res.message = "head must be -1 for all heads, or 0 to " + std::to_string(LADYBUG_NUM_CAMERAS - 1);
+    else if ((!req.gains.empty() && req.gains.size() != 3) || (!req.matrix.empty() && req.matrix.size() != 9))
+        res.message = "gains must have 3 numbers and matrix 9";
+    if (!res.message.empty())
+    {
+        ROS_WARN("Unable to set the color correction: %s", res.message.c_str());
+        return true;
+    }
+
+    // The kernel picks the new corrections up with the next head it demosaics
+    {
+        std::lock_guard<std::mutex> lock(m_colorMutex);
+        for (int i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+        {
+            if (req.head != -1 && req.head != i)
+                continue;
+            const std::shared_ptr<const ColorCorrection> old = std::atomic_load(&m_color[i]);
+            const double *gains = (req.gains.empty() || req.auto_white_balance) ? old->gains() : req.gains.data();
+            const double *matrix = req.matrix.empty() ? old->matrix() : req.matrix.data();
+            std::atomic_store(&m_color[i], std::make_shared<const ColorCorrection>(gains, matrix));
+        }
+    }
+    if (req.auto_white_balance)
+        m_whiteBalancePending = true;
+    res.success = true;
+    res.message = req.auto_white_balance ? "white balance is measured on the next frame" : "color correction set";
+    ROS_INFO("Set the color correction of %s", req.head == -1 ? "all heads" : ("head " + std::to_string(req.head)).c_str());
+    return true;
+}
+
+/**
+ * Build the table of a view for the size and orientation the kernel publishes
+ * A table is only built once per kernel, and takes about 40 ms for a 640x480 view
+ */
+std::unique_ptr<Panorama> LadybugDriver::build_view(const View &view, const BayerKernel &kernel)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const Panorama::PixelRay ray = Panorama::pinhole(view.cols, view.rows, view.yaw, view.pitch, view.fov);
+    std::unique_ptr<Panorama> table;
+    if (m_viewSdk)
+        table = Panorama::fromSdk(m_backend->context(), kernel, view.cols, view.rows, ray, m_panoRadius, m_panoFeather);
+    else
+        table = Panorama::fromCalibration(m_calibration, m_extrinsics, kernel, view.cols, view.rows, ray, m_panoRadius, m_panoFeather);
+    if (!table)
+    {
+        ROS_ERROR("Error: Unable to build the table of view %s, it will not be published", view.name.c_str());
+        return table;
+    }
+    ROS_INFO("Built the table of view %s in %.1f ms, it samples heads 0x%02x", view.name.c_str(),
+             1e-3 * std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count(), table->heads());
+    return table;
+}
+
+/**
+ * Build the tables of the watched views that do not have one for the current kernel yet, and collect the blocks they sample
+ * While the tables of a new scale are being built, newly watched views wait for those instead
+ * NOTE: this runs on the processing thread, on the views watched at the start of the frame
+ */
+void LadybugDriver::update_views()
+{
+    for (View *view : m_watchedViews)
+    {
+        if (view->built || m_pendingTables.valid())
+            continue;
+        view->table = build_view(*view, *m_kernel);
+        view->built = true;
+    }
+
+    // Blocks of each head that any watched view samples
+    for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    {
+        m_viewBlocks[i].assign((size_t)(m_kernel->block_cols() * m_kernel->block_rows()), 0);
+        for (View *view : m_watchedViews)
+        {
+            if (!view->table || !(view->table->heads() & (1u << i)))
+                continue;
+            const std::vector<uint8_t> &blocks = view->table->blocks(i);
+            for (size_t b = 0; b < blocks.size(); b++)
+                m_viewBlocks[i][b] |= blocks[b];
+        }
+    }
+}
+
+/**
+ * Load the calibration stored in the camera into the SDK context, this is only done once
+ * Returns false if there is no real camera or the calibration can not be loaded
+ */
+bool LadybugDriver::load_sdk_config()
+{
+    if (m_sdkConfigLoaded)
+        return true;
+    const LadybugError configError = m_backend->context() ? ladybugLoadConfig(m_backend->context(), nullptr) : LADYBUG_NOT_SUPPORTED;
+    if (configError != LADYBUG_OK)
+    {
+        ROS_WARN("Unable to load the camera's own calibration (%s)", ladybugErrorToString(configError));
+        return false;
+    }
+    m_sdkConfigLoaded = true;
+    return true;
+}
+
+/**
+ * Called whenever someone subscribes or unsubscribes, this recomputes which outputs are needed
+ * This runs on the callback queue of the node handle, processing picks up the new mask on its next frame
+ */
+void LadybugDriver::update_subscribers()
+{
+    uint32_t raw_heads = 0, bayer_heads = 0, jpeg_heads = 0, rect_heads = 0;
+    for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    {
+        if (m_pub[i].getNumSubscribers() > 0)
+            raw_heads |= (1u << i);
+        if (m_bayerPub[i] && m_bayerPub[i].getNumSubscribers() > 0)
+            bayer_heads |= (1u << i);
+        if (m_jpegPub[i] && m_jpegPub[i].getNumSubscribers() > 0)
+            jpeg_heads |= (1u << i);
+        if (m_rectPub[i] && m_rectPub[i].getNumSubscribers() > 0)
+            rect_heads |= (1u << i);
+    }
+
+    // Rectified images are remapped from the demosaiced ones, and the panorama needs all of the heads
+    const bool pano = m_panoPub && m_panoPub.getNumSubscribers() > 0;
+    const WatchedOutputs watched(raw_heads, bayer_heads, jpeg_heads, rect_heads, pano);
+
+    // Views work out which heads they need from their tables, on the processing thread
+    std::lock_guard<std::mutex> lock(m_viewMutex);
+    if (watched != m_watched)
+    {
+        ROS_INFO("Subscribed heads changed, raw 0x%02x, bayer 0x%02x, jpeg 0x%02x and rect 0x%02x", watched.raw, watched.bayer, watched.jpeg, watched.rect);
+    }
+    m_watched = watched;
+    for (const auto &view : m_views)
+        view->subscribed = view->pub.getNumSubscribers() > 0;
+}
+
+/**
+ * Report how well the camera clock is tracked, so stamp quality can be monitored
+ */
+void LadybugDriver::diagnose_clock(diagnostic_updater::DiagnosticStatusWrapper &stat)
+{
+    if (!m_useCameraTime)
+    {
+        stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Stamping with host time");
+        return;
+    }
+    double offset, drift_ppm, jitter;
+    size_t num_samples, num_resets;
+    m_clockSync.getEstimate(offset, drift_ppm, jitter, num_samples, num_resets);
+    if (num_samples < 10)
+        stat.summary(diagnostic_msgs::DiagnosticStatus::WARN, "Waiting for camera clock estimate");
+    else
+        stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Stamping with camera clock");
+    stat.add("Offset (s)", offset);
+    stat.add("Drift (ppm)", drift_ppm);
+    stat.add("Jitter (ms)", 1e3 * jitter);
+    stat.add("Samples", num_samples);
+    stat.add("Resets", num_resets);
+}
+
+LadybugDriver::LadybugDriver(ros::NodeHandle nh, ros::NodeHandle private_nh)
+    : m_nh(nh), m_privateNh(private_nh), m_cameraInfo(), m_dataFormat(LADYBUG_DATAFORMAT_RAW8), m_cameraStarted(false), m_frameRate(10.0f), m_shutterTime(0.1f), m_gainAmount(10), m_isFrameRateAuto(true), m_isShutterAuto(true),
+      m_isGainAuto(true), m_jpegQualityPercentage(80), m_outputFormat(OUTPUT_RGB), m_output16(false), m_falloff(false), m_falloffAttenuation(1.0f), m_falloffGamma(-1), m_colorCorrection(false), m_whiteBalancePending(false), m_imageScale(100), m_ringSize(4), m_numThreads(LADYBUG_NUM_CAMERAS), m_useCameraTime(true),
+      m_sdkConfigLoaded(false), m_viewSdk(true), m_bayerMaxFrames(2), m_running(false), m_releaseQueue(std::make_shared<FrameReleaseQueue>()), m_diagnostics(nh, private_nh)
+{
+}
+
+LadybugDriver::~LadybugDriver()
+{
+    stop();
+}
+
+/**
+ * This will startup the camera
+ * This will also make all the ROS publishers needed, and start grabbing and processing
+ */
+bool LadybugDriver::start()
+{
+
+    // Initialize ladybug camera
+    const LadybugError grabberInitError = init_camera();
+    if (grabberInitError != LADYBUG_OK)
+    {
+        ROS_FATAL("Error: Failed to initialize camera (%s). Terminating...", ladybugErrorToString(grabberInitError));
+        m_backend.reset();
+        return false;
+    }
+
+    // Read in how much we should scale each image by
+    // NOTE: this is a double so 12.5% works, below 50% the heads are binned instead of demosaiced
+    m_imageScale = 100;
+    if (m_privateNh.getParam("scale", m_imageScale) && m_imageScale > 0 && m_imageScale <= 100)
+    {
+        ROS_INFO("Ladybug ImageScale > %.1f%%", m_imageScale);
+    }
+    else
+    {
+        ROS_WARN("Ladybug ImageScale scale must be (0,100]. Defaulting to 20 ");
+        m_imageScale = 20;
+    }
+
+    // Read in what format the camera should send the images in
+    std::string data_format;
+    if (m_privateNh.getParam("data_format", data_format) && !parseDataFormat(data_format, m_dataFormat))
+    {
+        ROS_WARN("Ladybug data_format %s is not supported. Using the camera default", data_format.c_str());
+    }
+    if (isHalfHeightFormat(m_dataFormat))
+    {
+        ROS_INFO("Capturing half-height heads, they are stretched back to the full sensor height");
+    }
+
+    // Read in the layout of the published heads, and how RAW12 and RAW16 heads are published
+    // The 16-bit encodings keep the full depth of RAW12 and RAW16, otherwise those go through a tone curve
+    // The levels are fractions of the full range, so they mean the same for both formats
+    std::string output_encoding;
+    double tone_gamma, tone_black, tone_white;
+    m_privateNh.param<std::string>("output_encoding", output_encoding, "rgb8");
+    m_privateNh.param<double>("tone_gamma", tone_gamma, 2.2);
+    m_privateNh.param<double>("tone_black", tone_black, 0.0);
+    m_privateNh.param<double>("tone_white", tone_white, 1.0);
+    if (!parseOutputEncoding(output_encoding, m_outputFormat, m_output16))
+    {
+        ROS_WARN("Ladybug output_encoding must be rgb8, bgr8, mono8, rgb16, bgr16 or mono16. Defaulting to rgb8");
+        m_outputFormat = OUTPUT_RGB;
+        m_output16 = false;
+    }
+    if (m_output16 && rawSampleBits(m_dataFormat) == 8)
+    {
+        ROS_WARN("Ladybug output_encoding %s needs the raw12 or raw16 data_format, publishing %s", output_encoding.c_str(),
+                 outputEncoding(m_outputFormat, false).c_str());
+        m_output16 = false;
+    }
+    if (tone_gamma <= 0 || tone_black < 0 || tone_white > 1 || tone_black >= tone_white)
+    {
+        ROS_WARN("Ladybug tone curve needs tone_gamma > 0 and 0 <= tone_black < tone_white <= 1. Defaulting to gamma 2.2 over the full range");
+        tone_gamma = 2.2;
+        tone_black = 0.0;
+        tone_white = 1.0;
+    }
+    m_toneCurve = ToneCurve(tone_gamma, tone_black, tone_white);
+    if (rawSampleBits(m_dataFormat) > 8)
+    {
+        ROS_INFO("Publishing %d-bit heads as %s%s", rawSampleBits(m_dataFormat), outputEncoding(m_outputFormat, m_output16).c_str(),
+                 m_output16 ? "" : " through the tone curve");
+    }
+
+    // Read in if we should correct the lens falloff, with the camera's calibration and the same settings as the SDK's own correction
+    // The map of the gains is cached per camera, so only the first start with a camera needs its calibration from the SDK
+    m_privateNh.param<bool>("falloff", m_falloff, false);
+    m_privateNh.param<float>("falloff_attenuation", m_falloffAttenuation, 1.0f);
+    m_privateNh.param<int>("falloff_gamma", m_falloffGamma, -1);
+    m_privateNh.param<std::string>("falloff_cache", m_falloffCache, "");
+    if (m_falloff)
+    {
+        if (m_falloffAttenuation < 0.0f || m_falloffAttenuation > 1.0f)
+        {
+            ROS_WARN("Ladybug falloff_attenuation must be [0,1]. Defaulting to 1");
+            m_falloffAttenuation = 1.0f;
+        }
+        if (m_falloffCache.empty())
+        {
+            const char *ros_home = getenv("ROS_HOME");
+            const char *home = getenv("HOME");
+            const std::string dir = ros_home ? std::string(ros_home) : std::string(home ? home : "/tmp") + "/.ros";
+            m_falloffCache = dir + "/ladybug_falloff_" + std::to_string(m_cameraInfo.serialHead) + ".bin";
+        }
+        m_falloffMap = FalloffMap::load(m_falloffCache);
+        if (m_falloffMap)
+            ROS_INFO("Correcting lens falloff with attenuation %.2f, the map is cached in %s", m_falloffAttenuation, m_falloffCache.c_str());
+        else
+            ROS_INFO("Correcting lens falloff with attenuation %.2f, the map is fetched on the first frame", m_falloffAttenuation);
+    }
+
+    // Read in the white balance and color matrix, for all heads and optionally per head, the service can change them later
+    // They can also come from the SDK's own color correction, or the white balance can be measured on the first frame
+    m_privateNh.param<bool>("color_correction", m_colorCorrection, false);
+    if (m_colorCorrection)
+    {
+        std::string color_seed;
+        m_privateNh.param<std::string>("color_seed", color_seed, "params");
+        if (color_seed != "params" && color_seed != "sdk" && color_seed != "auto")
+        {
+            ROS_WARN("Ladybug color_seed must be params, sdk or auto. Defaulting to params");
+            color_seed = "params";
+        }
+        double gains[3] = {1.0, 1.0, 1.0};
+        double matrix[9] = {1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0};
+        getNumbers(m_privateNh, "white_balance", gains, 3);
+        getNumbers(m_privateNh, "color_matrix", matrix, 9);
+        bool seeded = false;
+        if (color_seed == "sdk")
+        {
+            seeded = m_backend->context() && ColorCorrection::fromSdk(m_backend->context(), gains, matrix);
+            if (!seeded)
+                ROS_WARN("Unable to get the color correction from the SDK, using the params instead");
+        }
+        for (int i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+        {
+            double head_gains[3], head_matrix[9];
+            std::copy(gains, gains + 3, head_gains);
+            std::copy(matrix, matrix + 9, head_matrix);
+            if (!seeded)
+            {
+                getNumbers(m_privateNh, "white_balance_" + std::to_string(i), head_gains, 3);
+                getNumbers(m_privateNh, "color_matrix_" + std::to_string(i), head_matrix, 9);
+            }
+            m_color[i] = std::make_shared<const ColorCorrection>(head_gains, head_matrix);
+        }
+        m_whiteBalancePending = (color_seed == "auto");
+        m_colorService = m_nh.advertiseService("/ladybug/set_color_correction", &LadybugDriver::on_set_color_correction, this);
+        ROS_INFO("Correcting the color of every head%s, it can be changed with the /ladybug/set_color_correction service",
+                 m_whiteBalancePending ? " with the white balance of the first frame" : "");
+    }
+
+    // Read in our launch parameters
+    m_privateNh.param<int>("jpeg_percent", m_jpegQualityPercentage, m_jpegQualityPercentage);
+    m_privateNh.param<float>("framerate", m_frameRate, m_frameRate);
+    m_privateNh.param<bool>("use_auto_framerate", m_isFrameRateAuto, m_isFrameRateAuto);
+    m_privateNh.param<float>("shutter_time", m_shutterTime, m_shutterTime);
+    m_privateNh.param<bool>("use_auto_shutter_time", m_isShutterAuto, m_isShutterAuto);
+    m_privateNh.param<float>("gain_amount", m_gainAmount, m_gainAmount);
+    m_privateNh.param<bool>("use_auto_gain", m_isGainAuto, m_isGainAuto);
+
+    // Read in how many locked SDK buffers we can queue between grabbing and processing
+    m_privateNh.param<int>("ring_size", m_ringSize, 4);
+    if (m_ringSize < 1)
+    {
+        ROS_WARN("Ladybug ring_size must be at least 1. Defaulting to 4");
+        m_ringSize = 4;
+    }
+
+    // Read in how many threads we should process the heads with
+    m_privateNh.param<int>("num_threads", m_numThreads, LADYBUG_NUM_CAMERAS);
+    m_privateNh.getParam("thread_affinity", m_threadAffinity);
+    if (m_numThreads < 1 || m_numThreads > LADYBUG_NUM_CAMERAS)
+    {
+        ROS_WARN("Ladybug num_threads must be [1,%d]. Defaulting to %d", LADYBUG_NUM_CAMERAS, LADYBUG_NUM_CAMERAS);
+        m_numThreads = LADYBUG_NUM_CAMERAS;
+    }
+
+    // Read in how we should stamp the frames
+    m_privateNh.param<bool>("use_camera_time", m_useCameraTime, true);
+    double camera_time_offset;
+    m_privateNh.param<double>("camera_time_offset", camera_time_offset, 0.0);
+    m_clockSync.setLatencyOffset(camera_time_offset);
+    ROS_INFO("Stamping frames with %s time", m_useCameraTime ? "camera" : "host");
+
+    // Name the diagnostics after the camera
+    m_diagnostics.setHardwareIDf("%s %d", m_cameraInfo.pszModelName, m_cameraInfo.serialBase);
+    m_diagnostics.add("Camera clock", this, &LadybugDriver::diagnose_clock);
+
+    // Read in if we should time every stage, this can also be switched at runtime with the enable_timing service
+    bool timing = false;
+    m_privateNh.param<bool>("timing", timing, false);
+    m_timing.setEnabled(timing);
+    m_diagnostics.add("Pipeline timing", &m_timing, &PipelineTiming::diagnose);
+    m_timingService = m_nh.advertiseService("/ladybug/enable_timing", &LadybugDriver::on_enable_timing, this);
+
+    // Start the camera!
+    const LadybugError startError = start_camera();
+    if (startError != LADYBUG_OK)
+    {
+        ROS_ERROR("Error: Failed to start camera (%s). Terminating...", ladybugErrorToString(startError));
+        m_backend.reset();
+        return false;
+    }
+    m_cameraStarted = true;
+
+    // Read in if we should lower the frame rate and scale when processing can not keep up
+    // The configured frame rate and scale are the upper bounds, the frame rate is only adapted if the backend can set it
+    bool adaptive = false;
+    m_privateNh.param<bool>("adaptive", adaptive, false);
+    if (adaptive)
+    {
+        RateControlConfig config;
+        m_privateNh.param<double>("adaptive_min_framerate", config.min_frame_rate, 0.5 * m_frameRate);
+        m_privateNh.param<double>("adaptive_min_scale", config.min_scale, 0.5 * m_imageScale);
+        m_privateNh.param<double>("adaptive_high_load", config.high_load, 0.9);
+        m_privateNh.param<double>("adaptive_low_load", config.low_load, 0.6);
+        m_privateNh.param<double>("adaptive_window", config.window, 2.0);
+        m_privateNh.param<int>("adaptive_recover_windows", config.recover_windows, 3);
+        m_privateNh.param<double>("adaptive_step", config.step, 0.8);
+        config.max_frame_rate = m_frameRate;
+        config.max_scale = m_imageScale;
+        config.min_frame_rate = std::min(std::max(config.min_frame_rate, 0.1), config.max_frame_rate);
+        config.min_scale = std::min(std::max(config.min_scale, 1.0), config.max_scale);
+        config.step = std::min(std::max(config.step, 0.1), 0.95);
+        config.adapt_frame_rate = (m_backend->setFrameRate(m_frameRate) == LADYBUG_OK);
+        if (!config.adapt_frame_rate)
+            ROS_WARN("This camera can not change its frame rate while streaming, only the scale will be adapted");
+        m_rateController.reset(new RateController(config));
+        m_diagnostics.add("Adaptive rate", m_rateController.get(), &RateController::diagnose);
+    }
+
+    // Load the calibration of each head, these get transformed to the published size once the first frame comes in
+    for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    {
+        std::string filename;
+        m_hasCalibration[i] = false;
+        m_hasExtrinsics[i] = false;
+        if (!m_privateNh.getParam("calib_file_" + std::to_string(i), filename) || filename.empty())
+        {
+            ROS_INFO("No calib_file_%d param was received, will not publish its camera_info", (int)i);
+            continue;
+        }
+        ROS_INFO("Trying to parse calib_file_%d", (int)i);
+        ROS_INFO("> %s", filename.c_str());
+        m_hasCalibration[i] = loadCameraInfo(filename, m_calibration[i]);
+        m_hasExtrinsics[i] = m_hasCalibration[i] && loadCameraExtrinsics(filename, m_extrinsics[i]);
+    }
+
+    // Read in if we should also publish undistorted images, with our calibration files or with the camera's own one
+    bool rectify = false;
+    std::string rectify_source;
+    m_privateNh.param<bool>("rectify", rectify, false);
+    m_privateNh.param<std::string>("rectify_source", rectify_source, "calib");
+    m_rectifySdk = (rectify_source == "sdk");
+    if (rectify && m_rectifySdk && !load_sdk_config())
+    {
+        ROS_WARN("Continuing without rectified images");
+        rectify = false;
+    }
+
+    // Read in if we should stitch a panorama, this needs the geometry of all six heads
+    bool panorama = false;
+    std::string panorama_source;
+    m_privateNh.param<bool>("panorama", panorama, false);
+    m_privateNh.param<std::string>("panorama_source", panorama_source, "sdk");
+    m_privateNh.param<int>("panorama_cols", m_panoCols, 2048);
+    m_privateNh.param<int>("panorama_rows", m_panoRows, 1024);
+    m_privateNh.param<double>("panorama_radius", m_panoRadius, 20.0);
+    m_privateNh.param<double>("panorama_feather", m_panoFeather, 0.1);
+    m_panoSdk = (panorama_source == "sdk");
+    if (panorama && (m_panoCols < 2 || m_panoRows < 2))
+    {
+        ROS_WARN("Ladybug panorama_cols and panorama_rows must be at least 2, continuing without a panorama");
+        panorama = false;
+    }
+    if (panorama && m_panoSdk && !load_sdk_config())
+    {
+        ROS_WARN("Continuing without a panorama");
+        panorama = false;
+    }
+    if (panorama && !m_panoSdk && std::count(m_hasExtrinsics, m_hasExtrinsics + LADYBUG_NUM_CAMERAS, true) != LADYBUG_NUM_CAMERAS)
+    {
+        ROS_WARN("A panorama from calibration files needs a calib_file_N with CameraExtrinsicMat for every head, continuing without it");
+        panorama = false;
+    }
+
+    // Read in the virtual pinhole views, these are stitched like the panorama and use the same radius and feather
+    bool cubemap = false, view_service = false;
+    int cubemap_size = 512;
+    std::string view_source;
+    XmlRpc::XmlRpcValue views;
+    m_privateNh.param<bool>("cubemap", cubemap, false);
+    m_privateNh.param<int>("cubemap_size", cubemap_size, 512);
+    m_privateNh.param<bool>("view_service", view_service, false);
+    m_privateNh.param<std::string>("view_source", view_source, "sdk");
+    m_privateNh.getParam("views", views);
+    m_viewSdk = (view_source == "sdk");
+    bool use_views = cubemap || view_service || (views.getType() == XmlRpc::XmlRpcValue::TypeArray && views.size() > 0);
+    if (use_views && m_viewSdk && !load_sdk_config())
+    {
+        ROS_WARN("Continuing without views");
+        use_views = false;
+    }
+    if (use_views && !m_viewSdk && std::count(m_hasExtrinsics, m_hasExtrinsics + LADYBUG_NUM_CAMERAS, true) != LADYBUG_NUM_CAMERAS)
+    {
+        ROS_WARN("Views from calibration files need a calib_file_N with CameraExtrinsicMat for every head, continuing without them");
+        use_views = false;
+    }
+
+    // Read in if we should also publish the raw Bayer planes, these are never demosaiced on the host
+    bool bayer = false;
+    m_privateNh.param<bool>("bayer", bayer, false);
+    if (bayer && isJpegFormat(m_dataFormat))
+    {
+        ROS_WARN("Bayer images need a raw data_format, the ladybug_jpeg topics already pass the camera's own data through");
+        bayer = false;
+    }
+
+    // Read in how many frames Bayer images may point into at once, further frames get their planes copied
+    m_privateNh.param<int>("bayer_max_frames", m_bayerMaxFrames, 2);
+    if (m_bayerMaxFrames < 0)
+    {
+        ROS_WARN("Ladybug bayer_max_frames must be at least 0. Defaulting to 2");
+        m_bayerMaxFrames = 2;
+    }
+
+    // Other encodings are only published, the rectified images, panorama and views all sample RGB8 images
+    if ((m_output16 || m_outputFormat != OUTPUT_RGB) && (rectify || panorama || use_views))
+    {
+        ROS_WARN("Rectified images, the panorama and views need output_encoding rgb8, continuing without them");
+        rectify = false;
+        panorama = false;
+        use_views = false;
+    }
+
+    // Create the publishers
+    // Only heads that have subscribers get processed, so we track when people connect and disconnect
+    ROS_INFO("Successfully started ladybug camera and stream");
+    ros::SubscriberStatusCallback connect_cb = [this](const ros::SingleSubscriberPublisher &) { update_subscribers(); };
+    for (int i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    {
+        std::string topic = "/ladybug/camera" + std::to_string(i) + "/image_raw";
+        m_pub[i] = m_nh.advertise<sensor_msgs::Image>(topic, 100, connect_cb, connect_cb);
+        ROS_INFO("Publishing.. %s", topic.c_str());
+        if (m_hasCalibration[i])
+        {
+            std::string info_topic = "/ladybug/camera" + std::to_string(i) + "/camera_info";
+            m_infoPub[i] = m_nh.advertise<sensor_msgs::CameraInfo>(info_topic, 100);
+            ROS_INFO("Publishing.. %s", info_topic.c_str());
+        }
+        if (rectify && (m_rectifySdk || m_hasCalibration[i]))
+        {
+            std::string rect_topic = "/ladybug/camera" + std::to_string(i) + "/image_rect";
+            m_rectPub[i] = m_nh.advertise<sensor_msgs::Image>(rect_topic, 100, connect_cb, connect_cb);
+            ROS_INFO("Publishing.. %s", rect_topic.c_str());
+        }
+        if (bayer)
+        {
+            std::string bayer_topic = "/ladybug/camera" + std::to_string(i) + "/image_bayer";
+            m_bayerPub[i] = m_nh.advertise<BayerImage>(bayer_topic, 100, connect_cb, connect_cb);
+            ROS_INFO("Publishing.. %s", bayer_topic.c_str());
+        }
+        if (isJpegFormat(m_dataFormat))
+        {
+            m_jpegPub[i] = m_nh.advertise<sensor_msgs::CompressedImage>(topic + "/" + LADYBUG_JPEG_TRANSPORT, 100, connect_cb, connect_cb);
+            ROS_INFO("Publishing.. %s/%s", topic.c_str(), LADYBUG_JPEG_TRANSPORT.c_str());
+        }
+    }
+    if (panorama)
+    {
+        m_panoPub = m_nh.advertise<sensor_msgs::Image>("/ladybug/panorama/image", 10, connect_cb, connect_cb);
+        ROS_INFO("Publishing.. /ladybug/panorama/image (%dx%d)", m_panoCols, m_panoRows);
+    }
+    update_subscribers();
+
+    // Add the views, the cube faces are square with a 90 degree fov so together they cover the whole sphere
+    std::string message;
+    if (use_views && cubemap)
+    {
+        const struct
+        {
+            const char *name;
+            double yaw, pitch;
+        } faces[] = {{"cube_front", 0, 0}, {"cube_left", 90, 0}, {"cube_back", 180, 0}, {"cube_right", -90, 0}, {"cube_up", 0, 90}, {"cube_down", 0, -90}};
+        for (const auto &face : faces)
+        {
+            if (!add_view(face.name, face.yaw, face.pitch, 90.0, cubemap_size, cubemap_size, message))
+                ROS_WARN("Unable to add view %s: %s", face.name, message.c_str());
+        }
+    }
+    const int num_views = (use_views && views.getType() == XmlRpc::XmlRpcValue::TypeArray) ? views.size() : 0;
+    for (int i = 0; i < num_views; i++)
+    {
+        double yaw = 0, pitch = 0, fov = 90, cols = 640, rows = 480;
+        if (views[i].getType() != XmlRpc::XmlRpcValue::TypeStruct || !views[i].hasMember("name") ||
+            views[i]["name"].getType() != XmlRpc::XmlRpcValue::TypeString)
+        {
+            ROS_WARN("Ladybug views entry %d needs a name, skipping it", i);
+            continue;
+        }
+        getNumber(views[i], "yaw", yaw);
+        getNumber(views[i], "pitch", pitch);
+        getNumber(views[i], "fov", fov);
+        getNumber(views[i], "cols", cols);
+        getNumber(views[i], "rows", rows);
+        const std::string name = views[i]["name"];
+        if (!add_view(name, yaw, pitch, fov, (int)cols, (int)rows, message))
+            ROS_WARN("Unable to add view %s: %s", name.c_str(), message.c_str());
+    }
+    if (use_views && view_service)
+    {
+        m_addViewService = m_nh.advertiseService("/ladybug/add_view", &LadybugDriver::on_add_view, this);
+        ROS_INFO("Views can be added with the /ladybug/add_view service");
+    }
+
+    // Record the untouched images, into .pgr streams with the SDK or into our own indexed frame files
+    bool record = false;
+    std::string record_format;
+    m_privateNh.param<bool>("record", record, false);
+    m_privateNh.param<std::string>("record_format", record_format, "pgr");
+    std::unique_ptr<RecordSink> sink;
+    if (record && record_format == "raw")
+    {
+        sink.reset(new FrameFileWriter(m_cameraInfo));
+    }
+    else if (record && m_backend->context() == nullptr)
+    {
+        ROS_WARN("Recording .pgr streams needs a real camera, use record_format raw instead. Continuing without recording");
+    }
+    else if (record)
+    {
+        sink.reset(new PgrStreamSink(m_backend->context()));
+    }
+    if (sink)
+    {
+        std::string record_path;
+        int record_queue_size, record_max_pinned;
+        double record_max_file_mb, record_max_file_duration;
+        m_privateNh.param<std::string>("record_path", record_path, "/tmp/ladybug");
+        m_privateNh.param<int>("record_queue_size", record_queue_size, 8);
+        m_privateNh.param<int>("record_max_pinned", record_max_pinned, 2);
+        m_privateNh.param<double>("record_max_file_mb", record_max_file_mb, 0.0);
+        m_privateNh.param<double>("record_max_file_duration", record_max_file_duration, 0.0);
+        ROS_INFO("Recording %s files to %s (queue %d, max %.0f MB, max %.0f s per file)", record_format.c_str(), record_path.c_str(),
+                 record_queue_size, record_max_file_mb, record_max_file_duration);
+        m_recorder.reset(new StreamRecorder(std::move(sink), record_path, (size_t)std::max(1, record_queue_size), (size_t)std::max(0, record_max_pinned),
+                                            record_max_file_mb, record_max_file_duration));
+        if (!m_recorder->start())
+        {
+            ROS_ERROR("Error: Unable to start recording, continuing without it");
+            m_recorder.reset();
+        }
+        else
+        {
+            m_diagnostics.add("Stream recorder", m_recorder.get(), &StreamRecorder::diagnose);
+        }
+    }
+
+    // Create the worker lanes that will process the heads in parallel
+    ROS_INFO("Processing heads with %d threads", m_numThreads);
+    m_pool.reset(new WorkerPool((size_t)m_numThreads, m_threadAffinity));
+
+    // Start the grab thread, this will fill the ring with locked buffers
+    // Then start processing what it gives us
+    ROS_INFO("Queueing up to %d locked buffers between grabbing and processing", m_ringSize);
+    m_ring.reset(new SpscRing<QueuedFrame>((size_t)m_ringSize));
+    m_running = true;
+    m_grabThread = std::thread(&LadybugDriver::grab_loop, this);
+    m_processThread = std::thread(&LadybugDriver::process_loop, this);
+    return true;
+}
+
+/**
+ * Stop grabbing and processing, give back the SDK buffers, and disconnect the camera
+ */
+void LadybugDriver::stop()
+{
+
+    // Stop the threads, and wait for them to finish what they are doing
+    m_running = false;
+    if (m_grabThread.joinable())
+        m_grabThread.join();
+    if (m_processThread.joinable())
+        m_processThread.join();
+
+    // Tables that are still being built read the settings, let them finish before anything goes away
+    if (m_pendingTables.valid())
+        m_pendingTables.wait();
+    m_droppedTables.clear();
+
+    // Frames still in the ring were never processed, drop the holds the recorder shares with them
+    // Then write out what is still queued for recording, this needs the camera context and lets go of the rest of its holds
+    QueuedFrame queued;
+    while (m_ring && m_ring->pop(queued))
+        queued.hold.reset();
+    if (m_recorder)
+        m_recorder->stop();
+
+    // Bayer images may still point into locked buffers, give subscribers a moment to let go of them
+    if (m_backend)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (m_releaseQueue->held() > 0 && std::chrono::steady_clock::now() < deadline)
+        {
+            release_frames();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        release_frames();
+    }
+
+    // Shutdown, and disconnect camera
+    // NOTE: any buffers still in the ring were never processed, so just give them all back
+    // Buffers that Bayer images still point into can not be unlocked under them, so then the last of them to go does this
+    if (m_backend)
+    {
+        const std::shared_ptr<CameraBackend> backend(std::move(m_backend));
+        const bool started = m_cameraStarted;
+        m_cameraStarted = false;
+        const size_t held = m_releaseQueue->retire([backend, started]() {
+            if (started)
+            {
+                ROS_INFO("Stopping ladybug_camera...");
+                backend->unlockAll();
+                const LadybugError cameraError = backend->stop();
+                if (cameraError != LADYBUG_OK)
+                    ROS_ERROR("Error: Unable to stop camera (%s)", ladybugErrorToString(cameraError));
+            }
+            ROS_INFO("ladybug_camera stopped");
+        });
+        if (held > 0)
+            ROS_WARN("%zu frames are still held by Bayer image subscribers, the camera is stopped once they let go of them", held);
+    }
 }
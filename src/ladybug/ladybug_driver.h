@@ -0,0 +1,413 @@
+#ifndef LADYBUG_DRIVER_H
+#define LADYBUG_DRIVER_H
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ladybug.h"
+
+#include <diagnostic_updater/diagnostic_updater.h>
+#include <ros/ros.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/CompressedImage.h>
+#include <sensor_msgs/Image.h>
+#include <std_srvs/SetBool.h>
+
+#include <pointgrey_ladybug/AddView.h>
+#include <pointgrey_ladybug/SetColorCorrection.h>
+
+#include "bayer_image.h"
+#include "bayer_kernel.h"
+#include "camera_backend.h"
+#include "clock_sync.h"
+#include "color_correction.h"
+#include "falloff.h"
+#include "frame_ring.h"
+#include "jpeg_decoder.h"
+#include "message_pool.h"
+#include "panorama.h"
+#include "pipeline_timing.h"
+#include "rate_controller.h"
+#include "raw_unpack.h"
+#include "rectifier.h"
+#include "stream_recorder.h"
+#include "tone_curve.h"
+#include "watched_outputs.h"
+#include "worker_pool.h"
+
+/**
+ * The Ladybug camera driver, this holds all the state of one camera
+ * It is used both by the standalone ladybug_camera node and the LadybugNodelet
+ *
+ * start() will connect to the camera, start the stream, and spawn the grab and processing threads.
+ * All processing happens on those threads, so the caller is free to spin its callback queue.
+ */
+class LadybugDriver
+{
+  public:
+    LadybugDriver(ros::NodeHandle nh, ros::NodeHandle private_nh);
+
+    /**
+     * Stops the threads and disconnects the camera if still running
+     */
+    ~LadybugDriver();
+
+    /**
+     * Initialize and start the camera, and start publishing
+     * Returns false if the camera could not be started
+     */
+    bool start();
+
+    /**
+     * Stop publishing and disconnect the camera
+     */
+    void stop();
+
+  private:
+    LadybugDriver(const LadybugDriver &) = delete;
+    LadybugDriver &operator=(const LadybugDriver &) = delete;
+
+    struct View;
+    struct KernelTables;
+
+    /**
+     * This will create the camera backend and initalize the camera
+     */
+    LadybugError init_camera();
+
+    /**
+     * This will configure the camera with our parameters, and start the actual stream
+     */
+    LadybugError start_camera();
+
+    /**
+     * Get the next image
+     */
+    LadybugError acquire_image(LadybugImage &image);
+
+    /**
+     * Unlock the old image
+     */
+    LadybugError unlock_image(unsigned int bufferIndex);
+
+    /**
+     * Grab thread, this keeps locking new buffers from the SDK and hands them to processing
+     */
+    void grab_loop();
+
+    /**
+     * Processing thread, this takes locked buffers from the ring and publishes all the heads
+     */
+    void process_loop();
+
+    /**
+     * Process and publish all the heads of a single locked frame
+     * The frame stays locked until the hold and every message that shares it are gone
+     */
+    void process_frame(const std::shared_ptr<FrameHold> &hold, long int count);
+
+    /**
+     * Unlock the buffers that nothing holds anymore
+     */
+    void release_frames();
+
+    /**
+     * Publish the raw Bayer plane of each watched head, without demosaicing it
+     * RAW12 planes are unpacked into recycled messages, which are returned so the kernel can use them too
+     */
+    void publish_bayer(const std::shared_ptr<FrameHold> &hold, long int count, uint32_t bayer_heads, sensor_msgs::ImagePtr unpacked[LADYBUG_NUM_CAMERAS]);
+
+    /**
+     * Demosaic head i into a recycled message, only the given kernel blocks if there are any
+     * 8-bit planes come in as raw, deeper ones as 16-bit samples, which are published as RGB16 or through the tone curve
+     * The falloff and color of the head are corrected in the same pass if that is enabled
+     */
+    void demosaic_head(size_t i, const uint8_t *raw, const uint16_t *samples, const std::vector<uint8_t> *blocks, sensor_msgs::Image &msg);
+
+    /**
+     * Apply the frame rate and scale the adaptive controller moved to
+     */
+    void apply_rate_control();
+
+    /**
+     * Publish the camera's own JPEG tiles of each head, without decoding or re-encoding them
+     */
+    void publish_jpeg_tiles(const LadybugImage &image, const ros::Time &timestamp, long int count, uint32_t jpeg_heads);
+
+    /**
+     * Build a kernel and everything that depends on it from the falloff map given, with the tables of the given views
+     * This only reads settings that are fixed while the camera runs, so it can run off the processing thread
+     * Without sdk the tables that come from the SDK are left out, finish_tables() builds them on the processing thread
+     */
+    std::unique_ptr<KernelTables> build_tables(int cols, int rows, double scale, bool half_height, BayerPattern pattern,
+                                               const std::vector<View *> &views, std::shared_ptr<const FalloffMap> falloff_map,
+                                               bool sdk);
+
+    /**
+     * Build the tables from the SDK that a build off the processing thread left out, on the processing thread
+     */
+    void finish_tables(KernelTables &tables);
+
+    /**
+     * Start building the tables of the new scale off the processing thread, the current ones are used until they are ready
+     */
+    void rebuild_tables();
+
+    /**
+     * Make built tables the current ones
+     */
+    void install_tables(std::unique_ptr<KernelTables> tables);
+
+    /**
+     * Transform the calibration of each head for the kernel of the tables
+     */
+    void build_camera_infos(KernelTables &tables);
+
+    /**
+     * Build the remap tables of the rectified outputs for the kernel of the tables
+     */
+    void build_rectifiers(KernelTables &tables);
+
+    /**
+     * Build the panorama table for the kernel of the tables
+     */
+    void build_panorama(KernelTables &tables);
+
+    /**
+     * Build the falloff tiles of each head for the kernel of the tables, from the map
+     */
+    void build_falloff_tiles(KernelTables &tables, const FalloffMap &map);
+
+    /**
+     * Fetch the falloff map if we have none for this sensor, on the processing thread
+     */
+    void update_falloff_map(int cols, int rows, BayerPattern pattern);
+
+    /**
+     * Build the table of a view for a kernel, nullptr if it can not be built
+     */
+    std::unique_ptr<Panorama> build_view(const View &view, const BayerKernel &kernel);
+
+    /**
+     * Give every head the white balance gains that make the watched heads of a frame gray on average, from their raw channel sums
+     */
+    void apply_white_balance(const double sums[LADYBUG_NUM_CAMERAS][3], const size_t counts[LADYBUG_NUM_CAMERAS]);
+
+    /**
+     * The set_color_correction service, changes the white balance and color matrix while the camera is running
+     */
+    bool on_set_color_correction(pointgrey_ladybug::SetColorCorrection::Request &req, pointgrey_ladybug::SetColorCorrection::Response &res);
+
+    /**
+     * Add a virtual pinhole view, and advertise its image and camera_info
+     * Returns false with the reason in message if the view can not be added
+     */
+    bool add_view(const std::string &name, double yaw, double pitch, double fov, int cols, int rows, std::string &message);
+
+    /**
+     * The add_view service, so views can also be added while the camera is running
+     */
+    bool on_add_view(pointgrey_ladybug::AddView::Request &req, pointgrey_ladybug::AddView::Response &res);
+
+    /**
+     * The enable_timing service, switches the per-stage timing on and off
+     */
+    bool on_enable_timing(std_srvs::SetBool::Request &req, std_srvs::SetBool::Response &res);
+
+    /**
+     * Build the tables of the views watched in this frame that do not have one yet, and collect the kernel blocks they sample
+     */
+    void update_views();
+
+    /**
+     * Load the camera's own calibration into the SDK, for rectifying and stitching with it
+     */
+    bool load_sdk_config();
+
+    /**
+     * Called whenever someone subscribes or unsubscribes, this recomputes which outputs are needed
+     */
+    void update_subscribers();
+
+    /**
+     * Diagnostics about how the camera clock maps onto ROS time
+     */
+    void diagnose_clock(diagnostic_updater::DiagnosticStatusWrapper &stat);
+
+    // Node handles we advertise and read params on
+    ros::NodeHandle m_nh;
+    ros::NodeHandle m_privateNh;
+
+    // Camera the images come from
+    std::unique_ptr<CameraBackend> m_backend;
+    LadybugCameraInfo m_cameraInfo;
+    LadybugDataFormat m_dataFormat;
+    bool m_cameraStarted;
+
+    // camera config settings
+    float m_frameRate, m_shutterTime, m_gainAmount;
+    bool m_isFrameRateAuto, m_isShutterAuto, m_isGainAuto;
+    int m_jpegQualityPercentage;
+
+    // Layout of the published heads, RGB, BGR or mono
+    // RAW12 and RAW16 heads are published with 16 bits, or with 8 bits through the tone curve
+    // RAW12 planes are unpacked into 16-bit samples first, one plane per head
+    OutputFormat m_outputFormat;
+    bool m_output16;
+    ToneCurve m_toneCurve;
+    std::vector<uint16_t> m_unpacked;
+
+    // Optional lens falloff correction, which the kernel applies per head with the tiles built from the map
+    // The map comes from the camera's calibration once, and is then read from the cache file
+    // Tables that are being built off the processing thread keep the map they were started with
+    bool m_falloff;
+    float m_falloffAttenuation;
+    int m_falloffGamma;
+    std::string m_falloffCache;
+    std::shared_ptr<const FalloffMap> m_falloffMap;
+    std::unique_ptr<FalloffTiles> m_falloffTiles[LADYBUG_NUM_CAMERAS];
+
+    // Optional white balance and color matrix of each head, which the kernel applies after the falloff
+    // Changes swap in a whole new correction with std::atomic_store, so they never wait for the frame that is being processed
+    // Only the writers take m_colorMutex, so a service call and an auto white balance do not undo each other
+    // A requested auto white balance is measured on the raw planes of the next frame
+    bool m_colorCorrection;
+    std::shared_ptr<const ColorCorrection> m_color[LADYBUG_NUM_CAMERAS];
+    std::atomic<bool> m_whiteBalancePending;
+    std::mutex m_colorMutex;
+    ros::ServiceServer m_colorService;
+
+    // post-processing settings
+    double m_imageScale;
+    int m_ringSize;
+    int m_numThreads;
+    std::vector<int> m_threadAffinity;
+
+    // Frame stamping, either from the camera clock or from when the buffer was locked
+    bool m_useCameraTime;
+    CameraClockSync m_clockSync;
+
+    // Publishers, and the recycled messages for each head
+    ros::Publisher m_pub[LADYBUG_NUM_CAMERAS];
+    MessagePool<sensor_msgs::Image> m_imagePool[LADYBUG_NUM_CAMERAS];
+
+    // Calibration of each head as loaded from calib_file_N, and transformed for the published images
+    // The transformed message is never changed after it is built, each frame copies it into a recycled message
+    bool m_hasCalibration[LADYBUG_NUM_CAMERAS];
+    sensor_msgs::CameraInfo m_calibration[LADYBUG_NUM_CAMERAS];
+    sensor_msgs::CameraInfoConstPtr m_headInfo[LADYBUG_NUM_CAMERAS];
+    ros::Publisher m_infoPub[LADYBUG_NUM_CAMERAS];
+    MessagePool<sensor_msgs::CameraInfo> m_infoPool[LADYBUG_NUM_CAMERAS];
+
+    // Optional undistorted images, remapped from the demosaiced ones with a table per head
+    bool m_rectifySdk;
+    std::unique_ptr<Rectifier> m_rectifier[LADYBUG_NUM_CAMERAS];
+    ros::Publisher m_rectPub[LADYBUG_NUM_CAMERAS];
+    MessagePool<sensor_msgs::Image> m_rectPool[LADYBUG_NUM_CAMERAS];
+
+    // Optional panorama stitched from all heads, with the camera's own calibration or with the extrinsics of the calibration files
+    bool m_sdkConfigLoaded;
+    bool m_hasExtrinsics[LADYBUG_NUM_CAMERAS];
+    double m_extrinsics[LADYBUG_NUM_CAMERAS][16];
+    bool m_panoSdk;
+    int m_panoCols, m_panoRows;
+    double m_panoRadius, m_panoFeather;
+    std::unique_ptr<Panorama> m_panorama;
+    ros::Publisher m_panoPub;
+    MessagePool<sensor_msgs::Image> m_panoPool;
+
+    // Virtual pinhole views, from the views and cubemap params or added with the add_view service
+    // A view only samples the heads and kernel blocks it sees, and its table is only built once someone watches it
+    struct View
+    {
+        std::string name;
+        double yaw, pitch, fov;
+        int cols, rows;
+        ros::Publisher pub;
+        ros::Publisher info_pub;
+        MessagePool<sensor_msgs::Image> pool;
+        MessagePool<sensor_msgs::CameraInfo> info_pool;
+        sensor_msgs::CameraInfoConstPtr info;
+        std::unique_ptr<Panorama> table;
+        bool built;
+        bool subscribed;
+    };
+
+    // The list of views and m_watched are guarded by m_viewMutex, which processing only holds to take a snapshot of them
+    // Views are never removed, and their tables are only touched on the processing thread, so the snapshot can point at them
+    // m_frameViews are all the views and m_watchedViews the subscribed ones as of the start of the frame
+    // m_viewBlocks are the kernel blocks of each head that the watched views sample
+    bool m_viewSdk;
+    std::vector<std::unique_ptr<View>> m_views;
+    std::mutex m_viewMutex;
+    std::vector<View *> m_frameViews;
+    std::vector<View *> m_watchedViews;
+    std::vector<uint8_t> m_viewBlocks[LADYBUG_NUM_CAMERAS];
+    ros::ServiceServer m_addViewService;
+
+    // The kernel and everything built for it: the transformed calibration, rectification, panorama, falloff and view tables
+    // A new scale from the adaptive controller is built into one of these off the processing thread, and swapped in by it
+    // That build leaves out the tables that come from the SDK, the grab thread uses the context at the same time
+    struct KernelTables
+    {
+        std::unique_ptr<BayerKernel> kernel;
+        sensor_msgs::CameraInfoConstPtr head_info[LADYBUG_NUM_CAMERAS];
+        std::unique_ptr<Rectifier> rectifier[LADYBUG_NUM_CAMERAS];
+        std::unique_ptr<Panorama> panorama;
+        std::unique_ptr<FalloffTiles> falloff_tiles[LADYBUG_NUM_CAMERAS];
+        std::vector<std::pair<View *, std::unique_ptr<Panorama>>> views;
+    };
+
+    // Optional raw Bayer planes of each head, RAW8 and RAW16 ones alias the locked buffer and RAW12 ones are unpacked
+    ros::Publisher m_bayerPub[LADYBUG_NUM_CAMERAS];
+    MessagePool<BayerImage> m_bayerPool[LADYBUG_NUM_CAMERAS];
+    MessagePool<sensor_msgs::Image> m_bayerUnpackedPool[LADYBUG_NUM_CAMERAS];
+    int m_bayerMaxFrames;
+
+    // Pass-through of the camera's JPEG tiles, only advertised for JPEG data formats
+    ros::Publisher m_jpegPub[LADYBUG_NUM_CAMERAS];
+    MessagePool<sensor_msgs::CompressedImage> m_jpegPool[LADYBUG_NUM_CAMERAS];
+
+    // Which heads of each output someone is subscribed to, set from the connect callbacks under m_viewMutex
+    // Processing only computes what is in the copy it takes at the start of a frame
+    WatchedOutputs m_watched;
+
+    // Grabbing and processing
+    std::atomic<bool> m_running;
+    std::unique_ptr<WorkerPool> m_pool;
+    std::unique_ptr<SpscRing<QueuedFrame>> m_ring;
+    FrameRingStats m_ringStats;
+
+    // Frames whose holds are gone, processing unlocks them after every frame
+    std::shared_ptr<FrameReleaseQueue> m_releaseQueue;
+    std::vector<LockedFrame> m_released;
+    std::unique_ptr<BayerKernel> m_kernel;
+
+    // Tables of a new scale that are being built, and builds for an old sensor that are left to finish and then dropped
+    std::future<std::unique_ptr<KernelTables>> m_pendingTables;
+    std::vector<std::future<std::unique_ptr<KernelTables>>> m_droppedTables;
+
+    JpegDecoder m_jpegDecoder;
+    std::thread m_grabThread;
+    std::thread m_processThread;
+
+    // Optional adaptive control of the frame rate and scale, driven from the processing thread
+    std::unique_ptr<RateController> m_rateController;
+
+    // Optional recording of the raw camera data, fed from the grab thread
+    std::unique_ptr<StreamRecorder> m_recorder;
+
+    // Latency of every stage, recorded from all threads while enabled and reported with the diagnostics
+    PipelineTiming m_timing;
+    ros::ServiceServer m_timingService;
+
+    // Published on /diagnostics from the processing thread
+    diagnostic_updater::Updater m_diagnostics;
+};
+
+#endif // LADYBUG_DRIVER_H
@@ -0,0 +1,100 @@
+#include <memory>
+#include <vector>
+
+#include <image_transport/simple_subscriber_plugin.h>
+#include <pluginlib/class_list_macros.h>
+#include <ros/ros.h>
+#include <sensor_msgs/CompressedImage.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/image_encodings.h>
+
+#include "bayer_image.h"
+#include "bayer_kernel.h"
+#include "jpeg_decoder.h"
+
+namespace pointgrey_ladybug
+{
+
+/**
+ * Subscriber side of the camera's JPEG tile pass-through, see jpeg_decoder.h for the layout
+ * Subscribe with the "ladybug_jpeg" transport to get the full resolution rgb8 image of a head back
+ */
+class LadybugJpegSubscriber : public image_transport::SimpleSubscriberPlugin<sensor_msgs::CompressedImage>
+{
+  public:
+    LadybugJpegSubscriber() : m_handle(tjInitDecompress()) {}
+
+    ~LadybugJpegSubscriber()
+    {
+        if (m_handle != nullptr)
+            tjDestroy(m_handle);
+    }
+
+    std::string getTransportName() const override { return LADYBUG_JPEG_TRANSPORT; }
+
+  protected:
+    void internalCallback(const sensor_msgs::CompressedImageConstPtr &message, const Callback &user_cb) override
+    {
+
+        // Find the four tiles of this head, and the CFA order of its raw plane if the format has one
+        JpegTile tiles[LADYBUG_JPEG_CHANNELS];
+        const size_t split = message->format.find("; ");
+        const std::string format = message->format.substr(0, split);
+        const bool half_height = format == LADYBUG_JPEG_HALF_HEIGHT_FORMAT;
+        BayerPattern pattern = BAYER_RGGB;
+        if ((format != LADYBUG_JPEG_FORMAT && !half_height) || (split != std::string::npos && !parseBayerPattern(message->format.substr(split + 2), pattern)) ||
+            !unpackJpegTiles(message->data, tiles))
+        {
+            ROS_WARN_THROTTLE(5, "Received a malformed %s message, skipping it", LADYBUG_JPEG_FORMAT.c_str());
+            return;
+        }
+
+        // The first tile tells us how big the raw plane is
+        int tile_cols, tile_rows, subsamp, colorspace;
+        if (tjDecompressHeader3(m_handle, tiles[0].data, tiles[0].size, &tile_cols, &tile_rows, &subsamp, &colorspace) != 0)
+        {
+            ROS_WARN_THROTTLE(5, "Unable to read JPEG tile header (%s)", tjGetErrorStr());
+            return;
+        }
+        const int cols = 2 * tile_cols;
+        const int rows = 2 * tile_rows;
+        m_plane.resize((size_t)cols * rows);
+
+        // Decode each channel back into the raw Bayer plane
+        for (size_t k = 0; k < LADYBUG_JPEG_CHANNELS; k++)
+        {
+            if (!decodeBayerTile(m_handle, tiles[k], k, m_tileBuffer, m_plane.data(), cols, rows))
+            {
+                ROS_WARN_THROTTLE(5, "Unable to decode JPEG tile %d (%s)", (int)k, tjGetErrorStr());
+                return;
+            }
+        }
+
+        // Demosaic and rotate it just like the driver does for image_raw, half-height planes are stretched to the sensor rows
+        const int sensor_rows = half_height ? 2 * rows : rows;
+        if (!m_kernel || m_kernel->src_cols() != cols || m_kernel->src_rows() != sensor_rows || m_kernel->half_height() != half_height ||
+            m_kernel->pattern() != pattern)
+            m_kernel.reset(new BayerKernel(cols, sensor_rows, 100, half_height, pattern));
+        sensor_msgs::ImagePtr image(new sensor_msgs::Image());
+        image->header = message->header;
+        image->height = m_kernel->out_rows();
+        image->width = m_kernel->out_cols();
+        image->encoding = sensor_msgs::image_encodings::RGB8;
+        image->is_bigendian = 0;
+        image->step = image->width * 3;
+        image->data.resize((size_t)image->step * image->height);
+        m_kernel->process(m_plane.data(), image->data.data(), image->step);
+        user_cb(image);
+    }
+
+  private:
+    // Decoder state, reused for every message
+    tjhandle m_handle;
+    std::vector<uint8_t> m_tileBuffer;
+    std::vector<uint8_t> m_plane;
+    std::unique_ptr<BayerKernel> m_kernel;
+};
+
+} // namespace pointgrey_ladybug
+
+PLUGINLIB_EXPORT_CLASS(pointgrey_ladybug::LadybugJpegSubscriber, image_transport::SubscriberPlugin)
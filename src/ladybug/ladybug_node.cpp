@@ -0,0 +1,44 @@
+#include <signal.h>
+
+#include <ros/ros.h>
+
+#include "ladybug_driver.h"
+
+/**
+ * Callback function when the user requests for shutdown
+ * Will signal the driver threads to stop grabbing frames
+ */
+static void signalHandler(int)
+{
+    ROS_INFO("Shutdown signal received!");
+    ros::shutdown();
+}
+
+/**
+ * Main method, that will startup the camera
+ * All the work is done by the LadybugDriver, we just spin till we are asked to shutdown
+ */
+int main(int argc, char **argv)
+{
+    ////ROS STUFF
+    ros::init(argc, argv, "ladybug_camera");
+    ros::NodeHandle n;
+    ros::NodeHandle private_nh("~");
+
+    // set our callback for closing
+    signal(SIGTERM, signalHandler);
+
+    // Start the camera, and spin till we are done
+    LadybugDriver driver(n, private_nh);
+    if (!driver.start())
+    {
+        return EXIT_FAILURE;
+    }
+    ros::spin();
+
+    // Shutdown, and disconnect camera
+    driver.stop();
+
+    // Done! :D
+    return EXIT_SUCCESS;
+}
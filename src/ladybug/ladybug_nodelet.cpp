@@ -0,0 +1,43 @@
+#include <memory>
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+#include "ladybug_driver.h"
+
+namespace pointgrey_ladybug
+{
+
+/**
+ * Nodelet version of the ladybug_camera node
+ * Consumers loaded into the same manager get the published images as ConstPtr, with zero copies
+ */
+class LadybugNodelet : public nodelet::Nodelet
+{
+  public:
+    ~LadybugNodelet()
+    {
+        if (m_driver)
+            m_driver->stop();
+    }
+
+  private:
+    /**
+     * Start the camera, the driver has its own grab and processing threads so this returns right away
+     */
+    void onInit() override
+    {
+        m_driver.reset(new LadybugDriver(getNodeHandle(), getPrivateNodeHandle()));
+        if (!m_driver->start())
+        {
+            NODELET_FATAL("Unable to start the ladybug camera");
+            m_driver.reset();
+        }
+    }
+
+    std::unique_ptr<LadybugDriver> m_driver;
+};
+
+} // namespace pointgrey_ladybug
+
+PLUGINLIB_EXPORT_CLASS(pointgrey_ladybug::LadybugNodelet, nodelet::Nodelet)
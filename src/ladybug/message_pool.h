@@ -0,0 +1,101 @@
+#ifndef LADYBUG_MESSAGE_POOL_H
+#define LADYBUG_MESSAGE_POOL_H
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+
+/**
+ * Called on every message that comes back to a pool, message types that point into memory they do not own overload this
+ * to let go of it, so it is not kept alive while the message waits in the free list (found by argument dependent lookup)
+ */
+template <typename M>
+inline void recycleMessage(M &)
+{
+}
+
+/**
+ * Pool of preallocated ROS messages that get recycled once every subscriber has let go of them
+ *
+ * acquire() hands out a boost::shared_ptr whose deleter puts the message back into the pool instead of freeing it.
+ * A recycled message keeps its buffers (e.g. the image data vector), so filling it again does not allocate or zero-fill.
+ * Messages are published as ConstPtr, so intra-process subscribers get the same memory with no serialization.
+ * It is fine for messages to outlive the pool, they will then simply be deleted.
+ */
+template <typename M>
+class MessagePool
+{
+  public:
+    /**
+     * Create the pool, keeping at most max_free messages around for reuse
+     */
+    explicit MessagePool(size_t max_free = 16) : m_store(new Store(max_free)) {}
+
+    /**
+     * Get a message to fill, this is a recycled one if we have it, otherwise a new one
+     * NOTE: recycled messages still hold their old contents
+     */
+    boost::shared_ptr<M> acquire()
+    {
+        M *msg = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_store->mutex);
+            if (!m_store->free.empty())
+            {
+                msg = m_store->free.back();
+                m_store->free.pop_back();
+            }
+        }
+        if (msg == nullptr)
+            msg = new M();
+        return boost::shared_ptr<M>(msg, Recycler(m_store));
+    }
+
+  private:
+    /**
+     * The free list, shared with all the messages we handed out
+     */
+    struct Store
+    {
+        explicit Store(size_t max) : max_free(max) {}
+        ~Store()
+        {
+            for (M *msg : free)
+                delete msg;
+        }
+        std::mutex mutex;
+        std::vector<M *> free;
+        size_t max_free;
+    };
+
+    /**
+     * Deleter of the shared pointers we hand out, gives the message back to the pool if it still exists
+     */
+    struct Recycler
+    {
+        explicit Recycler(const boost::shared_ptr<Store> &store) : store(store) {}
+        void operator()(M *msg) const
+        {
+            recycleMessage(*msg);
+            boost::shared_ptr<Store> locked = store.lock();
+            if (locked)
+            {
+                std::lock_guard<std::mutex> lock(locked->mutex);
+                if (locked->free.size() < locked->max_free)
+                {
+                    locked->free.push_back(msg);
+                    return;
+                }
+            }
+            delete msg;
+        }
+        boost::weak_ptr<Store> store;
+    };
+
+    boost::shared_ptr<Store> m_store;
+};
+
+#endif // LADYBUG_MESSAGE_POOL_H
@@ -0,0 +1,219 @@
+#include "panorama.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <ros/ros.h>
+
+#include "camera_calibration.h"
+#include "ladybuggeom.h"
+#include "ladybugrenderer.h"
+
+namespace
+{
+
+// Bilinear fractions and blend weights have 7 bits
+const int PANO_BITS = 7;
+const int PANO_ONE = 1 << PANO_BITS;
+const uint8_t NO_HEAD = 0xff;
+
+/**
+ * Bilinear sample of one channel, with 14-bit weights
+ */
+inline int sample(const uint8_t *p0, const uint8_t *p1, int w00, int w01, int w10, int w11)
+{
+    return (p0[0] * w00 + p0[3] * w01 + p1[0] * w10 + p1[3] * w11 + (1 << (2 * PANO_BITS - 1))) >> (2 * PANO_BITS);
+}
+
+} // namespace
+
+Panorama::Panorama(int cols, int rows, const PixelRay &ray, double radius, double feather, const BayerKernel &kernel, const HeadProjection &project)
+    : m_cols(cols), m_rows(rows), m_heads(0)
+{
+    const int head_cols = kernel.out_cols();
+    const int head_rows = kernel.out_rows();
+    const double feather_px = std::max(1.0, feather * std::min(head_cols, head_rows));
+    for (size_t h = 0; h < LADYBUG_NUM_CAMERAS; h++)
+        m_blocks[h].assign((size_t)kernel.block_rows() * kernel.block_cols(), 0);
+    m_table.resize((size_t)cols * rows);
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < cols; c++)
+        {
+            // Point on the stitching sphere this pixel looks at
+            double dir[3];
+            ray(c, r, dir);
+            const double norm = radius / std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+            const double point[3] = {norm * dir[0], norm * dir[1], norm * dir[2]};
+
+            // Find the two heads that see this point furthest from their border
+            Tap best[2] = {};
+            double best_w[2] = {0.0, 0.0};
+            best[0].head = best[1].head = NO_HEAD;
+            for (size_t h = 0; h < LADYBUG_NUM_CAMERAS; h++)
+            {
+                double u, v;
+                if (!project(h, point, u, v) || !(u >= 0 && u <= head_cols - 1 && v >= 0 && v <= head_rows - 1))
+                    continue;
+                const double border = std::min(std::min(u, head_cols - 1 - u), std::min(v, head_rows - 1 - v));
+                const double w = std::min(1.0, (border + 1.0) / feather_px);
+                const int slot = (w > best_w[0]) ? 0 : (w > best_w[1]) ? 1 : -1;
+                if (slot < 0)
+                    continue;
+                if (slot == 0)
+                {
+                    best[1] = best[0];
+                    best_w[1] = best_w[0];
+                }
+                Tap &t = best[slot];
+                const int x = std::min((int)u, head_cols - 2);
+                const int y = std::min((int)v, head_rows - 2);
+                t.x = (int16_t)x;
+                t.y = (int16_t)y;
+                t.ax = (uint8_t)std::lround((u - x) * PANO_ONE);
+                t.ay = (uint8_t)std::lround((v - y) * PANO_ONE);
+                t.head = (uint8_t)h;
+                best_w[slot] = w;
+            }
+
+            // Feather between them, a single head gets the full weight
+            Entry &e = m_table[(size_t)r * cols + c];
+            e.tap[0] = best[0];
+            e.tap[1] = best[1];
+            const double total = best_w[0] + best_w[1];
+            e.tap[0].weight = (uint8_t)((total > 0) ? std::lround(PANO_ONE * best_w[0] / total) : PANO_ONE);
+            e.tap[1].weight = (uint8_t)(PANO_ONE - e.tap[0].weight);
+
+            // Remember the heads and kernel blocks of the 2x2 neighbourhoods we sample
+            for (int t = 0; t < 2 && e.tap[t].head != NO_HEAD; t++)
+            {
+                const Tap &tap = e.tap[t];
+                m_heads |= (1u << tap.head);
+                for (int dy = 0; dy < 2; dy++)
+                {
+                    for (int dx = 0; dx < 2; dx++)
+                    {
+                        const int br = (tap.y + dy) / BayerKernel::BLOCK_SIZE;
+                        const int bc = (tap.x + dx) / BayerKernel::BLOCK_SIZE;
+                        m_blocks[tap.head][br * kernel.block_cols() + bc] = 1;
+                    }
+                }
+            }
+        }
+    }
+}
+
+Panorama::PixelRay Panorama::equirectangular(int cols, int rows)
+{
+    return [cols, rows](int col, int row, double ray[3]) {
+        const double pi = 3.14159265358979323846;
+        const double phi = pi * (row + 0.5) / rows;
+        const double theta = pi - 2.0 * pi * (col + 0.5) / cols;
+        ray[0] = std::sin(phi) * std::cos(theta);
+        ray[1] = std::sin(phi) * std::sin(theta);
+        ray[2] = std::cos(phi);
+    };
+}
+
+Panorama::PixelRay Panorama::pinhole(int cols, int rows, double yaw, double pitch, double fov)
+{
+    // Forward, right and down axes of the virtual camera in the Ladybug frame
+    const double deg = 3.14159265358979323846 / 180.0;
+    const double f[3] = {std::cos(pitch * deg) * std::cos(yaw * deg), std::cos(pitch * deg) * std::sin(yaw * deg), std::sin(pitch * deg)};
+    const double r[3] = {std::sin(yaw * deg), -std::cos(yaw * deg), 0.0};
+    const double d[3] = {f[1] * r[2] - f[2] * r[1], f[2] * r[0] - f[0] * r[2], f[0] * r[1] - f[1] * r[0]};
+    const double focal = 0.5 * cols / std::tan(0.5 * fov * deg);
+    return [=](int col, int row, double ray[3]) {
+        const double x = (col + 0.5 - 0.5 * cols) / focal;
+        const double y = (row + 0.5 - 0.5 * rows) / focal;
+        for (int i = 0; i < 3; i++)
+            ray[i] = f[i] + x * r[i] + y * d[i];
+    };
+}
+
+std::unique_ptr<Panorama> Panorama::fromSdk(LadybugContext context, const BayerKernel &kernel, int cols, int rows, const PixelRay &ray,
+                                            double radius, double feather)
+{
+    // The SDK works on the side-ways heads, so make its rectified images the scaled heads before our rotation
+    LadybugError error =
+        ladybugSetOffScreenImageSize(context, LADYBUG_ALL_RECTIFIED_IMAGES, (unsigned int)kernel.out_rows(), (unsigned int)kernel.out_cols());
+    if (error != LADYBUG_OK)
+    {
+        ROS_ERROR("Unable to set the rectified image size (%s)", ladybugErrorToString(error));
+        return nullptr;
+    }
+
+    // Point -> side-ways rectified pixel -> raw distorted pixel -> published pixel
+    auto project = [&](size_t head, const double point[3], double &col, double &row) {
+        double rect_row, rect_col, raw_row, raw_col;
+        if (ladybugXYZtoRC(context, point[0], point[1], point[2], (unsigned int)head, &rect_row, &rect_col, nullptr) != LADYBUG_OK ||
+            rect_row < 0 || rect_col < 0)
+            return false;
+        if (ladybugUnrectifyPixel(context, (unsigned int)head, rect_row, rect_col, &raw_row, &raw_col) != LADYBUG_OK)
+            return false;
+        kernel.rawToOutput(raw_col, raw_row, col, row);
+        return true;
+    };
+    return std::unique_ptr<Panorama>(new Panorama(cols, rows, ray, radius, feather, kernel, project));
+}
+
+std::unique_ptr<Panorama> Panorama::fromCalibration(const sensor_msgs::CameraInfo calib[LADYBUG_NUM_CAMERAS],
+                                                    const double extrinsics[LADYBUG_NUM_CAMERAS][16], const BayerKernel &kernel, int cols,
+                                                    int rows, const PixelRay &ray, double radius, double feather)
+{
+    // Point -> camera frame of the calibration -> distorted calibration pixel -> published pixel
+    auto project = [&](size_t head, const double point[3], double &col, double &row) {
+        const double *T = extrinsics[head];
+        const double d[3] = {point[0] - T[3], point[1] - T[7], point[2] - T[11]};
+        const double X = T[0] * d[0] + T[4] * d[1] + T[8] * d[2];
+        const double Y = T[1] * d[0] + T[5] * d[1] + T[9] * d[2];
+        const double Z = T[2] * d[0] + T[6] * d[1] + T[10] * d[2];
+        if (Z <= 0)
+            return false;
+
+        // Far outside of the image the distortion polynomial folds back, so reject those rays first
+        const double x = X / Z, y = Y / Z;
+        const boost::array<double, 9> &k = calib[head].K;
+        const double margin = 0.25;
+        const double u0 = k[0] * x + k[1] * y + k[2], v0 = k[4] * y + k[5];
+        if (u0 < -margin * calib[head].width || u0 > (1 + margin) * calib[head].width || v0 < -margin * calib[head].height ||
+            v0 > (1 + margin) * calib[head].height)
+            return false;
+        double xd, yd;
+        distortPoint(calib[head].D, x, y, xd, yd);
+        calibrationToOutput(calib[head], kernel, k[0] * xd + k[1] * yd + k[2], k[4] * yd + k[5], col, row);
+        return true;
+    };
+    return std::unique_ptr<Panorama>(new Panorama(cols, rows, ray, radius, feather, kernel, project));
+}
+
+void Panorama::render(const uint8_t *const heads[LADYBUG_NUM_CAMERAS], size_t head_step, uint8_t *out, size_t out_step, int r0, int r1) const
+{
+    for (int r = r0; r < r1; r++)
+    {
+        const Entry *e = m_table.data() + (size_t)r * m_cols;
+        uint8_t *dst = out + (size_t)r * out_step;
+        for (int c = 0; c < m_cols; c++, e++, dst += 3)
+        {
+            int acc[3] = {0, 0, 0};
+            for (int t = 0; t < 2; t++)
+            {
+                const Tap &tap = e->tap[t];
+                if (tap.head == NO_HEAD)
+                    break;
+                const uint8_t *p0 = heads[tap.head] + (size_t)tap.y * head_step + (size_t)tap.x * 3;
+                const uint8_t *p1 = p0 + head_step;
+                const int w00 = (PANO_ONE - tap.ax) * (PANO_ONE - tap.ay);
+                const int w01 = tap.ax * (PANO_ONE - tap.ay);
+                const int w10 = (PANO_ONE - tap.ax) * tap.ay;
+                const int w11 = tap.ax * tap.ay;
+                acc[0] += tap.weight * sample(p0, p1, w00, w01, w10, w11);
+                acc[1] += tap.weight * sample(p0 + 1, p1 + 1, w00, w01, w10, w11);
+                acc[2] += tap.weight * sample(p0 + 2, p1 + 2, w00, w01, w10, w11);
+            }
+            dst[0] = (uint8_t)((acc[0] + PANO_ONE / 2) >> PANO_BITS);
+            dst[1] = (uint8_t)((acc[1] + PANO_ONE / 2) >> PANO_BITS);
+            dst[2] = (uint8_t)((acc[2] + PANO_ONE / 2) >> PANO_BITS);
+        }
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef LADYBUG_PANORAMA_H
+#define LADYBUG_PANORAMA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <sensor_msgs/CameraInfo.h>
+
+#include "bayer_kernel.h"
+#include "ladybug.h"
+
+/**
+ * Image stitched on the CPU from the published images of the six heads, e.g. an equirectangular panorama or a virtual pinhole view
+ *
+ * Every output pixel is a ray from the camera center, which is intersected with a sphere of the stitching radius and
+ * projected into the heads. A table built once holds, per output pixel, the (up to) two heads that see it best,
+ * their subpixel positions, and a feather weight that fades each head out towards its border. Rendering then only does
+ * integer bilinear sampling and blending, and can be split into independent row blocks.
+ * The table also knows which heads, and which kernel blocks of them, it samples, so nothing else has to be demosaiced.
+ *
+ * The Ladybug frame has X through head 0 and Z up, see equirectangular() and pinhole() for how the outputs are oriented.
+ */
+class Panorama
+{
+  public:
+    /**
+     * Function giving the ray through output pixel (col, row), in the Ladybug frame
+     */
+    typedef std::function<void(int col, int row, double ray[3])> PixelRay;
+
+    /**
+     * Function giving the published pixel (col, row) of head that sees a point in the Ladybug frame, or false if it does not
+     */
+    typedef std::function<bool(size_t head, const double point[3], double &col, double &row)> HeadProjection;
+
+    /**
+     * Build the table of a cols x rows output, for heads published by this kernel
+     * Heads fade out over the outer feather fraction of their smallest side
+     */
+    Panorama(int cols, int rows, const PixelRay &ray, double radius, double feather, const BayerKernel &kernel, const HeadProjection &project);
+
+    /**
+     * Equirectangular panorama, columns go from +pi (left) to -pi (right) around Z with head 0 in the center,
+     * and rows go from straight up to straight down, which is the SDK's panoramic convention
+     */
+    static PixelRay equirectangular(int cols, int rows);
+
+    /**
+     * Virtual pinhole camera looking at yaw (around Z, from head 0 to the left) and pitch (up), in degrees
+     * The horizontal field of view is fov degrees, pixels are square and the principal point is the image center
+     */
+    static PixelRay pinhole(int cols, int rows, double yaw, double pitch, double fov);
+
+    /**
+     * Stitch with the camera's own calibration, which has to be loaded into the context with ladybugLoadConfig()
+     */
+    static std::unique_ptr<Panorama> fromSdk(LadybugContext context, const BayerKernel &kernel, int cols, int rows, const PixelRay &ray,
+                                             double radius, double feather);
+
+    /**
+     * Stitch with the calibration files of the heads, which all need an intrinsic calibration and extrinsics
+     */
+    static std::unique_ptr<Panorama> fromCalibration(const sensor_msgs::CameraInfo calib[LADYBUG_NUM_CAMERAS],
+                                                     const double extrinsics[LADYBUG_NUM_CAMERAS][16], const BayerKernel &kernel, int cols,
+                                                     int rows, const PixelRay &ray, double radius, double feather);
+
+    /**
+     * Render rows [r0, r1) of the output from the published RGB8 images of the heads it samples
+     * Rows are independent, so blocks of them can be rendered in parallel
+     */
+    void render(const uint8_t *const heads[LADYBUG_NUM_CAMERAS], size_t head_step, uint8_t *out, size_t out_step, int r0, int r1) const;
+
+    int cols() const { return m_cols; }
+    int rows() const { return m_rows; }
+
+    // Heads this samples, bit i is head i
+    uint32_t heads() const { return m_heads; }
+
+    // Kernel blocks of a head this samples, in the layout of BayerKernel::process()
+    const std::vector<uint8_t> &blocks(size_t head) const { return m_blocks[head]; }
+
+  private:
+    // Bilinear sample of one head, with 7-bit fractions
+    struct Tap
+    {
+        int16_t x, y;
+        uint8_t ax, ay;
+        uint8_t head;
+        uint8_t weight;
+    };
+
+    // The two taps of a pixel, unused taps have head NO_HEAD
+    struct Entry
+    {
+        Tap tap[2];
+    };
+
+    int m_cols, m_rows;
+    std::vector<Entry> m_table;
+    uint32_t m_heads;
+    std::vector<uint8_t> m_blocks[LADYBUG_NUM_CAMERAS];
+};
+
+#endif // LADYBUG_PANORAMA_H
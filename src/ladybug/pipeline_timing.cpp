@@ -0,0 +1,142 @@
+#include "pipeline_timing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+namespace
+{
+
+const char *STAGE_NAMES[NUM_STAGES] = {"Acquire", "Queue", "Decode", "Demosaic", "Rectify", "Publish", "Stitch", "Process", "Unlock", "End to end"};
+
+} // namespace
+
+const int LatencyHistogram::SUB_BUCKET_BITS;
+const int LatencyHistogram::SUB_BUCKETS;
+const int LatencyHistogram::MAX_EXPONENT;
+const int LatencyHistogram::NUM_BUCKETS;
+const size_t PipelineTiming::ALL_HEADS;
+
+LatencyHistogram::LatencyHistogram()
+{
+    for (auto &count : m_counts)
+        count.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::snapshot(std::vector<uint64_t> &counts) const
+{
+    counts.resize(NUM_BUCKETS);
+    for (int b = 0; b < NUM_BUCKETS; b++)
+        counts[b] = m_counts[b].load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::percentile(const std::vector<uint64_t> &counts, double p)
+{
+    uint64_t total = 0;
+    for (uint64_t count : counts)
+        total += count;
+    if (total == 0)
+        return 0.0;
+    const uint64_t target = std::max<uint64_t>(1, (uint64_t)std::ceil(p * total));
+    uint64_t seen = 0;
+    for (int b = 0; b < (int)counts.size(); b++)
+    {
+        seen += counts[b];
+        if (seen >= target)
+            return midpoint(b);
+    }
+    return midpoint((int)counts.size() - 1);
+}
+
+double LatencyHistogram::max(const std::vector<uint64_t> &counts)
+{
+    for (int b = (int)counts.size() - 1; b >= 0; b--)
+    {
+        if (counts[b] > 0)
+            return midpoint(b);
+    }
+    return 0.0;
+}
+
+int LatencyHistogram::bucket(uint64_t us)
+{
+    if (us < (uint64_t)SUB_BUCKETS)
+        return (int)us;
+    const int exponent = 63 - __builtin_clzll(us);
+    if (exponent > MAX_EXPONENT)
+        return NUM_BUCKETS - 1;
+
+    // The top SUB_BUCKET_BITS + 1 bits of the value, the leading one is implied
+    const int sub = (int)(us >> (exponent - SUB_BUCKET_BITS)) - SUB_BUCKETS;
+    return SUB_BUCKETS * (exponent - SUB_BUCKET_BITS + 1) + sub;
+}
+
+double LatencyHistogram::midpoint(int bucket)
+{
+    if (bucket < SUB_BUCKETS)
+        return (double)bucket;
+    const int exponent = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    const int sub = bucket % SUB_BUCKETS;
+    const double width = (double)(1ull << (exponent - SUB_BUCKET_BITS));
+    return (SUB_BUCKETS + sub) * width + 0.5 * (width - 1.0);
+}
+
+PipelineTiming::PipelineTiming() : m_enabled(false), m_recordCostNs(0.0)
+{
+    // Measure what timing one stage costs, into a scratch histogram so the real ones stay empty
+    LatencyHistogram scratch;
+    const int N = 10000;
+    const Clock::time_point start = Clock::now();
+    for (int i = 0; i < N; i++)
+    {
+        const Clock::time_point a = Clock::now();
+        const Clock::time_point b = Clock::now();
+        const uint64_t us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(b - a).count();
+        scratch.record(us);
+        scratch.record(us);
+    }
+    m_recordCostNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / N;
+}
+
+void PipelineTiming::diagnose(diagnostic_updater::DiagnosticStatusWrapper &stat)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!enabled())
+        stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Timing is off");
+    else
+        stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Latency since the last report");
+    stat.add("Cost per timed stage (ns)", m_recordCostNs);
+
+    // Everything recorded since the last report is the difference with the counts we kept then
+    std::vector<uint64_t> counts, window(LatencyHistogram::NUM_BUCKETS);
+    uint64_t records = 0, frames = 0;
+    for (int s = 0; s < NUM_STAGES; s++)
+    {
+        for (size_t h = 0; h <= LADYBUG_NUM_CAMERAS; h++)
+        {
+            // List the whole stage first, then its heads
+            const size_t head = (h == 0) ? ALL_HEADS : h - 1;
+            m_histograms[s][head].snapshot(counts);
+            std::vector<uint64_t> &last = m_last[s][head];
+            last.resize(LatencyHistogram::NUM_BUCKETS, 0);
+            uint64_t n = 0;
+            for (int b = 0; b < LatencyHistogram::NUM_BUCKETS; b++)
+            {
+                window[b] = counts[b] - last[b];
+                n += window[b];
+            }
+            last.swap(counts);
+            if (n == 0)
+                continue;
+            if (head == ALL_HEADS)
+                records += n;
+            if (head == ALL_HEADS && s == STAGE_PROCESS)
+                frames = n;
+            const std::string name = (head == ALL_HEADS) ? STAGE_NAMES[s] : std::string(STAGE_NAMES[s]) + " head " + std::to_string(head);
+            stat.addf(name, "p50 %.2f, p90 %.2f, p99 %.2f, max %.2f ms (%d)", 1e-3 * LatencyHistogram::percentile(window, 0.5),
+                      1e-3 * LatencyHistogram::percentile(window, 0.9), 1e-3 * LatencyHistogram::percentile(window, 0.99),
+                      1e-3 * LatencyHistogram::max(window), (int)n);
+        }
+    }
+    stat.add("Overhead per frame (us)", frames > 0 ? 1e-3 * m_recordCostNs * records / frames : 0.0);
+}
@@ -0,0 +1,136 @@
+#ifndef LADYBUG_PIPELINE_TIMING_H
+#define LADYBUG_PIPELINE_TIMING_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <diagnostic_updater/diagnostic_updater.h>
+
+#include "ladybug.h"
+
+/**
+ * Lock-free latency histogram with log-linear buckets, like HdrHistogram
+ *
+ * Values below SUB_BUCKETS microseconds get a bucket each, above that every power of two is split into SUB_BUCKETS
+ * equal buckets. So a bucket is never wider than 1/SUB_BUCKETS of its value, and reporting bucket midpoints is
+ * within about 3% of the real value, from 1 us up to MAX_EXPONENT (over a minute).
+ * record() is a single relaxed atomic add and can be called from any thread.
+ */
+class LatencyHistogram
+{
+  public:
+    static const int SUB_BUCKET_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int MAX_EXPONENT = 26;
+    static const int NUM_BUCKETS = SUB_BUCKETS * (MAX_EXPONENT - SUB_BUCKET_BITS + 2);
+
+    LatencyHistogram();
+
+    /**
+     * Count one value in microseconds, larger values than the histogram covers go into the last bucket
+     */
+    void record(uint64_t us)
+    {
+        m_counts[bucket(us)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Copy the current counts, so a reader can diff two snapshots to get the values of a window
+     */
+    void snapshot(std::vector<uint64_t> &counts) const;
+
+    /**
+     * Value in microseconds at percentile p [0,1] of these counts, the midpoint of its bucket
+     */
+    static double percentile(const std::vector<uint64_t> &counts, double p);
+
+    /**
+     * Midpoint in microseconds of the highest bucket with a count
+     */
+    static double max(const std::vector<uint64_t> &counts);
+
+  private:
+    static int bucket(uint64_t us);
+    static double midpoint(int bucket);
+
+    std::atomic<uint64_t> m_counts[NUM_BUCKETS];
+};
+
+/**
+ * Where the time of a frame goes, from locking the buffer to publishing its last output
+ * The demosaic stage is the fused demosaic, scale and rotate of BayerKernel, so those can not be split further
+ */
+enum PipelineStage
+{
+    STAGE_ACQUIRE,    // waiting in lockNext for the camera
+    STAGE_QUEUE,      // locked, waiting in the ring for processing
+    STAGE_DECODE,     // decoding the JPEG tiles, or unpacking the RAW12 plane of one head
+    STAGE_DEMOSAIC,   // demosaic, scale and rotate of one head
+    STAGE_RECTIFY,    // remapping one head into image_rect
+    STAGE_PUBLISH,    // publishing the image and camera_info of one head
+    STAGE_STITCH,     // rendering the panorama and views
+    STAGE_PROCESS,    // all processing of a frame
+    STAGE_UNLOCK,     // giving the buffer back
+    STAGE_END_TO_END, // camera exposure to the last publish, only with camera clock stamps
+    NUM_STAGES
+};
+
+/**
+ * Latency histograms of every stage of the pipeline, and of every head for the per-head stages
+ *
+ * Recording is lock-free, and costs two clock reads and one or two atomic adds per stage. It can be switched on and off
+ * at runtime, and when it is off the driver skips the clock reads too. The cost of one record is measured when this is
+ * created, and diagnostics report it per frame next to the percentiles of everything recorded since the last report.
+ */
+class PipelineTiming
+{
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    // Head index of the histograms that cover the whole frame (or all heads of a per-head stage)
+    static const size_t ALL_HEADS = LADYBUG_NUM_CAMERAS;
+
+    PipelineTiming();
+
+    void setEnabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * Record a stage of the whole frame, or of one head, which then also counts towards all heads
+     */
+    void record(PipelineStage stage, Clock::time_point start, Clock::time_point end, size_t head = ALL_HEADS)
+    {
+        recordUs(stage, (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(end - start).count(), head);
+    }
+    void recordUs(PipelineStage stage, uint64_t us, size_t head = ALL_HEADS)
+    {
+        m_histograms[stage][ALL_HEADS].record(us);
+        if (head != ALL_HEADS)
+            m_histograms[stage][head].record(us);
+    }
+
+    /**
+     * Percentiles of every stage since the last call, and the measured overhead
+     */
+    void diagnose(diagnostic_updater::DiagnosticStatusWrapper &stat);
+
+  private:
+    PipelineTiming(const PipelineTiming &) = delete;
+    PipelineTiming &operator=(const PipelineTiming &) = delete;
+
+    std::atomic<bool> m_enabled;
+    LatencyHistogram m_histograms[NUM_STAGES][LADYBUG_NUM_CAMERAS + 1];
+
+    // Cost of one timed stage (two clock reads and two records) in nanoseconds
+    double m_recordCostNs;
+
+    // Counts at the last report, only used by diagnose()
+    std::mutex m_mutex;
+    std::vector<uint64_t> m_last[NUM_STAGES][LADYBUG_NUM_CAMERAS + 1];
+};
+
+#endif // LADYBUG_PIPELINE_TIMING_H
@@ -0,0 +1,190 @@
+#include "rate_controller.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include <ros/ros.h>
+
+namespace
+{
+
+/**
+ * Values from max down to min, evenly spaced on a log scale with neighbours at most a factor step apart
+ */
+std::vector<double> stepsDown(double max, double min, double step)
+{
+    const int n = (max > min) ? (int)std::ceil(std::log(min / max) / std::log(step) - 1e-9) : 0;
+    std::vector<double> values(1, max);
+    for (int i = 1; i <= n; i++)
+        values.push_back(max * std::pow(min / max, (double)i / n));
+    return values;
+}
+
+} // namespace
+
+RateController::RateController(const RateControlConfig &config)
+    : m_config(config), m_step(0), m_started(false), m_windowDropped(0), m_busy(0), m_depthSum(0), m_frames(0), m_capacity(1),
+      m_settling(false), m_calmWindows(0), m_recoverWindows(std::max(1, config.recover_windows)), m_windowsSinceChange(0), m_recovered(false),
+      m_load(0), m_meanDepth(0), m_drops(0), m_failedRecoveries(0), m_changes(0)
+{
+    // Lower the scale first, then the frame rate at the lowest scale
+    const std::vector<double> scales = stepsDown(config.max_scale, config.min_scale, config.step);
+    for (double scale : scales)
+        m_ladder.push_back({config.max_frame_rate, scale});
+    if (config.adapt_frame_rate)
+    {
+        const std::vector<double> rates = stepsDown(config.max_frame_rate, config.min_frame_rate, config.step);
+        for (size_t i = 1; i < rates.size(); i++)
+            m_ladder.push_back({rates[i], scales.back()});
+    }
+    ROS_INFO("Adaptive control has %d steps, down to %.1f fps at %.1f%%", (int)m_ladder.size(), m_ladder.back().frame_rate,
+             m_ladder.back().scale);
+}
+
+void RateController::recordFrame(double busy, size_t depth, size_t capacity)
+{
+    m_busy += busy;
+    m_depthSum += (double)depth;
+    m_frames++;
+    m_capacity = std::max<size_t>(1, capacity);
+}
+
+bool RateController::update(std::chrono::steady_clock::time_point now, uint64_t dropped)
+{
+    if (!m_started)
+    {
+        resetWindow(now, dropped);
+        m_started = true;
+        return false;
+    }
+    const double elapsed = std::chrono::duration<double>(now - m_windowStart).count();
+    if (elapsed < m_config.window || m_frames == 0)
+        return false;
+
+    // What this window looked like
+    const double load = m_busy / elapsed;
+    const double mean_depth = m_depthSum / (double)m_frames;
+    const uint64_t drops = dropped - m_windowDropped;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_load = load;
+        m_meanDepth = mean_depth;
+        m_drops = drops;
+    }
+
+    // The window right after a change still has the rebuild of the kernel tables in it
+    const bool settling = m_settling;
+    resetWindow(now, dropped);
+    if (settling)
+        return false;
+
+    // A recovery that held for long enough was not a mistake, so the next one need not wait longer
+    m_windowsSinceChange++;
+    if (m_recovered && m_windowsSinceChange >= m_config.recover_windows)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_recovered = false;
+        m_recoverWindows = std::max(1, m_config.recover_windows);
+    }
+
+    // Overloaded, go one step down right away
+    // Right after a recovery that means it failed, so wait twice as long before trying again
+    const bool backlog = mean_depth > 0.5 * (double)m_capacity;
+    if ((drops > 0 || load > m_config.high_load || backlog) && m_step + 1 < m_ladder.size())
+    {
+        char reason[128];
+        snprintf(reason, sizeof(reason), "%d dropped, load %.2f, mean ring depth %.1f", (int)drops, load, mean_depth);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_recovered)
+        {
+            m_recoverWindows = std::min(2 * m_recoverWindows, MAX_BACKOFF * std::max(1, m_config.recover_windows));
+            m_failedRecoveries++;
+        }
+        m_step++;
+        m_calmWindows = 0;
+        m_windowsSinceChange = 0;
+        m_recovered = false;
+        m_settling = true;
+        m_changes++;
+        m_reason = reason;
+        ROS_WARN("Processing can not keep up (%s), degrading to %.1f fps at %.1f%%", reason, m_ladder[m_step].frame_rate,
+                 m_ladder[m_step].scale);
+        return true;
+    }
+
+    // Calm for long enough, go one step up if the load predicted for it is still fine
+    // NOTE: the load is taken to grow linearly with the frame rate and with the number of pixels, the square of the scale
+    const bool calm = drops == 0 && load < m_config.low_load && mean_depth <= 0.25 * (double)m_capacity;
+    m_calmWindows = calm ? m_calmWindows + 1 : 0;
+    if (m_step == 0 || m_calmWindows < m_recoverWindows)
+        return false;
+    const Step &current = m_ladder[m_step];
+    const Step &next = m_ladder[m_step - 1];
+    const double scale_ratio = next.scale / current.scale;
+    const double predicted = load * (next.frame_rate / current.frame_rate) * scale_ratio * scale_ratio;
+    if (predicted > m_config.high_load)
+        return false;
+    char reason[128];
+    snprintf(reason, sizeof(reason), "load %.2f for %d windows, predicted %.2f", load, m_calmWindows, predicted);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_step--;
+    m_calmWindows = 0;
+    m_windowsSinceChange = 0;
+    m_recovered = true;
+    m_settling = true;
+    m_changes++;
+    m_reason = reason;
+    ROS_INFO("Processing has headroom (%s), recovering to %.1f fps at %.1f%%", reason, m_ladder[m_step].frame_rate, m_ladder[m_step].scale);
+    return true;
+}
+
+void RateController::hold(std::chrono::steady_clock::time_point now, uint64_t dropped)
+{
+    resetWindow(now, dropped);
+    m_started = true;
+    m_settling = true;
+}
+
+double RateController::frameRate() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_ladder[m_step].frame_rate;
+}
+
+double RateController::scale() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_ladder[m_step].scale;
+}
+
+void RateController::diagnose(diagnostic_updater::DiagnosticStatusWrapper &stat)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_step == 0)
+        stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Full frame rate and scale");
+    else
+        stat.summaryf(diagnostic_msgs::DiagnosticStatus::WARN, "Degraded to %.1f fps at %.1f%%", m_ladder[m_step].frame_rate,
+                      m_ladder[m_step].scale);
+    stat.add("Step", m_step);
+    stat.add("Steps", m_ladder.size());
+    stat.add("Frame rate", m_ladder[m_step].frame_rate);
+    stat.add("Scale (%)", m_ladder[m_step].scale);
+    stat.add("Load", m_load);
+    stat.add("Mean ring depth", m_meanDepth);
+    stat.add("Dropped (last window)", m_drops);
+    stat.add("Changes", m_changes);
+    stat.add("Failed recoveries", m_failedRecoveries);
+    stat.add("Calm windows to recover", m_recoverWindows);
+    stat.add("Last change", m_reason);
+}
+
+void RateController::resetWindow(std::chrono::steady_clock::time_point now, uint64_t dropped)
+{
+    m_windowStart = now;
+    m_windowDropped = dropped;
+    m_busy = 0;
+    m_depthSum = 0;
+    m_frames = 0;
+    m_settling = false;
+}
@@ -0,0 +1,128 @@
+#ifndef LADYBUG_RATE_CONTROLLER_H
+#define LADYBUG_RATE_CONTROLLER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <diagnostic_updater/diagnostic_updater.h>
+
+/**
+ * Bounds and thresholds of the adaptive frame rate and scale control
+ */
+struct RateControlConfig
+{
+    // The controller starts at the max, and never goes outside of these
+    double min_frame_rate, max_frame_rate;
+    double min_scale, max_scale;
+
+    // False if the camera can not change its frame rate, then only the scale is adapted
+    bool adapt_frame_rate;
+
+    // Fraction of the wall time processing may be busy, above high we degrade and below low we may recover
+    double high_load, low_load;
+
+    // Length of a measurement window in seconds, and how many calm windows in a row it takes to recover one step
+    double window;
+    int recover_windows;
+
+    // Factor between neighbouring steps of the frame rate and of the scale
+    double step;
+};
+
+/**
+ * Degrades the frame rate and output scale in fixed steps when processing can not keep up, and recovers them when it can
+ *
+ * Processing reports how long each frame took, how deep the ring is, and how many frames the grab thread dropped.
+ * Every window these give the load (busy fraction of the wall time) and the backlog. Any drops, a load above high_load,
+ * or a ring that is on average more than half full moves one step down the ladder right away. The window after a change
+ * is not judged, since rebuilding the kernel tables makes it look worse than it is.
+ * Only after recover_windows calm windows in a row, and only if the load predicted for the step above is still below
+ * high_load, do we move one step back up. The load is predicted to grow with the frame rate and the square of the scale.
+ * A step down within recover_windows of a step up means the recovery failed, and doubles the calm windows the next one
+ * takes (up to MAX_BACKOFF times recover_windows). Once a recovered step holds for recover_windows it is back to normal.
+ * Together this keeps the controller from flapping between two steps.
+ *
+ * The ladder first lowers the scale down to min_scale and then the frame rate, recovering goes the other way round.
+ * All calls come from the processing thread, the mutex is only there for diagnostics.
+ */
+class RateController
+{
+  public:
+    explicit RateController(const RateControlConfig &config);
+
+    /**
+     * Record a processed frame, how long processing it took (s), and the depth of the ring after it
+     */
+    void recordFrame(double busy, size_t depth, size_t capacity);
+
+    /**
+     * Judge the window once it is complete, with the total number of frames the grab thread has dropped so far
+     * Returns true if the controller moved to another step, frameRate() and scale() then hold the new settings
+     */
+    bool update(std::chrono::steady_clock::time_point now, uint64_t dropped);
+
+    /**
+     * Discard the current window instead of judging it, and skip the next one as well
+     * For while the settings of a new step are not in effect yet, like the tables of a new scale that are still being built
+     */
+    void hold(std::chrono::steady_clock::time_point now, uint64_t dropped);
+
+    double frameRate() const;
+    double scale() const;
+
+    /**
+     * Diagnostics about the current step and the load of the last window
+     */
+    void diagnose(diagnostic_updater::DiagnosticStatusWrapper &stat);
+
+    // Most a failed recovery can stretch the calm windows needed for the next one, as a factor of recover_windows
+    static const int MAX_BACKOFF = 8;
+
+  private:
+    // One step of the ladder
+    struct Step
+    {
+        double frame_rate;
+        double scale;
+    };
+
+    /**
+     * Start a new window at now
+     */
+    void resetWindow(std::chrono::steady_clock::time_point now, uint64_t dropped);
+
+    RateControlConfig m_config;
+    std::vector<Step> m_ladder;
+    size_t m_step;
+
+    // Current window
+    bool m_started;
+    std::chrono::steady_clock::time_point m_windowStart;
+    uint64_t m_windowDropped;
+    double m_busy;
+    double m_depthSum;
+    size_t m_frames;
+    size_t m_capacity;
+    bool m_settling;
+    int m_calmWindows;
+
+    // Calm windows the next recovery takes, and windows judged since the last change, which was a recovery if m_recovered
+    int m_recoverWindows;
+    int m_windowsSinceChange;
+    bool m_recovered;
+
+    // Last judged window and decision, for diagnostics
+    mutable std::mutex m_mutex;
+    double m_load;
+    double m_meanDepth;
+    uint64_t m_drops;
+    uint64_t m_failedRecoveries;
+    uint64_t m_changes;
+    std::string m_reason;
+};
+
+#endif // LADYBUG_RATE_CONTROLLER_H
@@ -0,0 +1,83 @@
+#include "raw_unpack.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+#define LADYBUG_HAVE_SSSE3_UNPACK
+#endif
+
+namespace
+{
+
+/**
+ * Unpack one pair of pixels from its three bytes
+ */
+inline void unpackPair(const uint8_t *src, uint16_t *dst)
+{
+    dst[0] = (uint16_t)((src[0] << 8) | (src[2] & 0xf0));
+    dst[1] = (uint16_t)((src[1] << 8) | ((src[2] << 4) & 0xf0));
+}
+
+#ifdef LADYBUG_HAVE_SSSE3_UNPACK
+/**
+ * Unpack 8 pixels from every 12 bytes with a single shuffle
+ *
+ * The shuffle puts the shared low nibble byte under the high byte of both pixels of a pair.
+ * The first pixel of a pair then only has to mask out the low nibble, and the second one shifts it up first.
+ * NOTE: every load reads 16 bytes for the 12 it uses, so the last few pairs are left to the scalar loop
+ */
+__attribute__((target("ssse3"))) void unpackRaw12Ssse3(const uint8_t *packed, uint16_t *samples, size_t num_pixels)
+{
+    const __m128i shuffle = _mm_setr_epi8(2, 0, 2, 1, 5, 3, 5, 4, 8, 6, 8, 7, 11, 9, 11, 10);
+    const __m128i keep = _mm_set1_epi32((int)0xff00fff0);
+    const __m128i shifted_low = _mm_set1_epi32(0x00f00000);
+    size_t i = 0;
+    for (; i * 3 / 2 + 16 <= num_pixels * 3 / 2; i += 8)
+    {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(packed + i * 3 / 2));
+        const __m128i pairs = _mm_shuffle_epi8(bytes, shuffle);
+        const __m128i values = _mm_or_si128(_mm_and_si128(pairs, keep), _mm_and_si128(_mm_slli_epi16(pairs, 4), shifted_low));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(samples + i), values);
+    }
+    unpackRaw12Scalar(packed + i * 3 / 2, samples + i, num_pixels - i);
+}
+#endif
+
+} // namespace
+
+void unpackRaw12Scalar(const uint8_t *packed, uint16_t *samples, size_t num_pixels)
+{
+    for (size_t i = 0; i < num_pixels; i += 2, packed += 3, samples += 2)
+        unpackPair(packed, samples);
+}
+
+void unpackRaw12(const uint8_t *packed, uint16_t *samples, size_t num_pixels)
+{
+#ifdef LADYBUG_HAVE_SSSE3_UNPACK
+    static const bool ssse3 = __builtin_cpu_supports("ssse3");
+    if (ssse3)
+    {
+        unpackRaw12Ssse3(packed, samples, num_pixels);
+        return;
+    }
+#endif
+    unpackRaw12Scalar(packed, samples, num_pixels);
+}
+
+void packRaw12(const uint16_t *samples, uint8_t *packed, size_t num_pixels)
+{
+    for (size_t i = 0; i < num_pixels; i += 2, samples += 2, packed += 3)
+    {
+        packed[0] = (uint8_t)(samples[0] >> 8);
+        packed[1] = (uint8_t)(samples[1] >> 8);
+        packed[2] = (uint8_t)((samples[0] & 0xf0) | ((samples[1] >> 4) & 0x0f));
+    }
+}
+
+bool unpackRaw12IsVectorized()
+{
+#ifdef LADYBUG_HAVE_SSSE3_UNPACK
+    return __builtin_cpu_supports("ssse3");
+#else
+    return false;
+#endif
+}
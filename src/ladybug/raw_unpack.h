@@ -0,0 +1,33 @@
+#ifndef LADYBUG_RAW_UNPACK_H
+#define LADYBUG_RAW_UNPACK_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Unpack RAW12 pixels into 16-bit samples with the value in the high 12 bits, like RAW16
+ *
+ * Every pair of pixels is packed into three bytes: the top 8 bits of the first and of the second pixel,
+ * then the low 4 bits of the first in the high nibble and of the second in the low nibble.
+ * On CPUs with SSSE3 this unpacks 8 pixels per shuffle, otherwise it falls back to a scalar loop.
+ * The number of pixels must be even.
+ */
+void unpackRaw12(const uint8_t *packed, uint16_t *samples, size_t num_pixels);
+
+/**
+ * The scalar loop unpackRaw12 falls back to, for checking and timing the SSSE3 version against
+ */
+void unpackRaw12Scalar(const uint8_t *packed, uint16_t *samples, size_t num_pixels);
+
+/**
+ * Pack 16-bit samples into RAW12, keeping their high 12 bits, the inverse of unpackRaw12
+ * This is for image sources that are not a real camera
+ */
+void packRaw12(const uint16_t *samples, uint8_t *packed, size_t num_pixels);
+
+/**
+ * True if unpackRaw12 uses the SSSE3 version on this CPU
+ */
+bool unpackRaw12IsVectorized();
+
+#endif // LADYBUG_RAW_UNPACK_H
@@ -0,0 +1,151 @@
+#include "rectifier.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <ros/ros.h>
+
+#include "camera_calibration.h"
+#include "ladybuggeom.h"
+#include "ladybugrenderer.h"
+
+namespace
+{
+
+// Bilinear fractions have 7 bits, so the product of two weights fits in 14 bits
+const int REMAP_BITS = 7;
+const int REMAP_ONE = 1 << REMAP_BITS;
+
+/**
+ * Invert a row-major 3x3 matrix, returns false if it is singular
+ */
+bool invert3x3(const double *m, double *inv)
+{
+    const double c00 = m[4] * m[8] - m[5] * m[7];
+    const double c01 = m[5] * m[6] - m[3] * m[8];
+    const double c02 = m[3] * m[7] - m[4] * m[6];
+    const double det = m[0] * c00 + m[1] * c01 + m[2] * c02;
+    if (std::abs(det) < 1e-12)
+        return false;
+    inv[0] = c00 / det;
+    inv[1] = (m[2] * m[7] - m[1] * m[8]) / det;
+    inv[2] = (m[1] * m[5] - m[2] * m[4]) / det;
+    inv[3] = c01 / det;
+    inv[4] = (m[0] * m[8] - m[2] * m[6]) / det;
+    inv[5] = (m[2] * m[3] - m[0] * m[5]) / det;
+    inv[6] = c02 / det;
+    inv[7] = (m[1] * m[6] - m[0] * m[7]) / det;
+    inv[8] = (m[0] * m[4] - m[1] * m[3]) / det;
+    return true;
+}
+
+} // namespace
+
+Rectifier::Rectifier(int cols, int rows, int src_cols, int src_rows, const PixelMap &map) : m_cols(cols), m_rows(rows)
+{
+    // Each entry holds the top-left pixel of its 2x2 neighbourhood, which must stay inside of the source
+    m_table.resize((size_t)cols * rows);
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < cols; c++)
+        {
+            Entry &e = m_table[(size_t)r * cols + c];
+            double u, v;
+            if (!map(c, r, u, v) || !(u >= -0.5 && u <= src_cols - 0.5 && v >= -0.5 && v <= src_rows - 0.5))
+            {
+                e.x = e.y = -1;
+                e.ax = e.ay = 0;
+                continue;
+            }
+            u = std::min(std::max(u, 0.0), src_cols - 1.0);
+            v = std::min(std::max(v, 0.0), src_rows - 1.0);
+            const int x = std::min((int)u, src_cols - 2);
+            const int y = std::min((int)v, src_rows - 2);
+            e.x = (int16_t)x;
+            e.y = (int16_t)y;
+            e.ax = (uint8_t)std::lround((u - x) * REMAP_ONE);
+            e.ay = (uint8_t)std::lround((v - y) * REMAP_ONE);
+        }
+    }
+}
+
+std::unique_ptr<Rectifier> Rectifier::fromCalibration(const sensor_msgs::CameraInfo &info)
+{
+    // Rays of the rectified camera, rotated back into the distorted camera
+    double p[9] = {info.P[0], info.P[1], info.P[2], info.P[4], info.P[5], info.P[6], info.P[8], info.P[9], info.P[10]};
+    double p_inv[9];
+    if (info.width < 2 || info.height < 2 || !invert3x3(p, p_inv))
+    {
+        ROS_ERROR("Unable to rectify with this calibration, it needs a valid P");
+        return nullptr;
+    }
+    const boost::array<double, 9> &k = info.K;
+    const boost::array<double, 9> &rot = info.R;
+
+    // Same as cv::initUndistortRectifyMap, with plumb_bob or rational_polynomial distortion
+    auto map = [&](double col, double row, double &u, double &v) {
+        const double ray[3] = {p_inv[0] * col + p_inv[1] * row + p_inv[2], p_inv[3] * col + p_inv[4] * row + p_inv[5],
+                               p_inv[6] * col + p_inv[7] * row + p_inv[8]};
+        const double X = rot[0] * ray[0] + rot[3] * ray[1] + rot[6] * ray[2];
+        const double Y = rot[1] * ray[0] + rot[4] * ray[1] + rot[7] * ray[2];
+        const double Z = rot[2] * ray[0] + rot[5] * ray[1] + rot[8] * ray[2];
+        if (Z <= 0)
+            return false;
+        double xd, yd;
+        distortPoint(info.D, X / Z, Y / Z, xd, yd);
+        u = k[0] * xd + k[1] * yd + k[2];
+        v = k[3] * xd + k[4] * yd + k[5];
+        return true;
+    };
+    return std::unique_ptr<Rectifier>(new Rectifier((int)info.width, (int)info.height, (int)info.width, (int)info.height, map));
+}
+
+std::unique_ptr<Rectifier> Rectifier::fromSdk(LadybugContext context, unsigned int camera, const BayerKernel &kernel)
+{
+    // The SDK works on the side-ways head, so make its rectified images the scaled head before our rotation
+    const int scaled_cols = kernel.out_rows();
+    const int scaled_rows = kernel.out_cols();
+    LadybugError error = ladybugSetOffScreenImageSize(context, LADYBUG_ALL_RECTIFIED_IMAGES, (unsigned int)scaled_cols, (unsigned int)scaled_rows);
+    if (error != LADYBUG_OK)
+    {
+        ROS_ERROR("Unable to set the rectified image size (%s)", ladybugErrorToString(error));
+        return nullptr;
+    }
+
+    // Published pixel -> side-ways rectified pixel -> raw distorted pixel -> published pixel
+    auto map = [&](double col, double row, double &u, double &v) {
+        double raw_row, raw_col;
+        if (ladybugUnrectifyPixel(context, camera, (scaled_rows - 1) - col, row, &raw_row, &raw_col) != LADYBUG_OK)
+            return false;
+        kernel.rawToOutput(raw_col, raw_row, u, v);
+        return true;
+    };
+    return std::unique_ptr<Rectifier>(new Rectifier(kernel.out_cols(), kernel.out_rows(), kernel.out_cols(), kernel.out_rows(), map));
+}
+
+void Rectifier::remap(const uint8_t *src, size_t src_step, uint8_t *dst, size_t dst_step) const
+{
+    const int half = 1 << (2 * REMAP_BITS - 1);
+    for (int r = 0; r < m_rows; r++)
+    {
+        const Entry *e = m_table.data() + (size_t)r * m_cols;
+        uint8_t *out = dst + (size_t)r * dst_step;
+        for (int c = 0; c < m_cols; c++, e++, out += 3)
+        {
+            if (e->x < 0)
+            {
+                out[0] = out[1] = out[2] = 0;
+                continue;
+            }
+            const uint8_t *p0 = src + (size_t)e->y * src_step + (size_t)e->x * 3;
+            const uint8_t *p1 = p0 + src_step;
+            const int w00 = (REMAP_ONE - e->ax) * (REMAP_ONE - e->ay);
+            const int w01 = e->ax * (REMAP_ONE - e->ay);
+            const int w10 = (REMAP_ONE - e->ax) * e->ay;
+            const int w11 = e->ax * e->ay;
+            out[0] = (uint8_t)((p0[0] * w00 + p0[3] * w01 + p1[0] * w10 + p1[3] * w11 + half) >> (2 * REMAP_BITS));
+            out[1] = (uint8_t)((p0[1] * w00 + p0[4] * w01 + p1[1] * w10 + p1[4] * w11 + half) >> (2 * REMAP_BITS));
+            out[2] = (uint8_t)((p0[2] * w00 + p0[5] * w01 + p1[2] * w10 + p1[5] * w11 + half) >> (2 * REMAP_BITS));
+        }
+    }
+}
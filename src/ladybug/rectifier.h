@@ -0,0 +1,66 @@
+#ifndef LADYBUG_RECTIFIER_H
+#define LADYBUG_RECTIFIER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <sensor_msgs/CameraInfo.h>
+
+#include "bayer_kernel.h"
+#include "ladybug.h"
+
+/**
+ * Undistortion (and rectification) of the published RGB images of one head, with a precomputed fixed-point remap table
+ *
+ * Every output pixel stores its top-left source pixel as two int16 and the bilinear fractions as two 7-bit values,
+ * so a table is 6 bytes per pixel. It is built once for the published size and orientation, and after that each
+ * frame only does integer bilinear interpolation. Output pixels that map outside of the source image are black.
+ */
+class Rectifier
+{
+  public:
+    /**
+     * Function giving the source pixel (u, v) of the output pixel (col, row), or false if there is none
+     */
+    typedef std::function<bool(double col, double row, double &u, double &v)> PixelMap;
+
+    /**
+     * Build the table of a cols x rows output image sampling a src_cols x src_rows image
+     */
+    Rectifier(int cols, int rows, int src_cols, int src_rows, const PixelMap &map);
+
+    /**
+     * Undistort with a calibration that matches the published images (see transformCameraInfo())
+     * The rectified camera is P and R of the calibration, like image_proc
+     */
+    static std::unique_ptr<Rectifier> fromCalibration(const sensor_msgs::CameraInfo &info);
+
+    /**
+     * Undistort with the camera's own calibration, which has to be loaded into the context with ladybugLoadConfig()
+     * The rectified images have the same size and orientation as the kernel output, returns nullptr on any SDK error
+     */
+    static std::unique_ptr<Rectifier> fromSdk(LadybugContext context, unsigned int camera, const BayerKernel &kernel);
+
+    /**
+     * Remap one packed RGB8 image, the destination must hold rows() rows of dst_step bytes each
+     */
+    void remap(const uint8_t *src, size_t src_step, uint8_t *dst, size_t dst_step) const;
+
+    int cols() const { return m_cols; }
+    int rows() const { return m_rows; }
+
+  private:
+    struct Entry
+    {
+        int16_t x, y;
+        uint8_t ax, ay;
+    };
+
+    int m_cols, m_rows;
+    std::vector<Entry> m_table;
+};
+
+#endif // LADYBUG_RECTIFIER_H
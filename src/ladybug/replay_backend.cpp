@@ -0,0 +1,151 @@
+#include "replay_backend.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#include <ros/ros.h>
+
+#include "data_format.h"
+
+ReplayBackend::ReplayBackend(const ReplayConfig &config)
+    : m_config(config), m_started(false), m_finished(false), m_locked(0), m_startStampNs(0), m_next(0)
+{
+}
+
+LadybugError ReplayBackend::connect(LadybugCameraInfo &info)
+{
+    if (!m_reader.open(m_config.path))
+    {
+        return LADYBUG_STREAM_FILE_NOT_OPENED;
+    }
+    if (m_reader.size() == 0 || m_config.start_frame >= m_reader.size())
+    {
+        ROS_ERROR("Replay file %s has %d frames, can not start at frame %d", m_config.path.c_str(), (int)m_reader.size(),
+                  (int)m_config.start_frame);
+        return LADYBUG_INVALID_ARGUMENT;
+    }
+
+    // Report the camera the file was recorded with
+    const FrameFileHeader &header = m_reader.header();
+    info = LadybugCameraInfo();
+    info.serialBase = header.serial_base;
+    info.serialHead = header.serial_head;
+    info.bIsColourCamera = true;
+    info.deviceType = (LadybugDeviceType)header.device_type;
+    info.interfaceType = LADYBUG_INTERFACE_UNKNOWN;
+    info.maxBusSpeed = LADYBUG_SPEED_UNKNOWN;
+    strncpy(info.pszModelName, header.model, sizeof(info.pszModelName) - 1);
+    snprintf(info.pszSensorInfo, sizeof(info.pszSensorInfo), "replay of %d frames", (int)m_reader.size());
+    strncpy(info.pszVendorName, "pointgrey_ladybug", sizeof(info.pszVendorName) - 1);
+    return LADYBUG_OK;
+}
+
+LadybugError ReplayBackend::start(const CameraSettings &settings)
+{
+    // The frames are what they are, only the data format has to match so the right topics are advertised
+    const LadybugDataFormat recorded = (LadybugDataFormat)m_reader.entry(m_config.start_frame).data_format;
+    if (isJpegFormat(recorded) != isJpegFormat(settings.data_format) || rawSampleBits(recorded) != rawSampleBits(settings.data_format) ||
+        isHalfHeightFormat(recorded) != isHalfHeightFormat(settings.data_format))
+    {
+        ROS_ERROR("Replay file holds %s%s%d frames, set data_format to match", isHalfHeightFormat(recorded) ? "half_height_" : "",
+                  isJpegFormat(recorded) ? "jpeg" : "raw", rawSampleBits(recorded));
+        return LADYBUG_INVALID_ARGUMENT;
+    }
+    ROS_INFO("CONFIG: replaying %d frames from %s at rate %.2f (0 is as fast as they are processed), starting at frame %d%s",
+             (int)m_reader.size(), m_config.path.c_str(), std::max(0.0, m_config.rate), (int)m_config.start_frame,
+             m_config.loop ? ", looping" : "");
+    m_next = m_config.start_frame;
+    m_startStampNs = m_reader.entry(m_next).stamp_ns;
+    m_startTime = std::chrono::steady_clock::now();
+    m_finished = false;
+    m_started = true;
+    m_reader.prefetch(m_next);
+    return LADYBUG_OK;
+}
+
+LadybugError ReplayBackend::stop()
+{
+    m_started = false;
+    return LADYBUG_OK;
+}
+
+LadybugError ReplayBackend::lockNext(LadybugImage &image)
+{
+    if (!m_started)
+        return LADYBUG_NOT_STARTED;
+
+    // Go back to the start, or idle once everything has been replayed
+    if (m_next >= m_reader.size())
+    {
+        if (!m_config.loop)
+        {
+            if (!m_finished)
+                ROS_INFO("Replay of %s finished", m_config.path.c_str());
+            m_finished = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            return LADYBUG_TIMEOUT;
+        }
+        m_next = m_config.start_frame;
+        m_startStampNs = m_reader.entry(m_next).stamp_ns;
+        m_startTime = std::chrono::steady_clock::now();
+    }
+    const size_t i = m_next;
+
+    // Wait until this frame is due, relative to the first frame
+    if (m_config.rate > 0)
+    {
+        const double offset = 1e-9 * (double)(m_reader.entry(i).stamp_ns - m_startStampNs) / m_config.rate;
+        std::this_thread::sleep_until(m_startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                        std::chrono::duration<double>(std::max(0.0, offset))));
+    }
+
+    // Like the SDK a frame is lost when too many are locked, unless we replay as fast as they are processed
+    // NOTE: the wait times out so the caller can still stop, the same frame is tried again next time
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_config.rate <= 0 && !m_unlocked.wait_for(lock, std::chrono::milliseconds(100), [this] { return m_locked < m_config.max_locked; }))
+            return LADYBUG_TIMEOUT;
+        m_next++;
+        if (m_locked >= m_config.max_locked)
+            return LADYBUG_TOO_MANY_LOCKED_BUFFERS;
+        m_locked++;
+    }
+    m_reader.frame(i, image);
+    image.uiBufferIndex = (unsigned int)i;
+
+    // Start reading the next frame in while this one is processed
+    if (m_next < m_reader.size())
+        m_reader.prefetch(m_next);
+    return LADYBUG_OK;
+}
+
+LadybugError ReplayBackend::unlock(unsigned int bufferIndex)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (bufferIndex >= m_reader.size() || m_locked == 0)
+            return LADYBUG_INVALID_ARGUMENT;
+        m_locked--;
+    }
+    m_unlocked.notify_one();
+    return LADYBUG_OK;
+}
+
+LadybugError ReplayBackend::unlockAll()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_locked = 0;
+    }
+    m_unlocked.notify_one();
+    return LADYBUG_OK;
+}
+
+bool ReplayBackend::recordedStamp(const LadybugImage &image, ros::Time &stamp) const
+{
+    if (!m_config.use_recorded_time || image.uiBufferIndex >= m_reader.size())
+        return false;
+    stamp.fromNSec((uint64_t)m_reader.entry(image.uiBufferIndex).stamp_ns);
+    return true;
+}
@@ -0,0 +1,73 @@
+#ifndef LADYBUG_REPLAY_BACKEND_H
+#define LADYBUG_REPLAY_BACKEND_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "camera_backend.h"
+#include "frame_file.h"
+#include "ladybug.h"
+
+/**
+ * Which frame file to replay and how
+ */
+struct ReplayConfig
+{
+    // Frame file written with record_format raw
+    std::string path;
+
+    // Speed relative to how it was recorded, 1 is real-time and 0 replays as fast as processing keeps up
+    double rate;
+
+    // Start again from start_frame when the end of the file is reached
+    bool loop;
+    size_t start_frame;
+
+    // Most frames that can be locked at once, at rate 0 the next frame waits for one to be unlocked instead of being lost
+    size_t max_locked;
+
+    // Stamp frames with the time they were recorded with, instead of mapping the camera clock onto the current time
+    bool use_recorded_time;
+};
+
+/**
+ * Camera backend that replays a frame file, so processing can be run and profiled without hardware
+ *
+ * The file is memory mapped and frames are handed out without a copy, with the next frame prefetched while the
+ * current one is processed. Frames are paced by the recorded stamps divided by the rate.
+ */
+class ReplayBackend : public CameraBackend
+{
+  public:
+    explicit ReplayBackend(const ReplayConfig &config);
+
+    LadybugError connect(LadybugCameraInfo &info) override;
+    LadybugError start(const CameraSettings &settings) override;
+    LadybugError stop() override;
+    LadybugError lockNext(LadybugImage &image) override;
+    LadybugError unlock(unsigned int bufferIndex) override;
+    LadybugError unlockAll() override;
+    bool recordedStamp(const LadybugImage &image, ros::Time &stamp) const override;
+
+  private:
+    ReplayConfig m_config;
+    FrameFileReader m_reader;
+    bool m_started;
+    bool m_finished;
+
+    // The buffer index of a replayed frame is its index in the file, only the number of locked frames is tracked
+    size_t m_locked;
+    std::mutex m_mutex;
+    std::condition_variable m_unlocked;
+
+    // Frame timing, the first frame after a (re)start is shown straight away
+    std::chrono::steady_clock::time_point m_startTime;
+    int64_t m_startStampNs;
+    size_t m_next;
+};
+
+#endif // LADYBUG_REPLAY_BACKEND_H
@@ -0,0 +1,148 @@
+#include "sdk_backend.h"
+
+#include <ros/ros.h>
+
+SdkBackend::SdkBackend() : m_context(nullptr), m_contextCreated(false)
+{
+}
+
+SdkBackend::~SdkBackend()
+{
+    if (m_contextCreated)
+    {
+        ladybugDestroyContext(&m_context);
+        m_contextCreated = false;
+    }
+}
+
+/**
+ * We need to first create the context, and detect the cameras attached
+ * We then initialize the communication with the first one
+ */
+LadybugError SdkBackend::connect(LadybugCameraInfo &info)
+{
+
+    // Create the SDK context
+    LadybugError error;
+    error = ladybugCreateContext(&m_context);
+    if (error != LADYBUG_OK)
+    {
+        return error;
+    }
+    m_contextCreated = true;
+
+    // Here we want to get the number of cameras this sensor has
+    LadybugCameraInfo enumeratedCameras[16];
+    unsigned int numCameras = 16;
+    error = ladybugBusEnumerateCameras(m_context, enumeratedCameras, &numCameras);
+    if (error != LADYBUG_OK)
+    {
+        return error;
+    }
+    ROS_INFO("%d cameras detected", numCameras);
+
+    // If we where not able to load any cameras, then error
+    // NOTE: Need to at least have one camera...
+    if (numCameras == 0)
+    {
+        ROS_ERROR("Insufficient number of cameras detected. ");
+        return LADYBUG_FAILED;
+    }
+
+    // Finally, lets initalize!
+    error = ladybugInitializeFromIndex(m_context, 0);
+    if (error != LADYBUG_OK)
+    {
+        return error;
+    }
+
+    // Get the camera information about the connected device
+    return ladybugGetCameraInfo(m_context, &info);
+}
+
+/**
+ * This will configure the camera with our parameters, and start the actual stream
+ * We will set the framerate, and JPEG quality here...
+ */
+LadybugError SdkBackend::start(const CameraSettings &settings)
+{
+
+    // Start the camera in the "lock" mode where we can unlock and lock to get the image
+    LadybugError error;
+    error = ladybugStartLockNext(m_context, settings.data_format);
+    if (error != LADYBUG_OK)
+    {
+        return error;
+    }
+
+    // Set the framerate of the camera
+    ROS_INFO("CONFIG: setting framerate of %d (auto = %d)", (int)settings.frame_rate, (int)settings.is_frame_rate_auto);
+    error = ladybugSetAbsPropertyEx(m_context, LADYBUG_FRAME_RATE, false, true, settings.is_frame_rate_auto, settings.frame_rate);
+    if (error != LADYBUG_OK)
+    {
+        return error;
+    }
+
+    // Set the shutter/exposure of the camera
+    ROS_INFO("CONFIG: setting shutter time of %.3f (auto = %d)", settings.shutter_time, (int)settings.is_shutter_auto);
+    error = ladybugSetAbsPropertyEx(m_context, LADYBUG_SHUTTER, false, true, settings.is_shutter_auto, settings.shutter_time);
+    if (error != LADYBUG_OK)
+    {
+        return error;
+    }
+
+    // Set the gain of the camera
+    ROS_INFO("CONFIG: setting gain db of %d (auto = %d)", (int)settings.gain_amount, (int)settings.is_gain_auto);
+    error = ladybugSetAbsPropertyEx(m_context, LADYBUG_GAIN, false, true, settings.is_gain_auto, settings.gain_amount);
+    if (error != LADYBUG_OK)
+    {
+        return error;
+    }
+
+    // Set the JPEG quality of the image
+    ROS_INFO("CONFIG: setting jpeg quality of %d", settings.jpeg_quality);
+    error = ladybugSetJPEGQuality(m_context, settings.jpeg_quality);
+    if (error != LADYBUG_OK)
+    {
+        return error;
+    }
+
+    // Perform a quick test to make sure images can be successfully acquired
+    ROS_INFO("Testing that images can be acquired..");
+    for (int i = 0; i < 5; i++)
+    {
+        LadybugImage tempImage;
+        error = ladybugLockNext(m_context, &tempImage);
+        ROS_INFO("\t- got image %d", i + 1);
+    }
+    ROS_INFO("Testing successful! All good to stream!");
+
+    // Unlock all the images we have
+    return ladybugUnlockAll(m_context);
+}
+
+LadybugError SdkBackend::stop()
+{
+    return ladybugStop(m_context);
+}
+
+LadybugError SdkBackend::lockNext(LadybugImage &image)
+{
+    return ladybugLockNext(m_context, &image);
+}
+
+LadybugError SdkBackend::unlock(unsigned int bufferIndex)
+{
+    return ladybugUnlock(m_context, bufferIndex);
+}
+
+LadybugError SdkBackend::unlockAll()
+{
+    return ladybugUnlockAll(m_context);
+}
+
+LadybugError SdkBackend::setFrameRate(float frame_rate)
+{
+    // Setting an absolute value also turns auto frame rate off
+    return ladybugSetAbsPropertyEx(m_context, LADYBUG_FRAME_RATE, false, true, false, frame_rate);
+}
@@ -0,0 +1,37 @@
+#ifndef LADYBUG_SDK_BACKEND_H
+#define LADYBUG_SDK_BACKEND_H
+
+#include "camera_backend.h"
+#include "ladybug.h"
+
+/**
+ * Camera backend that talks to the first Ladybug on the bus through the SDK
+ */
+class SdkBackend : public CameraBackend
+{
+  public:
+    SdkBackend();
+
+    /**
+     * Destroys the SDK context
+     */
+    ~SdkBackend();
+
+    LadybugError connect(LadybugCameraInfo &info) override;
+    LadybugError start(const CameraSettings &settings) override;
+    LadybugError stop() override;
+    LadybugError lockNext(LadybugImage &image) override;
+    LadybugError unlock(unsigned int bufferIndex) override;
+    LadybugError unlockAll() override;
+    LadybugError setFrameRate(float frame_rate) override;
+    LadybugContext context() const override { return m_context; }
+
+  private:
+    SdkBackend(const SdkBackend &) = delete;
+    SdkBackend &operator=(const SdkBackend &) = delete;
+
+    LadybugContext m_context;
+    bool m_contextCreated;
+};
+
+#endif // LADYBUG_SDK_BACKEND_H
@@ -0,0 +1,281 @@
+#include "stream_recorder.h"
+
+#include <cstring>
+#include <ctime>
+
+#include <ros/ros.h>
+
+PgrStreamSink::PgrStreamSink(LadybugContext camera) : m_camera(camera), m_stream(nullptr), m_open(false)
+{
+}
+
+PgrStreamSink::~PgrStreamSink()
+{
+    close();
+    if (m_stream != nullptr)
+        ladybugDestroyStreamContext(&m_stream);
+}
+
+bool PgrStreamSink::open(const std::string &base_name, std::string &file_name)
+{
+    close();
+    if (m_stream == nullptr)
+    {
+        const LadybugError error = ladybugCreateStreamContext(&m_stream);
+        if (error != LADYBUG_OK)
+        {
+            ROS_ERROR("Error: Unable to create stream context (%s)", ladybugErrorToString(error));
+            return false;
+        }
+    }
+
+    // Open it, the SDK appends the -NNNNNN.pgr suffix
+    // NOTE: if that name is already taken, the SDK bumps the file number itself
+    char opened[512] = {0};
+    const LadybugError error = ladybugInitializeStreamForWriting(m_stream, base_name.c_str(), m_camera, opened, false);
+    if (error != LADYBUG_OK)
+    {
+        ROS_ERROR("Error: Unable to open stream %s (%s)", base_name.c_str(), ladybugErrorToString(error));
+        return false;
+    }
+    m_open = true;
+    file_name = opened;
+    return true;
+}
+
+bool PgrStreamSink::write(const LadybugImage &image, const ros::Time &)
+{
+    // This blocks until it is on disk
+    const LadybugError error = ladybugWriteImageToStream(m_stream, &image);
+    if (error != LADYBUG_OK)
+    {
+        ROS_ERROR_THROTTLE(5, "Error: Unable to write image to stream (%s)", ladybugErrorToString(error));
+        return false;
+    }
+    return true;
+}
+
+void PgrStreamSink::close()
+{
+    if (m_open)
+    {
+        ladybugStopStream(m_stream);
+        m_open = false;
+    }
+}
+
+StreamRecorder::StreamRecorder(std::unique_ptr<RecordSink> sink, const std::string &base_path, size_t queue_size, size_t max_pinned,
+                               double max_file_mb, double max_file_seconds)
+    : m_sink(std::move(sink)), m_basePath(base_path), m_maxFileMb(max_file_mb), m_maxFileSeconds(max_file_seconds), m_fileOpen(false), m_fileMb(0.0), m_slots(queue_size), m_free(new SpscRing<size_t>(queue_size)),
+      m_filled(new SpscRing<size_t>(queue_size)), m_maxPinned(max_pinned), m_pinned(0), m_errors(0), m_files(0), m_bytesWritten(0), m_grabCopies(0), m_running(false)
+{
+    for (size_t i = 0; i < queue_size; i++)
+        m_free->push(i);
+}
+
+StreamRecorder::~StreamRecorder()
+{
+    stop();
+}
+
+bool StreamRecorder::start()
+{
+    if (!open_file())
+        return false;
+    m_running = true;
+    m_writeThread = std::thread(&StreamRecorder::write_loop, this);
+    return true;
+}
+
+void StreamRecorder::stop()
+{
+
+    // The writer drains the queue before it exits
+    m_running = false;
+    if (m_writeThread.joinable())
+        m_writeThread.join();
+
+    // Close the file, this flushes what is left
+    if (m_fileOpen)
+    {
+        m_sink->close();
+        m_fileOpen = false;
+        ROS_INFO("Closed recording %s", m_fileName.c_str());
+    }
+}
+
+bool StreamRecorder::push(const LadybugImage &image, const ros::Time &stamp)
+{
+
+    // Get a free buffer, if there is none the writer has fallen behind and we drop this image
+    size_t index;
+    if (!m_running || !m_free->pop(index))
+    {
+        m_queueStats.dropped++;
+        return false;
+    }
+
+    // Copy the image so the SDK buffer can be unlocked before it is written
+    Slot &slot = m_slots[index];
+    slot.image = image;
+    slot.data.resize(image.uiDataSizeBytes);
+    memcpy(slot.data.data(), image.pData, image.uiDataSizeBytes);
+    slot.image.pData = slot.data.data();
+    slot.stamp = stamp;
+    m_grabCopies++;
+
+    // Hand it to the writer, there is always room since there are only as many indices as slots
+    m_filled->push(index);
+    m_queueStats.grabbed++;
+    m_queueStats.recordDepth(m_filled->size());
+    return true;
+}
+
+bool StreamRecorder::push(const std::shared_ptr<FrameHold> &hold, const ros::Time &stamp)
+{
+    // Past the limit we copy here, so the recorder can not keep the SDK from getting its buffers back
+    // NOTE: only the writer lowers the count meanwhile, so this can only be too careful
+    if (m_pinned.load() >= m_maxPinned)
+        return push(hold->frame().image, stamp);
+    size_t index;
+    if (!m_running || !m_free->pop(index))
+    {
+        m_queueStats.dropped++;
+        return false;
+    }
+
+    // Share the hold, the writer copies the image out of the buffer and lets go of it
+    Slot &slot = m_slots[index];
+    slot.image = hold->frame().image;
+    slot.hold = hold;
+    slot.stamp = stamp;
+    m_pinned++;
+    m_filled->push(index);
+    m_queueStats.grabbed++;
+    m_queueStats.recordDepth(m_filled->size());
+    return true;
+}
+
+bool StreamRecorder::open_file()
+{
+
+    // Close the current file
+    if (m_fileOpen)
+    {
+        m_sink->close();
+        m_fileOpen = false;
+        ROS_INFO("Closed recording %s (%.1f MB)", m_fileName.c_str(), m_fileMb);
+    }
+
+    // Each file is named after the time it was opened
+    char stamp[32];
+    const std::time_t now = std::time(nullptr);
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", std::localtime(&now));
+    const std::string base_name = m_basePath + "-" + stamp;
+
+    // Open it
+    std::string file_name;
+    if (!m_sink->open(base_name, file_name))
+    {
+        m_errors++;
+        return false;
+    }
+    m_fileOpen = true;
+    {
+        std::lock_guard<std::mutex> lock(m_fileMutex);
+        m_fileName = file_name;
+    }
+    m_fileMb = 0.0;
+    m_fileStart = std::chrono::steady_clock::now();
+    m_files++;
+    ROS_INFO("Recording to %s", m_fileName.c_str());
+    return true;
+}
+
+void StreamRecorder::write_loop()
+{
+    while (true)
+    {
+
+        // Get the oldest queued image, once stopped we still write out the rest of the queue
+        size_t index;
+        if (!m_filled->pop(index))
+        {
+            if (!m_running)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        // Copy a pinned image out of its SDK buffer and let go of it, so the buffer is not held while the disk is busy
+        Slot &slot = m_slots[index];
+        if (slot.hold)
+        {
+            slot.data.resize(slot.image.uiDataSizeBytes);
+            memcpy(slot.data.data(), slot.hold->data(), slot.image.uiDataSizeBytes);
+            slot.image.pData = slot.data.data();
+            slot.hold.reset();
+            m_pinned--;
+        }
+
+        // Roll over to a new file if this one is big or old enough
+        // If the last open failed, we keep trying on every image until it works
+        const double file_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_fileStart).count();
+        const bool full = (m_maxFileMb > 0 && m_fileMb >= m_maxFileMb) || (m_maxFileSeconds > 0 && file_seconds >= m_maxFileSeconds);
+        if (!m_fileOpen || full)
+            open_file();
+
+        // Write it out, this blocks until it is on disk
+        if (m_fileOpen)
+        {
+            if (m_sink->write(slot.image, slot.stamp))
+            {
+                m_fileMb += 1e-6 * slot.image.uiDataSizeBytes;
+                m_bytesWritten += slot.image.uiDataSizeBytes;
+                m_queueStats.processed++;
+            }
+            else
+            {
+                m_errors++;
+            }
+        }
+        else
+        {
+            m_queueStats.dropped++;
+        }
+
+        // Give the buffer back
+        m_free->push(index);
+    }
+}
+
+std::string StreamRecorder::fileName() const
+{
+    std::lock_guard<std::mutex> lock(m_fileMutex);
+    return m_fileName;
+}
+
+void StreamRecorder::diagnose(diagnostic_updater::DiagnosticStatusWrapper &stat)
+{
+    if (!m_fileOpen)
+        stat.summary(diagnostic_msgs::DiagnosticStatus::ERROR, "No file open");
+    else if (m_queueStats.dropped > 0)
+        stat.summary(diagnostic_msgs::DiagnosticStatus::WARN, "Recording, but images were dropped");
+    else
+        stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Recording");
+    {
+        std::lock_guard<std::mutex> lock(m_fileMutex);
+        stat.add("File", m_fileName);
+    }
+    stat.add("Files", m_files.load());
+    stat.add("Queued", m_queueStats.grabbed.load());
+    stat.add("Written", m_queueStats.processed.load());
+    stat.add("Dropped", m_queueStats.dropped.load());
+    stat.add("Errors", m_errors.load());
+    stat.add("Queue depth", m_filled->size());
+    stat.add("Queue high-water", m_queueStats.max_depth.load());
+    stat.add("Queue size", m_filled->capacity());
+    stat.add("Pinned", m_pinned.load());
+    stat.add("Copied on grab thread", m_grabCopies.load());
+    stat.add("Written (MB)", 1e-6 * m_bytesWritten.load());
+}
@@ -0,0 +1,194 @@
+#ifndef LADYBUG_STREAM_RECORDER_H
+#define LADYBUG_STREAM_RECORDER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <diagnostic_updater/diagnostic_updater.h>
+#include <ros/ros.h>
+
+#include "frame_ring.h"
+#include "ladybug.h"
+#include "ladybugstream.h"
+
+/**
+ * Where the recorder writes images to, all calls come from the writer thread
+ */
+class RecordSink
+{
+  public:
+    virtual ~RecordSink() {}
+
+    /**
+     * Open a new file for this base name, and return the name of the file that was actually opened
+     */
+    virtual bool open(const std::string &base_name, std::string &file_name) = 0;
+
+    /**
+     * Write one image, and the ROS time it was stamped with
+     */
+    virtual bool write(const LadybugImage &image, const ros::Time &stamp) = 0;
+
+    /**
+     * Finish and close the current file
+     */
+    virtual void close() = 0;
+};
+
+/**
+ * Sink writing Ladybug .pgr stream files through the SDK, named <base name>-NNNNNN.pgr
+ * The SDK splits these files at 2GB on its own
+ */
+class PgrStreamSink : public RecordSink
+{
+  public:
+    explicit PgrStreamSink(LadybugContext camera);
+    ~PgrStreamSink();
+
+    bool open(const std::string &base_name, std::string &file_name) override;
+    bool write(const LadybugImage &image, const ros::Time &stamp) override;
+    void close() override;
+
+  private:
+    PgrStreamSink(const PgrStreamSink &) = delete;
+    PgrStreamSink &operator=(const PgrStreamSink &) = delete;
+
+    LadybugContext m_camera;
+    LadybugStreamContext m_stream;
+    bool m_open;
+};
+
+/**
+ * Records the untouched camera images into files, e.g. Ladybug .pgr streams
+ *
+ * Images are queued in a fixed set of slots, and a dedicated writer thread writes them out to the sink.
+ * Up to max_pinned queued images share the FrameHold of their locked SDK buffer, and the writer copies them out
+ * of it before writing, so the grab thread does not spend a full frame memcpy (about 30 MB for RAW8) on them.
+ * Past that the grab thread copies the image itself, so the recorder never keeps more than max_pinned SDK buffers.
+ * If the disk stalls and all slots are full, new images are dropped from the recording,
+ * but acquisition itself never waits on the disk.
+ * Files are rolled over to a new one once they reach a maximum size or duration.
+ */
+class StreamRecorder
+{
+  public:
+    /**
+     * Create a recorder writing files with the base name <base_path>-<date>_<time>
+     * The queue holds up to queue_size images, of which max_pinned can be SDK buffers, a limit of zero disables that kind of rollover
+     */
+    StreamRecorder(std::unique_ptr<RecordSink> sink, const std::string &base_path, size_t queue_size, size_t max_pinned,
+                   double max_file_mb, double max_file_seconds);
+
+    /**
+     * Stops the writer and closes the stream if still running
+     */
+    ~StreamRecorder();
+
+    /**
+     * Open the first file and start the writer thread, returns false if the file could not be opened
+     */
+    bool start();
+
+    /**
+     * Write out everything still queued and close the file
+     */
+    void stop();
+
+    /**
+     * Queue a copy of this image to be written (grab thread only)
+     * Returns false if the queue is full and the image was dropped
+     */
+    bool push(const LadybugImage &image, const ros::Time &stamp);
+
+    /**
+     * Queue the image of this hold, sharing the hold until the writer has copied it (grab thread only)
+     * If max_pinned images are already shared, the image is copied right away like push(image) does
+     * Returns false if the queue is full and the image was dropped
+     */
+    bool push(const std::shared_ptr<FrameHold> &hold, const ros::Time &stamp);
+
+    /**
+     * True if push(hold) would share the hold instead of copying the image, so the grab thread only makes a hold then
+     */
+    bool canPin() const { return m_running && m_pinned.load() < m_maxPinned; }
+
+    /**
+     * Name of the file being written, or the last one once stopped
+     */
+    std::string fileName() const;
+
+    /**
+     * Report the queue and writer state
+     */
+    void diagnose(diagnostic_updater::DiagnosticStatusWrapper &stat);
+
+  private:
+    StreamRecorder(const StreamRecorder &) = delete;
+    StreamRecorder &operator=(const StreamRecorder &) = delete;
+
+    /**
+     * A copy of one image, the image pData points into the data vector
+     * A pinned image has the hold of its SDK buffer instead, until the writer copies it into the data vector
+     */
+    struct Slot
+    {
+        LadybugImage image;
+        ros::Time stamp;
+        std::vector<uint8_t> data;
+        std::shared_ptr<FrameHold> hold;
+    };
+
+    /**
+     * Open a new file, closing the current one if open
+     */
+    bool open_file();
+
+    /**
+     * Writer thread, this writes out queued slots and handles rollover
+     */
+    void write_loop();
+
+    // Where the images are written to
+    std::unique_ptr<RecordSink> m_sink;
+    std::string m_basePath;
+    double m_maxFileMb;
+    double m_maxFileSeconds;
+
+    // File we are writing to, and how much is in it
+    // The file name is also read by the diagnostics, so it has a mutex
+    std::atomic<bool> m_fileOpen;
+    mutable std::mutex m_fileMutex;
+    std::string m_fileName;
+    double m_fileMb;
+    std::chrono::steady_clock::time_point m_fileStart;
+
+    // Buffers, and the indices of the free and filled ones
+    // The grab thread pops free and pushes filled slots, the writer does the opposite
+    std::vector<Slot> m_slots;
+    std::unique_ptr<SpscRing<size_t>> m_free;
+    std::unique_ptr<SpscRing<size_t>> m_filled;
+
+    // Number of queued slots that share the hold of an SDK buffer, the grab thread adds and the writer removes them
+    size_t m_maxPinned;
+    std::atomic<size_t> m_pinned;
+
+    // Counters, these are read from the diagnostics
+    // The queue stats count queued images as grabbed and written images as processed
+    FrameRingStats m_queueStats;
+    std::atomic<uint64_t> m_errors;
+    std::atomic<uint64_t> m_files;
+    std::atomic<uint64_t> m_bytesWritten;
+    std::atomic<uint64_t> m_grabCopies;
+
+    std::atomic<bool> m_running;
+    std::thread m_writeThread;
+};
+
+#endif // LADYBUG_STREAM_RECORDER_H
@@ -0,0 +1,274 @@
+#include "synthetic_backend.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#include <ros/ros.h>
+
+#include "bayer_image.h"
+#include "data_format.h"
+#include "jpeg_decoder.h"
+#include "raw_unpack.h"
+
+SyntheticBackend::SyntheticBackend(const SyntheticConfig &config) : m_config(config), m_started(false), m_startWallUs(0), m_frame(0), m_rateFrame(0), m_rateTime(0.0), m_random(config.seed)
+{
+}
+
+LadybugError SyntheticBackend::connect(LadybugCameraInfo &info)
+{
+    if (m_config.cols < 4 || m_config.rows < 4 || m_config.cols % 2 != 0 || m_config.rows % 2 != 0 || m_config.num_buffers < 1)
+    {
+        ROS_ERROR("Synthetic camera needs an even head size of at least 4x4 and at least one buffer");
+        return LADYBUG_INVALID_ARGUMENT;
+    }
+    info = LadybugCameraInfo();
+    info.bIsColourCamera = true;
+    info.deviceType = LADYBUG_DEVICE_LADYBUG5;
+    info.interfaceType = LADYBUG_INTERFACE_UNKNOWN;
+    info.maxBusSpeed = LADYBUG_SPEED_UNKNOWN;
+    strncpy(info.pszModelName, "Synthetic", sizeof(info.pszModelName) - 1);
+    snprintf(info.pszSensorInfo, sizeof(info.pszSensorInfo), "%dx%d test pattern", m_config.cols, m_config.rows);
+    strncpy(info.pszVendorName, "pointgrey_ladybug", sizeof(info.pszVendorName) - 1);
+    return LADYBUG_OK;
+}
+
+LadybugError SyntheticBackend::start(const CameraSettings &settings)
+{
+    LadybugDataFormat full_format;
+    switch (settings.data_format)
+    {
+    case LADYBUG_DATAFORMAT_HALF_HEIGHT_RAW8:
+        full_format = LADYBUG_DATAFORMAT_RAW8;
+        break;
+    case LADYBUG_DATAFORMAT_HALF_HEIGHT_RAW12:
+        full_format = LADYBUG_DATAFORMAT_RAW12;
+        break;
+    case LADYBUG_DATAFORMAT_HALF_HEIGHT_RAW16:
+        full_format = LADYBUG_DATAFORMAT_RAW16;
+        break;
+    case LADYBUG_DATAFORMAT_COLOR_SEP_HALF_HEIGHT_JPEG8:
+        full_format = LADYBUG_DATAFORMAT_COLOR_SEP_JPEG8;
+        break;
+    default:
+        full_format = settings.data_format;
+        break;
+    }
+    if (full_format != LADYBUG_DATAFORMAT_RAW8 && full_format != LADYBUG_DATAFORMAT_RAW12 && full_format != LADYBUG_DATAFORMAT_RAW16 &&
+        full_format != LADYBUG_DATAFORMAT_COLOR_SEP_JPEG8)
+    {
+        ROS_ERROR("Synthetic camera only supports the raw8, raw12, raw16 and jpeg8 data formats, and their half-height versions");
+        return LADYBUG_NOT_SUPPORTED;
+    }
+    if (isHalfHeightFormat(settings.data_format) && m_config.rows % 4 != 0)
+    {
+        ROS_ERROR("Synthetic camera needs a head height that is a multiple of 4 for the half-height formats");
+        return LADYBUG_INVALID_ARGUMENT;
+    }
+    if (settings.frame_rate <= 0)
+    {
+        return LADYBUG_INVALID_ARGUMENT;
+    }
+    m_settings = settings;
+    ROS_INFO("CONFIG: synthetic %dx%d %s heads at %.1f fps (jitter %.1f ms, error rate %.3f, %d buffers)", m_config.cols, m_config.rows,
+             bayerEncoding(m_config.stippled_format, 8).c_str(), settings.frame_rate, 1e3 * m_config.jitter, m_config.error_rate,
+             (int)m_config.num_buffers);
+
+    // Render every buffer up front, so generating frames costs nothing while streaming
+    // Half-height heads only keep every other pair of rows of the full pattern, like the camera does
+    const int plane_rows = isHalfHeightFormat(settings.data_format) ? m_config.rows / 2 : m_config.rows;
+    const size_t plane_size = (size_t)m_config.cols * plane_rows;
+    const int bits = rawSampleBits(settings.data_format);
+    m_buffers.assign(m_config.num_buffers, std::vector<uint8_t>());
+    m_locked.assign(m_config.num_buffers, false);
+    tjhandle handle = isJpegFormat(settings.data_format) ? tjInitCompress() : nullptr;
+    std::vector<uint8_t> plane((size_t)m_config.cols * m_config.rows), scratch;
+    std::vector<uint16_t> samples(bits > 8 ? plane_size : 0);
+    for (size_t b = 0; b < m_config.num_buffers; b++)
+    {
+        if (!isJpegFormat(settings.data_format) && bits == 8)
+        {
+            m_buffers[b].resize(LADYBUG_NUM_CAMERAS * plane_size);
+            for (size_t h = 0; h < LADYBUG_NUM_CAMERAS; h++)
+                renderHead(b, h, m_buffers[b].data() + h * plane_size);
+            continue;
+        }
+
+        // Deeper formats get the same pattern stretched to the full 16-bit range, RAW12 keeps its high 12 bits
+        if (!isJpegFormat(settings.data_format))
+        {
+            const size_t plane_bytes = plane_size * bits / 8;
+            m_buffers[b].resize(LADYBUG_NUM_CAMERAS * plane_bytes);
+            for (size_t h = 0; h < LADYBUG_NUM_CAMERAS; h++)
+            {
+                renderHead(b, h, plane.data());
+                for (size_t p = 0; p < plane_size; p++)
+                    samples[p] = (uint16_t)(plane[p] * 257);
+                uint8_t *dst = m_buffers[b].data() + h * plane_bytes;
+                if (bits == 12)
+                    packRaw12(samples.data(), dst, plane_size);
+                else
+                    memcpy(dst, samples.data(), plane_bytes);
+            }
+            continue;
+        }
+
+        // Compress each Bayer channel of each head into its own tile, like the camera does
+        std::vector<uint8_t> tiles[LADYBUG_JPEG_TILES];
+        for (size_t h = 0; h < LADYBUG_NUM_CAMERAS; h++)
+        {
+            renderHead(b, h, plane.data());
+            for (size_t k = 0; k < LADYBUG_JPEG_CHANNELS; k++)
+            {
+                if (!encodeBayerTile(handle, plane.data(), m_config.cols, plane_rows, k, settings.jpeg_quality, scratch,
+                                     tiles[h * LADYBUG_JPEG_CHANNELS + k]))
+                {
+                    ROS_ERROR("Unable to encode synthetic JPEG tile (%s)", tjGetErrorStr());
+                    tjDestroy(handle);
+                    return LADYBUG_JPEG_ERROR;
+                }
+            }
+        }
+        packJpegImage(tiles, m_buffers[b]);
+    }
+    if (handle != nullptr)
+        tjDestroy(handle);
+
+    m_startTime = std::chrono::steady_clock::now();
+    m_startWallUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    m_frame = 0;
+    m_rateFrame = 0;
+    m_rateTime = 0.0;
+    m_started = true;
+    return LADYBUG_OK;
+}
+
+LadybugError SyntheticBackend::stop()
+{
+    m_started = false;
+    return LADYBUG_OK;
+}
+
+LadybugError SyntheticBackend::lockNext(LadybugImage &image)
+{
+    if (!m_started)
+        return LADYBUG_NOT_STARTED;
+
+    // Exposure time of this frame, and when it gets delivered
+    uint64_t frame;
+    double camera_time;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        frame = m_frame++;
+        camera_time = m_rateTime + (frame - m_rateFrame) / m_settings.frame_rate;
+    }
+    double delay = 0.0;
+    bool failed = false;
+    if (m_config.jitter > 0)
+        delay = std::abs(std::normal_distribution<double>(0.0, m_config.jitter)(m_random));
+    if (m_config.error_rate > 0)
+        failed = std::uniform_real_distribution<double>(0.0, 1.0)(m_random) < m_config.error_rate;
+    std::this_thread::sleep_until(m_startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                    std::chrono::duration<double>(camera_time + delay)));
+    if (failed)
+        return LADYBUG_TIMEOUT;
+
+    // Lock its buffer, if it is still locked this frame is lost
+    const size_t b = frame % m_buffers.size();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_locked[b])
+            return LADYBUG_TOO_MANY_LOCKED_BUFFERS;
+        m_locked[b] = true;
+    }
+
+    // Describe it the same way the SDK does
+    image = LadybugImage();
+    image.uiCols = image.uiFullCols = (unsigned int)m_config.cols;
+    image.uiRows = image.uiFullRows = (unsigned int)m_config.rows;
+    image.dataFormat = m_settings.data_format;
+    image.resolution = LADYBUG_RESOLUTION_ANY;
+    image.pData = m_buffers[b].data();
+    image.uiDataSizeBytes = (unsigned int)m_buffers[b].size();
+    image.bStippled = true;
+    image.stippledFormat = m_config.stippled_format;
+    image.uiBufferIndex = (unsigned int)b;
+    image.imageInfo.ulFingerprint = LADYBUGIMAGEINFO_STRUCT_FINGERPRINT;
+    image.imageInfo.ulVersion = 2;
+    image.imageInfo.ulSequenceId = (unsigned int)frame;
+
+    // Wall clock time of the exposure, and the 128 second camera cycle timer
+    const int64_t wall_us = m_startWallUs + (int64_t)std::llround(1e6 * camera_time);
+    image.timeStamp.ulSeconds = wall_us / 1000000;
+    image.timeStamp.ulMicroSeconds = (unsigned int)(wall_us % 1000000);
+    const double cycle = std::fmod(camera_time, 128.0);
+    const double counts = (cycle - std::floor(cycle)) * 8000.0;
+    image.timeStamp.ulCycleSeconds = (unsigned int)cycle;
+    image.timeStamp.ulCycleCount = std::min(7999u, (unsigned int)counts);
+    image.timeStamp.ulCycleOffset = std::min(3071u, (unsigned int)((counts - std::floor(counts)) * 3072.0));
+    return LADYBUG_OK;
+}
+
+LadybugError SyntheticBackend::unlock(unsigned int bufferIndex)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (bufferIndex >= m_locked.size())
+        return LADYBUG_INVALID_ARGUMENT;
+    m_locked[bufferIndex] = false;
+    return LADYBUG_OK;
+}
+
+LadybugError SyntheticBackend::unlockAll()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::fill(m_locked.begin(), m_locked.end(), false);
+    return LADYBUG_OK;
+}
+
+LadybugError SyntheticBackend::setFrameRate(float frame_rate)
+{
+    if (frame_rate <= 0)
+        return LADYBUG_INVALID_ARGUMENT;
+
+    // Keep the camera time continuous, the frames after the next one are spaced at the new rate
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_rateTime += (m_frame - m_rateFrame) / m_settings.frame_rate;
+    m_rateFrame = m_frame;
+    m_settings.frame_rate = frame_rate;
+    return LADYBUG_OK;
+}
+
+void SyntheticBackend::renderHead(size_t buffer, size_t head, uint8_t *plane) const
+{
+    // Mosaic of a horizontal red and vertical green gradient, with a checkerboard that moves with the buffer
+    // Half-height heads get sensor rows 4k and 4k + 1 as plane rows 2k and 2k + 1
+    const int cols = m_config.cols;
+    const int rows = m_config.rows;
+    const int pattern = bayerPattern(m_config.stippled_format);
+    const bool half_height = isHalfHeightFormat(m_settings.data_format);
+    for (int y = 0; y < rows; y++)
+    {
+        if (half_height && (y & 2))
+            continue;
+        uint8_t *dst = plane + (size_t)(half_height ? ((y >> 2) << 1) | (y & 1) : y) * cols;
+        for (int x = 0; x < cols; x++)
+        {
+            const int checker = ((x / 64 + y / 64 + (int)buffer) & 1) ? 48 : 0;
+            int value;
+            switch ((((y ^ (pattern >> 1)) & 1) << 1) | ((x ^ pattern) & 1))
+            {
+            case 0:
+                value = 160 * x / cols + 16 * (int)head;
+                break;
+            case 3:
+                value = 160 - 160 * x / cols + 16 * (int)head;
+                break;
+            default:
+                value = 160 * y / rows + 8 * (int)head;
+                break;
+            }
+            dst[x] = (uint8_t)std::min(255, value + checker);
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef LADYBUG_SYNTHETIC_BACKEND_H
+#define LADYBUG_SYNTHETIC_BACKEND_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "camera_backend.h"
+#include "ladybug.h"
+
+/**
+ * How the synthetic camera behaves, the frame rate and data format come from the CameraSettings
+ */
+struct SyntheticConfig
+{
+    // Size of each raw head, the sensor is mounted side-ways so this is 2048x2448 for a Ladybug5
+    int cols;
+    int rows;
+
+    // Number of image buffers, like the SDK a frame is lost if its buffer is still locked
+    size_t num_buffers;
+
+    // Standard deviation of the delivery delay in seconds, the camera timestamp itself has no jitter
+    double jitter;
+
+    // Probability that a frame fails with LADYBUG_TIMEOUT instead of being delivered
+    double error_rate;
+
+    // Seed of the jitter and error generator, so runs can be repeated exactly
+    unsigned int seed;
+
+    // CFA order the heads are mosaiced in and reported with
+    LadybugStippledFormat stippled_format;
+};
+
+/**
+ * Camera backend that generates deterministic six-head Bayer frames without any hardware
+ *
+ * Every buffer holds a fixed test pattern (a gradient per head with a checkerboard that shifts between buffers),
+ * rendered once in start(), and frame n is delivered in buffer n % num_buffers at the requested frame rate.
+ * Frames carry camera cycle timestamps that advance exactly with the frame rate, so the clock sync can be checked.
+ * RAW8, RAW12, RAW16 and JPEG8 data formats are supported, JPEG tiles are encoded once in start() like the camera would.
+ */
+class SyntheticBackend : public CameraBackend
+{
+  public:
+    explicit SyntheticBackend(const SyntheticConfig &config);
+
+    LadybugError connect(LadybugCameraInfo &info) override;
+    LadybugError start(const CameraSettings &settings) override;
+    LadybugError stop() override;
+    LadybugError lockNext(LadybugImage &image) override;
+    LadybugError unlock(unsigned int bufferIndex) override;
+    LadybugError unlockAll() override;
+    LadybugError setFrameRate(float frame_rate) override;
+
+  private:
+    /**
+     * Render the test pattern of buffer b into a raw plane of one head
+     */
+    void renderHead(size_t buffer, size_t head, uint8_t *plane) const;
+
+    SyntheticConfig m_config;
+    CameraSettings m_settings;
+    bool m_started;
+
+    // Image data of every buffer, and whether it is locked
+    std::vector<std::vector<uint8_t>> m_buffers;
+    std::vector<bool> m_locked;
+    std::mutex m_mutex;
+
+    // Frame timing, frames from m_rateFrame on are spaced at the current frame rate starting at m_rateTime (s)
+    std::chrono::steady_clock::time_point m_startTime;
+    int64_t m_startWallUs;
+    uint64_t m_frame;
+    uint64_t m_rateFrame;
+    double m_rateTime;
+    std::mt19937 m_random;
+};
+
+#endif // LADYBUG_SYNTHETIC_BACKEND_H
@@ -0,0 +1,19 @@
+#include "tone_curve.h"
+
+#include <algorithm>
+#include <cmath>
+
+const int ToneCurve::INPUT_BITS;
+
+ToneCurve::ToneCurve(double gamma, double black, double white) : m_gamma(gamma), m_black(black), m_white(white)
+{
+    // The first entry is zero and the last one is full scale, so black stays black and white stays white
+    const int size = 1 << INPUT_BITS;
+    const double range = std::max(white - black, 1e-6);
+    m_table.resize(size);
+    for (int i = 0; i < size; i++)
+    {
+        const double x = std::min(std::max(((double)i / (size - 1) - black) / range, 0.0), 1.0);
+        m_table[i] = (uint8_t)std::lround(255.0 * std::pow(x, 1.0 / gamma));
+    }
+}
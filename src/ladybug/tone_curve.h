@@ -0,0 +1,35 @@
+#ifndef LADYBUG_TONE_CURVE_H
+#define LADYBUG_TONE_CURVE_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Maps linear 16-bit samples to 8-bit output values, for publishing RAW12 and RAW16 data as RGB8
+ *
+ * Values at or below black map to 0 and values at or above white map to 255, with a gamma curve in between.
+ * Both levels are fractions of the full 16-bit range. The curve is a table indexed by the top INPUT_BITS bits of
+ * the sample, which is exact for the 12-bit ADC of the Ladybug5, so mapping a value is a single lookup.
+ */
+class ToneCurve
+{
+  public:
+    static const int INPUT_BITS = 12;
+
+    ToneCurve(double gamma = 1.0, double black = 0.0, double white = 1.0);
+
+    uint8_t operator()(uint16_t value) const { return m_table[value >> (16 - INPUT_BITS)]; }
+
+    // The 1 << INPUT_BITS entries of the curve
+    const uint8_t *table() const { return m_table.data(); }
+
+    double gamma() const { return m_gamma; }
+    double black() const { return m_black; }
+    double white() const { return m_white; }
+
+  private:
+    double m_gamma, m_black, m_white;
+    std::vector<uint8_t> m_table;
+};
+
+#endif // LADYBUG_TONE_CURVE_H
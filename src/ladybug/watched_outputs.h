@@ -0,0 +1,51 @@
+#ifndef LADYBUG_WATCHED_OUTPUTS_H
+#define LADYBUG_WATCHED_OUTPUTS_H
+
+#include <cstdint>
+
+#include "ladybug.h"
+
+// Mask with a bit set for every head, bit i is head i
+const uint32_t LADYBUG_ALL_HEADS = (1u << LADYBUG_NUM_CAMERAS) - 1;
+
+/**
+ * Which heads of each output someone is subscribed to, bit i is head i
+ * The connect callbacks set these, and processing takes a copy at the start of each frame so it works from one consistent set
+ */
+struct WatchedOutputs
+{
+    uint32_t raw;   // demosaiced images, including the ones the rectified images and the panorama are made from
+    uint32_t bayer; // raw Bayer planes
+    uint32_t jpeg;  // pass-through JPEG tiles
+    uint32_t rect;  // rectified images
+    bool pano;
+
+    WatchedOutputs() : raw(0), bayer(0), jpeg(0), rect(0), pano(false) {}
+
+    /**
+     * From the subscribers of each topic, rectified images need their heads demosaiced and the panorama needs all of them
+     */
+    WatchedOutputs(uint32_t image_heads, uint32_t bayer_heads, uint32_t jpeg_heads, uint32_t rect_heads, bool pano_subscribed)
+        : raw(pano_subscribed ? LADYBUG_ALL_HEADS : (image_heads | rect_heads)), bayer(bayer_heads), jpeg(jpeg_heads), rect(rect_heads),
+          pano(pano_subscribed)
+    {
+    }
+
+    bool operator==(const WatchedOutputs &other) const
+    {
+        return raw == other.raw && bayer == other.bayer && jpeg == other.jpeg && rect == other.rect && pano == other.pano;
+    }
+    bool operator!=(const WatchedOutputs &other) const { return !(*this == other); }
+};
+
+/**
+ * Heads the Bayer kernel runs on for a frame, the demosaiced outputs and the heads the watched views sample
+ * The views can only use heads that were decoded, for JPEG formats those are the ones asked for before the view tables were known
+ * The pass-through outputs never need the kernel
+ */
+inline uint32_t kernelHeads(const WatchedOutputs &watched, uint32_t view_heads, uint32_t decoded_heads)
+{
+    return watched.raw | (view_heads & decoded_heads);
+}
+
+#endif // LADYBUG_WATCHED_OUTPUTS_H
@@ -0,0 +1,85 @@
+#include "worker_pool.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <ros/ros.h>
+
+WorkerPool::WorkerPool(size_t num_lanes, const std::vector<int> &affinity)
+    : m_job(nullptr), m_numJobs(0), m_nextJob(0), m_jobsLeft(0), m_batch(0), m_stop(false)
+{
+    // Always have at least one lane to run things on
+    if (num_lanes == 0)
+        num_lanes = 1;
+
+    // Start all the threads, and pin them if requested
+    for (size_t i = 0; i < num_lanes; i++)
+    {
+        m_threads.emplace_back(&WorkerPool::lane, this, i);
+        if (affinity.empty())
+            continue;
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(affinity.at(i % affinity.size()), &cpuset);
+        if (pthread_setaffinity_np(m_threads.back().native_handle(), sizeof(cpu_set_t), &cpuset) != 0)
+        {
+            ROS_WARN("Unable to pin worker lane %d to cpu %d", (int)i, affinity.at(i % affinity.size()));
+        }
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cvStart.notify_all();
+    for (std::thread &thread : m_threads)
+        thread.join();
+}
+
+void WorkerPool::run(size_t num_jobs, const std::function<void(size_t)> &job)
+{
+    if (num_jobs == 0)
+        return;
+
+    // Publish the new batch to the lanes
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_job = &job;
+    m_numJobs = num_jobs;
+    m_nextJob = 0;
+    m_jobsLeft = num_jobs;
+    m_batch++;
+    m_cvStart.notify_all();
+
+    // Wait till every job of this batch has been finished
+    m_cvDone.wait(lock, [this] { return m_jobsLeft == 0; });
+    m_job = nullptr;
+}
+
+void WorkerPool::lane(size_t id)
+{
+    size_t seen_batch = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        // Wait for either a new batch or the shutdown
+        m_cvStart.wait(lock, [&] { return m_stop || (m_batch != seen_batch && m_nextJob < m_numJobs); });
+        if (m_stop)
+            return;
+
+        // Keep pulling jobs from this batch till there are none left
+        while (m_nextJob < m_numJobs)
+        {
+            const size_t job_id = m_nextJob++;
+            const std::function<void(size_t)> *job = m_job;
+            lock.unlock();
+            (*job)(job_id);
+            lock.lock();
+            if (--m_jobsLeft == 0)
+                m_cvDone.notify_one();
+        }
+        seen_batch = m_batch;
+    }
+}
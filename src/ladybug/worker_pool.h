@@ -0,0 +1,64 @@
+#ifndef LADYBUG_WORKER_POOL_H
+#define LADYBUG_WORKER_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Small fixed-size pool of worker threads, one lane per thread
+ * Each call to run() hands out a batch of jobs (normally one per camera head)
+ * and blocks the caller until every job of the batch has finished
+ */
+class WorkerPool
+{
+  public:
+    /**
+     * Creates the pool and starts all the lanes
+     * If an affinity list is given, lane i is pinned to cpu affinity[i % affinity.size()]
+     */
+    WorkerPool(size_t num_lanes, const std::vector<int> &affinity = std::vector<int>());
+
+    /**
+     * Stops and joins all lanes
+     */
+    ~WorkerPool();
+
+    /**
+     * Runs job(0) ... job(num_jobs-1) across the lanes and waits for all of them
+     * Jobs are pulled by the lanes in order, so num_jobs can be larger than the lane count
+     */
+    void run(size_t num_jobs, const std::function<void(size_t)> &job);
+
+    /**
+     * Number of lanes (threads) in this pool
+     */
+    size_t size() const { return m_threads.size(); }
+
+  private:
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    /**
+     * Main function of each lane, waits for a new batch and pulls jobs from it
+     */
+    void lane(size_t id);
+
+    std::vector<std::thread> m_threads;
+
+    // Current batch, all protected by the mutex
+    std::mutex m_mutex;
+    std::condition_variable m_cvStart;
+    std::condition_variable m_cvDone;
+    const std::function<void(size_t)> *m_job;
+    size_t m_numJobs;
+    size_t m_nextJob;
+    size_t m_jobsLeft;
+    size_t m_batch;
+    bool m_stop;
+};
+
+#endif // LADYBUG_WORKER_POOL_H
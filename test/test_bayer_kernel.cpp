@@ -0,0 +1,172 @@
+#include <gtest/gtest.h>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "bayer_kernel.h"
+#include "test_util.h"
+
+namespace
+{
+
+const BayerPattern PATTERNS[] = {BAYER_RGGB, BAYER_GRBG, BAYER_GBRG, BAYER_BGGR};
+
+// A small head with the proportions of a Ladybug5 one, every scale below still gives whole Bayer cells
+const int COLS = 256;
+const int ROWS = 304;
+
+} // namespace
+
+TEST(BayerKernel, MatchesOpenCvChainAtFullScale)
+{
+    const cv::Mat raw = testPlane(COLS, ROWS, CV_8UC1, 1);
+    for (BayerPattern pattern : PATTERNS)
+    {
+        BayerKernel kernel(COLS, ROWS, 100, false, pattern);
+        const cv::Mat out = runKernel(kernel, raw);
+        const cv::Mat expected = opencvChain(raw, pattern, 100);
+        ASSERT_EQ(out.size(), expected.size());
+        EXPECT_EQ(maxDifference(out, expected), 0) << "pattern " << pattern;
+    }
+}
+
+TEST(BayerKernel, MatchesOpenCvChainDownToHalfScale)
+{
+    // Same weights as cv::resize(INTER_LINEAR), the blend only differs in rounding
+    const cv::Mat raw = testPlane(COLS, ROWS, CV_8UC1, 2);
+    for (BayerPattern pattern : PATTERNS)
+    {
+        for (double scale : {90.0, 75.0, 62.5, 51.0, 50.0})
+        {
+            BayerKernel kernel(COLS, ROWS, scale, false, pattern);
+            const cv::Mat out = runKernel(kernel, raw);
+            const cv::Mat expected = opencvChain(raw, pattern, scale);
+            ASSERT_EQ(out.size(), expected.size()) << "scale " << scale;
+            EXPECT_LE(maxDifference(out, expected), 1) << "pattern " << pattern << ", scale " << scale;
+        }
+    }
+}
+
+TEST(BayerKernel, BinsCellsBelowHalfScale)
+{
+    // Binning is not the chain, it averages whole cells instead of interpolating a full-size demosaic
+    // It has to match its own definition, and stay close enough to the chain to be a drop-in replacement
+    const cv::Mat raw = testPlane(COLS, ROWS, CV_8UC1, 3);
+    for (BayerPattern pattern : PATTERNS)
+    {
+        for (double scale : {49.0, 40.0, 33.0, 25.0, 12.5})
+        {
+            BayerKernel kernel(COLS, ROWS, scale, false, pattern);
+            const cv::Mat out = runKernel(kernel, raw);
+            const cv::Mat binned = binnedReference(raw, pattern, scale);
+            ASSERT_EQ(out.size(), binned.size()) << "scale " << scale;
+            EXPECT_LE(maxDifference(out, binned), 1) << "pattern " << pattern << ", scale " << scale;
+            EXPECT_GT(cv::PSNR(out, opencvChain(raw, pattern, scale)), 30) << "pattern " << pattern << ", scale " << scale;
+        }
+    }
+}
+
+TEST(BayerKernel, WritesTheOutputFormats)
+{
+    const cv::Mat raw = testPlane(COLS, ROWS, CV_8UC1, 4);
+    for (double scale : {100.0, 75.0, 25.0})
+    {
+        const cv::Mat rgb = runKernel(BayerKernel(COLS, ROWS, scale, false, BAYER_GRBG, OUTPUT_RGB), raw);
+        const cv::Mat bgr = runKernel(BayerKernel(COLS, ROWS, scale, false, BAYER_GRBG, OUTPUT_BGR), raw);
+        const cv::Mat mono = runKernel(BayerKernel(COLS, ROWS, scale, false, BAYER_GRBG, OUTPUT_MONO), raw);
+        cv::Mat expected;
+        cv::cvtColor(rgb, expected, cv::COLOR_RGB2BGR);
+        EXPECT_EQ(maxDifference(bgr, expected), 0) << "scale " << scale;
+        cv::cvtColor(rgb, expected, cv::COLOR_RGB2GRAY);
+        EXPECT_LE(maxDifference(mono, expected), 1) << "scale " << scale;
+    }
+}
+
+TEST(BayerKernel, MapsRawPositionsLikeTheChain)
+{
+    for (double scale : {100.0, 75.0, 50.0, 12.5})
+    {
+        BayerKernel kernel(COLS, ROWS, scale);
+        EXPECT_EQ(kernel.out_rows(), (int)(COLS * scale / 100));
+        EXPECT_EQ(kernel.out_cols(), (int)(ROWS * scale / 100));
+
+        // The top left of the sensor ends up in the top right of the output, its bottom left in the top left
+        double col, row;
+        kernel.rawToOutput(-0.5, -0.5, col, row);
+        EXPECT_NEAR(col, kernel.out_cols() - 0.5, 1e-9);
+        EXPECT_NEAR(row, -0.5, 1e-9);
+        kernel.rawToOutput(-0.5, ROWS - 0.5, col, row);
+        EXPECT_NEAR(col, -0.5, 1e-9);
+        EXPECT_NEAR(row, -0.5, 1e-9);
+
+        double raw_col, raw_row;
+        kernel.outputToRaw(12.25, 7.5, raw_col, raw_row);
+        kernel.rawToOutput(raw_col, raw_row, col, row);
+        EXPECT_NEAR(col, 12.25, 1e-9);
+        EXPECT_NEAR(row, 7.5, 1e-9);
+    }
+}
+
+TEST(BayerKernel, EveryPatternMatchesTheReferenceOnEveryPath)
+{
+    // Full-height planes interpolate down to 50% and bin below it
+    // Half-height planes have half the rows, so above 50% they are stretched, down to 26% they still interpolate, and only then bin
+    // Interpolation is checked against the chain and binning against its definition, 16-bit samples keep their low bits
+    const struct
+    {
+        bool half_height;
+        double scale;
+        bool binned;
+        const char *path;
+    } paths[] = {{false, 100.0, false, "linear"},    {false, 75.0, false, "linear"},    {false, 51.0, false, "linear"},
+                 {false, 50.0, false, "linear"},     {false, 25.0, true, "binned"},     {false, 12.5, true, "binned"},
+                 {true, 100.0, false, "stretched"},  {true, 75.0, false, "stretched"},  {true, 51.0, false, "stretched"},
+                 {true, 50.0, false, "linear"},      {true, 40.0, false, "linear"},     {true, 25.0, true, "binned"},
+                 {true, 12.5, true, "binned"}};
+    for (int type : {CV_8UC1, CV_16UC1})
+    {
+        const cv::Mat full = testPlane(COLS, ROWS, type, 6), half = testPlane(COLS, ROWS / 2, type, 7);
+        const double tolerance = (type == CV_16UC1) ? 3.0 : 1.0;
+        for (BayerPattern pattern : PATTERNS)
+        {
+            for (const auto &path : paths)
+            {
+                const cv::Mat &raw = path.half_height ? half : full;
+                const BayerKernel kernel(COLS, ROWS, path.scale, path.half_height, pattern);
+                const cv::Mat out = runKernel(kernel, raw);
+                const cv::Mat expected = path.binned ? binnedReference(raw, pattern, path.scale, path.half_height)
+                                                     : opencvChain(raw, pattern, path.scale, path.half_height);
+                ASSERT_EQ(out.size(), expected.size()) << path.path << " at " << path.scale << "%";
+                EXPECT_LE(maxDifference(out, expected), tolerance)
+                    << (type == CV_16UC1 ? "16-bit " : "8-bit ") << (path.half_height ? "half-height " : "") << path.path << " path at "
+                    << path.scale << "%, pattern " << pattern;
+            }
+        }
+    }
+}
+
+TEST(BayerKernel, VectorizedMatchesScalar)
+{
+    // SSE4.1 must give the same bits as one pixel at a time, the odd width leaves a scalar tail on every row
+    const int cols = 250, rows = 298;
+    if (!BayerKernel(cols, rows, 100).vectorized())
+        return;
+    for (int type : {CV_8UC1, CV_16UC1})
+    {
+        for (bool half_height : {false, true})
+        {
+            const cv::Mat raw = testPlane(cols, half_height ? rows / 2 : rows, type, 8);
+            for (BayerPattern pattern : PATTERNS)
+            {
+                for (double scale : {100.0, 75.0, 51.0, 50.0})
+                {
+                    BayerKernel kernel(cols, rows, scale, half_height, pattern);
+                    const cv::Mat vectorized = runKernel(kernel, raw);
+                    kernel.setVectorized(false);
+                    const cv::Mat scalar = runKernel(kernel, raw);
+                    EXPECT_EQ(maxDifference(vectorized, scalar), 0) << (type == CV_16UC1 ? "16-bit " : "8-bit ")
+                                                                    << (half_height ? "half-height " : "") << "pattern " << pattern
+                                                                    << " at " << scale << "%";
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,160 @@
+#include <array>
+
+#include <gtest/gtest.h>
+
+#include "camera_calibration.h"
+
+namespace
+{
+
+const int COLS = 2048;
+const int ROWS = 2448;
+
+/**
+ * A calibration of a head of width x height pixels with some of every distortion term, like the ones from the Ladybug SDK
+ */
+sensor_msgs::CameraInfo testCalibration(int width, int height)
+{
+    sensor_msgs::CameraInfo calib;
+    calib.width = (uint32_t)width;
+    calib.height = (uint32_t)height;
+    const double f = 0.6 * width;
+    const double K[9] = {f, 0, 0.52 * width, 0, 1.01 * f, 0.47 * height, 0, 0, 1};
+    for (int row = 0; row < 3; row++)
+    {
+        for (int col = 0; col < 3; col++)
+        {
+            calib.K[row * 3 + col] = K[row * 3 + col];
+            calib.P[row * 4 + col] = K[row * 3 + col];
+            calib.R[row * 3 + col] = (row == col) ? 1.0 : 0.0;
+        }
+    }
+    calib.D = {-0.21, 0.05, 0.0012, -0.0007, -0.004};
+    calib.distortion_model = "plumb_bob";
+    return calib;
+}
+
+/**
+ * Pixel a point in the camera frame is seen at, through the distortion and K of a calibration
+ */
+void project(const sensor_msgs::CameraInfo &info, const double X[3], double &u, double &v)
+{
+    double xd, yd;
+    distortPoint(info.D, X[0] / X[2], X[1] / X[2], xd, yd);
+    u = info.K[0] * xd + info.K[1] * yd + info.K[2];
+    v = info.K[3] * xd + info.K[4] * yd + info.K[5];
+}
+
+/**
+ * Pixel a point is seen at through P, the camera the rectified images are made for
+ */
+void projectRectified(const sensor_msgs::CameraInfo &info, const double X[3], double &u, double &v)
+{
+    const double w = info.P[8] * X[0] + info.P[9] * X[1] + info.P[10] * X[2] + info.P[11];
+    u = (info.P[0] * X[0] + info.P[1] * X[1] + info.P[2] * X[2] + info.P[3]) / w;
+    v = (info.P[4] * X[0] + info.P[5] * X[1] + info.P[6] * X[2] + info.P[7]) / w;
+}
+
+/**
+ * Points spread over the field of view of the test calibrations
+ */
+std::vector<std::array<double, 3>> testPoints()
+{
+    std::vector<std::array<double, 3>> points;
+    for (double x = -0.75; x <= 0.75; x += 0.25)
+        for (double y = -0.85; y <= 0.85; y += 0.34)
+            points.push_back({{x * 3.0, y * 3.0, 3.0}});
+    return points;
+}
+
+/**
+ * Check that the transformed calibration sees every test point where rawToOutput() puts it in the published image
+ * raw_scale is the size of the raw head over the size of the image the calibration was made on
+ */
+void checkSideways(const sensor_msgs::CameraInfo &calib, const BayerKernel &kernel, double raw_scale)
+{
+    sensor_msgs::CameraInfo msg;
+    transformCameraInfo(calib, kernel, msg);
+    EXPECT_EQ(msg.width, (uint32_t)kernel.out_cols());
+    EXPECT_EQ(msg.height, (uint32_t)kernel.out_rows());
+    EXPECT_EQ(msg.distortion_model, calib.distortion_model);
+    for (const auto &point : testPoints())
+    {
+        // The published camera frame is the calibration frame rotated with the image, x' = -y, y' = x
+        const double X[3] = {point[0], point[1], point[2]};
+        const double rotated[3] = {-point[1], point[0], point[2]};
+        double u, v, col, row, expected_col, expected_row;
+        project(calib, X, u, v);
+        kernel.rawToOutput((u + 0.5) * raw_scale - 0.5, (v + 0.5) * raw_scale - 0.5, expected_col, expected_row);
+        project(msg, rotated, col, row);
+        EXPECT_NEAR(col, expected_col, 1e-6) << "scale " << kernel.scale() << " point " << X[0] << ", " << X[1];
+        EXPECT_NEAR(row, expected_row, 1e-6) << "scale " << kernel.scale() << " point " << X[0] << ", " << X[1];
+
+        // And the same for the undistorted projection through P
+        projectRectified(calib, X, u, v);
+        kernel.rawToOutput((u + 0.5) * raw_scale - 0.5, (v + 0.5) * raw_scale - 0.5, expected_col, expected_row);
+        projectRectified(msg, rotated, col, row);
+        EXPECT_NEAR(col, expected_col, 1e-6) << "scale " << kernel.scale() << " point " << X[0] << ", " << X[1];
+        EXPECT_NEAR(row, expected_row, 1e-6) << "scale " << kernel.scale() << " point " << X[0] << ", " << X[1];
+    }
+}
+
+} // namespace
+
+TEST(CameraCalibration, SidewaysCalibrationFollowsTheKernel)
+{
+    const sensor_msgs::CameraInfo calib = testCalibration(COLS, ROWS);
+    for (double scale : {100.0, 75.0, 50.0, 37.5, 25.0, 12.5})
+        checkSideways(calib, BayerKernel(COLS, ROWS, scale), 1.0);
+}
+
+TEST(CameraCalibration, HalfHeightHeadsKeepTheFullHeightCalibration)
+{
+    // Half-height planes are scaled to the proportions of the full sensor, so the same calibration applies
+    const sensor_msgs::CameraInfo calib = testCalibration(COLS, ROWS);
+    for (double scale : {100.0, 50.0, 25.0})
+    {
+        const BayerKernel full(COLS, ROWS, scale), half(COLS, ROWS, scale, true);
+        checkSideways(calib, half, 1.0);
+        sensor_msgs::CameraInfo full_msg, half_msg;
+        transformCameraInfo(calib, full, full_msg);
+        transformCameraInfo(calib, half, half_msg);
+        EXPECT_EQ(full_msg.K, half_msg.K) << "scale " << scale;
+        EXPECT_EQ(full_msg.P, half_msg.P) << "scale " << scale;
+        EXPECT_EQ(full_msg.D, half_msg.D) << "scale " << scale;
+    }
+}
+
+TEST(CameraCalibration, LowerResolutionCalibrationIsScaledUp)
+{
+    // Calibrated on images binned 2x2, whose pixel centers sit between the sensor pixels
+    const sensor_msgs::CameraInfo calib = testCalibration(COLS / 2, ROWS / 2);
+    for (double scale : {100.0, 50.0, 25.0})
+        checkSideways(calib, BayerKernel(COLS, ROWS, scale), 2.0);
+}
+
+TEST(CameraCalibration, UprightCalibrationIsOnlyScaled)
+{
+    // A calibration of the published image at 100% sees the same camera frame, only the pixels get bigger
+    const sensor_msgs::CameraInfo calib = testCalibration(ROWS, COLS);
+    for (double scale : {100.0, 50.0, 25.0})
+    {
+        const BayerKernel kernel(COLS, ROWS, scale);
+        sensor_msgs::CameraInfo msg;
+        transformCameraInfo(calib, kernel, msg);
+        EXPECT_EQ(msg.D, calib.D);
+        EXPECT_EQ(msg.R, calib.R);
+        for (const auto &point : testPoints())
+        {
+            const double X[3] = {point[0], point[1], point[2]};
+            double u, v, col, row, expected_col, expected_row;
+            project(calib, X, u, v);
+            calibrationToOutput(calib, kernel, u, v, expected_col, expected_row);
+            EXPECT_NEAR(expected_col, (u + 0.5) * kernel.out_cols() / ROWS - 0.5, 1e-9);
+            EXPECT_NEAR(expected_row, (v + 0.5) * kernel.out_rows() / COLS - 0.5, 1e-9);
+            project(msg, X, col, row);
+            EXPECT_NEAR(col, expected_col, 1e-6) << "scale " << scale;
+            EXPECT_NEAR(row, expected_row, 1e-6) << "scale " << scale;
+        }
+    }
+}
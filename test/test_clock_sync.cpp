@@ -0,0 +1,200 @@
+#include <cmath>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "clock_sync.h"
+
+namespace
+{
+
+/**
+ * The cycle timer stamp of a camera time in seconds, wrapped at 128 seconds like the camera does
+ */
+LadybugTimestamp cycleStamp(double camera)
+{
+    LadybugTimestamp stamp = {};
+    const double wrapped = std::fmod(camera, 128.0);
+    stamp.ulCycleSeconds = (unsigned int)wrapped;
+    const double cycles = (wrapped - stamp.ulCycleSeconds) * 8000.0;
+    stamp.ulCycleCount = (unsigned int)cycles;
+    stamp.ulCycleOffset = (unsigned int)std::lround((cycles - stamp.ulCycleCount) * 3072.0);
+    if (stamp.ulCycleOffset == 3072)
+    {
+        stamp.ulCycleOffset = 0;
+        stamp.ulCycleCount++;
+    }
+    return stamp;
+}
+
+/**
+ * A camera whose clock runs drift_ppm fast, and whose frames reach the host with some jitter
+ */
+struct SyntheticClock
+{
+    double host_start;
+    double camera_start;
+    double drift_ppm;
+    double jitter;
+    std::mt19937 rng;
+    std::normal_distribution<double> noise;
+
+    SyntheticClock(double drift_ppm_ = 0, double jitter_ = 0)
+        : host_start(1500000000.0), camera_start(100.0), drift_ppm(drift_ppm_), jitter(jitter_), rng(7), noise(0.0, 1.0)
+    {
+    }
+
+    // Host time the frame taken at this many seconds of camera time would be stamped with, without the jitter
+    double host(double t) const { return host_start + t / (1 + drift_ppm * 1e-6); }
+
+    ros::Time update(CameraClockSync &sync, double t)
+    {
+        return sync.update(cycleStamp(camera_start + t), ros::Time(host(t) + jitter * noise(rng)));
+    }
+};
+
+} // namespace
+
+TEST(CameraClockSync, ConvertsCycleTime)
+{
+    LadybugTimestamp stamp = {};
+    stamp.ulCycleSeconds = 127;
+    stamp.ulCycleCount = 4000;
+    stamp.ulCycleOffset = 1536;
+    EXPECT_DOUBLE_EQ(CameraClockSync::cycleTime(stamp), 127.5 + 0.5 / 8000.0);
+    EXPECT_NEAR(CameraClockSync::cycleTime(cycleStamp(300.25)), 44.25, 1e-7);
+}
+
+TEST(CameraClockSync, UsesHostTimeUntilItHasEnoughSamples)
+{
+    CameraClockSync sync(300, 10);
+    SyntheticClock clock;
+    for (int i = 0; i < 9; i++)
+    {
+        const ros::Time host(clock.host(0.1 * i));
+        EXPECT_EQ(sync.update(cycleStamp(clock.camera_start + 0.1 * i), host), host);
+    }
+}
+
+TEST(CameraClockSync, UnwrapsThe128SecondCounter)
+{
+    // 10 fps for 300 seconds of camera time, the counter wraps at 128 and 256 seconds
+    CameraClockSync sync(300, 10);
+    SyntheticClock clock;
+    double last = 0;
+    for (int i = 0; i < 3000; i++)
+    {
+        const double t = 0.1 * i;
+        const double stamp = clock.update(sync, t).toSec();
+        if (i >= 10)
+        {
+            ASSERT_NEAR(stamp, clock.host(t), 1e-6) << "frame " << i;
+            ASSERT_NEAR(stamp - last, 0.1, 1e-6) << "frame " << i;
+        }
+        last = stamp;
+    }
+    double offset, drift_ppm, jitter;
+    size_t num_samples, num_resets;
+    sync.getEstimate(offset, drift_ppm, jitter, num_samples, num_resets);
+    EXPECT_EQ(num_resets, 0u);
+    EXPECT_EQ(num_samples, 300u);
+    EXPECT_NEAR(offset, clock.host_start - clock.camera_start, 1e-6);
+}
+
+TEST(CameraClockSync, RestartsAfterAGapItCanNotUnwrap)
+{
+    CameraClockSync sync(300, 10);
+    SyntheticClock clock;
+    for (int i = 0; i < 50; i++)
+        clock.update(sync, 0.1 * i);
+
+    // 70 seconds without frames, we can not know how often the counter wrapped meanwhile
+    const double resume = 4.9 + 70;
+    const ros::Time host(clock.host(resume));
+    EXPECT_EQ(sync.update(cycleStamp(clock.camera_start + resume), host), host);
+    double offset, drift_ppm, jitter;
+    size_t num_samples, num_resets;
+    sync.getEstimate(offset, drift_ppm, jitter, num_samples, num_resets);
+    EXPECT_EQ(num_resets, 1u);
+    EXPECT_EQ(num_samples, 1u);
+
+    // And the fit picks up again from there
+    for (int i = 1; i < 20; i++)
+        EXPECT_NEAR(clock.update(sync, resume + 0.1 * i).toSec(), clock.host(resume + 0.1 * i), 1e-6);
+}
+
+TEST(CameraClockSync, RestartsWhenTheCameraClockJumps)
+{
+    CameraClockSync sync(300, 10);
+    SyntheticClock clock;
+    for (int i = 0; i < 50; i++)
+        clock.update(sync, 0.1 * i);
+
+    // The camera restarts, its clock is 10 seconds behind where it was, while the host time goes on
+    clock.camera_start -= 10;
+    clock.update(sync, 5.0);
+    double offset, drift_ppm, jitter;
+    size_t num_samples, num_resets;
+    sync.getEstimate(offset, drift_ppm, jitter, num_samples, num_resets);
+    EXPECT_EQ(num_resets, 1u);
+    EXPECT_EQ(num_samples, 1u);
+    for (int i = 1; i < 20; i++)
+        EXPECT_NEAR(clock.update(sync, 5.0 + 0.1 * i).toSec(), clock.host(5.0 + 0.1 * i), 1e-6);
+
+    // Smaller steps than a second are taken as jitter
+    for (int i = 20; i < 40; i++)
+        clock.update(sync, 5.0 + 0.1 * i);
+    clock.host_start += 0.5;
+    clock.update(sync, 9.0);
+    sync.getEstimate(offset, drift_ppm, jitter, num_samples, num_resets);
+    EXPECT_EQ(num_resets, 1u);
+}
+
+TEST(CameraClockSync, FitsDriftThroughJitter)
+{
+    // 300 frames at 1 fps, the camera clock runs 100 ppm fast and the host receive time has 1 ms of jitter
+    CameraClockSync sync(300, 10);
+    SyntheticClock clock(100, 0.001);
+    double host_error = 0, stamp_error = 0;
+    int count = 0;
+    for (int i = 0; i < 600; i++)
+    {
+        const double stamp = clock.update(sync, i).toSec();
+        if (i < 300)
+            continue;
+        stamp_error += (stamp - clock.host(i)) * (stamp - clock.host(i));
+        host_error += clock.jitter * clock.jitter;
+        count++;
+    }
+    double offset, drift_ppm, jitter;
+    size_t num_samples, num_resets;
+    sync.getEstimate(offset, drift_ppm, jitter, num_samples, num_resets);
+    EXPECT_EQ(num_resets, 0u);
+    EXPECT_EQ(num_samples, 300u);
+    EXPECT_NEAR(drift_ppm, -100, 5);
+    EXPECT_NEAR(jitter, 0.001, 0.0002);
+
+    // The fitted stamps are much closer to the real exposure times than the host receive times
+    EXPECT_LT(std::sqrt(stamp_error / count), 0.25 * std::sqrt(host_error / count));
+}
+
+TEST(CameraClockSync, SubtractsTheLatencyOffset)
+{
+    CameraClockSync plain(300, 10), offset(300, 10);
+    offset.setLatencyOffset(0.015);
+    SyntheticClock a, b;
+    for (int i = 0; i < 50; i++)
+    {
+        const double expected = a.update(plain, 0.1 * i).toSec() - 0.015;
+        EXPECT_NEAR(b.update(offset, 0.1 * i).toSec(), expected, 1e-6) << "frame " << i;
+    }
+
+    // The offset is a setting, not part of the estimate, so it survives a reset
+    plain.reset();
+    offset.reset();
+    for (int i = 0; i < 20; i++)
+    {
+        const double expected = a.update(plain, 10 + 0.1 * i).toSec() - 0.015;
+        EXPECT_NEAR(b.update(offset, 10 + 0.1 * i).toSec(), expected, 1e-6) << "frame " << i;
+    }
+}
@@ -0,0 +1,123 @@
+#include <iostream>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "color_correction.h"
+#include "color_matrix.h"
+#include "test_util.h"
+
+namespace
+{
+
+/**
+ * Corrections with gains up to MAX_GAIN and matrices with negative terms, so the clamps at both ends are used
+ */
+std::vector<ColorCorrection> testCorrections(unsigned int seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> gain(0.25, ColorCorrection::MAX_GAIN), coef(-1.0, 2.0);
+    std::vector<ColorCorrection> corrections;
+    const double saturation[9] = {1.6, -0.4, -0.2, -0.3, 1.5, -0.2, -0.1, -0.5, 1.6};
+    const double gains[3] = {1.9, 1.0, 1.4};
+    corrections.emplace_back(gains, saturation);
+    for (int i = 0; i < 20; i++)
+    {
+        double g[3], m[9];
+        for (double &v : g)
+            v = gain(rng);
+        for (double &v : m)
+            v = coef(rng);
+        corrections.emplace_back(g, m);
+    }
+    return corrections;
+}
+
+/**
+ * Rows of random values up to Max with both ends in them, through the SSE2 version and through the scalar loop alone
+ */
+template <int Max>
+void checkAgainstScalar()
+{
+    std::mt19937 rng(Max);
+    std::uniform_int_distribution<int> value(0, Max);
+    for (const ColorCorrection &color : testCorrections(Max))
+    {
+        for (int n : {0, 1, 7, 8, 9, 15, 16, 63, BayerKernel::BLOCK_SIZE})
+        {
+            int values[3][BayerKernel::BLOCK_SIZE], expected[3][BayerKernel::BLOCK_SIZE];
+            for (int ch = 0; ch < 3; ch++)
+            {
+                for (int i = 0; i < n; i++)
+                    values[ch][i] = expected[ch][i] = (i % 5 == 0) ? 0 : (i % 5 == 1) ? Max : value(rng);
+            }
+            correctColor<Max>(color.coefs(), values[0], values[1], values[2], n);
+            correctColorScalar<Max>(color.coefs(), expected[0], expected[1], expected[2], n);
+            for (int ch = 0; ch < 3; ch++)
+            {
+                for (int i = 0; i < n; i++)
+                    ASSERT_EQ(values[ch][i], expected[ch][i]) << "channel " << ch << " of pixel " << i << " of " << n;
+            }
+        }
+    }
+}
+
+/**
+ * The kernel with a correction, against the kernel without one and the scalar loop over its output
+ */
+template <typename Sample, int Max>
+void checkKernel(const cv::Mat &raw, double scale, const ColorCorrection &color)
+{
+    const BayerKernel kernel(raw.cols, raw.rows, scale);
+    const cv::Mat plain = runKernel(kernel, raw);
+    cv::Mat corrected(plain.size(), plain.type());
+    if (sizeof(Sample) == 2)
+        kernel.process(raw.ptr<uint16_t>(), corrected.ptr<uint16_t>(), corrected.step, nullptr, &color);
+    else
+        kernel.process(raw.ptr<uint8_t>(), corrected.ptr<uint8_t>(), corrected.step, nullptr, &color);
+    for (int r = 0; r < plain.rows; r++)
+    {
+        const Sample *p = plain.ptr<Sample>(r), *q = corrected.ptr<Sample>(r);
+        for (int c = 0; c < plain.cols; c++, p += 3, q += 3)
+        {
+            int rgb[3] = {p[0], p[1], p[2]};
+            correctColorScalar<Max>(color.coefs(), &rgb[0], &rgb[1], &rgb[2], 1);
+            for (int ch = 0; ch < 3; ch++)
+                ASSERT_EQ(q[ch], rgb[ch]) << "pixel " << c << ", " << r << " at " << scale << "%";
+        }
+    }
+}
+
+} // namespace
+
+TEST(ColorCorrection, Sse2MatchesTheScalarLoop)
+{
+#ifndef LADYBUG_HAVE_SSE2_COLOR
+    std::cout << "SSE2 is not available, the color matrix is the scalar loop" << std::endl;
+#endif
+    checkAgainstScalar<255>();
+    checkAgainstScalar<65535>();
+}
+
+TEST(ColorCorrection, KernelAppliesTheMatrixToWhatItWouldStore)
+{
+    const ColorCorrection color = testCorrections(1)[0];
+    const cv::Mat raw8 = testPlane(256, 304, CV_8UC1, 8), raw16 = testPlane(256, 304, CV_16UC1, 9);
+    for (double scale : {100.0, 75.0, 25.0})
+    {
+        checkKernel<uint8_t, 255>(raw8, scale, color);
+        checkKernel<uint16_t, 65535>(raw16, scale, color);
+    }
+}
+
+TEST(ColorCorrection, IdentityChangesNothing)
+{
+    const ColorCorrection identity;
+    EXPECT_TRUE(identity.identity());
+    const cv::Mat raw = testPlane(256, 304, CV_8UC1, 10);
+    const BayerKernel kernel(raw.cols, raw.rows, 50.0);
+    const cv::Mat plain = runKernel(kernel, raw);
+    cv::Mat corrected(plain.size(), plain.type());
+    kernel.process(raw.ptr<uint8_t>(), corrected.ptr<uint8_t>(), corrected.step, nullptr, &identity);
+    EXPECT_EQ(maxDifference(plain, corrected), 0);
+}
@@ -0,0 +1,112 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include "falloff.h"
+
+namespace
+{
+
+const int COLS = 100;
+const int ROWS = 70;
+const uint32_t SERIAL = 1234;
+const float ATTENUATION = 0.75f;
+const long GAMMA = -1;
+
+/**
+ * The layout of a falloff cache file, as falloff.cpp writes it
+ */
+struct FileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t serial;
+    uint32_t cols;
+    uint32_t rows;
+    uint32_t tile;
+    float attenuation;
+    int32_t gamma;
+    uint32_t pattern;
+};
+
+std::string tempPath(const std::string &name)
+{
+    return "/tmp/ladybug_test_" + std::to_string(getpid()) + "_" + name;
+}
+
+/**
+ * Write a cache file by hand, with gains that differ per head and channel, and drop the last few of them if truncate
+ */
+std::string writeFile(const std::string &name, uint32_t version, uint32_t pattern, bool truncate = false)
+{
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "LBFALLO1", 8);
+    header.version = version;
+    header.serial = SERIAL;
+    header.cols = COLS;
+    header.rows = ROWS;
+    header.tile = FalloffMap::TILE;
+    header.attenuation = ATTENUATION;
+    header.gamma = (int32_t)GAMMA;
+    header.pattern = pattern;
+    const size_t tiles = (size_t)((COLS + FalloffMap::TILE - 1) / FalloffMap::TILE) * ((ROWS + FalloffMap::TILE - 1) / FalloffMap::TILE);
+    std::vector<uint16_t> gains(LADYBUG_NUM_CAMERAS * 3 * tiles);
+    for (size_t i = 0; i < gains.size(); i++)
+        gains[i] = (uint16_t)((1 << FalloffMap::GAIN_BITS) + 100 * (i / tiles));
+    const std::string path = tempPath(name);
+    FILE *file = fopen(path.c_str(), "wb");
+    EXPECT_TRUE(file != nullptr);
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(gains.data(), sizeof(uint16_t), gains.size() - (truncate ? 3 : 0), file);
+    fclose(file);
+    return path;
+}
+
+} // namespace
+
+TEST(Falloff, CacheKeepsTheBayerPattern)
+{
+    const std::string path = writeFile("falloff_grbg", 2, BAYER_GRBG);
+    std::unique_ptr<FalloffMap> map = FalloffMap::load(path);
+    ASSERT_TRUE(map != nullptr);
+    EXPECT_EQ(map->pattern(), BAYER_GRBG);
+    EXPECT_TRUE(map->matches(SERIAL, COLS, ROWS, BAYER_GRBG, ATTENUATION, GAMMA));
+    for (BayerPattern other : {BAYER_RGGB, BAYER_GBRG, BAYER_BGGR})
+        EXPECT_FALSE(map->matches(SERIAL, COLS, ROWS, other, ATTENUATION, GAMMA)) << "pattern " << other;
+    EXPECT_FALSE(map->matches(SERIAL + 1, COLS, ROWS, BAYER_GRBG, ATTENUATION, GAMMA));
+    EXPECT_FALSE(map->matches(SERIAL, COLS, ROWS / 2, BAYER_GRBG, ATTENUATION, GAMMA));
+    EXPECT_FALSE(map->matches(SERIAL, COLS, ROWS, BAYER_GRBG, 1.0f, GAMMA));
+
+    // Saving and loading it again keeps the pattern and the gains
+    const std::string copy = tempPath("falloff_copy");
+    ASSERT_TRUE(map->save(copy));
+    std::unique_ptr<FalloffMap> loaded = FalloffMap::load(copy);
+    ASSERT_TRUE(loaded != nullptr);
+    EXPECT_TRUE(loaded->matches(SERIAL, COLS, ROWS, BAYER_GRBG, ATTENUATION, GAMMA));
+    for (size_t head = 0; head < LADYBUG_NUM_CAMERAS; head++)
+    {
+        for (int channel = 0; channel < 3; channel++)
+        {
+            EXPECT_EQ(loaded->gain(head, channel, 10.0, 20.0), map->gain(head, channel, 10.0, 20.0));
+            EXPECT_NEAR(map->gain(head, channel, 10.0, 20.0), 1.0 + 100.0 * (head * 3 + channel) / (1 << FalloffMap::GAIN_BITS), 1e-9);
+        }
+    }
+    remove(path.c_str());
+    remove(copy.c_str());
+}
+
+TEST(Falloff, RejectsOldAndDamagedFiles)
+{
+    // Version 1 had no pattern, so its gains may belong to other channels and it has to be fetched again
+    for (const std::string &path : {writeFile("falloff_v1", 1, 0), writeFile("falloff_pattern", 2, 7), writeFile("falloff_short", 2, BAYER_RGGB, true)})
+    {
+        EXPECT_TRUE(FalloffMap::load(path) == nullptr) << path;
+        remove(path.c_str());
+    }
+    EXPECT_TRUE(FalloffMap::load(tempPath("falloff_missing")) == nullptr);
+}
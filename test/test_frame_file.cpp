@@ -0,0 +1,168 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include <gtest/gtest.h>
+
+#include "frame_file.h"
+
+namespace
+{
+
+const int COLS = 64;
+const int ROWS = 48;
+
+/**
+ * A RAW8 frame of six small heads with its own bytes and metadata, sizes differ so the padding is exercised
+ */
+LadybugImage testImage(size_t n, std::vector<uint8_t> &buffer)
+{
+    buffer.resize((size_t)LADYBUG_NUM_CAMERAS * COLS * ROWS + n * 100);
+    for (size_t k = 0; k < buffer.size(); k++)
+        buffer[k] = (uint8_t)(k * 13 + n * 7);
+    LadybugImage image = LadybugImage();
+    image.uiCols = image.uiFullCols = COLS;
+    image.uiRows = image.uiFullRows = ROWS;
+    image.dataFormat = LADYBUG_DATAFORMAT_RAW8;
+    image.stippledFormat = LADYBUG_GRBG;
+    image.pData = buffer.data();
+    image.uiDataSizeBytes = (unsigned int)buffer.size();
+    image.timeStamp.ulSeconds = 1500000000 + (unsigned int)n;
+    image.timeStamp.ulMicroSeconds = 1000 * (unsigned int)n;
+    image.timeStamp.ulCycleSeconds = 100 + (unsigned int)n;
+    image.timeStamp.ulCycleCount = 50 * (unsigned int)n;
+    image.timeStamp.ulCycleOffset = 7 * (unsigned int)n;
+    image.imageInfo.ulSequenceId = 1000 + (unsigned int)n;
+    for (size_t h = 0; h < LADYBUG_NUM_CAMERAS; h++)
+    {
+        image.imageInfo.arulGainAdjust[h] = (unsigned int)(10 * n + h);
+        image.imageInfo.ulShutter[h] = (unsigned int)(20 * n + h);
+    }
+    return image;
+}
+
+/**
+ * Write frames into a new frame file and return its name
+ */
+std::string writeFile(size_t frames, std::vector<std::vector<uint8_t>> &buffers)
+{
+    LadybugCameraInfo camera = LadybugCameraInfo();
+    camera.serialBase = 1234;
+    strncpy(camera.pszModelName, "Ladybug5", sizeof(camera.pszModelName) - 1);
+    FrameFileWriter writer(camera);
+    std::string file_name;
+    EXPECT_TRUE(writer.open("/tmp/ladybug_test_" + std::to_string(getpid()) + "_" + std::to_string(frames), file_name));
+    buffers.resize(frames);
+    for (size_t n = 0; n < frames; n++)
+        EXPECT_TRUE(writer.write(testImage(n, buffers[n]), ros::Time(1500000000.0 + 0.1 * n)));
+    writer.close();
+    return file_name;
+}
+
+/**
+ * Overwrite part of a file in place
+ */
+void patch(const std::string &file_name, off_t offset, const void *data, size_t size)
+{
+    const int fd = open(file_name.c_str(), O_WRONLY);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(pwrite(fd, data, size, offset), (ssize_t)size);
+    close(fd);
+}
+
+off_t fileSize(const std::string &file_name)
+{
+    const int fd = open(file_name.c_str(), O_RDONLY);
+    const off_t size = lseek(fd, 0, SEEK_END);
+    close(fd);
+    return size;
+}
+
+} // namespace
+
+TEST(FrameFile, RoundTripsFramesAndMetadata)
+{
+    std::vector<std::vector<uint8_t>> buffers;
+    const std::string file_name = writeFile(5, buffers);
+    FrameFileReader reader;
+    ASSERT_TRUE(reader.open(file_name));
+    ASSERT_EQ(reader.size(), 5u);
+    EXPECT_EQ(reader.header().serial_base, 1234u);
+    EXPECT_STREQ(reader.header().model, "Ladybug5");
+
+    // Read them out of order, every frame starts on a block and is the same as what was written
+    for (size_t n : {3, 0, 4, 1, 2})
+    {
+        const FrameIndexEntry &entry = reader.entry(n);
+        EXPECT_EQ(entry.offset % FRAME_FILE_ALIGNMENT, 0u);
+        EXPECT_EQ(entry.stamp_ns, (int64_t)ros::Time(1500000000.0 + 0.1 * n).toNSec());
+
+        LadybugImage image, expected = testImage(n, buffers[n]);
+        reader.frame(n, image);
+        ASSERT_EQ(image.uiDataSizeBytes, expected.uiDataSizeBytes) << "frame " << n;
+        EXPECT_EQ(memcmp(image.pData, expected.pData, image.uiDataSizeBytes), 0) << "frame " << n;
+        EXPECT_EQ(image.uiCols, expected.uiCols);
+        EXPECT_EQ(image.uiRows, expected.uiRows);
+        EXPECT_EQ(image.dataFormat, expected.dataFormat);
+        EXPECT_EQ(image.stippledFormat, expected.stippledFormat);
+        EXPECT_EQ(image.timeStamp.ulSeconds, expected.timeStamp.ulSeconds);
+        EXPECT_EQ(image.timeStamp.ulMicroSeconds, expected.timeStamp.ulMicroSeconds);
+        EXPECT_EQ(image.timeStamp.ulCycleSeconds, expected.timeStamp.ulCycleSeconds);
+        EXPECT_EQ(image.timeStamp.ulCycleCount, expected.timeStamp.ulCycleCount);
+        EXPECT_EQ(image.timeStamp.ulCycleOffset, expected.timeStamp.ulCycleOffset);
+        EXPECT_EQ(image.imageInfo.ulSequenceId, expected.imageInfo.ulSequenceId);
+        for (size_t h = 0; h < LADYBUG_NUM_CAMERAS; h++)
+        {
+            EXPECT_EQ(image.imageInfo.arulGainAdjust[h], expected.imageInfo.arulGainAdjust[h]);
+            EXPECT_EQ(image.imageInfo.ulShutter[h], expected.imageInfo.ulShutter[h]);
+        }
+    }
+    reader.close();
+    unlink(file_name.c_str());
+}
+
+TEST(FrameFile, RejectsDamagedFiles)
+{
+    std::vector<std::vector<uint8_t>> buffers;
+    const std::string file_name = writeFile(3, buffers);
+    const off_t size = fileSize(file_name);
+    const off_t footer_offset = size - (off_t)sizeof(FrameFileFooter);
+    FrameFileFooter footer;
+    const int fd = open(file_name.c_str(), O_RDONLY);
+    ASSERT_EQ(pread(fd, &footer, sizeof(footer), footer_offset), (ssize_t)sizeof(footer));
+    close(fd);
+    FrameFileFooter damaged = footer;
+
+    // A frame count that wraps around when it is multiplied by the entry size still adds up to the file size
+    damaged.num_frames = footer.num_frames + (1ull << 61);
+    patch(file_name, footer_offset, &damaged, sizeof(damaged));
+    EXPECT_FALSE(FrameFileReader().open(file_name));
+
+    // So does an index offset far past the end with a frame count that wraps back to it
+    damaged.index_offset = footer.index_offset + (1ull << 63);
+    damaged.num_frames = footer.num_frames + (1ull << 60);
+    patch(file_name, footer_offset, &damaged, sizeof(damaged));
+    EXPECT_FALSE(FrameFileReader().open(file_name));
+
+    // A frame whose offset and size wrap around to inside the file
+    patch(file_name, footer_offset, &footer, sizeof(footer));
+    FrameIndexEntry entry;
+    const off_t entry_offset = (off_t)footer.index_offset + (off_t)sizeof(FrameIndexEntry);
+    {
+        FrameFileReader reader;
+        ASSERT_TRUE(reader.open(file_name));
+        entry = reader.entry(1);
+    }
+    const FrameIndexEntry good = entry;
+    entry.size = ~(uint64_t)0 - entry.offset + 2;
+    patch(file_name, entry_offset, &entry, sizeof(entry));
+    EXPECT_FALSE(FrameFileReader().open(file_name));
+
+    // And a file from a crash, without an index
+    patch(file_name, entry_offset, &good, sizeof(good));
+    ASSERT_TRUE(FrameFileReader().open(file_name));
+    ASSERT_EQ(truncate(file_name.c_str(), (off_t)footer.index_offset), 0);
+    EXPECT_FALSE(FrameFileReader().open(file_name));
+    unlink(file_name.c_str());
+}
@@ -0,0 +1,159 @@
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "frame_ring.h"
+
+TEST(SpscRing, KeepsOrderAndCapacity)
+{
+    SpscRing<int> ring(3);
+    EXPECT_EQ(ring.capacity(), 3u);
+    int item = -1;
+    EXPECT_FALSE(ring.pop(item));
+    for (int round = 0; round < 5; round++)
+    {
+        EXPECT_TRUE(ring.push(3 * round));
+        EXPECT_TRUE(ring.push(3 * round + 1));
+        EXPECT_TRUE(ring.push(3 * round + 2));
+        EXPECT_FALSE(ring.push(-1));
+        EXPECT_EQ(ring.size(), 3u);
+        for (int i = 0; i < 3; i++)
+        {
+            ASSERT_TRUE(ring.pop(item));
+            EXPECT_EQ(item, 3 * round + i);
+        }
+        EXPECT_EQ(ring.size(), 0u);
+    }
+}
+
+TEST(SpscRing, PassesEverythingBetweenThreads)
+{
+    SpscRing<size_t> ring(4);
+    const size_t count = 200000;
+    std::thread producer([&]() {
+        for (size_t i = 0; i < count; i++)
+        {
+            while (!ring.push(i))
+                std::this_thread::yield();
+        }
+    });
+    size_t expected = 0, item;
+    while (expected < count)
+    {
+        if (!ring.pop(item))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        ASSERT_EQ(item, expected);
+        expected++;
+    }
+    producer.join();
+}
+
+TEST(SpscRing, WaitSleepsUntilAPush)
+{
+    SpscRing<size_t> ring(2);
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(ring.wait(std::chrono::milliseconds(20)));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+
+    // Every push wakes the consumer, long before the timeout
+    const size_t count = 2000;
+    std::thread producer([&]() {
+        for (size_t i = 0; i < count; i++)
+        {
+            while (!ring.push(i))
+                std::this_thread::yield();
+        }
+    });
+    size_t expected = 0, item;
+    while (expected < count)
+    {
+        if (!ring.pop(item))
+        {
+            ASSERT_TRUE(ring.wait(std::chrono::seconds(5))) << "item " << expected;
+            continue;
+        }
+        ASSERT_EQ(item, expected);
+        expected++;
+    }
+    producer.join();
+    EXPECT_TRUE(ring.push(0));
+    EXPECT_TRUE(ring.wait(std::chrono::seconds(0)));
+}
+
+TEST(FrameHold, QueuesTheFrameWhenTheLastHoldGoes)
+{
+    auto queue = std::make_shared<FrameReleaseQueue>();
+    std::vector<uint8_t> buffer(64, 1);
+    LockedFrame frame = {};
+    frame.image.pData = buffer.data();
+    frame.image.uiDataSizeBytes = (unsigned int)buffer.size();
+    frame.image.uiBufferIndex = 5;
+
+    std::vector<LockedFrame> released;
+    {
+        auto hold = std::make_shared<FrameHold>(frame, queue);
+        auto message = hold;
+        hold.reset();
+        queue->take(released);
+        EXPECT_TRUE(released.empty());
+        EXPECT_EQ(queue->held(), 1u);
+        EXPECT_EQ(message->data(), buffer.data());
+    }
+    queue->take(released);
+    ASSERT_EQ(released.size(), 1u);
+    EXPECT_EQ(released[0].image.uiBufferIndex, 5u);
+    EXPECT_EQ(queue->held(), 0u);
+}
+
+TEST(FrameHold, CountsPublishedHoldsOnce)
+{
+    auto queue = std::make_shared<FrameReleaseQueue>();
+    LockedFrame frame = {};
+    auto a = std::make_shared<FrameHold>(frame, queue);
+    auto b = std::make_shared<FrameHold>(frame, queue);
+    a->markPublished();
+    a->markPublished();
+    EXPECT_EQ(queue->published(), 1u);
+    b->markPublished();
+    EXPECT_EQ(queue->published(), 2u);
+    a.reset();
+    EXPECT_EQ(queue->published(), 1u);
+    b.reset();
+    EXPECT_EQ(queue->published(), 0u);
+}
+
+TEST(FrameHold, RetiredQueueTearsDownOnceTheLastHoldIsGone)
+{
+    // Without holds the teardown runs right away
+    auto idle = std::make_shared<FrameReleaseQueue>();
+    int idle_teardowns = 0;
+    EXPECT_EQ(idle->retire([&]() { idle_teardowns++; }), 0u);
+    EXPECT_EQ(idle_teardowns, 1);
+
+    auto queue = std::make_shared<FrameReleaseQueue>();
+    std::vector<uint8_t> buffer(64, 7);
+    LockedFrame frame = {};
+    frame.image.pData = buffer.data();
+    frame.image.uiDataSizeBytes = (unsigned int)buffer.size();
+    auto a = std::make_shared<FrameHold>(frame, queue);
+    auto b = std::make_shared<FrameHold>(frame, queue);
+
+    // The holds keep reading the buffer itself, which is not given back while either of them is alive
+    int teardowns = 0;
+    EXPECT_EQ(queue->retire([&]() { teardowns++; }), 2u);
+    EXPECT_EQ(teardowns, 0);
+    EXPECT_EQ(a->data(), buffer.data());
+    a.reset();
+    EXPECT_EQ(teardowns, 0);
+    EXPECT_EQ(b->data()[63], 7);
+    b.reset();
+    EXPECT_EQ(teardowns, 1);
+
+    // The teardown gives back every buffer, so nothing is queued for unlocking one by one
+    std::vector<LockedFrame> released;
+    queue->take(released);
+    EXPECT_TRUE(released.empty());
+}
@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cstring>
+
+#include <gtest/gtest.h>
+
+#include "jpeg_decoder.h"
+#include "test_util.h"
+
+namespace
+{
+
+const int COLS = 128;
+const int ROWS = 96;
+
+/**
+ * Six raw planes, and a buffer laid out like the camera's COLOR_SEP_JPEG8 images holding their tiles
+ */
+struct JpegFrame
+{
+    std::vector<cv::Mat> planes;
+    std::vector<uint8_t> tiles[LADYBUG_JPEG_TILES];
+    std::vector<uint8_t> buffer;
+    LadybugImage image;
+
+    explicit JpegFrame(int quality = 90)
+    {
+        tjhandle handle = tjInitCompress();
+        std::vector<uint8_t> scratch;
+        for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+        {
+            planes.push_back(testPlane(COLS, ROWS, CV_8UC1, (unsigned int)i));
+            for (size_t k = 0; k < LADYBUG_JPEG_CHANNELS; k++)
+                encodeBayerTile(handle, planes[i].ptr<uint8_t>(), COLS, ROWS, k, quality, scratch, tiles[i * LADYBUG_JPEG_CHANNELS + k]);
+        }
+        tjDestroy(handle);
+        packJpegImage(tiles, buffer);
+        image = LadybugImage();
+        image.pData = buffer.data();
+        image.uiDataSizeBytes = (unsigned int)buffer.size();
+        image.dataFormat = LADYBUG_DATAFORMAT_COLOR_SEP_JPEG8;
+    }
+};
+
+/**
+ * Decode one tile on its own with libturbojpeg, into a tile sized gray image
+ */
+cv::Mat decodeTile(const std::vector<uint8_t> &jpeg)
+{
+    tjhandle handle = tjInitDecompress();
+    cv::Mat tile(ROWS / 2, COLS / 2, CV_8UC1);
+    EXPECT_EQ(tjDecompress2(handle, jpeg.data(), jpeg.size(), tile.ptr<uint8_t>(), tile.cols, 0, tile.rows, TJPF_GRAY, TJFLAG_FASTDCT), 0);
+    tjDestroy(handle);
+    return tile;
+}
+
+} // namespace
+
+TEST(JpegDecoder, FindsTheTilesOfAnImage)
+{
+    JpegFrame frame;
+    JpegTile tiles[LADYBUG_JPEG_TILES];
+    ASSERT_TRUE(findJpegTiles(frame.image, tiles));
+    for (size_t i = 0; i < LADYBUG_JPEG_TILES; i++)
+    {
+        ASSERT_EQ(tiles[i].size, frame.tiles[i].size());
+        EXPECT_EQ(memcmp(tiles[i].data, frame.tiles[i].data(), tiles[i].size), 0) << "tile " << i;
+    }
+
+    // A table that points past the end of the buffer is rejected
+    frame.image.uiDataSizeBytes -= (unsigned int)frame.tiles[LADYBUG_JPEG_TILES - 1].size() / 2;
+    EXPECT_FALSE(findJpegTiles(frame.image, tiles));
+    frame.image.uiDataSizeBytes = 100;
+    EXPECT_FALSE(findJpegTiles(frame.image, tiles));
+}
+
+TEST(JpegDecoder, MatchesTurboJpegPerTile)
+{
+    JpegFrame frame;
+    WorkerPool pool(3);
+    JpegDecoder decoder;
+    ASSERT_TRUE(decoder.decode(frame.image, pool));
+    ASSERT_EQ(decoder.cols(), COLS);
+    ASSERT_EQ(decoder.rows(), ROWS);
+    for (size_t i = 0; i < LADYBUG_JPEG_TILES; i++)
+    {
+        const size_t head = i / LADYBUG_JPEG_CHANNELS, k = i % LADYBUG_JPEG_CHANNELS;
+        const cv::Mat tile = decodeTile(frame.tiles[i]);
+        const uint8_t *plane = decoder.planes() + head * COLS * ROWS;
+        int mismatches = 0;
+        for (int r = 0; r < tile.rows; r++)
+        {
+            for (int c = 0; c < tile.cols; c++)
+                mismatches += plane[(size_t)(2 * r + k / 2) * COLS + 2 * c + k % 2] != tile.at<uint8_t>(r, c);
+        }
+        EXPECT_EQ(mismatches, 0) << "tile " << i;
+    }
+
+    // And the planes are close to what was encoded, JPEG being lossy
+    for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    {
+        const cv::Mat decoded(ROWS, COLS, CV_8UC1, const_cast<uint8_t *>(decoder.planes()) + i * COLS * ROWS);
+        EXPECT_GT(cv::PSNR(decoded, frame.planes[i]), 30) << "head " << i;
+    }
+}
+
+TEST(JpegDecoder, OnlyDecodesTheRequestedHeads)
+{
+    JpegFrame frame;
+    WorkerPool pool(2);
+    JpegDecoder all, some;
+    ASSERT_TRUE(all.decode(frame.image, pool));
+    ASSERT_TRUE(some.decode(frame.image, pool, (1u << 2) | (1u << 5)));
+    const size_t plane_size = (size_t)COLS * ROWS;
+    for (size_t i = 0; i < LADYBUG_NUM_CAMERAS; i++)
+    {
+        const uint8_t *plane = some.planes() + i * plane_size;
+        if (i == 2 || i == 5)
+            EXPECT_EQ(memcmp(plane, all.planes() + i * plane_size, plane_size), 0) << "head " << i;
+        else
+            EXPECT_EQ(std::count(plane, plane + plane_size, 0), (long)plane_size) << "head " << i;
+    }
+}
+
+TEST(JpegDecoder, RejectsBrokenTiles)
+{
+    JpegFrame frame;
+    WorkerPool pool(2);
+    JpegDecoder decoder;
+
+    // A tile of another size than the rest
+    tjhandle handle = tjInitCompress();
+    std::vector<uint8_t> scratch;
+    const cv::Mat small = testPlane(COLS / 2, ROWS, CV_8UC1, 9);
+    encodeBayerTile(handle, small.ptr<uint8_t>(), small.cols, small.rows, 1, 90, scratch, frame.tiles[7]);
+    tjDestroy(handle);
+    packJpegImage(frame.tiles, frame.buffer);
+    frame.image.pData = frame.buffer.data();
+    frame.image.uiDataSizeBytes = (unsigned int)frame.buffer.size();
+    EXPECT_FALSE(decoder.decode(frame.image, pool));
+
+    // Garbage instead of a tile
+    std::fill(frame.tiles[7].begin(), frame.tiles[7].end(), 0x55);
+    packJpegImage(frame.tiles, frame.buffer);
+    frame.image.pData = frame.buffer.data();
+    EXPECT_FALSE(decoder.decode(frame.image, pool));
+}
+
+TEST(JpegDecoder, PacksTheTilesOfAHead)
+{
+    JpegFrame frame;
+    JpegTile tiles[LADYBUG_JPEG_TILES];
+    ASSERT_TRUE(findJpegTiles(frame.image, tiles));
+    std::vector<uint8_t> data;
+    packJpegTiles(tiles + 4, data);
+    JpegTile unpacked[LADYBUG_JPEG_CHANNELS];
+    ASSERT_TRUE(unpackJpegTiles(data, unpacked));
+    for (size_t k = 0; k < LADYBUG_JPEG_CHANNELS; k++)
+    {
+        ASSERT_EQ(unpacked[k].size, tiles[4 + k].size);
+        EXPECT_EQ(memcmp(unpacked[k].data, tiles[4 + k].data, tiles[4 + k].size), 0);
+    }
+
+    // Sizes that do not add up to the data are rejected
+    data.pop_back();
+    EXPECT_FALSE(unpackJpegTiles(data, unpacked));
+    data.resize(LADYBUG_JPEG_HEADER_SIZE - 1);
+    EXPECT_FALSE(unpackJpegTiles(data, unpacked));
+}
@@ -0,0 +1,111 @@
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "message_pool.h"
+
+namespace
+{
+
+/**
+ * A message with a buffer, that counts how many of it are alive and how often it came back to a pool
+ */
+struct TestMessage
+{
+    TestMessage() : recycled(0) { alive++; }
+    ~TestMessage() { alive--; }
+
+    std::vector<uint8_t> data;
+    int recycled;
+    static int alive;
+};
+
+int TestMessage::alive = 0;
+
+void recycleMessage(TestMessage &msg)
+{
+    msg.recycled++;
+}
+
+} // namespace
+
+TEST(MessagePool, RecyclesOnceEverySubscriberLetsGo)
+{
+    MessagePool<TestMessage> pool;
+    boost::shared_ptr<TestMessage> msg = pool.acquire();
+    TestMessage *const first = msg.get();
+
+    // Subscribers share the message, it only comes back once the last of them drops it
+    boost::shared_ptr<const TestMessage> subscriber = msg;
+    msg.reset();
+    EXPECT_EQ(first->recycled, 0);
+    boost::shared_ptr<TestMessage> other = pool.acquire();
+    EXPECT_NE(other.get(), first);
+    other.reset();
+
+    subscriber.reset();
+    EXPECT_EQ(first->recycled, 1);
+    msg = pool.acquire();
+    EXPECT_EQ(msg.get(), first);
+}
+
+TEST(MessagePool, MessagesOutliveThePool)
+{
+    const int alive = TestMessage::alive;
+    boost::shared_ptr<TestMessage> msg, freed;
+    {
+        MessagePool<TestMessage> pool;
+        msg = pool.acquire();
+        freed = pool.acquire();
+        freed.reset();
+        EXPECT_EQ(TestMessage::alive, alive + 2);
+    }
+
+    // The free list went with the pool, the message that is still out is deleted once it is dropped
+    EXPECT_EQ(TestMessage::alive, alive + 1);
+    msg->data.assign(16, 1);
+    msg.reset();
+    EXPECT_EQ(TestMessage::alive, alive);
+}
+
+TEST(MessagePool, KeepsAtMostMaxFree)
+{
+    const int alive = TestMessage::alive;
+    {
+        MessagePool<TestMessage> pool(2);
+        std::vector<boost::shared_ptr<TestMessage>> msgs;
+        for (int i = 0; i < 5; i++)
+            msgs.push_back(pool.acquire());
+        EXPECT_EQ(TestMessage::alive, alive + 5);
+
+        // Only two of them fit in the free list, the others are deleted as they come back
+        msgs.clear();
+        EXPECT_EQ(TestMessage::alive, alive + 2);
+
+        // Those two are handed out again before any new one is made
+        for (int i = 0; i < 3; i++)
+            msgs.push_back(pool.acquire());
+        EXPECT_EQ(msgs[0]->recycled + msgs[1]->recycled + msgs[2]->recycled, 2);
+        EXPECT_EQ(TestMessage::alive, alive + 3);
+    }
+    EXPECT_EQ(TestMessage::alive, alive);
+}
+
+TEST(MessagePool, ReusesBuffersWithoutZeroFilling)
+{
+    MessagePool<TestMessage> pool(1);
+    boost::shared_ptr<TestMessage> msg = pool.acquire();
+    msg->data.assign(1024, 0xab);
+    const uint8_t *const data = msg->data.data();
+    msg.reset();
+
+    // The recycled message still holds its old contents in the same buffer, resizing it to the same size does not touch them
+    msg = pool.acquire();
+    ASSERT_EQ(msg->data.size(), 1024u);
+    EXPECT_EQ(msg->data.data(), data);
+    msg->data.resize(1024);
+    for (uint8_t v : msg->data)
+        ASSERT_EQ(v, 0xab);
+}
@@ -0,0 +1,367 @@
+#include <cmath>
+
+#include <gtest/gtest.h>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "camera_calibration.h"
+#include "panorama.h"
+#include "watched_outputs.h"
+
+namespace
+{
+
+// Published size of the small test heads, the kernel is only used for its sizes and blocks
+const int HEAD_COLS = 200;
+const int HEAD_ROWS = 160;
+const double RADIUS = 20.0;
+const double FEATHER = 0.1;
+
+/**
+ * A rig like the Ladybug5, five heads around the horizon 72 degrees apart and one looking up
+ * Each head has an upright calibration of its published image, and sits a few centimeters out from the center
+ */
+struct TestRig
+{
+    sensor_msgs::CameraInfo calib[LADYBUG_NUM_CAMERAS];
+    double extrinsics[LADYBUG_NUM_CAMERAS][16];
+
+    TestRig()
+    {
+        const double deg = 3.14159265358979323846 / 180.0;
+        for (size_t h = 0; h < LADYBUG_NUM_CAMERAS; h++)
+        {
+            sensor_msgs::CameraInfo &info = calib[h];
+            info.width = HEAD_COLS;
+            info.height = HEAD_ROWS;
+            const double K[9] = {82.0 + h, 0, 99.5 + 0.3 * h, 0, 82.5, 79.5 - 0.2 * h, 0, 0, 1};
+            for (int i = 0; i < 9; i++)
+            {
+                info.K[i] = K[i];
+                info.R[i] = (i % 4 == 0) ? 1.0 : 0.0;
+                info.P[(i / 3) * 4 + i % 3] = K[i];
+            }
+            info.D = {-0.04, 0.006, 0.0003, -0.0002, 0.0};
+            info.distortion_model = "plumb_bob";
+
+            // Columns of the rotation are the camera's right, down and forward axes in the Ladybug frame
+            double right[3], down[3], forward[3];
+            if (h < 5)
+            {
+                const double yaw = 72.0 * h * deg;
+                const double f[3] = {std::cos(yaw), std::sin(yaw), 0}, r[3] = {std::sin(yaw), -std::cos(yaw), 0}, d[3] = {0, 0, -1};
+                std::copy(f, f + 3, forward);
+                std::copy(r, r + 3, right);
+                std::copy(d, d + 3, down);
+            }
+            else
+            {
+                const double f[3] = {0, 0, 1}, r[3] = {0, -1, 0}, d[3] = {1, 0, 0};
+                std::copy(f, f + 3, forward);
+                std::copy(r, r + 3, right);
+                std::copy(d, d + 3, down);
+            }
+            double *T = extrinsics[h];
+            for (int row = 0; row < 3; row++)
+            {
+                T[row * 4 + 0] = right[row];
+                T[row * 4 + 1] = down[row];
+                T[row * 4 + 2] = forward[row];
+                T[row * 4 + 3] = 0.04 * forward[row];
+            }
+            T[12] = T[13] = T[14] = 0.0;
+            T[15] = 1.0;
+        }
+    }
+
+    /**
+     * Published pixel of a head that sees a point, the same camera model Panorama::fromCalibration() uses
+     */
+    bool project(size_t h, const double point[3], double &u, double &v) const
+    {
+        const double *T = extrinsics[h];
+        const double d[3] = {point[0] - T[3], point[1] - T[7], point[2] - T[11]};
+        const double X = T[0] * d[0] + T[4] * d[1] + T[8] * d[2];
+        const double Y = T[1] * d[0] + T[5] * d[1] + T[9] * d[2];
+        const double Z = T[2] * d[0] + T[6] * d[1] + T[10] * d[2];
+        if (Z <= 0)
+            return false;
+        const boost::array<double, 9> &k = calib[h].K;
+        const double x = X / Z, y = Y / Z;
+        const double u0 = k[0] * x + k[2], v0 = k[4] * y + k[5];
+        if (u0 < -0.25 * HEAD_COLS || u0 > 1.25 * HEAD_COLS || v0 < -0.25 * HEAD_ROWS || v0 > 1.25 * HEAD_ROWS)
+            return false;
+        double xd, yd;
+        distortPoint(calib[h].D, x, y, xd, yd);
+        u = k[0] * xd + k[1] * yd + k[2];
+        v = k[4] * yd + k[5];
+        return true;
+    }
+};
+
+/**
+ * Published images of the six heads stacked on top of each other, with channels that are linear in the pixel
+ * position and a blue that tells the heads apart, so bilinear sampling is exact within a head
+ */
+cv::Mat stackedHeads()
+{
+    cv::Mat heads(LADYBUG_NUM_CAMERAS * HEAD_ROWS, HEAD_COLS, CV_8UC3);
+    for (int r = 0; r < heads.rows; r++)
+    {
+        for (int c = 0; c < HEAD_COLS; c++)
+        {
+            uint8_t *p = heads.ptr<uint8_t>(r) + 3 * c;
+            p[0] = (uint8_t)c;
+            p[1] = (uint8_t)(r % HEAD_ROWS);
+            p[2] = (uint8_t)(40 * (r / HEAD_ROWS));
+        }
+    }
+    return heads;
+}
+
+/**
+ * The same stitch with cv::remap: for each output pixel the two heads that see it furthest from their border,
+ * sampled from the stacked heads with float maps and blended in float with their feather weights
+ */
+cv::Mat opencvStitch(const TestRig &rig, const cv::Mat &heads, int cols, int rows, const Panorama::PixelRay &ray)
+{
+    cv::Mat map_x[2], map_y[2], weight[2];
+    for (int s = 0; s < 2; s++)
+    {
+        map_x[s] = cv::Mat(rows, cols, CV_32FC1);
+        map_y[s] = cv::Mat(rows, cols, CV_32FC1);
+        weight[s] = cv::Mat(rows, cols, CV_64FC1);
+    }
+    const double feather_px = std::max(1.0, FEATHER * std::min(HEAD_COLS, HEAD_ROWS));
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < cols; c++)
+        {
+            double dir[3];
+            ray(c, r, dir);
+            const double norm = RADIUS / std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+            const double point[3] = {norm * dir[0], norm * dir[1], norm * dir[2]};
+            double best_u[2] = {-10, -10}, best_v[2] = {-10, -10}, best_w[2] = {0, 0};
+            for (size_t h = 0; h < LADYBUG_NUM_CAMERAS; h++)
+            {
+                double u, v;
+                if (!rig.project(h, point, u, v) || !(u >= 0 && u <= HEAD_COLS - 1 && v >= 0 && v <= HEAD_ROWS - 1))
+                    continue;
+                const double border = std::min(std::min(u, HEAD_COLS - 1 - u), std::min(v, HEAD_ROWS - 1 - v));
+                const double w = std::min(1.0, (border + 1.0) / feather_px);
+                const int slot = (w > best_w[0]) ? 0 : (w > best_w[1]) ? 1 : -1;
+                if (slot == 0)
+                {
+                    best_u[1] = best_u[0];
+                    best_v[1] = best_v[0];
+                    best_w[1] = best_w[0];
+                }
+                if (slot >= 0)
+                {
+                    best_u[slot] = u;
+                    best_v[slot] = v + (double)h * HEAD_ROWS;
+                    best_w[slot] = w;
+                }
+            }
+            const double total = best_w[0] + best_w[1];
+            for (int s = 0; s < 2; s++)
+            {
+                map_x[s].at<float>(r, c) = (float)best_u[s];
+                map_y[s].at<float>(r, c) = (float)best_v[s];
+                weight[s].at<double>(r, c) = (total > 0) ? best_w[s] / total : 0.0;
+            }
+        }
+    }
+    cv::Mat sampled[2];
+    for (int s = 0; s < 2; s++)
+        cv::remap(heads, sampled[s], map_x[s], map_y[s], cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+    cv::Mat out(rows, cols, CV_8UC3);
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < cols; c++)
+        {
+            for (int ch = 0; ch < 3; ch++)
+            {
+                const double value = weight[0].at<double>(r, c) * sampled[0].ptr<uint8_t>(r)[3 * c + ch] +
+                                     weight[1].at<double>(r, c) * sampled[1].ptr<uint8_t>(r)[3 * c + ch];
+                out.ptr<uint8_t>(r)[3 * c + ch] = (uint8_t)std::lround(value);
+            }
+        }
+    }
+    return out;
+}
+
+/**
+ * Largest difference between two images of the same size
+ */
+int maxDifference(const cv::Mat &a, const cv::Mat &b)
+{
+    int max_diff = 0;
+    for (int r = 0; r < a.rows; r++)
+        for (int c = 0; c < a.cols * a.channels(); c++)
+            max_diff = std::max(max_diff, std::abs((int)a.ptr<uint8_t>(r)[c] - (int)b.ptr<uint8_t>(r)[c]));
+    return max_diff;
+}
+
+/**
+ * Render a stitch of the stacked heads with the table
+ */
+cv::Mat render(const Panorama &panorama, const cv::Mat &heads)
+{
+    const uint8_t *planes[LADYBUG_NUM_CAMERAS];
+    for (size_t h = 0; h < LADYBUG_NUM_CAMERAS; h++)
+        planes[h] = heads.ptr<uint8_t>((int)h * HEAD_ROWS);
+    cv::Mat out(panorama.rows(), panorama.cols(), CV_8UC3);
+    panorama.render(planes, heads.step, out.ptr<uint8_t>(), out.step, 0, panorama.rows());
+    return out;
+}
+
+} // namespace
+
+TEST(Panorama, EquirectangularConvention)
+{
+    // Head 0 in the center, +Y (to the left of it) a quarter of the way in, and straight up on the first row
+    const int cols = 360, rows = 180;
+    const Panorama::PixelRay ray = Panorama::equirectangular(cols, rows);
+    const double tolerance = 3.14159265358979323846 / rows;
+    double dir[3];
+    ray(cols / 2, rows / 2, dir);
+    EXPECT_NEAR(dir[0], 1.0, tolerance);
+    EXPECT_NEAR(dir[1], 0.0, tolerance);
+    EXPECT_NEAR(dir[2], 0.0, tolerance);
+    ray(cols / 4, rows / 2, dir);
+    EXPECT_NEAR(dir[1], 1.0, tolerance);
+    ray(cols / 2, 0, dir);
+    EXPECT_NEAR(dir[2], 1.0, tolerance);
+}
+
+TEST(Panorama, EquirectangularMatchesOpencvRemap)
+{
+    const TestRig rig;
+    const BayerKernel kernel(HEAD_ROWS, HEAD_COLS, 100);
+    ASSERT_EQ(kernel.out_cols(), HEAD_COLS);
+    ASSERT_EQ(kernel.out_rows(), HEAD_ROWS);
+    const int cols = 360, rows = 180;
+    const Panorama::PixelRay ray = Panorama::equirectangular(cols, rows);
+    std::unique_ptr<Panorama> panorama = Panorama::fromCalibration(rig.calib, rig.extrinsics, kernel, cols, rows, ray, RADIUS, FEATHER);
+    ASSERT_TRUE(panorama != nullptr);
+    EXPECT_EQ(panorama->heads(), LADYBUG_ALL_HEADS);
+
+    // Fixed-point fractions and weights of 7 bits against float, on the ramps that stays within two steps
+    const cv::Mat heads = stackedHeads();
+    const cv::Mat out = render(*panorama, heads);
+    const cv::Mat expected = opencvStitch(rig, heads, cols, rows, ray);
+    double total = 0;
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < 3 * cols; c++)
+        {
+            const int diff = std::abs((int)out.ptr<uint8_t>(r)[c] - (int)expected.ptr<uint8_t>(r)[c]);
+            ASSERT_LE(diff, 2) << "pixel " << c / 3 << ", " << r << " channel " << c % 3;
+            total += diff;
+        }
+    }
+    EXPECT_LT(total / (3.0 * cols * rows), 0.25);
+}
+
+TEST(Panorama, RowBlocksRenderTheSameAsOnePass)
+{
+    const TestRig rig;
+    const BayerKernel kernel(HEAD_ROWS, HEAD_COLS, 100);
+    const Panorama panorama(
+        240, 120, Panorama::equirectangular(240, 120), RADIUS, FEATHER, kernel,
+        [&](size_t h, const double point[3], double &u, double &v) { return rig.project(h, point, u, v); });
+    const cv::Mat heads = stackedHeads();
+    const cv::Mat whole = render(panorama, heads);
+    const uint8_t *planes[LADYBUG_NUM_CAMERAS];
+    for (size_t h = 0; h < LADYBUG_NUM_CAMERAS; h++)
+        planes[h] = heads.ptr<uint8_t>((int)h * HEAD_ROWS);
+    cv::Mat blocks(120, 240, CV_8UC3, cv::Scalar(7, 7, 7));
+    for (int r0 = 0; r0 < 120; r0 += 17)
+        panorama.render(planes, heads.step, blocks.ptr<uint8_t>(), blocks.step, r0, std::min(120, r0 + 17));
+    for (int r = 0; r < 120; r++)
+        EXPECT_EQ(memcmp(whole.ptr<uint8_t>(r), blocks.ptr<uint8_t>(r), 3 * 240), 0) << "row " << r;
+}
+
+TEST(Panorama, PinholeRaysMatchTheViewIntrinsics)
+{
+    // The driver publishes a view with focal 0.5 cols / tan(fov / 2) and its principal point in the center
+    const int cols = 160, rows = 120;
+    const double yaw = 36.0, pitch = 10.0, fov = 70.0;
+    const double deg = 3.14159265358979323846 / 180.0;
+    const double focal = 0.5 * cols / std::tan(0.5 * fov * deg);
+    const Panorama::PixelRay ray = Panorama::pinhole(cols, rows, yaw, pitch, fov);
+    const double forward[3] = {std::cos(pitch * deg) * std::cos(yaw * deg), std::cos(pitch * deg) * std::sin(yaw * deg), std::sin(pitch * deg)};
+    const double right[3] = {std::sin(yaw * deg), -std::cos(yaw * deg), 0.0};
+    const double down[3] = {forward[1] * right[2] - forward[2] * right[1], forward[2] * right[0] - forward[0] * right[2],
+                            forward[0] * right[1] - forward[1] * right[0]};
+    for (int r = 0; r < rows; r += 17)
+    {
+        for (int c = 0; c < cols; c += 13)
+        {
+            double dir[3];
+            ray(c, r, dir);
+            const double z = dir[0] * forward[0] + dir[1] * forward[1] + dir[2] * forward[2];
+            const double x = dir[0] * right[0] + dir[1] * right[1] + dir[2] * right[2];
+            const double y = dir[0] * down[0] + dir[1] * down[1] + dir[2] * down[2];
+            EXPECT_NEAR(focal * x / z + 0.5 * cols - 0.5, c, 1e-9);
+            EXPECT_NEAR(focal * y / z + 0.5 * rows - 0.5, r, 1e-9);
+        }
+    }
+}
+
+TEST(Panorama, PinholeViewsMatchOpencvRemap)
+{
+    const TestRig rig;
+    const BayerKernel kernel(HEAD_ROWS, HEAD_COLS, 100);
+    const cv::Mat heads = stackedHeads();
+    const struct
+    {
+        double yaw, pitch, fov;
+        int cols, rows;
+    } views[] = {{0, 0, 90, 64, 64}, {90, 0, 90, 64, 64}, {180, 0, 90, 64, 64}, {-90, 0, 90, 64, 64}, {0, 90, 90, 64, 64},
+                 {0, -90, 90, 64, 64}, {36, 10, 70, 160, 120}};
+    for (const auto &view : views)
+    {
+        const Panorama::PixelRay ray = Panorama::pinhole(view.cols, view.rows, view.yaw, view.pitch, view.fov);
+        std::unique_ptr<Panorama> table = Panorama::fromCalibration(rig.calib, rig.extrinsics, kernel, view.cols, view.rows, ray, RADIUS, FEATHER);
+        ASSERT_TRUE(table != nullptr);
+        EXPECT_LE(maxDifference(render(*table, heads), opencvStitch(rig, heads, view.cols, view.rows, ray)), 2)
+            << "view at yaw " << view.yaw << " pitch " << view.pitch;
+    }
+}
+
+TEST(Panorama, ViewsOnlyReadTheBlocksTheySample)
+{
+    // A narrow view into head 1, which should not need most of it and none of the heads far from it
+    const TestRig rig;
+    const BayerKernel kernel(HEAD_ROWS, HEAD_COLS, 100);
+    const Panorama view(48, 32, Panorama::pinhole(48, 32, 72.0, 5.0, 30.0), RADIUS, FEATHER, kernel,
+                        [&](size_t h, const double point[3], double &u, double &v) { return rig.project(h, point, u, v); });
+    EXPECT_EQ(view.heads(), 1u << 1);
+    size_t sampled = 0;
+    for (uint8_t block : view.blocks(1))
+        sampled += block;
+    EXPECT_GT(sampled, 0u);
+    EXPECT_LT(sampled, view.blocks(1).size() / 2);
+
+    // Whatever is in the other blocks, and in the other heads, the view comes out the same
+    const cv::Mat heads = stackedHeads();
+    const cv::Mat expected = render(view, heads);
+    cv::Mat scrambled = heads.clone();
+    for (size_t h = 0; h < LADYBUG_NUM_CAMERAS; h++)
+    {
+        for (int r = 0; r < HEAD_ROWS; r++)
+        {
+            for (int c = 0; c < HEAD_COLS; c++)
+            {
+                const size_t block = (size_t)(r / BayerKernel::BLOCK_SIZE) * kernel.block_cols() + c / BayerKernel::BLOCK_SIZE;
+                if ((view.heads() & (1u << h)) && view.blocks(h)[block])
+                    continue;
+                uint8_t *p = scrambled.ptr<uint8_t>((int)h * HEAD_ROWS + r) + 3 * c;
+                p[0] = p[1] = p[2] = (uint8_t)(r * 31 + c * 17);
+            }
+        }
+    }
+    EXPECT_EQ(maxDifference(render(view, scrambled), expected), 0);
+}
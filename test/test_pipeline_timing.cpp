@@ -0,0 +1,142 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "pipeline_timing.h"
+
+namespace
+{
+
+/**
+ * What the histogram reports for a single value, the midpoint of the bucket the value lands in
+ */
+double reported(uint64_t us)
+{
+    LatencyHistogram histogram;
+    histogram.record(us);
+    std::vector<uint64_t> counts;
+    histogram.snapshot(counts);
+    return LatencyHistogram::percentile(counts, 0.5);
+}
+
+/**
+ * The value of a diagnostics key, or an empty string if it is not there
+ */
+std::string value(const diagnostic_updater::DiagnosticStatusWrapper &stat, const std::string &key)
+{
+    for (const auto &kv : stat.values)
+    {
+        if (kv.key == key)
+            return kv.value;
+    }
+    return std::string();
+}
+
+} // namespace
+
+TEST(LatencyHistogram, SmallValuesGetABucketEach)
+{
+    // Up to the first power of two that is split, every bucket is one microsecond wide
+    for (uint64_t us = 0; us < 2 * LatencyHistogram::SUB_BUCKETS; us++)
+        EXPECT_EQ(reported(us), (double)us) << us << " us";
+}
+
+TEST(LatencyHistogram, SplitsEveryPowerOfTwo)
+{
+    for (int exponent = LatencyHistogram::SUB_BUCKET_BITS + 1; exponent <= LatencyHistogram::MAX_EXPONENT; exponent++)
+    {
+        const uint64_t width = 1ull << (exponent - LatencyHistogram::SUB_BUCKET_BITS);
+        for (int sub = 0; sub < LatencyHistogram::SUB_BUCKETS; sub++)
+        {
+            // Both ends of the bucket report its midpoint, and the values just outside it do not
+            const uint64_t first = (1ull << exponent) + sub * width, last = first + width - 1;
+            const double midpoint = first + 0.5 * (width - 1);
+            EXPECT_EQ(reported(first), midpoint) << first << " us";
+            EXPECT_EQ(reported(last), midpoint) << last << " us";
+            EXPECT_LT(reported(first - 1), midpoint) << first - 1 << " us";
+            if (exponent < LatencyHistogram::MAX_EXPONENT || sub + 1 < LatencyHistogram::SUB_BUCKETS)
+                EXPECT_GT(reported(last + 1), midpoint) << last + 1 << " us";
+
+            // Which is within 1/SUB_BUCKETS of every value in it
+            EXPECT_LE(midpoint - first, (double)first / LatencyHistogram::SUB_BUCKETS);
+            EXPECT_LE(last - midpoint, (double)last / LatencyHistogram::SUB_BUCKETS);
+        }
+    }
+}
+
+TEST(LatencyHistogram, ClampsLargeValuesIntoTheLastBucket)
+{
+    const uint64_t top = 1ull << (LatencyHistogram::MAX_EXPONENT + 1);
+    EXPECT_EQ(reported(top), reported(top - 1));
+    EXPECT_EQ(reported(1ull << 40), reported(top - 1));
+    EXPECT_EQ(reported(UINT64_MAX), reported(top - 1));
+}
+
+TEST(LatencyHistogram, Percentiles)
+{
+    LatencyHistogram histogram;
+    std::vector<uint64_t> empty, counts, later;
+    histogram.snapshot(empty);
+    EXPECT_EQ(LatencyHistogram::percentile(empty, 0.5), 0.0);
+    EXPECT_EQ(LatencyHistogram::max(empty), 0.0);
+
+    // 1 to 10 us, the percentile is the smallest value with at least that share of the counts at or below it
+    for (uint64_t us = 1; us <= 10; us++)
+        histogram.record(us);
+    histogram.snapshot(counts);
+    EXPECT_EQ(LatencyHistogram::percentile(counts, 0.0), 1.0);
+    EXPECT_EQ(LatencyHistogram::percentile(counts, 0.1), 1.0);
+    EXPECT_EQ(LatencyHistogram::percentile(counts, 0.11), 2.0);
+    EXPECT_EQ(LatencyHistogram::percentile(counts, 0.5), 5.0);
+    EXPECT_EQ(LatencyHistogram::percentile(counts, 0.9), 9.0);
+    EXPECT_EQ(LatencyHistogram::percentile(counts, 0.99), 10.0);
+    EXPECT_EQ(LatencyHistogram::percentile(counts, 1.0), 10.0);
+    EXPECT_EQ(LatencyHistogram::max(counts), 10.0);
+
+    // The difference of two snapshots is what was recorded in between
+    for (int i = 0; i < 10; i++)
+        histogram.record(20);
+    histogram.snapshot(later);
+    for (size_t b = 0; b < later.size(); b++)
+        later[b] -= counts[b];
+    EXPECT_EQ(LatencyHistogram::percentile(later, 0.0), 20.0);
+    EXPECT_EQ(LatencyHistogram::max(later), 20.0);
+}
+
+TEST(PipelineTiming, ReportsWhatWasRecordedSinceTheLastReport)
+{
+    PipelineTiming timing;
+    EXPECT_FALSE(timing.enabled());
+    diagnostic_updater::DiagnosticStatusWrapper off;
+    timing.diagnose(off);
+    EXPECT_EQ(off.message, "Timing is off");
+    EXPECT_EQ(value(off, "Process"), "");
+
+    timing.setEnabled(true);
+    EXPECT_TRUE(timing.enabled());
+    for (int i = 0; i < 3; i++)
+        timing.recordUs(STAGE_PROCESS, 5000);
+    timing.recordUs(STAGE_DEMOSAIC, 1000, 2);
+    diagnostic_updater::DiagnosticStatusWrapper on;
+    timing.diagnose(on);
+    EXPECT_EQ(on.message, "Latency since the last report");
+    EXPECT_NE(value(on, "Process").find("(3)"), std::string::npos) << value(on, "Process");
+    EXPECT_NE(value(on, "Demosaic").find("(1)"), std::string::npos) << value(on, "Demosaic");
+    EXPECT_NE(value(on, "Demosaic head 2").find("(1)"), std::string::npos) << value(on, "Demosaic head 2");
+    EXPECT_EQ(value(on, "Demosaic head 1"), "");
+
+    // Nothing new since then, so no stage is listed
+    diagnostic_updater::DiagnosticStatusWrapper again;
+    timing.diagnose(again);
+    EXPECT_EQ(value(again, "Process"), "");
+    EXPECT_EQ(value(again, "Demosaic"), "");
+
+    // Switching it off again is reported as such
+    timing.setEnabled(false);
+    EXPECT_FALSE(timing.enabled());
+    diagnostic_updater::DiagnosticStatusWrapper off_again;
+    timing.diagnose(off_again);
+    EXPECT_EQ(off_again.message, "Timing is off");
+}
@@ -0,0 +1,169 @@
+#include <chrono>
+
+#include <gtest/gtest.h>
+
+#include "rate_controller.h"
+
+namespace
+{
+
+/**
+ * Scales 100 to 50 in steps of at most 0.8, which are 100, 84.1, 70.7, 59.5 and 50, then frame rates 30 to 15
+ */
+RateControlConfig testConfig()
+{
+    RateControlConfig config;
+    config.min_frame_rate = 15.0;
+    config.max_frame_rate = 30.0;
+    config.min_scale = 50.0;
+    config.max_scale = 100.0;
+    config.adapt_frame_rate = true;
+    config.high_load = 0.8;
+    config.low_load = 0.6;
+    config.window = 1.0;
+    config.recover_windows = 3;
+    config.step = 0.8;
+    return config;
+}
+
+/**
+ * Feeds the controller whole windows of frames at a given load, on a clock of its own
+ */
+class Simulation
+{
+  public:
+    explicit Simulation(RateController &controller) : m_controller(controller), m_now(), m_dropped(0)
+    {
+        m_controller.update(m_now, m_dropped);
+    }
+
+    /**
+     * One window of ten frames that keep processing busy for load of it, returns true if the controller changed step
+     */
+    bool window(double load, uint64_t drops = 0)
+    {
+        for (int i = 0; i < 10; i++)
+            m_controller.recordFrame(0.1 * load, 0, 4);
+        m_now += std::chrono::seconds(1);
+        m_dropped += drops;
+        return m_controller.update(m_now, m_dropped);
+    }
+
+    /**
+     * Windows at a load until the controller changes step, returns how many it took or 0 if it did not within max
+     */
+    int windowsUntilChange(double load, int max)
+    {
+        for (int i = 1; i <= max; i++)
+            if (window(load))
+                return i;
+        return 0;
+    }
+
+    void hold()
+    {
+        m_controller.hold(m_now, m_dropped);
+    }
+
+  private:
+    RateController &m_controller;
+    std::chrono::steady_clock::time_point m_now;
+    uint64_t m_dropped;
+};
+
+} // namespace
+
+TEST(RateController, LowersTheScaleAndThenTheFrameRate)
+{
+    RateController controller(testConfig());
+    Simulation sim(controller);
+    EXPECT_EQ(controller.frameRate(), 30.0);
+    EXPECT_EQ(controller.scale(), 100.0);
+    const double scales[] = {84.09, 70.71, 59.46, 50.0, 50.0, 50.0, 50.0};
+    const double rates[] = {30.0, 30.0, 30.0, 30.0, 25.23, 21.21, 17.84};
+    for (int step = 0; step < 7; step++)
+    {
+        // Every change is followed by a window that is not judged
+        ASSERT_TRUE(sim.window(0.95)) << "step " << step;
+        EXPECT_NEAR(controller.scale(), scales[step], 0.01) << "step " << step;
+        EXPECT_NEAR(controller.frameRate(), rates[step], 0.01) << "step " << step;
+        EXPECT_FALSE(sim.window(0.95)) << "step " << step;
+    }
+    ASSERT_TRUE(sim.window(0.95));
+    EXPECT_NEAR(controller.frameRate(), 15.0, 1e-9);
+
+    // The bottom of the ladder is as far as it goes
+    for (int i = 0; i < 5; i++)
+        EXPECT_FALSE(sim.window(0.95));
+}
+
+TEST(RateController, DropsDegradeEvenAtLowLoad)
+{
+    RateController controller(testConfig());
+    Simulation sim(controller);
+    EXPECT_FALSE(sim.window(0.3));
+    EXPECT_TRUE(sim.window(0.3, 2));
+    EXPECT_LT(controller.scale(), 100.0);
+}
+
+TEST(RateController, PredictsTheLoadWithTheSquareOfTheScale)
+{
+    // At 84.1% the step above has 1.41 times the pixels, so a load of 0.58 would be 0.82 there, above high_load
+    // If the load only grew with the scale it would be 0.69 and the controller would flap between the two steps
+    RateController controller(testConfig());
+    Simulation sim(controller);
+    ASSERT_TRUE(sim.window(0.95));
+    sim.window(0.58);
+    EXPECT_EQ(sim.windowsUntilChange(0.58, 20), 0);
+    EXPECT_NEAR(controller.scale(), 84.09, 0.01);
+
+    // A load of 0.55 is predicted to be 0.78, which fits, after calm windows in a row
+    EXPECT_FALSE(sim.window(0.7));
+    EXPECT_EQ(sim.windowsUntilChange(0.55, 20), 3);
+    EXPECT_EQ(controller.scale(), 100.0);
+}
+
+TEST(RateController, FailedRecoveriesBackOff)
+{
+    RateController controller(testConfig());
+    Simulation sim(controller);
+    ASSERT_TRUE(sim.window(0.95));
+    sim.window(0.3);
+
+    // Each recovery that has to be undone right away doubles the calm windows the next one takes, up to 8 times
+    for (int expected : {3, 6, 12, 24, 24})
+    {
+        ASSERT_EQ(sim.windowsUntilChange(0.3, 50), expected);
+        EXPECT_EQ(controller.scale(), 100.0);
+        sim.window(0.3);
+        ASSERT_TRUE(sim.window(0.95));
+        sim.window(0.3);
+    }
+
+    // A recovery that holds for recover_windows resets it
+    ASSERT_EQ(sim.windowsUntilChange(0.3, 50), 24);
+    sim.window(0.3);
+    for (int i = 0; i < 3; i++)
+        EXPECT_FALSE(sim.window(0.3));
+    ASSERT_TRUE(sim.window(0.95));
+    sim.window(0.3);
+    EXPECT_EQ(sim.windowsUntilChange(0.3, 50), 3);
+}
+
+TEST(RateController, HoldDefersJudgement)
+{
+    // While the tables of the new step are built, the windows say nothing about it
+    RateController controller(testConfig());
+    Simulation sim(controller);
+    ASSERT_TRUE(sim.window(0.95));
+    for (int i = 0; i < 5; i++)
+    {
+        sim.window(0.95);
+        sim.hold();
+    }
+    EXPECT_NEAR(controller.scale(), 84.09, 0.01);
+
+    // Nor is the window after it is in effect
+    EXPECT_FALSE(sim.window(0.95));
+    EXPECT_TRUE(sim.window(0.95));
+}
@@ -0,0 +1,71 @@
+#include <iostream>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "raw_unpack.h"
+
+namespace
+{
+
+/**
+ * Random packed bytes for num_pixels pixels, every bit pattern of the shared nibble byte shows up
+ */
+std::vector<uint8_t> randomPacked(size_t num_pixels, unsigned int seed)
+{
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> packed(num_pixels * 3 / 2);
+    for (uint8_t &byte : packed)
+        byte = (uint8_t)rng();
+    return packed;
+}
+
+} // namespace
+
+TEST(RawUnpack, MatchesTheScalarLoopAtEveryLengthAndOffset)
+{
+    // Lengths around the 8 pixels of a shuffle and the 16 bytes of a load, and from every byte offset of a pair
+    // NOTE: the vectorized version leaves the last pairs to the scalar loop, so the lengths cover where it hands over
+    if (!unpackRaw12IsVectorized())
+        std::cout << "SSSE3 is not available, unpackRaw12 is the scalar loop" << std::endl;
+    const std::vector<uint8_t> packed = randomPacked(1024 + 16, 1);
+    for (size_t offset = 0; offset < 12; offset += 3)
+    {
+        for (size_t num_pixels = 0; num_pixels <= 1024; num_pixels += (num_pixels < 64) ? 2 : 62)
+        {
+            std::vector<uint16_t> expected(num_pixels + 8, 0xdead), samples(num_pixels + 8, 0xdead);
+            unpackRaw12Scalar(packed.data() + offset, expected.data(), num_pixels);
+            unpackRaw12(packed.data() + offset, samples.data(), num_pixels);
+            ASSERT_EQ(samples, expected) << num_pixels << " pixels from byte " << offset;
+        }
+    }
+}
+
+TEST(RawUnpack, UnpacksTheDocumentedLayout)
+{
+    // 0xabc and 0x123, then the same the other way round, as the camera packs them
+    const uint8_t packed[6] = {0xab, 0x12, 0xc3, 0x12, 0xab, 0x3c};
+    uint16_t scalar[4], samples[4];
+    unpackRaw12Scalar(packed, scalar, 4);
+    unpackRaw12(packed, samples, 4);
+    const uint16_t expected[4] = {0xabc0, 0x1230, 0x1230, 0xabc0};
+    for (int i = 0; i < 4; i++)
+    {
+        EXPECT_EQ(scalar[i], expected[i]) << "pixel " << i;
+        EXPECT_EQ(samples[i], expected[i]) << "pixel " << i;
+    }
+}
+
+TEST(RawUnpack, PackIsTheInverse)
+{
+    // A whole head, so the vectorized loop does most of it
+    const size_t num_pixels = 2048 * 2448;
+    const std::vector<uint8_t> packed = randomPacked(num_pixels, 2);
+    std::vector<uint16_t> samples(num_pixels);
+    unpackRaw12(packed.data(), samples.data(), num_pixels);
+    for (size_t i = 0; i < num_pixels; i++)
+        ASSERT_EQ(samples[i] & 0xf, 0) << "pixel " << i;
+    std::vector<uint8_t> repacked(packed.size());
+    packRaw12(samples.data(), repacked.data(), num_pixels);
+    EXPECT_TRUE(repacked == packed);
+}
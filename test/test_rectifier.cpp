@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "camera_calibration.h"
+#include "rectifier.h"
+
+namespace
+{
+
+const int COLS = 240;
+const int ROWS = 180;
+
+/**
+ * Calibration of a COLS x ROWS image, the rectified camera has a shorter focal length so part of it maps outside of the image
+ */
+sensor_msgs::CameraInfo testCalibration(const std::vector<double> &D)
+{
+    sensor_msgs::CameraInfo info;
+    info.width = COLS;
+    info.height = ROWS;
+    const double K[9] = {150, 0, 122.5, 0, 152, 88.25, 0, 0, 1};
+    const double R[9] = {0.9998, -0.0175, 0.0087, 0.0174, 0.9998, 0.0052, -0.0088, -0.0050, 0.9999};
+    for (int row = 0; row < 3; row++)
+    {
+        for (int col = 0; col < 3; col++)
+        {
+            info.K[row * 3 + col] = K[row * 3 + col];
+            info.R[row * 3 + col] = R[row * 3 + col];
+            info.P[row * 4 + col] = (row < 2 ? 0.8 : 1.0) * K[row * 3 + col];
+        }
+    }
+    info.P[2] = 120.0;
+    info.P[6] = 90.0;
+    info.D = D;
+    info.distortion_model = (D.size() > 5) ? "rational_polynomial" : "plumb_bob";
+    return info;
+}
+
+/**
+ * An RGB image whose channels are linear in the pixel position, so bilinear sampling is exact and every
+ * output pixel tells where it was sampled from
+ */
+cv::Mat rampImage()
+{
+    cv::Mat image(ROWS, COLS, CV_8UC3);
+    for (int r = 0; r < ROWS; r++)
+    {
+        for (int c = 0; c < COLS; c++)
+        {
+            uint8_t *p = image.ptr<uint8_t>(r) + 3 * c;
+            p[0] = (uint8_t)c;
+            p[1] = (uint8_t)r;
+            p[2] = (uint8_t)((c + 2 * r) / 3);
+        }
+    }
+    return image;
+}
+
+/**
+ * Rectify with the table and with cv::initUndistortRectifyMap and cv::remap, and compare them wherever OpenCV samples
+ * inside of the image; pixels that map outside of it must be black
+ */
+void checkAgainstOpencv(const sensor_msgs::CameraInfo &info)
+{
+    std::unique_ptr<Rectifier> rectifier = Rectifier::fromCalibration(info);
+    ASSERT_TRUE(rectifier != nullptr);
+    ASSERT_EQ(rectifier->cols(), COLS);
+    ASSERT_EQ(rectifier->rows(), ROWS);
+    const cv::Mat src = rampImage();
+    cv::Mat out(ROWS, COLS, CV_8UC3);
+    rectifier->remap(src.ptr<uint8_t>(), src.step, out.ptr<uint8_t>(), out.step);
+
+    cv::Mat K(3, 3, CV_64F), R(3, 3, CV_64F), P(3, 3, CV_64F), D(1, (int)info.D.size(), CV_64F);
+    for (int row = 0; row < 3; row++)
+    {
+        for (int col = 0; col < 3; col++)
+        {
+            K.at<double>(row, col) = info.K[row * 3 + col];
+            R.at<double>(row, col) = info.R[row * 3 + col];
+            P.at<double>(row, col) = info.P[row * 4 + col];
+        }
+    }
+    for (size_t i = 0; i < info.D.size(); i++)
+        D.at<double>(0, (int)i) = info.D[i];
+    cv::Mat map_x, map_y, expected;
+    cv::initUndistortRectifyMap(K, D, R, P, cv::Size(COLS, ROWS), CV_32FC1, map_x, map_y);
+    cv::remap(src, expected, map_x, map_y, cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+
+    // OpenCV has 5-bit bilinear fractions and the table 7-bit ones, on the ramps that is at most one step apart
+    // OpenCV maps in float, so pixels right on the border of the image are left out
+    int inside = 0, outside = 0;
+    for (int r = 0; r < ROWS; r++)
+    {
+        for (int c = 0; c < COLS; c++)
+        {
+            const float u = map_x.at<float>(r, c), v = map_y.at<float>(r, c);
+            const uint8_t *a = out.ptr<uint8_t>(r) + 3 * c;
+            const uint8_t *b = expected.ptr<uint8_t>(r) + 3 * c;
+            if (u >= 0 && u <= COLS - 1 && v >= 0 && v <= ROWS - 1)
+            {
+                inside++;
+                for (int ch = 0; ch < 3; ch++)
+                    ASSERT_LE(std::abs((int)a[ch] - (int)b[ch]), 1) << "pixel " << c << ", " << r << " channel " << ch;
+            }
+            else if (u < -0.51 || u > COLS - 0.49 || v < -0.51 || v > ROWS - 0.49)
+            {
+                outside++;
+                ASSERT_EQ(a[0] | a[1] | a[2], 0) << "pixel " << c << ", " << r;
+            }
+        }
+    }
+
+    // The test calibration has both
+    EXPECT_GT(inside, COLS * ROWS / 2);
+    EXPECT_GT(outside, 0);
+}
+
+} // namespace
+
+TEST(Rectifier, PlumbBobMatchesOpencv)
+{
+    checkAgainstOpencv(testCalibration({-0.28, 0.09, 0.0011, -0.0006, -0.012}));
+}
+
+TEST(Rectifier, RationalPolynomialMatchesOpencv)
+{
+    checkAgainstOpencv(testCalibration({-0.28, 0.09, 0.0011, -0.0006, -0.012, 0.02, -0.01, 0.004}));
+}
+
+TEST(Rectifier, IdentityMapCopiesTheImage)
+{
+    const Rectifier rectifier(COLS, ROWS, COLS, ROWS, [](double col, double row, double &u, double &v) {
+        u = col;
+        v = row;
+        return true;
+    });
+    const cv::Mat src = rampImage();
+    cv::Mat out(ROWS, COLS, CV_8UC3);
+    rectifier.remap(src.ptr<uint8_t>(), src.step, out.ptr<uint8_t>(), out.step);
+    for (int r = 0; r < ROWS; r++)
+        EXPECT_EQ(memcmp(out.ptr<uint8_t>(r), src.ptr<uint8_t>(r), 3 * COLS), 0) << "row " << r;
+}
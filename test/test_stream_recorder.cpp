@@ -0,0 +1,210 @@
+#include <unistd.h>
+
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+
+#include <gtest/gtest.h>
+
+#include "stream_recorder.h"
+
+namespace
+{
+
+const int COLS = 64;
+const int ROWS = 48;
+
+/**
+ * Locked RAW8 frames of six small heads, each filled with its own bytes
+ */
+struct Frames
+{
+    std::vector<std::vector<uint8_t>> buffers;
+    std::vector<LockedFrame> frames;
+
+    explicit Frames(size_t count) : buffers(count), frames(count)
+    {
+        for (size_t n = 0; n < count; n++)
+        {
+            buffers[n].resize((size_t)LADYBUG_NUM_CAMERAS * COLS * ROWS);
+            for (size_t k = 0; k < buffers[n].size(); k++)
+                buffers[n][k] = (uint8_t)(k * 7 + n * 31);
+            LadybugImage &image = frames[n].image;
+            image = LadybugImage();
+            image.uiFullCols = COLS;
+            image.uiFullRows = ROWS;
+            image.uiCols = COLS;
+            image.uiRows = ROWS;
+            image.dataFormat = LADYBUG_DATAFORMAT_RAW8;
+            image.uiBufferIndex = (unsigned int)n;
+            image.uiDataSizeBytes = (unsigned int)buffers[n].size();
+            image.pData = buffers[n].data();
+            frames[n].stamp = ros::Time(1500000000.0 + 0.1 * n);
+            frames[n].camera_stamp = false;
+        }
+    }
+};
+
+/**
+ * Keeps what is written in memory, and can hold the writer in write() until it is let go
+ */
+class MemorySink : public RecordSink
+{
+  public:
+    MemorySink() : m_blocked(false) {}
+
+    bool open(const std::string &base_name, std::string &file_name) override
+    {
+        file_name = base_name + ".mem";
+        return true;
+    }
+    bool write(const LadybugImage &image, const ros::Time &stamp) override
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this] { return !m_blocked; });
+        images.push_back(std::vector<uint8_t>(image.pData, image.pData + image.uiDataSizeBytes));
+        stamps.push_back(stamp);
+        return true;
+    }
+    void close() override {}
+
+    void block(bool blocked)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_blocked = blocked;
+        m_cv.notify_all();
+    }
+
+    std::vector<std::vector<uint8_t>> images;
+    std::vector<ros::Time> stamps;
+
+  private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_blocked;
+};
+
+} // namespace
+
+TEST(StreamRecorder, PinsUpToTheLimitAndCopiesTheRest)
+{
+    Frames frames(6);
+    MemorySink *sink = new MemorySink();
+    sink->block(true);
+    auto queue = std::make_shared<FrameReleaseQueue>();
+    StreamRecorder recorder((std::unique_ptr<RecordSink>(sink)), "/tmp/ladybug_test", 8, 2, 0, 0);
+    ASSERT_TRUE(recorder.start());
+
+    // The writer is stuck on the disk, so at most two buffers stay held however many frames come in
+    for (const LockedFrame &frame : frames.frames)
+    {
+        ASSERT_TRUE(recorder.push(std::make_shared<FrameHold>(frame, queue), frame.stamp));
+        EXPECT_LE(queue->held(), 2u);
+    }
+
+    // Once it is let go, everything is written as it was and every buffer can be unlocked
+    sink->block(false);
+    recorder.stop();
+    ASSERT_EQ(sink->images.size(), frames.frames.size());
+    for (size_t n = 0; n < frames.frames.size(); n++)
+    {
+        EXPECT_EQ(sink->images[n], frames.buffers[n]) << "frame " << n;
+        EXPECT_EQ(sink->stamps[n], frames.frames[n].stamp) << "frame " << n;
+    }
+    EXPECT_EQ(queue->held(), 0u);
+    std::vector<LockedFrame> released;
+    queue->take(released);
+    EXPECT_EQ(released.size(), frames.frames.size());
+}
+
+TEST(StreamRecorder, CopiesEverythingWithoutPinnedFrames)
+{
+    Frames frames(3);
+    MemorySink *sink = new MemorySink();
+    auto queue = std::make_shared<FrameReleaseQueue>();
+    StreamRecorder recorder((std::unique_ptr<RecordSink>(sink)), "/tmp/ladybug_test", 4, 0, 0, 0);
+    ASSERT_TRUE(recorder.start());
+    EXPECT_FALSE(recorder.canPin());
+    for (const LockedFrame &frame : frames.frames)
+    {
+        std::shared_ptr<FrameHold> hold = std::make_shared<FrameHold>(frame, queue);
+        ASSERT_TRUE(recorder.push(hold, frame.stamp));
+        EXPECT_EQ(hold.use_count(), 1);
+    }
+
+    // The copies are taken when they are queued, so changing the buffers afterwards does not matter
+    for (auto &buffer : frames.buffers)
+        std::fill(buffer.begin(), buffer.end(), 0);
+    recorder.stop();
+    ASSERT_EQ(sink->images.size(), 3u);
+    for (size_t n = 0; n < 3; n++)
+        EXPECT_EQ(sink->images[n], Frames(3).buffers[n]) << "frame " << n;
+}
+
+TEST(StreamRecorder, DropsWhenTheQueueIsFull)
+{
+    Frames frames(4);
+    MemorySink *sink = new MemorySink();
+    sink->block(true);
+    StreamRecorder recorder((std::unique_ptr<RecordSink>(sink)), "/tmp/ladybug_test", 2, 2, 0, 0);
+    ASSERT_TRUE(recorder.start());
+
+    // Whether or not the writer took the first one yet, only two fit
+    size_t queued = 0;
+    for (const LockedFrame &frame : frames.frames)
+        queued += recorder.push(frame.image, frame.stamp);
+    EXPECT_EQ(queued, 2u);
+    sink->block(false);
+    recorder.stop();
+    EXPECT_EQ(sink->images.size(), 2u);
+    EXPECT_FALSE(recorder.push(frames.frames[0].image, frames.frames[0].stamp));
+}
+
+TEST(StreamRecorder, RoundTripsThroughTheSdkStream)
+{
+    LadybugContext camera = nullptr;
+    ASSERT_EQ(ladybugCreateContext(&camera), LADYBUG_OK);
+    Frames frames(5);
+    auto queue = std::make_shared<FrameReleaseQueue>();
+    const std::string base = "/tmp/ladybug_test_" + std::to_string(getpid());
+    {
+        StreamRecorder recorder(std::unique_ptr<RecordSink>(new PgrStreamSink(camera)), base, 4, 2, 0, 0);
+        if (!recorder.start())
+        {
+            // The SDK takes the stream header from the camera, without one there is nothing to check
+            std::cout << "The SDK can not open a stream without a camera, skipping" << std::endl;
+            ladybugDestroyContext(&camera);
+            return;
+        }
+        for (const LockedFrame &frame : frames.frames)
+        {
+            if (recorder.canPin())
+                ASSERT_TRUE(recorder.push(std::make_shared<FrameHold>(frame, queue), frame.stamp));
+            else
+                ASSERT_TRUE(recorder.push(frame.image, frame.stamp));
+            usleep(20000);
+        }
+        recorder.stop();
+
+        // Read it back the way any other stream is read
+        LadybugStreamContext stream = nullptr;
+        ASSERT_EQ(ladybugCreateStreamContext(&stream), LADYBUG_OK);
+        ASSERT_EQ(ladybugInitializeStreamForReading(stream, recorder.fileName().c_str()), LADYBUG_OK);
+        unsigned int num_images = 0;
+        ASSERT_EQ(ladybugGetStreamNumOfImages(stream, &num_images), LADYBUG_OK);
+        ASSERT_EQ(num_images, frames.frames.size());
+        for (unsigned int n = 0; n < num_images; n++)
+        {
+            LadybugImage image;
+            ASSERT_EQ(ladybugGoToImage(stream, n), LADYBUG_OK);
+            ASSERT_EQ(ladybugReadImageFromStream(stream, &image), LADYBUG_OK);
+            ASSERT_EQ(image.uiDataSizeBytes, frames.buffers[n].size()) << "image " << n;
+            EXPECT_EQ(memcmp(image.pData, frames.buffers[n].data(), image.uiDataSizeBytes), 0) << "image " << n;
+        }
+        ladybugStopStream(stream);
+        ladybugDestroyStreamContext(&stream);
+        unlink(recorder.fileName().c_str());
+    }
+    EXPECT_EQ(queue->held(), 0u);
+    ladybugDestroyContext(&camera);
+}
@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include <gtest/gtest.h>
+
+#include "data_format.h"
+#include "jpeg_decoder.h"
+#include "raw_unpack.h"
+#include "synthetic_backend.h"
+
+namespace
+{
+
+const int COLS = 128;
+const int ROWS = 96;
+
+SyntheticConfig testConfig()
+{
+    SyntheticConfig config;
+    config.cols = COLS;
+    config.rows = ROWS;
+    config.num_buffers = 2;
+    config.jitter = 0.0;
+    config.error_rate = 0.0;
+    config.seed = 1;
+    config.stippled_format = LADYBUG_RGGB;
+    return config;
+}
+
+CameraSettings testSettings(LadybugDataFormat format, float frame_rate = 500.0f)
+{
+    CameraSettings settings = CameraSettings();
+    settings.data_format = format;
+    settings.frame_rate = frame_rate;
+    settings.jpeg_quality = 95;
+    return settings;
+}
+
+/**
+ * The 8-bit Bayer planes of all heads of a frame, the high byte of deeper samples and the decoded planes of JPEG frames
+ */
+std::vector<uint8_t> planes(const LadybugImage &image)
+{
+    int sensor_rows, plane_rows;
+    rawPlaneRows(image, sensor_rows, plane_rows);
+    const size_t plane_size = (size_t)image.uiCols * plane_rows;
+    std::vector<uint8_t> result(LADYBUG_NUM_CAMERAS * plane_size);
+    if (isJpegFormat(image.dataFormat))
+    {
+        WorkerPool pool(1);
+        JpegDecoder decoder;
+        EXPECT_TRUE(decoder.decode(image, pool));
+        memcpy(result.data(), decoder.planes(), result.size());
+        return result;
+    }
+    const int bits = rawSampleBits(image.dataFormat);
+    EXPECT_EQ(image.uiDataSizeBytes, result.size() * bits / 8);
+    if (bits == 8)
+    {
+        memcpy(result.data(), image.pData, result.size());
+        return result;
+    }
+    std::vector<uint16_t> samples(result.size());
+    if (bits == 12)
+        unpackRaw12(image.pData, samples.data(), samples.size());
+    else
+        memcpy(samples.data(), image.pData, samples.size() * 2);
+    for (size_t p = 0; p < samples.size(); p++)
+        result[p] = (uint8_t)(samples[p] >> 8);
+    return result;
+}
+
+/**
+ * Cycle timer of a frame in seconds
+ */
+double cycleSeconds(const LadybugImage &image)
+{
+    return image.timeStamp.ulCycleSeconds + image.timeStamp.ulCycleCount / 8000.0 + image.timeStamp.ulCycleOffset / (8000.0 * 3072.0);
+}
+
+} // namespace
+
+TEST(SyntheticBackend, RejectsWhatItCannotGenerate)
+{
+    LadybugCameraInfo info;
+    SyntheticConfig config = testConfig();
+    config.cols = COLS + 1;
+    EXPECT_EQ(SyntheticBackend(config).connect(info), LADYBUG_INVALID_ARGUMENT);
+
+    SyntheticBackend backend(testConfig());
+    ASSERT_EQ(backend.connect(info), LADYBUG_OK);
+    EXPECT_TRUE(info.bIsColourCamera);
+    EXPECT_EQ(backend.start(testSettings(LADYBUG_DATAFORMAT_COLOR_SEP_JPEG12)), LADYBUG_NOT_SUPPORTED);
+    EXPECT_EQ(backend.start(testSettings(LADYBUG_DATAFORMAT_RAW8, 0.0f)), LADYBUG_INVALID_ARGUMENT);
+    LadybugImage image;
+    EXPECT_EQ(backend.lockNext(image), LADYBUG_NOT_STARTED);
+}
+
+TEST(SyntheticBackend, EveryFormatCarriesTheSamePattern)
+{
+    for (bool half_height : {false, true})
+    {
+        const LadybugDataFormat raw8 = half_height ? LADYBUG_DATAFORMAT_HALF_HEIGHT_RAW8 : LADYBUG_DATAFORMAT_RAW8;
+        SyntheticBackend reference_backend(testConfig());
+        ASSERT_EQ(reference_backend.start(testSettings(raw8)), LADYBUG_OK);
+        LadybugImage image;
+        ASSERT_EQ(reference_backend.lockNext(image), LADYBUG_OK);
+        const std::vector<uint8_t> reference = planes(image);
+        EXPECT_EQ(reference.size(), (size_t)LADYBUG_NUM_CAMERAS * COLS * (half_height ? ROWS / 2 : ROWS));
+
+        const std::vector<LadybugDataFormat> formats =
+            half_height ? std::vector<LadybugDataFormat>{LADYBUG_DATAFORMAT_HALF_HEIGHT_RAW12, LADYBUG_DATAFORMAT_HALF_HEIGHT_RAW16,
+                                                         LADYBUG_DATAFORMAT_COLOR_SEP_HALF_HEIGHT_JPEG8}
+                        : std::vector<LadybugDataFormat>{LADYBUG_DATAFORMAT_RAW12, LADYBUG_DATAFORMAT_RAW16, LADYBUG_DATAFORMAT_COLOR_SEP_JPEG8};
+        for (LadybugDataFormat format : formats)
+        {
+            SyntheticBackend backend(testConfig());
+            ASSERT_EQ(backend.start(testSettings(format)), LADYBUG_OK);
+            ASSERT_EQ(backend.lockNext(image), LADYBUG_OK);
+            EXPECT_EQ(image.dataFormat, format);
+            EXPECT_EQ(image.uiCols, (unsigned int)COLS);
+            EXPECT_EQ(image.uiRows, (unsigned int)ROWS);
+            const std::vector<uint8_t> result = planes(image);
+            ASSERT_EQ(result.size(), reference.size()) << "format " << format;
+
+            // The raw formats hold the pattern exactly, the JPEG tiles only up to their compression
+            double total = 0;
+            for (size_t p = 0; p < result.size(); p++)
+                total += std::abs((int)result[p] - (int)reference[p]);
+            if (isJpegFormat(format))
+                EXPECT_LT(total / result.size(), 2.0) << "format " << format;
+            else
+                EXPECT_EQ(total, 0.0) << "format " << format;
+        }
+    }
+
+    // Half-height heads keep sensor rows 4k and 4k + 1 of the full pattern
+    SyntheticBackend full(testConfig()), half(testConfig());
+    ASSERT_EQ(full.start(testSettings(LADYBUG_DATAFORMAT_RAW8)), LADYBUG_OK);
+    ASSERT_EQ(half.start(testSettings(LADYBUG_DATAFORMAT_HALF_HEIGHT_RAW8)), LADYBUG_OK);
+    LadybugImage full_image, half_image;
+    ASSERT_EQ(full.lockNext(full_image), LADYBUG_OK);
+    ASSERT_EQ(half.lockNext(half_image), LADYBUG_OK);
+    for (int h = 0; h < (int)LADYBUG_NUM_CAMERAS; h++)
+    {
+        for (int r = 0; r < ROWS / 2; r++)
+        {
+            const int sensor_row = ((r >> 1) << 2) | (r & 1);
+            EXPECT_EQ(memcmp(half_image.pData + ((size_t)h * ROWS / 2 + r) * COLS, full_image.pData + ((size_t)h * ROWS + sensor_row) * COLS, COLS), 0)
+                << "head " << h << " row " << r;
+        }
+    }
+}
+
+TEST(SyntheticBackend, DeliversBuffersInTurnAndLosesLockedOnes)
+{
+    SyntheticBackend backend(testConfig()), other(testConfig());
+    ASSERT_EQ(backend.start(testSettings(LADYBUG_DATAFORMAT_RAW8)), LADYBUG_OK);
+    ASSERT_EQ(other.start(testSettings(LADYBUG_DATAFORMAT_RAW8)), LADYBUG_OK);
+    LadybugImage first, second, image;
+    ASSERT_EQ(backend.lockNext(first), LADYBUG_OK);
+    ASSERT_EQ(backend.lockNext(second), LADYBUG_OK);
+    EXPECT_EQ(first.uiBufferIndex, 0u);
+    EXPECT_EQ(second.uiBufferIndex, 1u);
+    EXPECT_EQ(first.imageInfo.ulSequenceId, 0u);
+    EXPECT_EQ(second.imageInfo.ulSequenceId, 1u);
+    EXPECT_NE(memcmp(first.pData, second.pData, first.uiDataSizeBytes), 0);
+
+    // Another backend with the same config generates the same frames
+    ASSERT_EQ(other.lockNext(image), LADYBUG_OK);
+    EXPECT_EQ(memcmp(first.pData, image.pData, first.uiDataSizeBytes), 0);
+
+    // Both buffers are locked, so frames 2 and 3 are lost
+    EXPECT_EQ(backend.lockNext(image), LADYBUG_TOO_MANY_LOCKED_BUFFERS);
+    EXPECT_EQ(backend.lockNext(image), LADYBUG_TOO_MANY_LOCKED_BUFFERS);
+    EXPECT_EQ(backend.unlock(2), LADYBUG_INVALID_ARGUMENT);
+    ASSERT_EQ(backend.unlock(first.uiBufferIndex), LADYBUG_OK);
+    ASSERT_EQ(backend.lockNext(image), LADYBUG_OK);
+    EXPECT_EQ(image.uiBufferIndex, 0u);
+    EXPECT_EQ(image.imageInfo.ulSequenceId, 4u);
+    EXPECT_EQ(backend.lockNext(image), LADYBUG_TOO_MANY_LOCKED_BUFFERS);
+    ASSERT_EQ(backend.unlockAll(), LADYBUG_OK);
+    ASSERT_EQ(backend.lockNext(image), LADYBUG_OK);
+    EXPECT_EQ(image.imageInfo.ulSequenceId, 6u);
+}
+
+TEST(SyntheticBackend, TimestampsFollowTheFrameRate)
+{
+    SyntheticBackend backend(testConfig());
+    ASSERT_EQ(backend.start(testSettings(LADYBUG_DATAFORMAT_RAW8, 200.0f)), LADYBUG_OK);
+    std::vector<double> cycles;
+    for (int n = 0; n < 10; n++)
+    {
+        if (n == 5)
+        {
+            ASSERT_EQ(backend.setFrameRate(100.0f), LADYBUG_OK);
+        }
+        LadybugImage image;
+        ASSERT_EQ(backend.lockNext(image), LADYBUG_OK);
+        cycles.push_back(cycleSeconds(image));
+        backend.unlock(image.uiBufferIndex);
+    }
+
+    // The frame after the change still comes at the old rate, the ones after it at the new one
+    const double tick = 1.0 / (8000.0 * 3072.0);
+    for (int n = 1; n < 10; n++)
+        EXPECT_NEAR(cycles[n] - cycles[n - 1], n <= 5 ? 0.005 : 0.01, 2 * tick) << "frame " << n;
+}
+
+TEST(SyntheticBackend, InjectsTheSameErrorsForTheSameSeed)
+{
+    SyntheticConfig config = testConfig();
+    config.error_rate = 0.3;
+    config.seed = 7;
+    std::vector<LadybugError> runs[2];
+    for (auto &errors : runs)
+    {
+        SyntheticBackend backend(config);
+        ASSERT_EQ(backend.start(testSettings(LADYBUG_DATAFORMAT_RAW8, 2000.0f)), LADYBUG_OK);
+        for (int n = 0; n < 100; n++)
+        {
+            LadybugImage image;
+            errors.push_back(backend.lockNext(image));
+            if (errors.back() == LADYBUG_OK)
+                backend.unlock(image.uiBufferIndex);
+        }
+    }
+    EXPECT_EQ(runs[0], runs[1]);
+    const size_t timeouts = std::count(runs[0].begin(), runs[0].end(), LADYBUG_TIMEOUT);
+    EXPECT_GT(timeouts, 10u);
+    EXPECT_LT(timeouts, 50u);
+    EXPECT_EQ(std::count(runs[0].begin(), runs[0].end(), LADYBUG_OK), 100 - (long)timeouts);
+}
@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <random>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "test_util.h"
+
+cv::Mat testPlane(int cols, int rows, int type, unsigned int seed)
+{
+    cv::Mat plane(rows, cols, type);
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> noise(-15, 15);
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < cols; c++)
+        {
+            const int value = std::min(255, std::max(0, (c * 200) / cols + (r * 40) / rows + noise(rng)));
+            if (type == CV_16UC1)
+                plane.at<uint16_t>(r, c) = (uint16_t)((value << 8) | (rng() & 0xf0));
+            else
+                plane.at<uint8_t>(r, c) = (uint8_t)value;
+        }
+    }
+    return plane;
+}
+
+int opencvBayerCode(BayerPattern pattern)
+{
+    switch (pattern)
+    {
+    case BAYER_GRBG:
+        return cv::COLOR_BayerGB2RGB;
+    case BAYER_GBRG:
+        return cv::COLOR_BayerGR2RGB;
+    case BAYER_BGGR:
+        return cv::COLOR_BayerRG2RGB;
+    default:
+        return cv::COLOR_BayerBG2RGB;
+    }
+}
+
+/**
+ * Scaled size of the full sensor, like the kernel computes it
+ */
+static cv::Size scaledSize(const cv::Mat &raw, double scale, bool half_height)
+{
+    const int sensor_rows = half_height ? 2 * raw.rows : raw.rows;
+    return cv::Size(std::max(1, (int)(raw.cols * scale / 100)), std::max(1, (int)(sensor_rows * scale / 100)));
+}
+
+cv::Mat opencvChain(const cv::Mat &raw, BayerPattern pattern, double scale, bool half_height)
+{
+    cv::Mat image;
+    cv::cvtColor(raw, image, opencvBayerCode(pattern));
+    const cv::Size size = scaledSize(raw, scale, half_height);
+    if (!(size == image.size()))
+        cv::resize(image, image, size);
+    cv::transpose(image, image);
+    cv::flip(image, image, 1);
+    return image;
+}
+
+cv::Mat binnedReference(const cv::Mat &raw, BayerPattern pattern, double scale, bool half_height)
+{
+    const int red_col = pattern & 1, red_row = (pattern >> 1) & 1;
+    cv::Mat cells(raw.rows / 2, raw.cols / 2, CV_32FC3);
+    for (int r = 0; r < cells.rows; r++)
+    {
+        for (int c = 0; c < cells.cols; c++)
+        {
+            float v[2][2];
+            for (int y = 0; y < 2; y++)
+            {
+                for (int x = 0; x < 2; x++)
+                    v[y][x] = raw.depth() == CV_16U ? raw.at<uint16_t>(2 * r + y, 2 * c + x) : raw.at<uint8_t>(2 * r + y, 2 * c + x);
+            }
+            cv::Vec3f &cell = cells.at<cv::Vec3f>(r, c);
+            cell[0] = v[red_row][red_col];
+            cell[1] = (v[red_row][1 - red_col] + v[1 - red_row][red_col]) / 2;
+            cell[2] = v[1 - red_row][1 - red_col];
+        }
+    }
+    cv::Mat image;
+    cv::resize(cells, image, scaledSize(raw, scale, half_height), 0, 0, cv::INTER_AREA);
+    cv::transpose(image, image);
+    cv::flip(image, image, 1);
+    return image;
+}
+
+cv::Mat runKernel(const BayerKernel &kernel, const cv::Mat &raw)
+{
+    if (raw.depth() == CV_16U)
+    {
+        cv::Mat out(kernel.out_rows(), kernel.out_cols(), CV_16UC(kernel.channels()));
+        kernel.process(raw.ptr<uint16_t>(), out.ptr<uint16_t>(), out.step);
+        return out;
+    }
+    cv::Mat out(kernel.out_rows(), kernel.out_cols(), CV_8UC(kernel.channels()));
+    kernel.process(raw.ptr<uint8_t>(), out.ptr<uint8_t>(), out.step);
+    return out;
+}
+
+double maxDifference(const cv::Mat &a, const cv::Mat &b)
+{
+    cv::Mat a64, b64;
+    a.convertTo(a64, CV_64FC(a.channels()));
+    b.convertTo(b64, CV_64FC(b.channels()));
+    return cv::norm(a64, b64, cv::NORM_INF);
+}
@@ -0,0 +1,42 @@
+#ifndef LADYBUG_TEST_UTIL_H
+#define LADYBUG_TEST_UTIL_H
+
+#include <opencv2/core/core.hpp>
+
+#include "bayer_kernel.h"
+
+/**
+ * A deterministic Bayer plane, a gradient with noise on it, so neither the demosaic nor the scaling has it easy
+ * type is CV_8UC1, or CV_16UC1 with the value in the high bits like the unpacked RAW12 and RAW16 samples
+ */
+cv::Mat testPlane(int cols, int rows, int type, unsigned int seed);
+
+/**
+ * The cvtColor code that demosaics a Bayer pattern into RGB
+ * OpenCV names its Bayer codes after the second row and col of the image, so RGGB is COLOR_BayerBG2RGB
+ */
+int opencvBayerCode(BayerPattern pattern);
+
+/**
+ * The chain BayerKernel replaced, cvtColor, resize(INTER_LINEAR) to the scaled sensor size, transpose and flip
+ * For a half-height plane the plane is demosaiced as it is and resized to the scaled size of the full sensor
+ */
+cv::Mat opencvChain(const cv::Mat &raw, BayerPattern pattern, double scale, bool half_height = false);
+
+/**
+ * What the kernel does below 50%, every 2x2 cell is an RGB superpixel (red, mean of the greens, blue),
+ * which is resized with INTER_AREA in floating point, then transposed and flipped like the chain
+ */
+cv::Mat binnedReference(const cv::Mat &raw, BayerPattern pattern, double scale, bool half_height = false);
+
+/**
+ * Run the kernel over a raw plane, 8-bit planes give RGB8 and 16-bit planes RGB16, in the format of the kernel
+ */
+cv::Mat runKernel(const BayerKernel &kernel, const cv::Mat &raw);
+
+/**
+ * Largest absolute difference between two images of the same size and number of channels
+ */
+double maxDifference(const cv::Mat &a, const cv::Mat &b);
+
+#endif // LADYBUG_TEST_UTIL_H
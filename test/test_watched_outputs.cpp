@@ -0,0 +1,74 @@
+#include <bitset>
+
+#include <gtest/gtest.h>
+
+#include "watched_outputs.h"
+
+namespace
+{
+
+/**
+ * How often the kernel runs for a frame, once per head it is given
+ */
+size_t kernelRuns(const WatchedOutputs &watched, uint32_t view_heads, uint32_t decoded_heads)
+{
+    return std::bitset<32>(kernelHeads(watched, view_heads, decoded_heads)).count();
+}
+
+} // namespace
+
+TEST(WatchedOutputs, PassThroughOutputsNeverRunTheKernel)
+{
+    for (uint32_t bayer = 0; bayer <= LADYBUG_ALL_HEADS; bayer++)
+    {
+        for (uint32_t jpeg = 0; jpeg <= LADYBUG_ALL_HEADS; jpeg++)
+            ASSERT_EQ(kernelRuns(WatchedOutputs(0, bayer, jpeg, 0, false), 0, LADYBUG_ALL_HEADS), 0u) << bayer << " " << jpeg;
+    }
+}
+
+TEST(WatchedOutputs, RunsTheKernelOncePerNeededHead)
+{
+    struct Case
+    {
+        uint32_t image, bayer, jpeg, rect;
+        bool pano;
+        uint32_t view_heads, decoded_heads;
+        size_t runs;
+    };
+    const Case cases[] = {
+        {0x00, 0x00, 0x00, 0x00, false, 0x00, 0x3f, 0}, // nobody watches
+        {0x01, 0x00, 0x00, 0x00, false, 0x00, 0x3f, 1}, // one image
+        {0x01, 0x3f, 0x3f, 0x00, false, 0x00, 0x3f, 1}, // and pass-through of all heads on top
+        {0x05, 0x00, 0x00, 0x05, false, 0x00, 0x3f, 2}, // images and rectified images of the same heads
+        {0x01, 0x00, 0x00, 0x06, false, 0x00, 0x3f, 3}, // rectified images of other heads
+        {0x00, 0x00, 0x00, 0x00, true, 0x00, 0x3f, 6},  // the panorama
+        {0x01, 0x00, 0x00, 0x00, true, 0x06, 0x3f, 6},  // the panorama and a view
+        {0x00, 0x00, 0x00, 0x00, false, 0x06, 0x3f, 2}, // only a view
+        {0x01, 0x00, 0x00, 0x00, false, 0x06, 0x03, 2}, // a view of a head that was not decoded
+        {0x00, 0x3f, 0x00, 0x00, false, 0x30, 0x3f, 2}, // bayer planes and a view
+    };
+    for (const Case &c : cases)
+    {
+        const WatchedOutputs watched(c.image, c.bayer, c.jpeg, c.rect, c.pano);
+        EXPECT_EQ(kernelRuns(watched, c.view_heads, c.decoded_heads), c.runs)
+            << "image " << c.image << ", bayer " << c.bayer << ", jpeg " << c.jpeg << ", rect " << c.rect << ", pano " << c.pano << ", views "
+            << c.view_heads;
+    }
+}
+
+TEST(WatchedOutputs, DemosaicsWhatTheDerivedOutputsNeed)
+{
+    for (uint32_t image = 0; image <= LADYBUG_ALL_HEADS; image++)
+    {
+        for (uint32_t rect = 0; rect <= LADYBUG_ALL_HEADS; rect++)
+        {
+            const WatchedOutputs watched(image, 0, 0, rect, false);
+            ASSERT_EQ(watched.raw, image | rect);
+            ASSERT_EQ(watched.rect, rect);
+            ASSERT_EQ(WatchedOutputs(image, 0, 0, rect, true).raw, LADYBUG_ALL_HEADS);
+        }
+    }
+    EXPECT_EQ(WatchedOutputs(), WatchedOutputs(0, 0, 0, 0, false));
+    EXPECT_NE(WatchedOutputs(), WatchedOutputs(0, 1, 0, 0, false));
+    EXPECT_NE(WatchedOutputs(), WatchedOutputs(0, 0, 0, 0, true));
+}
@@ -0,0 +1,53 @@
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "worker_pool.h"
+
+TEST(WorkerPool, RunsEveryJobOnce)
+{
+    WorkerPool pool(3);
+    ASSERT_EQ(pool.size(), 3u);
+    for (size_t num_jobs : {0, 1, 3, 6, 17})
+    {
+        std::vector<std::atomic<int>> runs(num_jobs);
+        for (auto &r : runs)
+            r = 0;
+        pool.run(num_jobs, [&](size_t i) { runs[i]++; });
+        for (size_t i = 0; i < num_jobs; i++)
+            EXPECT_EQ(runs[i], 1) << "job " << i << " of " << num_jobs;
+    }
+}
+
+TEST(WorkerPool, WaitsForTheWholeBatch)
+{
+    WorkerPool pool(4);
+    std::atomic<int> done(0);
+    for (int batch = 0; batch < 100; batch++)
+    {
+        pool.run(6, [&](size_t i) {
+            if (i == 5)
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            done++;
+        });
+        ASSERT_EQ(done, 6 * (batch + 1));
+    }
+}
+
+TEST(WorkerPool, SpreadsJobsOverLanes)
+{
+    WorkerPool pool(6);
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    pool.run(6, [&](size_t) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        std::lock_guard<std::mutex> lock(mutex);
+        threads.insert(std::this_thread::get_id());
+    });
+    EXPECT_GT(threads.size(), 1u);
+    EXPECT_EQ(threads.count(std::this_thread::get_id()), 0u);
+}